@@ -2,11 +2,18 @@
 
 #include "frak_args.h"
 
+#include <math.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "frakl/buddhabrot.h"
+#include "frakl/budget.h"
+#include "frakl/flame.h"
+#include "frakl/newton.h"
+#include "frakl/supersample.h"
+
 void frak_usage(int code) {
   static char const* const cmd = "frak";
   char* usage = create_usage(cmd, "a tiff generator", frak_arg_specs);
@@ -29,6 +36,75 @@ static struct arg_enum_opt palette_enum_opts[] = {
 static struct arg_enum_opt design_enum_opts[] = {
     {.option = "mandlebrot", .value = frak_design_mandlebrot},
     {.option = "mand", .value = frak_design_mandlebrot},
+    {.option = "multibrot", .value = frak_design_multibrot},
+    {.option = "burning-ship", .value = frak_design_burning_ship},
+    {.option = "tricorn", .value = frak_design_tricorn},
+    {.option = "celtic", .value = frak_design_celtic},
+    {.option = "buddhabrot", .value = frak_design_buddhabrot},
+    {.option = "nebulabrot", .value = frak_design_nebulabrot},
+    {.option = "mandelbulb", .value = frak_design_mandelbulb},
+    {.option = "lyapunov", .value = frak_design_lyapunov},
+    {.option = "newton", .value = frak_design_newton},
+    {.option = "flame", .value = frak_design_flame},
+    {.option = NULL, .value = 0},
+};
+
+static struct arg_enum_opt histogram_enum_opts[] = {
+    {.option = "private", .value = fractal_histogram_private},
+    {.option = "atomic", .value = fractal_histogram_atomic},
+    {.option = NULL, .value = 0},
+};
+
+static struct arg_enum_opt kernel_enum_opts[] = {
+    {.option = "auto", .value = fractal_kernel_auto},
+    {.option = "scalar", .value = fractal_kernel_scalar},
+    {.option = "sse2", .value = fractal_kernel_sse2},
+    {.option = "avx2", .value = fractal_kernel_avx2},
+    {.option = "avx512", .value = fractal_kernel_avx512},
+    {.option = NULL, .value = 0},
+};
+
+static struct arg_enum_opt periodicity_enum_opts[] = {
+    {.option = "auto", .value = fractal_periodicity_auto},
+    {.option = "off", .value = fractal_periodicity_off},
+    {.option = "on", .value = fractal_periodicity_on},
+    {.option = NULL, .value = 0},
+};
+
+static struct arg_enum_opt algorithm_enum_opts[] = {
+    {.option = "brute", .value = fractal_algorithm_brute},
+    {.option = "mariani", .value = fractal_algorithm_mariani},
+    {.option = NULL, .value = 0},
+};
+
+static struct arg_enum_opt tiles_enum_opts[] = {
+    {.option = "off", .value = frak_tiles_off},
+    {.option = "row-major", .value = frak_tiles_row_major},
+    {.option = "morton", .value = frak_tiles_morton},
+    {.option = "hilbert", .value = frak_tiles_hilbert},
+    {.option = NULL, .value = 0},
+};
+
+static struct arg_enum_opt aa_enum_opts[] = {
+    {.option = "off", .value = frak_aa_off},
+    {.option = "adaptive", .value = frak_aa_adaptive},
+    {.option = NULL, .value = 0},
+};
+
+static struct arg_enum_opt precision_enum_opts[] = {
+    {.option = "auto", .value = fractal_precision_auto},
+    {.option = "float", .value = fractal_precision_float},
+    {.option = "double", .value = fractal_precision_double},
+    {.option = "long-double", .value = fractal_precision_long_double},
+    {.option = "double-double", .value = fractal_precision_double_double},
+    {.option = "fixed", .value = fractal_precision_fixed},
+    {.option = NULL, .value = 0},
+};
+
+static struct arg_enum_opt perturbation_enum_opts[] = {
+    {.option = "auto", .value = fractal_perturbation_auto},
+    {.option = "off", .value = fractal_perturbation_off},
+    {.option = "on", .value = fractal_perturbation_on},
     {.option = NULL, .value = 0},
 };
 
@@ -79,11 +155,127 @@ out:
   return err;
 }
 
-const struct tuple_spec center_tuple_spec = {
+static char* max_iteration_parser(const char* arg, void* slot, void* ctx) {
+  if (arg && strcmp(arg, "auto") == 0) {
+    *(uint32_t*)slot = FRAK_MAX_ITERATION_AUTO;
+    return NULL;
+  }
+  return pu32_parser(arg, slot, ctx);
+}
+
+static char* limits_parser(const char* arg, void* slot, void* ctx) {
+  (void)ctx;
+
+  long limits[3];
+  struct tuple_spec spec = {
+      .is_double = false,
+      .count = 3,
+  };
+  char* err = tuple_parser(arg, limits, &spec);
+  if (err) {
+    return err;
+  }
+  for (unsigned i = 0; i < 3; i++) {
+    if (limits[i] < 1 || limits[i] > UINT32_MAX - 1) {
+      asprintf(&err, "limits must be between 1 and %u, was %ld",
+               UINT32_MAX - 1, limits[i]);
+      return err;
+    }
+    ((uint32_t*)slot)[i] = (uint32_t)limits[i];
+  }
+  return NULL;
+}
+
+static char* budgets_parser(const char* arg, void* slot, void* ctx) {
+  (void)ctx;
+
+  if (!arg) {
+    return strdup("programmer error, budget options require an argument");
+  }
+  char* items = strdup(arg);
+  char* err = NULL;
+  struct frak_budgets* budgets = calloc(1, sizeof(struct frak_budgets));
+  char* item = items;
+  for (;;) {
+    char* comma = strchr(item, ',');
+    if (comma) {
+      *comma = '\0';
+    }
+    uint32_t budget;
+    if ((err = pu32_parser(item, &budget, NULL)) != NULL) {
+      break;
+    }
+    if (budgets->count && budget <= budgets->budgets[budgets->count - 1]) {
+      asprintf(&err, "budgets must be rising, %u comes after %u", budget,
+               budgets->budgets[budgets->count - 1]);
+      break;
+    }
+    budgets = realloc(budgets, sizeof(struct frak_budgets) +
+                                   sizeof(uint32_t) * (++budgets->count));
+    budgets->budgets[budgets->count - 1] = budget;
+    if (!comma) {
+      break;
+    }
+    item = comma + 1;
+  }
+  free(items);
+  if (err) {
+    free(budgets);
+    return err;
+  }
+  free(*(struct frak_budgets**)slot);
+  *(struct frak_budgets**)slot = budgets;
+  return NULL;
+}
+
+const struct tuple_spec julia_tuple_spec = {
     .count = 2,
     .is_double = true,
 };
 
+static char* roots_parser(const char* arg, void* slot, void* ctx) {
+  (void)ctx;
+
+  if (!arg) {
+    return strdup("programmer error, root options require an argument");
+  }
+  char* items = strdup(arg);
+  char* err = NULL;
+  struct frak_roots* roots = calloc(1, sizeof(struct frak_roots));
+  char* item = items;
+  for (;;) {
+    char* colon = strchr(item, ':');
+    if (colon) {
+      *colon = '\0';
+    }
+    double root[2];
+    if ((err = tuple_parser(item, root, (void*)&julia_tuple_spec)) != NULL) {
+      break;
+    }
+    roots = realloc(roots, sizeof(struct frak_roots) +
+                               sizeof(roots->roots[0]) * (++roots->count));
+    roots->roots[roots->count - 1][0] = root[0];
+    roots->roots[roots->count - 1][1] = root[1];
+    if (!colon) {
+      break;
+    }
+    item = colon + 1;
+  }
+  free(items);
+  if (err) {
+    free(roots);
+    return err;
+  }
+  free(*(struct frak_roots**)slot);
+  *(struct frak_roots**)slot = roots;
+  return NULL;
+}
+
+const struct tuple_spec center_tuple_spec = {
+    .count = 2,
+    .is_decimal = true,
+};
+
 struct arg_spec const* const frak_arg_specs = (struct arg_spec[]){
     {.flag = "--width",
      .takes_arg = true,
@@ -120,10 +312,97 @@ struct arg_spec const* const frak_arg_specs = (struct arg_spec[]){
      .parser = enum_parser,
      .parser_ctx = (void*)design_enum_opts,
      .offset = offsetof(struct frak_args, design)},
+    {.flag = "--power",
+     .takes_arg = true,
+     .parser = pu32_parser,
+     .offset = offsetof(struct frak_args, power),
+     .help = "The power n of --design multibrot's z^n + c, from 2 to 8."
+             " Defaults to 3"},
+    {.flag = "--julia-c",
+     .takes_arg = true,
+     .parser = tuple_parser,
+     .parser_ctx = (void*)&julia_tuple_spec,
+     .offset = offsetof(struct frak_args, julia_c),
+     .help = "Render the Julia set of the design for c = x,y, iterating from"
+             " z = the pixel. Symmetric about the origin, so centered views"
+             " with a power of two width compute about half of the rows"},
     {.flag = "--max-iter",
+     .takes_arg = true,
+     .parser = max_iteration_parser,
+     .offset = offsetof(struct frak_args, max_iteration),
+     .help = "The iterations a pixel may run before it counts as inside the"
+             " set. auto probes the view and gives every 64x64 tile a budget"
+             " of its own, shading pixels against the largest. Defaults to"
+             " 1000"},
+    {.flag = "--samples",
      .takes_arg = true,
      .parser = pu32_parser,
-     .offset = offsetof(struct frak_args, max_iteration)},
+     .offset = offsetof(struct frak_args, samples),
+     .help = "Millions of c values --design buddhabrot and nebulabrot sample,"
+             " favouring those near the boundary of the Mandelbrot set, or of"
+             " chaos game iterations --design flame plays. Defaults to 10, or"
+             " 100 for --design flame"},
+    {.flag = "--limits",
+     .takes_arg = true,
+     .parser = limits_parser,
+     .offset = offsetof(struct frak_args, limits),
+     .help = "The iteration limits r,g,b of --design nebulabrot's red, green"
+             " and blue channels, each counting the orbits that escape within"
+             " its limit. Defaults to 5000,500,50"},
+    {.flag = "--histogram",
+     .takes_arg = true,
+     .parser = enum_parser,
+     .parser_ctx = (void*)histogram_enum_opts,
+     .offset = offsetof(struct frak_args, histogram),
+     .help = "How --design buddhabrot and nebulabrot workers count hits."
+             " private gives every worker a histogram of its own, merged in"
+             " parallel at the end, atomic has them all add to one."
+             " Defaults to private"},
+    {.flag = "--depth-prepass",
+     .parser = bool_parser,
+     .offset = offsetof(struct frak_args, depth_prepass),
+     .help = "Before --design mandelbulb marches its rays, march one cone per"
+             " 8x8 pixels wide enough to hold all of their rays and start"
+             " each ray where its cone first came near the bulb"},
+    {.flag = "--sequence",
+     .takes_arg = true,
+     .parser = str_parser,
+     .offset = offsetof(struct frak_args, sequence),
+     .help = "The A's and B's --design lyapunov picks r from for each step of"
+             " the logistic map x <- rx(1 - x), A being the pixel's x and B its"
+             " y. The exponent is averaged over --max-iter steps. Defaults to"
+             " AB"},
+    {.flag = "--roots",
+     .takes_arg = true,
+     .parser = roots_parser,
+     .offset = offsetof(struct frak_args, roots),
+     .help = "The roots of the polynomial --design newton runs Newton's method"
+             " on, given as x,y:x,y:..., at most 8 of them. Pixels are shaded"
+             " by the root they converge to and how fast. Defaults to the"
+             " cube roots of unity"},
+    {.flag = "--flame",
+     .takes_arg = true,
+     .parser = str_parser,
+     .offset = offsetof(struct frak_args, flame),
+     .help = "The file --design flame loads its transforms and palette from,"
+             " lines of 'xform weight color a b c d e f [variation amount]...'"
+             " and 'color index red green blue'. The variations are linear,"
+             " sinusoidal, spherical, swirl, horseshoe, polar, heart and disc"},
+    {.flag = "--oversample",
+     .takes_arg = true,
+     .parser = pu32_parser,
+     .offset = offsetof(struct frak_args, oversample),
+     .help = "The cells along each axis of a pixel --design flame accumulates"
+             " points into, up to 4. Defaults to 2"},
+    {.flag = "--escalate",
+     .takes_arg = true,
+     .parser = budgets_parser,
+     .offset = offsetof(struct frak_args, escalate),
+     .help = "Iterate against rising budgets given as a,b,c, e.g."
+             " 1000,10000,100000. Only the pixels still iterating when a"
+             " budget runs out carry on against the next, from where they"
+             " stopped. The image is the same as with --max-iter set to the"
+             " last budget. Always renders in double precision"},
     {.flag = "--color",
      .takes_arg = true,
      .parser = color_parser,
@@ -157,6 +436,53 @@ struct arg_spec const* const frak_arg_specs = (struct arg_spec[]){
      .parser = pu32_parser,
      .offset = offsetof(struct frak_args, worker_cache_size),
      .help = "The number of pixels to place into a single work item"},
+    {.flag = "--tiles",
+     .takes_arg = true,
+     .parser = enum_parser,
+     .parser_ctx = (void*)tiles_enum_opts,
+     .offset = offsetof(struct frak_args, tiles),
+     .help = "Hand workers square tiles instead of rows, in row-major, morton"
+             " or hilbert order. Defaults to off"},
+    {.flag = "--tile-size",
+     .takes_arg = true,
+     .parser = pu32_parser,
+     .offset = offsetof(struct frak_args, tile_size),
+     .help = "The side of a tile in pixels. Defaults to the largest tile that"
+             " fits in the L1 data cache while leaving every worker plenty of"
+             " tiles"},
+    {.flag = "--balance",
+     .parser = bool_parser,
+     .offset = offsetof(struct frak_args, balance),
+     .help = "Estimate what every 16x16 cell costs from one probe, hand"
+             " workers chunks of about equal cost, most expensive first, and"
+             " print how busy each worker was expected to be and was"},
+    {.flag = "--progressive",
+     .parser = bool_parser,
+     .offset = offsetof(struct frak_args, progressive),
+     .help = "Render every 8th pixel in each direction first, then every 4th,"
+             " 2nd and 1st, filling in the rest of the image after each pass."
+             " No pixel is computed twice and the final image is the same."
+             " Ignores --tiles and --no-symmetry"},
+    {.flag = "--aa",
+     .takes_arg = true,
+     .parser = enum_parser,
+     .parser_ctx = (void*)aa_enum_opts,
+     .offset = offsetof(struct frak_args, aa),
+     .help = "Anti-alias the image. adaptive supersamples only the pixels that"
+             " differ from a neighbour by more than --aa-threshold shades."
+             " Defaults to off"},
+    {.flag = "--aa-grid",
+     .takes_arg = true,
+     .parser = pu32_parser,
+     .offset = offsetof(struct frak_args, aa_grid),
+     .help = "The samples per refined pixel along each axis, up to 8."
+             " Defaults to 4"},
+    {.flag = "--aa-threshold",
+     .takes_arg = true,
+     .parser = pu32_parser,
+     .offset = offsetof(struct frak_args, aa_threshold),
+     .help = "How many shades a pixel has to differ from a neighbour by to be"
+             " refined. Defaults to 16"},
     {.flag = "--stats",
      .parser = bool_parser,
      .offset = offsetof(struct frak_args, stats),
@@ -171,14 +497,94 @@ struct arg_spec const* const frak_arg_specs = (struct arg_spec[]){
      .parser = tuple_parser,
      .parser_ctx = (void*)&center_tuple_spec,
      .offset = offsetof(struct frak_args, center),
-     .help = "Specify the center of the fractal in x,y. Defaults to 0,0"},
+     .help = "Specify the center of the fractal in x,y. Any number of digits"
+             " are kept for deep zooms. Defaults to 0,0, or 3,3 for --design"
+             " lyapunov"},
     {.flag = "--fwidth",
      .takes_arg = true,
      .parser = pdbl_parser,
      .offset = offsetof(struct frak_args, fwidth),
      .help = "Specify the width of the fractal in the fractal's coordinate"
              " system. The height will automatically be calculated based on the"
-             " aspect ratio of the image. Defaults to 4"},
+             " aspect ratio of the image. Defaults to 4, or 2 for --design"
+             " lyapunov"},
+    {.flag = "--kernel",
+     .takes_arg = true,
+     .parser = enum_parser,
+     .parser_ctx = (void*)kernel_enum_opts,
+     .offset = offsetof(struct frak_args, kernel),
+     .help = "Specify the instruction set used to compute pixels. Defaults to"
+             " auto, the widest one supported by this CPU"},
+    {.flag = "--lane-refill",
+     .parser = bool_parser,
+     .offset = offsetof(struct frak_args, lane_refill),
+     .help = "Refill each vector lane with the next pixel as soon as its"
+             " current pixel finishes, rather than waiting on the slowest"
+             " lane"},
+    {.flag = "--no-interior-check",
+     .parser = bool_parser,
+     .offset = offsetof(struct frak_args, no_interior_check),
+     .help = "Iterate pixels inside the main cardioid and period-2 bulb"
+             " instead of classifying them analytically"},
+    {.flag = "--no-symmetry",
+     .parser = bool_parser,
+     .offset = offsetof(struct frak_args, no_symmetry),
+     .help = "Compute rows mirrored about the real axis instead of copying"
+             " them. Only rows whose coordinates mirror exactly are copied, so"
+             " the image is the same either way"},
+    {.flag = "--periodicity",
+     .takes_arg = true,
+     .parser = enum_parser,
+     .parser_ctx = (void*)periodicity_enum_opts,
+     .offset = offsetof(struct frak_args, periodicity),
+     .help = "Stop iterating orbits caught cycling. Defaults to auto, which"
+             " enables it when a probe of the view estimates it will pay off"},
+    {.flag = "--algorithm",
+     .takes_arg = true,
+     .parser = enum_parser,
+     .parser_ctx = (void*)algorithm_enum_opts,
+     .offset = offsetof(struct frak_args, algorithm),
+     .help = "Specify how pixels are scheduled. brute computes every pixel,"
+             " mariani fills in rectangles whose border pixels all took the"
+             " same number of iterations, or are all provably in the set."
+             " Defaults to brute"},
+    {.flag = "--precision",
+     .takes_arg = true,
+     .parser = enum_parser,
+     .parser_ctx = (void*)precision_enum_opts,
+     .offset = offsetof(struct frak_args, precision),
+     .help = "Specify the arithmetic pixels are iterated in. long-double"
+             " always uses the scalar kernel. fixed is reproducible bit for bit"
+             " but only covers views within [-4, 4]. Defaults to auto, the"
+             " narrowest type precise enough for the pixel size and max"
+             " iterations"},
+    {.flag = "--float-first",
+     .parser = bool_parser,
+     .offset = offsetof(struct frak_args, float_first),
+     .help = "Iterate every pixel in float first and redo only those it can't"
+             " vouch for in double. The image matches a double render exactly."
+             " Only applies to double precision on vector kernels"},
+    {.flag = "--unroll",
+     .parser = bool_parser,
+     .offset = offsetof(struct frak_args, unroll),
+     .help = "Run 8 iterations between escape checks, replaying the last 8 one"
+             " at a time once a pixel escapes. Only applies to double"
+             " precision without --lane-refill"},
+    {.flag = "--compare",
+     .parser = bool_parser,
+     .offset = offsetof(struct frak_args, compare),
+     .help = "Render the view again in double precision afterwards and print"
+             " how long it took and how many pixels differ, to benchmark the"
+             " other precisions against it"},
+    {.flag = "--perturbation",
+     .takes_arg = true,
+     .parser = enum_parser,
+     .parser_ctx = (void*)perturbation_enum_opts,
+     .offset = offsetof(struct frak_args, perturbation),
+     .help = "Iterate pixels as offsets from a high precision reference orbit"
+             " so zooms can go past the precision of a double. Always uses the"
+             " scalar kernel and brute algorithm. Defaults to auto, which"
+             " enables it once pixels get too small for doubles"},
     {.flag = NULL},
 };
 
@@ -189,7 +595,21 @@ void frak_args_init(frak_args_t args) {
   args->name = NULL;
   args->palette = 0;
   args->design = frak_design_default;
+  args->power = 0;
+  args->julia_c[0] = NAN;
+  args->julia_c[1] = NAN;
   args->max_iteration = 0;
+  args->samples = 0;
+  args->limits[0] = 0;
+  args->limits[1] = 0;
+  args->limits[2] = 0;
+  args->histogram = fractal_histogram_private;
+  args->depth_prepass = false;
+  args->sequence = NULL;
+  args->roots = NULL;
+  args->flame = NULL;
+  args->oversample = 0;
+  args->escalate = NULL;
   args->colors = NULL;
   args->curve = 1.0;
   args->palette_only = false;
@@ -198,9 +618,36 @@ void frak_args_init(frak_args_t args) {
   args->worker_cache_size = 0;
   args->stats = false;
   args->no_compute = false;
-  args->center[0] = 0;
-  args->center[1] = 0;
-  args->fwidth = 4;
+  args->center[0] = NULL;
+  args->center[1] = NULL;
+  args->fwidth = 0;
+  args->kernel = fractal_kernel_auto;
+  args->lane_refill = false;
+  args->no_interior_check = false;
+  args->no_symmetry = false;
+  args->tiles = frak_tiles_off;
+  args->tile_size = 0;
+  args->balance = false;
+  args->progressive = false;
+  args->aa = frak_aa_off;
+  args->aa_grid = 4;
+  args->aa_threshold = 16;
+  args->periodicity = fractal_periodicity_auto;
+  args->algorithm = fractal_algorithm_brute;
+  args->precision = fractal_precision_auto;
+  args->float_first = false;
+  args->unroll = false;
+  args->compare = false;
+  args->perturbation = fractal_perturbation_auto;
+}
+
+const char* frak_tiles_name(unsigned tiles) {
+  for (struct arg_enum_opt const* opt = tiles_enum_opts; opt->option; opt++) {
+    if (opt->value == tiles) {
+      return opt->option;
+    }
+  }
+  return "unknown";
 }
 
 static int color_sort(void const* a, void const* b) {
@@ -218,12 +665,148 @@ char* frak_args_validate(frak_args_t args) {
   if (args->design == frak_design_default) {
     args->design = frak_design_mandlebrot;
   }
-  if (args->max_iteration != 0) {
-    if (args->design == frak_design_default) {
-      args->design = frak_design_mandlebrot;
-    } else if (args->design != frak_design_mandlebrot) {
-      return strdup("Cannot specify --max-iter without --design mandlebrot");
+  if (args->power != 0 && args->design != frak_design_multibrot) {
+    return strdup("Cannot specify --power without --design multibrot");
+  }
+  if (args->design == frak_design_multibrot) {
+    args->power = args->power ?: 3;
+    if (args->power < 2 || args->power > FRACTAL_MAX_POWER) {
+      return strdup("--power must be between 2 and 8");
+    }
+  }
+  const bool density = args->design == frak_design_buddhabrot ||
+                       args->design == frak_design_nebulabrot;
+  if (args->samples && !density && args->design != frak_design_flame) {
+    return strdup(
+        "Cannot specify --samples without --design buddhabrot, nebulabrot or"
+        " flame");
+  }
+  if (args->limits[0] && args->design != frak_design_nebulabrot) {
+    return strdup("Cannot specify --limits without --design nebulabrot");
+  }
+  if (density) {
+    if (!isnan(args->julia_c[0]) || args->escalate ||
+        args->max_iteration == FRAK_MAX_ITERATION_AUTO ||
+        args->progressive || args->algorithm == fractal_algorithm_mariani ||
+        args->balance || args->aa != frak_aa_off || args->compare ||
+        args->palette_only) {
+      return strdup(
+          "Cannot specify --julia-c, --escalate, --max-iter auto,"
+          " --progressive, --algorithm mariani, --balance, --aa, --compare or"
+          " --palette-only with --design buddhabrot or nebulabrot");
+    }
+    args->samples = args->samples ?: 10;
+  }
+  if (args->design == frak_design_nebulabrot) {
+    if (args->max_iteration) {
+      return strdup("--design nebulabrot takes --limits instead of --max-iter");
+    }
+    if (args->palette != frak_palette_default || args->colors) {
+      return strdup(
+          "--design nebulabrot is always red, green and blue, cannot specify"
+          " --palette or --color");
+    }
+    if (!args->limits[0]) {
+      args->limits[0] = 5000;
+      args->limits[1] = 500;
+      args->limits[2] = 50;
+    }
+  }
+  if (args->depth_prepass && args->design != frak_design_mandelbulb) {
+    return strdup("Cannot specify --depth-prepass without --design mandelbulb");
+  }
+  if (args->design == frak_design_mandelbulb &&
+      (!isnan(args->julia_c[0]) || args->escalate || args->max_iteration ||
+       args->progressive || args->algorithm == fractal_algorithm_mariani ||
+       args->balance || args->aa != frak_aa_off || args->compare)) {
+    return strdup(
+        "Cannot specify --julia-c, --escalate, --max-iter, --progressive,"
+        " --algorithm mariani, --balance, --aa or --compare with --design"
+        " mandelbulb");
+  }
+  if (args->design == frak_design_mandelbulb) {
+    // Rays vary too much in cost for rows, tiles even it out.
+    args->tiles = args->tiles ?: frak_tiles_row_major;
+  }
+  if (args->sequence && args->design != frak_design_lyapunov) {
+    return strdup("Cannot specify --sequence without --design lyapunov");
+  }
+  if (args->design == frak_design_lyapunov) {
+    if (!isnan(args->julia_c[0]) || args->escalate ||
+        args->max_iteration == FRAK_MAX_ITERATION_AUTO || args->balance ||
+        args->compare || args->perturbation == fractal_perturbation_on) {
+      return strdup(
+          "Cannot specify --julia-c, --escalate, --max-iter auto, --balance,"
+          " --compare or --perturbation on with --design lyapunov");
+    }
+    args->sequence = args->sequence ?: "AB";
+  }
+  if ((args->flame || args->oversample) &&
+      args->design != frak_design_flame) {
+    return strdup("Cannot specify --flame or --oversample without --design"
+                  " flame");
+  }
+  if (args->design == frak_design_flame) {
+    if (!args->flame) {
+      return strdup("--design flame needs a --flame file");
+    }
+    if (!isnan(args->julia_c[0]) || args->escalate || args->max_iteration ||
+        args->progressive || args->algorithm == fractal_algorithm_mariani ||
+        args->balance || args->aa != frak_aa_off || args->compare ||
+        args->palette_only) {
+      return strdup(
+          "Cannot specify --julia-c, --escalate, --max-iter, --progressive,"
+          " --algorithm mariani, --balance, --aa, --compare or"
+          " --palette-only with --design flame");
+    }
+    if (args->palette != frak_palette_default || args->colors) {
+      return strdup(
+          "--design flame takes its colors from its --flame file, cannot"
+          " specify --palette or --color");
+    }
+    args->samples = args->samples ?: 100;
+    args->oversample = args->oversample ?: 2;
+    if (args->oversample > FRACTAL_FLAME_MAX_OVERSAMPLE) {
+      return strdup("--oversample must be between 1 and 4");
+    }
+  }
+  if (args->roots && args->design != frak_design_newton) {
+    return strdup("Cannot specify --roots without --design newton");
+  }
+  if (args->design == frak_design_newton) {
+    if (!isnan(args->julia_c[0]) || args->escalate ||
+        args->max_iteration == FRAK_MAX_ITERATION_AUTO || args->balance ||
+        args->compare || args->perturbation == fractal_perturbation_on) {
+      return strdup(
+          "Cannot specify --julia-c, --escalate, --max-iter auto, --balance,"
+          " --compare or --perturbation on with --design newton");
     }
+    if (!args->roots) {
+      roots_parser("1,0:-0.5,0.8660254037844386:-0.5,-0.8660254037844386",
+                   &args->roots, NULL);
+    }
+    if (args->roots->count > FRACTAL_NEWTON_MAX_ROOTS) {
+      return strdup("--design newton takes at most 8 roots");
+    }
+  }
+  if (!args->center[0]) {
+    const char* center =
+        args->design == frak_design_lyapunov ? "3" : "0";
+    args->center[0] = center;
+    args->center[1] = center;
+  }
+  if (args->fwidth == 0) {
+    args->fwidth = args->design == frak_design_lyapunov ? 2 : 4;
+  }
+  if (args->escalate && (args->design != frak_design_mandlebrot ||
+                         !isnan(args->julia_c[0]))) {
+    return strdup("--escalate only supports the Mandelbrot set");
+  }
+  if (args->escalate) {
+    if (args->max_iteration != 0) {
+      return strdup("Cannot specify both --max-iter and --escalate");
+    }
+    args->max_iteration = args->escalate->budgets[args->escalate->count - 1];
   }
   if (args->max_iteration == 0) {
     args->max_iteration = 1000;
@@ -259,6 +842,47 @@ char* frak_args_validate(frak_args_t args) {
           " being used (--palette color/custom)");
     }
   }
+  if (args->progressive && args->algorithm == fractal_algorithm_mariani) {
+    return strdup("Cannot specify --progressive with --algorithm mariani");
+  }
+  if (args->balance &&
+      (args->tiles != frak_tiles_off || args->progressive ||
+       args->algorithm == fractal_algorithm_mariani ||
+       args->max_iteration == FRAK_MAX_ITERATION_AUTO)) {
+    return strdup(
+        "Cannot specify --balance with --tiles, --progressive, --algorithm "
+        "mariani or --max-iter auto");
+  }
+  if (args->max_iteration == FRAK_MAX_ITERATION_AUTO) {
+    if (args->progressive || args->algorithm == fractal_algorithm_mariani) {
+      return strdup(
+          "Cannot specify --max-iter auto with --progressive or --algorithm "
+          "mariani");
+    }
+    if (args->tile_size && args->tile_size != FRACTAL_BUDGET_TILE) {
+      return strdup("--max-iter auto only renders tiles of 64");
+    }
+    // Every rect has to stay within one tile's budget, mirrored bands don't
+    // line up with them.
+    args->tiles = args->tiles ?: frak_tiles_row_major;
+    args->tile_size = FRACTAL_BUDGET_TILE;
+    args->no_symmetry = true;
+  }
+  if (args->escalate && (args->progressive ||
+                         args->algorithm == fractal_algorithm_mariani)) {
+    return strdup(
+        "Cannot specify --escalate with --progressive or --algorithm "
+        "mariani");
+  }
+  if (args->aa_grid > FRACTAL_SUPERSAMPLE_MAX_GRID) {
+    return strdup("--aa-grid can't be more than 8");
+  }
+  if (!fractal_kernel_is_supported(args->kernel)) {
+    char* err;
+    asprintf(&err, "Kernel %s is not supported by this CPU",
+             fractal_kernel_name(args->kernel));
+    return err;
+  }
   if (!args->worker_cache_size) {
     args->worker_cache_size = (uint32_t)-1;
   }
@@ -5,6 +5,7 @@
 #include <stdint.h>
 
 #include "frakl/args.h"
+#include "frakl/fractal.h"
 
 enum frak_palette {
   frak_palette_default = 0,
@@ -17,6 +18,16 @@ enum frak_palette {
 enum frak_design {
   frak_design_mandlebrot = 1,
   frak_design_default = 2,
+  frak_design_multibrot = 3,
+  frak_design_burning_ship = 4,
+  frak_design_tricorn = 5,
+  frak_design_celtic = 6,
+  frak_design_buddhabrot = 7,
+  frak_design_nebulabrot = 8,
+  frak_design_mandelbulb = 9,
+  frak_design_lyapunov = 10,
+  frak_design_newton = 11,
+  frak_design_flame = 12,
 };
 
 struct frak_color {
@@ -31,6 +42,34 @@ struct frak_colors {
   struct frak_color colors[];
 };
 
+struct frak_budgets {
+  unsigned count;
+  uint32_t budgets[];
+};
+
+struct frak_roots {
+  unsigned count;
+  double roots[][2];
+};
+
+enum frak_tiles {
+  // Whole rows, or row segments of --worker-cache-size pixels.
+  frak_tiles_off = 0,
+  // The rest are 1 + the matching wq_tile_order.
+  frak_tiles_row_major = 1,
+  frak_tiles_morton = 2,
+  frak_tiles_hilbert = 3,
+};
+
+enum frak_aa {
+  frak_aa_off = 0,
+  // Supersample only pixels that stand out from a neighbour.
+  frak_aa_adaptive = 1,
+};
+
+// --max-iter auto, see budget.h.
+#define FRAK_MAX_ITERATION_AUTO UINT32_MAX
+
 typedef struct frak_args {
   uint32_t width;
   uint32_t height;
@@ -38,7 +77,25 @@ typedef struct frak_args {
   const char* name;
   unsigned palette;
   unsigned design;
+  uint32_t power;
+  // NAN unless --julia-c was given.
+  double julia_c[2];
   uint32_t max_iteration;
+  // Millions of c values --design buddhabrot and nebulabrot sample.
+  uint32_t samples;
+  // The red, green and blue iteration limits of --design nebulabrot.
+  uint32_t limits[3];
+  unsigned histogram;
+  bool depth_prepass;
+  // The A/B sequence of --design lyapunov.
+  const char* sequence;
+  // The polynomial's roots of --design newton.
+  struct frak_roots* roots;
+  // The spec file of --design flame and the cells along each axis of a pixel
+  // it accumulates into.
+  const char* flame;
+  uint32_t oversample;
+  struct frak_budgets* escalate;
   struct frak_colors* colors;
   double curve;
   bool palette_only;
@@ -47,14 +104,33 @@ typedef struct frak_args {
   uint32_t worker_cache_size;
   bool stats;
   bool no_compute;
-  double center[2];
+  const char* center[2];
   double fwidth;
+  unsigned kernel;
+  bool lane_refill;
+  bool no_interior_check;
+  bool no_symmetry;
+  unsigned tiles;
+  uint32_t tile_size;
+  bool balance;
+  bool progressive;
+  unsigned aa;
+  uint32_t aa_grid;
+  uint32_t aa_threshold;
+  unsigned periodicity;
+  unsigned algorithm;
+  unsigned precision;
+  bool float_first;
+  bool unroll;
+  bool compare;
+  unsigned perturbation;
 } * frak_args_t;
 
 extern struct arg_spec const* const frak_arg_specs;
 
 void frak_usage(int code) __attribute__((noreturn));
 void frak_args_init(frak_args_t args);
+const char* frak_tiles_name(unsigned tiles);
 char* frak_args_validate(frak_args_t args);
 
 static inline char* parse_frak_args(frak_args_t args, int argc,
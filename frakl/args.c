@@ -2,6 +2,7 @@
 
 #include "args.h"
 
+#include <ctype.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -156,28 +157,96 @@ static void cp_num(const char** in_iter, char** out) {
 union value_holder {
   double dbl;
   long lng;
+  char* str;
 };
 
-static union value_holder strtovh(const char* str, char** endptr, bool dbl) {
-  if (dbl) {
-    return (union value_holder){.dbl = strtod(str, endptr)};
-  } else {
-    return (union value_holder){.lng = strtol(str, endptr, 0)};
+enum value_kind {
+  value_kind_long,
+  value_kind_double,
+  value_kind_decimal,
+};
+
+// [+-]digits[.digits][e[+-]digits], with digits on at least one side of the
+// point.
+static const char* strtodecimal(const char* str) {
+  const char* iter = str;
+  if (*iter == '-' || *iter == '+') {
+    iter++;
+  }
+  const char* digits = iter;
+  while (isdigit(*iter)) {
+    iter++;
+  }
+  bool any = iter != digits;
+  if (*iter == '.') {
+    digits = ++iter;
+    while (isdigit(*iter)) {
+      iter++;
+    }
+    any |= iter != digits;
+  }
+  if (!any) {
+    return str;
+  }
+  if (*iter == 'e' || *iter == 'E') {
+    const char* exponent = iter + 1;
+    if (*exponent == '-' || *exponent == '+') {
+      exponent++;
+    }
+    if (isdigit(*exponent)) {
+      iter = exponent;
+      while (isdigit(*iter)) {
+        iter++;
+      }
+    }
   }
+  return iter;
 }
 
-static void bind_value_holder(void** io_slot, union value_holder vh, bool dbl) {
+static union value_holder strtovh(char* str, char** endptr,
+                                  enum value_kind kind) {
+  switch (kind) {
+    case value_kind_double:
+      return (union value_holder){.dbl = strtod(str, endptr)};
+    case value_kind_decimal:
+      *endptr = str + (strtodecimal(str) - str);
+      return (union value_holder){.str = str};
+    default:
+      return (union value_holder){.lng = strtol(str, endptr, 0)};
+  }
+}
+
+static void bind_value_holder(void** io_slot, union value_holder vh,
+                              enum value_kind kind) {
   void* slot = *io_slot;
-  if (dbl) {
-    *(double*)slot = vh.dbl;
-    slot += sizeof(double);
-  } else {
-    *(long*)slot = vh.lng;
-    slot += sizeof(long);
+  switch (kind) {
+    case value_kind_double:
+      *(double*)slot = vh.dbl;
+      slot += sizeof(double);
+      break;
+    case value_kind_decimal:
+      *(char**)slot = vh.str;
+      slot += sizeof(char*);
+      break;
+    default:
+      *(long*)slot = vh.lng;
+      slot += sizeof(long);
+      break;
   }
   *io_slot = slot;
 }
 
+static const char* value_kind_name(enum value_kind kind) {
+  switch (kind) {
+    case value_kind_double:
+      return "double";
+    case value_kind_decimal:
+      return "decimal";
+    default:
+      return "long";
+  }
+}
+
 char* tuple_parser(const char* arg, void* slot, void* ctx) {
   if (!arg) {
     return strdup("programmer error, tuple options require an argument");
@@ -189,7 +258,10 @@ char* tuple_parser(const char* arg, void* slot, void* ctx) {
 
   const struct tuple_spec* spec = ctx;
   const uint16_t count = spec->count;
-  const bool is_double = spec->is_double;
+  const enum value_kind kind = spec->is_decimal  ? value_kind_decimal
+                               : spec->is_double ? value_kind_double
+                                                 : value_kind_long;
+  const char* kind_name = value_kind_name(kind);
   char* res = NULL;
   char* num_buf = NULL;
   uint16_t i;
@@ -207,20 +279,20 @@ char* tuple_parser(const char* arg, void* slot, void* ctx) {
     }
 
     char* tmp;
-    union value_holder vh = strtovh(num_buf, &tmp, is_double);
+    union value_holder vh = strtovh(num_buf, &tmp, kind);
     if (*tmp != '\0') {
-      asprintf(&res, "expected %s, error at '%c'",
-               is_double ? "double" : "long", *tmp);
+      asprintf(&res, "expected %s, error at '%c'", kind_name, *tmp);
       goto loop_out;
     } else {
-      bind_value_holder(&slot, vh, is_double);
+      bind_value_holder(&slot, vh, kind);
+    }
+    if (kind != value_kind_decimal) {
+      free(num_buf);
     }
-    free(num_buf);
   }
 
   if (i != count || *arg != '\0') {
-    asprintf(&res, "expected %d %s%s", count, is_double ? "double" : "long",
-             count != 1 ? "s" : "");
+    asprintf(&res, "expected %d %s%s", count, kind_name, count != 1 ? "s" : "");
   }
 
 out:
@@ -37,6 +37,9 @@ char* enum_parser(const char* arg, void* slot, void* ctx);
 struct tuple_spec {
   uint16_t count;
   bool is_double;
+  // Keep each item as a malloc'd string (char*) after checking it's a plain
+  // decimal number, so no precision is lost to a double.
+  bool is_decimal;
 };
 
 char* tuple_parser(const char* arg, void* slot, void* ctx);
@@ -0,0 +1,160 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#include "balance.h"
+
+#include <stdlib.h>
+
+// The pixels column of cells starts at and how many it spans.
+static uint32_t balance_cell_x(struct fractal_balance const* balance,
+                               uint32_t column, uint32_t* w) {
+  const uint32_t x = column * FRACTAL_BALANCE_CELL;
+  *w = balance->width - x < FRACTAL_BALANCE_CELL ? balance->width - x
+                                                 : FRACTAL_BALANCE_CELL;
+  return x;
+}
+
+static uint64_t balance_cell_cost(struct fractal_balance const* balance,
+                                  uint32_t row, uint32_t column, uint32_t w,
+                                  uint32_t h) {
+  const uint32_t cost = balance->costs[(uintptr_t)row * balance->columns +
+                                       column];
+  return (uint64_t)(cost + FRACTAL_BALANCE_PIXEL_COST) * w * h;
+}
+
+void fractal_balance_init(struct fractal_balance* balance,
+                          struct fractal_ctx const* ctx, size_t worker_count) {
+  const uint32_t columns =
+      (ctx->width + FRACTAL_BALANCE_CELL - 1) / FRACTAL_BALANCE_CELL;
+  const uint32_t rows =
+      (ctx->height + FRACTAL_BALANCE_CELL - 1) / FRACTAL_BALANCE_CELL;
+  balance->costs = malloc((uintptr_t)columns * rows * sizeof(uint32_t));
+  balance->columns = columns;
+  balance->rows = rows;
+  balance->width = ctx->width;
+  balance->height = ctx->height;
+  balance->chunks = NULL;
+  balance->count = 0;
+  balance->capacity = 0;
+  balance->worker_count = worker_count ?: 1;
+  balance->predicted = calloc(balance->worker_count, sizeof(uint64_t));
+
+  uint64_t total = 0;
+  for (uint32_t row = 0; row < rows; row++) {
+    const uint32_t y = row * FRACTAL_BALANCE_CELL;
+    const uint32_t h = ctx->height - y < FRACTAL_BALANCE_CELL
+                           ? ctx->height - y
+                           : FRACTAL_BALANCE_CELL;
+    const double py = y + h / 2.0;
+    for (uint32_t column = 0; column < columns; column++) {
+      uint32_t w;
+      const double px = balance_cell_x(balance, column, &w) + w / 2.0;
+      balance->costs[(uintptr_t)row * columns + column] =
+          fractal_ctx_probe_cost(ctx, px, py);
+      total += balance_cell_cost(balance, row, column, w, h);
+    }
+  }
+  balance->target =
+      total / (FRACTAL_BALANCE_CHUNKS_PER_WORKER * balance->worker_count) ?: 1;
+}
+
+void fractal_balance_destroy(struct fractal_balance* balance) {
+  free(balance->costs);
+  free(balance->chunks);
+  free(balance->predicted);
+  balance->costs = NULL;
+  balance->chunks = NULL;
+  balance->predicted = NULL;
+}
+
+static void balance_append(struct fractal_balance* balance, wq_rect_t rect,
+                           uint64_t cost) {
+  if (balance->count == balance->capacity) {
+    balance->capacity = balance->capacity ? 2 * balance->capacity : 256;
+    balance->chunks = realloc(balance->chunks,
+                              balance->capacity * sizeof(*balance->chunks));
+  }
+  balance->chunks[balance->count++] =
+      (struct fractal_balance_chunk){.rect = rect, .cost = cost};
+}
+
+uintptr_t fractal_balance_add_rows(struct fractal_balance* balance, uint32_t y,
+                                   uint32_t height) {
+  const uintptr_t before = balance->count;
+  const uint32_t end = y + height;
+  const uint64_t target = balance->target;
+  // The band of whole rows still taking more, if the last chunk is one.
+  bool band = false;
+  for (uint32_t top = y; top < end;) {
+    const uint32_t row = top / FRACTAL_BALANCE_CELL;
+    const uint32_t bottom = (row + 1) * FRACTAL_BALANCE_CELL < end
+                                ? (row + 1) * FRACTAL_BALANCE_CELL
+                                : end;
+    const uint32_t h = bottom - top;
+    uint64_t row_cost = 0;
+    for (uint32_t column = 0; column < balance->columns; column++) {
+      uint32_t w;
+      balance_cell_x(balance, column, &w);
+      row_cost += balance_cell_cost(balance, row, column, w, h);
+    }
+
+    if (row_cost <= target) {
+      struct fractal_balance_chunk* last =
+          band ? &balance->chunks[balance->count - 1] : NULL;
+      if (last && last->cost + row_cost <= target) {
+        last->rect.h += h;
+        last->cost += row_cost;
+      } else {
+        balance_append(
+            balance, (wq_rect_t){.y = top, .w = balance->width, .h = h},
+            row_cost);
+        band = true;
+      }
+    } else {
+      band = false;
+      wq_rect_t rect = {.y = top, .h = h};
+      uint64_t cost = 0;
+      for (uint32_t column = 0; column < balance->columns; column++) {
+        uint32_t w;
+        const uint32_t x = balance_cell_x(balance, column, &w);
+        const uint64_t cell = balance_cell_cost(balance, row, column, w, h);
+        if (rect.w && cost + cell > target) {
+          balance_append(balance, rect, cost);
+          rect.x = x;
+          rect.w = 0;
+          cost = 0;
+        }
+        rect.w += w;
+        cost += cell;
+      }
+      balance_append(balance, rect, cost);
+    }
+    top = bottom;
+  }
+  return balance->count - before;
+}
+
+static int balance_chunk_sort(const void* a, const void* b) {
+  const uint64_t ca = ((struct fractal_balance_chunk const*)a)->cost;
+  const uint64_t cb = ((struct fractal_balance_chunk const*)b)->cost;
+  return ca < cb ? 1 : ca > cb ? -1 : 0;
+}
+
+unsigned fractal_balance_push(struct fractal_balance* balance, wq_t wq) {
+  qsort(balance->chunks, balance->count, sizeof(*balance->chunks),
+        balance_chunk_sort);
+  const size_t workers = balance->worker_count;
+  uint64_t* predicted = balance->predicted;
+  unsigned res = 0;
+  for (uintptr_t i = 0; i < balance->count; i++) {
+    size_t idle = 0;
+    for (size_t worker = 1; worker < workers; worker++) {
+      idle = predicted[worker] < predicted[idle] ? worker : idle;
+    }
+    predicted[idle] += balance->chunks[i].cost;
+    if (!wq_push_rect(wq, balance->chunks[i].rect)) {
+      break;
+    }
+    res += 1;
+  }
+  return res;
+}
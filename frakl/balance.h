@@ -0,0 +1,57 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#pragma once
+
+#include <stdint.h>
+
+#include "fractal.h"
+#include "wq.h"
+
+// Side of the cells whose cost is estimated from a single probe, in pixels.
+#define FRACTAL_BALANCE_CELL 16
+// Chunks aimed for per worker, so the cheap ones left at the end even out
+// whatever the estimates got wrong.
+#define FRACTAL_BALANCE_CHUNKS_PER_WORKER 16
+// What a pixel costs on top of its iterations, in iterations, for setting up
+// the point and storing the result.
+#define FRACTAL_BALANCE_PIXEL_COST 4
+
+struct fractal_balance_chunk {
+  wq_rect_t rect;
+  uint64_t cost;
+};
+
+struct fractal_balance {
+  // Estimated iterations per pixel of every cell, row-major.
+  uint32_t* costs;
+  uint32_t columns;
+  uint32_t rows;
+  uint32_t width;
+  uint32_t height;
+  // What every chunk should cost, roughly.
+  uint64_t target;
+  struct fractal_balance_chunk* chunks;
+  uintptr_t count;
+  uintptr_t capacity;
+  size_t worker_count;
+  // Each worker's load in cost units if every worker takes the next chunk
+  // as soon as it's free, filled in by fractal_balance_push.
+  uint64_t* predicted;
+};
+
+// Builds the cost map by probing the middle of every cell of the view with
+// fractal_ctx_probe_cost. The kernel must already be selected.
+void fractal_balance_init(struct fractal_balance* balance,
+                          struct fractal_ctx const* ctx, size_t worker_count);
+
+void fractal_balance_destroy(struct fractal_balance* balance);
+
+// Splits rows [y, y + height) into chunks of about balance->target each.
+// Expensive cells get chunks of a few cells along their row, cheap rows of
+// cells are merged into bands of whole rows. Returns how many were added.
+uintptr_t fractal_balance_add_rows(struct fractal_balance* balance, uint32_t y,
+                                   uint32_t height);
+
+// Pushes the chunks added so far most expensive first, the longest
+// processing time first order, and predicts each worker's load from it.
+unsigned fractal_balance_push(struct fractal_balance* balance, wq_t wq);
@@ -0,0 +1,239 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#include "bignum.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+unsigned bignum_limbs_for(double resolution, unsigned guard_bits) {
+  int exponent = 0;
+  if (resolution < 1.0) {
+    frexp(resolution, &exponent);
+  }
+  const unsigned bits = (unsigned)-exponent + guard_bits;
+  const unsigned len = 1 + (bits + 31) / 32;
+  return len <= BIGNUM_MAX_LIMBS ? len : 0;
+}
+
+static bool bignum_is_zero(struct bignum const* n) {
+  for (unsigned i = 0; i < n->len; i++) {
+    if (n->limbs[i] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void bignum_init(struct bignum* n, unsigned len) {
+  assert(len > 0 && len <= BIGNUM_MAX_LIMBS);
+  n->negative = false;
+  n->len = len;
+  memset(n->limbs, 0, sizeof(n->limbs));
+}
+
+void bignum_from_double(struct bignum* n, double value, unsigned len) {
+  bignum_init(n, len);
+  n->negative = value < 0.0;
+  value = fabs(value);
+  assert(value < 4294967296.0);
+  // Peeling off the integer part and scaling by 2^32 are both exact.
+  for (unsigned i = 0; i < len && value != 0.0; i++) {
+    const double limb = floor(value);
+    n->limbs[i] = (uint32_t)limb;
+    value = ldexp(value - limb, 32);
+  }
+  if (bignum_is_zero(n)) {
+    n->negative = false;
+  }
+}
+
+static void bignum_div10(struct bignum* n) {
+  uint64_t rem = 0;
+  for (unsigned i = 0; i < n->len; i++) {
+    const uint64_t cur = (rem << 32) | n->limbs[i];
+    n->limbs[i] = (uint32_t)(cur / 10);
+    rem = cur % 10;
+  }
+}
+
+const char* bignum_from_decimal(struct bignum* n, const char* str,
+                                unsigned len) {
+  bignum_init(n, len);
+  const char* iter = str;
+  bool negative = false;
+  if (*iter == '-' || *iter == '+') {
+    negative = *iter++ == '-';
+  }
+
+  // Digits with the decimal point dropped, and how many came before it.
+  char* digits = malloc(strlen(iter) + 1);
+  long ndigits = 0;
+  long point = -1;
+  for (; isdigit(*iter) || (*iter == '.' && point < 0); iter++) {
+    if (*iter == '.') {
+      point = ndigits;
+    } else {
+      digits[ndigits++] = *iter - '0';
+    }
+  }
+  if (point < 0) {
+    point = ndigits;
+  }
+  const char* res = NULL;
+  if (ndigits == 0) {
+    res = "expected digits";
+    goto out;
+  }
+  if (*iter == 'e' || *iter == 'E') {
+    char* end;
+    const long exponent = strtol(iter + 1, &end, 10);
+    if (end == iter + 1 || !isdigit(end[-1])) {
+      res = "expected exponent digits";
+      goto out;
+    }
+    if (exponent > INT_MAX || exponent < -INT_MAX) {
+      res = "exponent out of range";
+      goto out;
+    }
+    point += exponent;
+    iter = end;
+  }
+  if (*iter != '\0') {
+    res = "expected decimal number";
+    goto out;
+  }
+
+  uint64_t integer = 0;
+  for (long i = 0; i < point; i++) {
+    integer = 10 * integer + (i < ndigits ? digits[i] : 0);
+    if (integer > UINT32_MAX) {
+      res = "integer part out of range";
+      goto out;
+    }
+  }
+
+  // Horner's rule from the last digit in: frac = (digit + frac) / 10. Each
+  // division truncates, but the error shrinks by 10 every digit after.
+  for (long i = ndigits - 1; i >= (point > 0 ? point : 0); i--) {
+    n->limbs[0] = digits[i];
+    bignum_div10(n);
+  }
+  for (long i = point; i < 0 && !bignum_is_zero(n); i++) {
+    bignum_div10(n);
+  }
+  n->limbs[0] = (uint32_t)integer;
+  n->negative = negative && !bignum_is_zero(n);
+
+out:
+  free(digits);
+  return res;
+}
+
+double bignum_to_double(struct bignum const* n) {
+  // Three limbs cover the 53 bits of a double wherever the leading one is.
+  unsigned i = n->len;
+  while (i > 0 && n->limbs[i - 1] == 0) {
+    i--;
+  }
+  double res = 0.0;
+  unsigned first = 0;
+  while (first < i && n->limbs[first] == 0) {
+    first++;
+  }
+  if (i > first + 3) {
+    i = first + 3;
+  }
+  while (i-- > 0) {
+    res = ldexp(res, -32) + n->limbs[i];
+  }
+  return n->negative ? -res : res;
+}
+
+static int bignum_cmp_magnitude(struct bignum const* a,
+                                struct bignum const* b) {
+  for (unsigned i = 0; i < a->len; i++) {
+    if (a->limbs[i] != b->limbs[i]) {
+      return a->limbs[i] < b->limbs[i] ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+// r = |a| + |b|, dropping any carry out of the integer limb.
+static void bignum_add_magnitude(struct bignum* r, struct bignum const* a,
+                                 struct bignum const* b) {
+  uint64_t carry = 0;
+  for (unsigned i = a->len; i-- > 0;) {
+    const uint64_t cur = (uint64_t)a->limbs[i] + b->limbs[i] + carry;
+    r->limbs[i] = (uint32_t)cur;
+    carry = cur >> 32;
+  }
+}
+
+// r = |a| - |b|, where |a| >= |b|.
+static void bignum_sub_magnitude(struct bignum* r, struct bignum const* a,
+                                 struct bignum const* b) {
+  uint64_t borrow = 0;
+  for (unsigned i = a->len; i-- > 0;) {
+    const uint64_t cur = (uint64_t)a->limbs[i] - b->limbs[i] - borrow;
+    r->limbs[i] = (uint32_t)cur;
+    borrow = (cur >> 32) & 1;
+  }
+}
+
+static void bignum_add_signed(struct bignum* r, struct bignum const* a,
+                              struct bignum const* b, bool b_negative) {
+  assert(a->len == b->len);
+  r->len = a->len;
+  bool negative;
+  if (a->negative == b_negative) {
+    negative = a->negative;
+    bignum_add_magnitude(r, a, b);
+  } else if (bignum_cmp_magnitude(a, b) >= 0) {
+    negative = a->negative;
+    bignum_sub_magnitude(r, a, b);
+  } else {
+    negative = b_negative;
+    bignum_sub_magnitude(r, b, a);
+  }
+  r->negative = negative && !bignum_is_zero(r);
+}
+
+void bignum_add(struct bignum* r, struct bignum const* a,
+                struct bignum const* b) {
+  bignum_add_signed(r, a, b, b->negative);
+}
+
+void bignum_sub(struct bignum* r, struct bignum const* a,
+                struct bignum const* b) {
+  bignum_add_signed(r, a, b, !b->negative);
+}
+
+void bignum_mul(struct bignum* r, struct bignum const* a,
+                struct bignum const* b) {
+  const unsigned len = a->len;
+  assert(b->len == len);
+  // Limb i of a times limb j of b lands in limb i + j of the product, with
+  // carries flowing toward limb 0. Everything past len is dropped at the end.
+  uint32_t product[2 * BIGNUM_MAX_LIMBS] = {0};
+  for (unsigned i = len; i-- > 0;) {
+    uint64_t carry = 0;
+    for (unsigned j = len; j-- > 0;) {
+      const uint64_t cur =
+          (uint64_t)a->limbs[i] * b->limbs[j] + product[i + j] + carry;
+      product[i + j] = (uint32_t)cur;
+      carry = cur >> 32;
+    }
+    if (i > 0) {
+      product[i - 1] = (uint32_t)carry;
+    }
+  }
+  const bool negative = a->negative != b->negative;
+  r->len = len;
+  memcpy(r->limbs, product, len * sizeof(uint32_t));
+  r->negative = negative && !bignum_is_zero(r);
+}
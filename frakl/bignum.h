@@ -0,0 +1,42 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Enough for pixels around 1e-300 wide, past where doubles underflow anyway.
+#define BIGNUM_MAX_LIMBS 40
+
+// Signed fixed-point number. limbs[0] is the integer part and each following
+// limb holds the next 32 bits of the fraction, so a bignum with len limbs
+// resolves 2^(-32 * (len - 1)). Results are truncated toward zero.
+struct bignum {
+  bool negative;
+  uint16_t len;
+  uint32_t limbs[BIGNUM_MAX_LIMBS];
+};
+
+// The number of limbs needed to resolve resolution with guard_bits to spare,
+// or 0 if that's more than BIGNUM_MAX_LIMBS.
+unsigned bignum_limbs_for(double resolution, unsigned guard_bits);
+
+void bignum_init(struct bignum* n, unsigned len);
+
+void bignum_from_double(struct bignum* n, double value, unsigned len);
+
+// Parses [+-]digits[.digits][e[+-]digits] exactly, up to the precision of len
+// limbs. Returns an error if str isn't a decimal or its integer part doesn't
+// fit in a limb.
+const char* bignum_from_decimal(struct bignum* n, const char* str,
+                                unsigned len);
+
+double bignum_to_double(struct bignum const* n);
+
+// a and b must have the same len, which r takes on. r may alias either.
+void bignum_add(struct bignum* r, struct bignum const* a,
+                struct bignum const* b);
+void bignum_sub(struct bignum* r, struct bignum const* a,
+                struct bignum const* b);
+void bignum_mul(struct bignum* r, struct bignum const* a,
+                struct bignum const* b);
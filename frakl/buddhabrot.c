@@ -0,0 +1,397 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#include "buddhabrot.h"
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wq.h"
+
+// Orbits coming back this close to their saved point, squared, are caught
+// cycling.
+#define FRACTAL_BUDDHABROT_EPSSQ 1e-12
+// Batches of samples aimed for per worker, and the fewest a batch takes.
+#define FRACTAL_BUDDHABROT_BATCHES_PER_WORKER 64
+#define FRACTAL_BUDDHABROT_BATCH_MIN 1024
+#define FRACTAL_BUDDHABROT_BATCH_MAX (1u << 24)
+// Orbits escaping within FRACTAL_BUDDHABROT_STEP iterations weigh 1, each
+// doubling of that doubles the weight.
+#define FRACTAL_BUDDHABROT_STEP 16
+// Pixels merged or tone mapped per work item.
+#define FRACTAL_BUDDHABROT_MERGE_PIXELS 65536
+
+// splitmix64's output function, turning a counter into 64 random bits.
+static inline uint64_t buddhabrot_random(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+// Iterates z <- z^2 + c from z = 0 up to buddhabrot->max_limit times.
+// Returns the iteration z escaped on, or 0 if it didn't. Unless orbit is
+// NULL, the histogram index of every point after c itself landing in view is
+// appended to it and *visited set to how many did. c is left out as it's
+// only where the sample was drawn.
+__attribute__((always_inline)) static inline uint32_t buddhabrot_iterate(
+    struct fractal_buddhabrot const* buddhabrot, double cx, double cy,
+    uint32_t* orbit, uint32_t* visited) {
+  if (mandlebrot_in_main_bulbs(cx, cy)) {
+    return 0;
+  }
+  struct fractal_ctx const* ctx = buddhabrot->ctx;
+  const double xscale = ctx->width / ctx->fwidth;
+  const double yscale = ctx->height / ctx->fheight;
+  const uint32_t max = buddhabrot->max_limit;
+  double zx = 0.0;
+  double zy = 0.0;
+  double tmp;
+  double magsq = 0.0;
+  double sx = 0.0;
+  double sy = 0.0;
+  double dx;
+  double dy;
+  uint64_t check = FRACTAL_PERIOD_FIRST_CHECK;
+  uint32_t result = 0;
+  uint32_t count = 0;
+
+  while (magsq <= 4.0 && result != max) {
+    tmp = zx * zx - zy * zy + cx;
+    zy = 2 * zx * zy + cy;
+    zx = tmp;
+    magsq = zx * zx + zy * zy;
+    result += 1;
+    if (orbit && result > 1) {
+      const double px = (zx - ctx->fleft) * xscale;
+      const double py = (zy - ctx->ftop) * yscale;
+      if (px >= 0.0 && px < ctx->width && py >= 0.0 && py < ctx->height) {
+        orbit[count++] = (uint32_t)py * ctx->width + (uint32_t)px;
+      }
+    }
+    dx = zx - sx;
+    dy = zy - sy;
+    if (magsq <= 4.0 && dx * dx + dy * dy < FRACTAL_BUDDHABROT_EPSSQ) {
+      return 0;
+    }
+    if (result == check) {
+      sx = zx;
+      sy = zy;
+      check *= 2;
+    }
+  }
+  if (visited) {
+    *visited = count;
+  }
+  return magsq > 4.0 ? result : 0;
+}
+
+// Weighs the cells of the row of cells rect->y.
+static void buddhabrot_weigh_worker(wq_rect_t const* rect,
+                                    struct fractal_buddhabrot* buddhabrot) {
+  const double side = 4.0 / FRACTAL_BUDDHABROT_GRID;
+  for (uint32_t column = 0; column < FRACTAL_BUDDHABROT_GRID; column++) {
+    uint32_t longest = 0;
+    bool inside = false;
+    for (uint32_t i = 0; i < FRACTAL_BUDDHABROT_PROBES; i++) {
+      for (uint32_t j = 0; j < FRACTAL_BUDDHABROT_PROBES; j++) {
+        const double cx =
+            -2.0 + side * (column + (j + 0.5) / FRACTAL_BUDDHABROT_PROBES);
+        const double cy =
+            -2.0 + side * (rect->y + (i + 0.5) / FRACTAL_BUDDHABROT_PROBES);
+        const uint32_t escaped =
+            buddhabrot_iterate(buddhabrot, cx, cy, NULL, NULL);
+        inside |= !escaped;
+        longest = escaped > longest ? escaped : longest;
+      }
+    }
+    // Orbits escaping from a cell run about as long as its probes' did.
+    // Cells reaching into the set aren't favoured however long their orbits,
+    // the samples landing inside cost the most and count for nothing.
+    uint32_t weight = 1;
+    while (!inside && weight < FRACTAL_BUDDHABROT_WEIGHT &&
+           FRACTAL_BUDDHABROT_STEP * weight <= longest) {
+      weight *= 2;
+    }
+    buddhabrot->cells[rect->y * FRACTAL_BUDDHABROT_GRID + column] = weight;
+  }
+}
+
+const char* fractal_buddhabrot_init(struct fractal_buddhabrot* buddhabrot,
+                                    struct fractal_ctx const* ctx,
+                                    uint32_t const* limits, unsigned channels,
+                                    enum fractal_histogram histogram,
+                                    size_t worker_count) {
+  if (channels != 1 && channels != FRACTAL_BUDDHABROT_CHANNELS) {
+    return "Buddhabrots have 1 or 3 channels";
+  }
+  memset(buddhabrot, 0, sizeof(*buddhabrot));
+  buddhabrot->ctx = ctx;
+  buddhabrot->channels = channels;
+  for (unsigned channel = 0; channel < channels; channel++) {
+    buddhabrot->limits[channel] = limits[channel];
+    if (limits[channel] > buddhabrot->max_limit) {
+      buddhabrot->max_limit = limits[channel];
+    }
+  }
+  buddhabrot->histogram = histogram;
+  buddhabrot->worker_count = worker_count ?: 1;
+  buddhabrot->workers = aligned_alloc(
+      64, buddhabrot->worker_count * sizeof(*buddhabrot->workers));
+  memset(buddhabrot->workers, 0,
+         buddhabrot->worker_count * sizeof(*buddhabrot->workers));
+  const size_t counts = (size_t)ctx->width * ctx->height * channels;
+  for (size_t i = 0; i < buddhabrot->worker_count; i++) {
+    struct fractal_buddhabrot_worker* worker = &buddhabrot->workers[i];
+    worker->orbit = malloc(buddhabrot->max_limit * sizeof(uint32_t));
+    if (histogram == fractal_histogram_private) {
+      worker->histogram = calloc(counts, sizeof(uint64_t));
+    }
+  }
+  // Private histograms are merged into the first.
+  buddhabrot->counts = histogram == fractal_histogram_private
+                           ? buddhabrot->workers[0].histogram
+                           : calloc(counts, sizeof(uint64_t));
+
+  const uint32_t cells = FRACTAL_BUDDHABROT_GRID * FRACTAL_BUDDHABROT_GRID;
+  buddhabrot->cells = malloc(cells * sizeof(uint32_t));
+  wq_t wq = wq_create_rect("frak", (void*)buddhabrot_weigh_worker,
+                           buddhabrot->worker_count, FRACTAL_BUDDHABROT_GRID);
+  wq_push_grid(wq, FRACTAL_BUDDHABROT_GRID, FRACTAL_BUDDHABROT_GRID,
+               FRACTAL_BUDDHABROT_GRID);
+  wq_start(wq, buddhabrot);
+  wq_wait(wq);
+  wq_destroy(wq);
+  for (uint32_t cell = 1; cell < cells; cell++) {
+    buddhabrot->cells[cell] += buddhabrot->cells[cell - 1];
+  }
+  return NULL;
+}
+
+void fractal_buddhabrot_destroy(struct fractal_buddhabrot* buddhabrot) {
+  if (!buddhabrot->workers) {
+    return;
+  }
+  if (buddhabrot->histogram != fractal_histogram_private) {
+    free(buddhabrot->counts);
+  }
+  for (size_t i = 0; i < buddhabrot->worker_count; i++) {
+    free(buddhabrot->workers[i].orbit);
+    free(buddhabrot->workers[i].histogram);
+  }
+  free(buddhabrot->workers);
+  free(buddhabrot->cells);
+  buddhabrot->workers = NULL;
+  buddhabrot->cells = NULL;
+  buddhabrot->counts = NULL;
+}
+
+// Adds amount to channel of every pixel orbit visited.
+__attribute__((always_inline)) static inline void buddhabrot_count(
+    uint64_t* counts, uint32_t const* orbit, uint32_t visited,
+    unsigned channel, const unsigned channels, uint32_t amount,
+    const bool atomic) {
+  for (uint32_t i = 0; i < visited; i++) {
+    uint64_t* count = &counts[(uintptr_t)orbit[i] * channels + channel];
+    if (atomic) {
+      atomic_fetch_add_explicit((_Atomic(uint64_t)*)count, amount,
+                                memory_order_relaxed);
+    } else {
+      *count += amount;
+    }
+  }
+}
+
+__attribute__((always_inline)) static inline void buddhabrot_sample(
+    struct fractal_buddhabrot* buddhabrot, wq_rect_t const* rect,
+    const unsigned channels, const bool atomic) {
+  struct fractal_buddhabrot_worker* worker =
+      &buddhabrot->workers[wq_get_worker_index()];
+  uint64_t* const counts = atomic ? buddhabrot->counts : worker->histogram;
+  uint32_t const* const cells = buddhabrot->cells;
+  const uint32_t cell_count =
+      FRACTAL_BUDDHABROT_GRID * FRACTAL_BUDDHABROT_GRID;
+  const uint64_t total = cells[cell_count - 1];
+  const double side = 4.0 / FRACTAL_BUDDHABROT_GRID;
+  uint64_t escaped = 0;
+  uint64_t hits = 0;
+
+  // Batches start at sample (x << 32) | y.
+  const uint64_t first = (uint64_t)rect->x << 32 | rect->y;
+  for (uint64_t i = first; i < first + rect->w; i++) {
+    // Pick a cell in proportion to its weight, then a point within it.
+    const uint64_t pick = (buddhabrot_random(2 * i) >> 32) * total >> 32;
+    uint32_t low = 0;
+    uint32_t high = cell_count - 1;
+    while (low < high) {
+      const uint32_t mid = (low + high) / 2;
+      if (cells[mid] > pick) {
+        high = mid;
+      } else {
+        low = mid + 1;
+      }
+    }
+    const uint32_t weight = cells[low] - (low ? cells[low - 1] : 0);
+    const uint64_t offset = buddhabrot_random(2 * i + 1);
+    const double cx =
+        -2.0 + side * (low % FRACTAL_BUDDHABROT_GRID +
+                       (uint32_t)offset * 0x1p-32);
+    const double cy =
+        -2.0 + side * (low / FRACTAL_BUDDHABROT_GRID +
+                       (uint32_t)(offset >> 32) * 0x1p-32);
+
+    uint32_t visited;
+    const uint32_t escape =
+        buddhabrot_iterate(buddhabrot, cx, cy, worker->orbit, &visited);
+    if (!escape) {
+      continue;
+    }
+    escaped += 1;
+    hits += visited;
+    const uint32_t amount = FRACTAL_BUDDHABROT_WEIGHT / weight;
+    for (unsigned channel = 0; channel < channels; channel++) {
+      if (escape <= buddhabrot->limits[channel]) {
+        buddhabrot_count(counts, worker->orbit, visited, channel, channels,
+                         amount, atomic);
+      }
+    }
+  }
+  worker->escaped += escaped;
+  worker->hits += hits;
+}
+
+static void buddhabrot_sample_worker(wq_rect_t const* rect,
+                                     struct fractal_buddhabrot* buddhabrot) {
+  const bool atomic = buddhabrot->histogram == fractal_histogram_atomic;
+  if (buddhabrot->channels == 1) {
+    if (atomic) {
+      buddhabrot_sample(buddhabrot, rect, 1, true);
+    } else {
+      buddhabrot_sample(buddhabrot, rect, 1, false);
+    }
+  } else if (atomic) {
+    buddhabrot_sample(buddhabrot, rect, FRACTAL_BUDDHABROT_CHANNELS, true);
+  } else {
+    buddhabrot_sample(buddhabrot, rect, FRACTAL_BUDDHABROT_CHANNELS, false);
+  }
+}
+
+// The counts of the pixels rect covers, which wq_push_grid keeps within a
+// row or to whole rows.
+static void buddhabrot_range(struct fractal_buddhabrot const* buddhabrot,
+                             wq_rect_t const* rect, uintptr_t* begin,
+                             uintptr_t* end) {
+  const uintptr_t width = buddhabrot->ctx->width;
+  *begin = (rect->y * width + rect->x) * buddhabrot->channels;
+  *end = *begin + (uintptr_t)rect->w * rect->h * buddhabrot->channels;
+}
+
+// Sums rect's counts of every private histogram into the first and finds
+// the largest of each channel.
+static void buddhabrot_merge_worker(wq_rect_t const* rect,
+                                    struct fractal_buddhabrot* buddhabrot) {
+  const unsigned channels = buddhabrot->channels;
+  uint64_t* const counts = buddhabrot->counts;
+  uintptr_t begin;
+  uintptr_t end;
+  buddhabrot_range(buddhabrot, rect, &begin, &end);
+  if (buddhabrot->histogram == fractal_histogram_private) {
+    for (size_t i = 1; i < buddhabrot->worker_count; i++) {
+      uint64_t const* const other = buddhabrot->workers[i].histogram;
+      for (uintptr_t j = begin; j < end; j++) {
+        counts[j] += other[j];
+      }
+    }
+  }
+  uint64_t max[FRACTAL_BUDDHABROT_CHANNELS] = {0};
+  for (uintptr_t j = begin; j < end; j += channels) {
+    for (unsigned channel = 0; channel < channels; channel++) {
+      const uint64_t count = counts[j + channel];
+      max[channel] = count > max[channel] ? count : max[channel];
+    }
+  }
+  for (unsigned channel = 0; channel < channels; channel++) {
+    uint64_t seen = atomic_load(&buddhabrot->max[channel]);
+    while (seen < max[channel] &&
+           !atomic_compare_exchange_weak(&buddhabrot->max[channel], &seen,
+                                         max[channel])) {
+    }
+  }
+}
+
+static void buddhabrot_map_worker(wq_rect_t const* rect,
+                                  struct fractal_buddhabrot* buddhabrot) {
+  const unsigned channels = buddhabrot->channels;
+  uint64_t const* const counts = buddhabrot->counts;
+  uint8_t* const buffer = buddhabrot->ctx->buffer;
+  double scale[FRACTAL_BUDDHABROT_CHANNELS];
+  for (unsigned channel = 0; channel < channels; channel++) {
+    const uint64_t max = atomic_load(&buddhabrot->max[channel]);
+    scale[channel] = max ? 1.0 / max : 0.0;
+  }
+  uintptr_t begin;
+  uintptr_t end;
+  buddhabrot_range(buddhabrot, rect, &begin, &end);
+  for (uintptr_t j = begin; j < end; j += channels) {
+    for (unsigned channel = 0; channel < channels; channel++) {
+      buffer[j + channel] =
+          (uint8_t)lround(255.0 * sqrt(counts[j + channel] * scale[channel]));
+    }
+  }
+}
+
+// Runs cb over the view's pixels, FRACTAL_BUDDHABROT_MERGE_PIXELS at a time.
+static void buddhabrot_run_pixels(struct fractal_buddhabrot* buddhabrot,
+                                  wq_rect_cb_t cb) {
+  struct fractal_ctx const* ctx = buddhabrot->ctx;
+  wq_t wq = wq_create_rect(
+      "frak", cb, buddhabrot->worker_count,
+      wq_grid_count(ctx->width, ctx->height, FRACTAL_BUDDHABROT_MERGE_PIXELS));
+  wq_push_grid(wq, ctx->width, ctx->height, FRACTAL_BUDDHABROT_MERGE_PIXELS);
+  wq_start(wq, buddhabrot);
+  wq_wait(wq);
+  wq_destroy(wq);
+}
+
+void fractal_buddhabrot_render(struct fractal_buddhabrot* buddhabrot,
+                               uint64_t samples) {
+  uint64_t batch = samples / (FRACTAL_BUDDHABROT_BATCHES_PER_WORKER *
+                              buddhabrot->worker_count);
+  batch = batch < FRACTAL_BUDDHABROT_BATCH_MIN ? FRACTAL_BUDDHABROT_BATCH_MIN
+          : batch > FRACTAL_BUDDHABROT_BATCH_MAX ? FRACTAL_BUDDHABROT_BATCH_MAX
+                                                 : batch;
+  const uintptr_t batches = (samples + batch - 1) / batch;
+  wq_t wq = wq_create_rect("frak", (void*)buddhabrot_sample_worker,
+                           buddhabrot->worker_count, batches);
+  for (uint64_t first = 0; first < samples; first += batch) {
+    const uint64_t left = samples - first;
+    wq_push_rect(wq, (wq_rect_t){.x = (uint32_t)(first >> 32),
+                                 .y = (uint32_t)first,
+                                 .w = left < batch ? left : batch,
+                                 .h = 1});
+  }
+  wq_start(wq, buddhabrot);
+  wq_wait(wq);
+  wq_destroy(wq);
+
+  buddhabrot->samples = samples;
+  buddhabrot->escaped = 0;
+  buddhabrot->hits = 0;
+  for (size_t i = 0; i < buddhabrot->worker_count; i++) {
+    buddhabrot->escaped += buddhabrot->workers[i].escaped;
+    buddhabrot->hits += buddhabrot->workers[i].hits;
+  }
+  buddhabrot_run_pixels(buddhabrot, (void*)buddhabrot_merge_worker);
+  buddhabrot_run_pixels(buddhabrot, (void*)buddhabrot_map_worker);
+}
+
+const char* fractal_histogram_name(enum fractal_histogram histogram) {
+  switch (histogram) {
+    case fractal_histogram_private:
+      return "private";
+    case fractal_histogram_atomic:
+      return "atomic";
+  }
+  return "unknown";
+}
@@ -0,0 +1,81 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fractal.h"
+
+// Color channels of a Nebulabrot, one per iteration limit.
+#define FRACTAL_BUDDHABROT_CHANNELS 3
+// Cells along each side of the [-2, 2] x [-2, 2] square c is sampled from,
+// each probed on a FRACTAL_BUDDHABROT_PROBES x FRACTAL_BUDDHABROT_PROBES grid
+// to weigh how often it's sampled.
+#define FRACTAL_BUDDHABROT_GRID 128
+#define FRACTAL_BUDDHABROT_PROBES 3
+// The weight of the cells worth sampling most, a power of 2. Cells are
+// sampled in proportion to their weight, and every hit of a sample counts
+// FRACTAL_BUDDHABROT_WEIGHT / weight times so the density stays unbiased.
+#define FRACTAL_BUDDHABROT_WEIGHT 16
+
+enum fractal_histogram {
+  // Every worker counts hits in a histogram of its own, summed afterwards.
+  fractal_histogram_private = 0,
+  // Every worker counts hits in one shared histogram with atomic adds.
+  fractal_histogram_atomic = 1,
+};
+
+struct fractal_buddhabrot_worker {
+  // The private histogram, NULL when they're shared.
+  uint64_t* histogram;
+  // Where the current orbit passed through the view, as histogram indices.
+  uint32_t* orbit;
+  uint64_t escaped;
+  uint64_t hits;
+} __attribute__((aligned(64)));
+
+struct fractal_buddhabrot {
+  // The view, whose buffer gets channels bytes per pixel.
+  struct fractal_ctx const* ctx;
+  unsigned channels;
+  // The iterations orbits of each channel may run, an orbit only counts in
+  // the channels it escaped within.
+  uint32_t limits[FRACTAL_BUDDHABROT_CHANNELS];
+  uint32_t max_limit;
+  enum fractal_histogram histogram;
+  // Running totals of the cell weights, row-major, to pick cells from.
+  uint32_t* cells;
+  // The merged histogram, or the shared one with fractal_histogram_atomic.
+  // channels counts per pixel, interleaved. Hits count up to
+  // FRACTAL_BUDDHABROT_WEIGHT each, so with billions of samples hot pixels
+  // pass 32 bits. Counts are 64 bits, 8 bytes per pixel and channel for each
+  // histogram.
+  uint64_t* counts;
+  _Atomic(uint64_t) max[FRACTAL_BUDDHABROT_CHANNELS];
+  struct fractal_buddhabrot_worker* workers;
+  size_t worker_count;
+  uint64_t samples;
+  uint64_t escaped;
+  uint64_t hits;
+};
+
+// Sets buddhabrot up to render ctx's view, one channel per limit, and
+// weighs every cell of c by how long its probes' orbits run.
+const char* fractal_buddhabrot_init(struct fractal_buddhabrot* buddhabrot,
+                                    struct fractal_ctx const* ctx,
+                                    uint32_t const* limits, unsigned channels,
+                                    enum fractal_histogram histogram,
+                                    size_t worker_count);
+
+void fractal_buddhabrot_destroy(struct fractal_buddhabrot* buddhabrot);
+
+// Iterates samples values of c, spread over batches on a wq, counting every
+// point of the escaping orbits that lands in view. The histograms are then
+// merged and tone mapped into ctx->buffer, the square root of each count
+// against its channel's largest. Sample i always picks the same c, so the
+// image doesn't depend on the worker count or histogram.
+void fractal_buddhabrot_render(struct fractal_buddhabrot* buddhabrot,
+                               uint64_t samples);
+
+const char* fractal_histogram_name(enum fractal_histogram histogram);
@@ -0,0 +1,163 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#include "budget.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Most runs of dark pixels redone at once, so the rects take a bounded
+// amount of memory however many pixels are dark.
+#define FRACTAL_BUDGET_BATCH 65536
+
+// The smallest power of 2 no less than x, clamped to cap.
+static uint32_t budget_round(uint64_t x, uint32_t cap) {
+  uint64_t budget = FRACTAL_BUDGET_MIN;
+  while (budget < x && budget < cap) {
+    budget *= 2;
+  }
+  return budget < cap ? budget : cap;
+}
+
+void fractal_budgets_init(struct fractal_budgets* budgets,
+                          struct fractal_ctx* ctx, uint32_t cap) {
+  const uint32_t columns =
+      (ctx->width + FRACTAL_BUDGET_TILE - 1) / FRACTAL_BUDGET_TILE;
+  const uint32_t rows =
+      (ctx->height + FRACTAL_BUDGET_TILE - 1) / FRACTAL_BUDGET_TILE;
+  const uintptr_t count = (uintptr_t)columns * rows;
+  budgets->budgets = malloc(count * sizeof(uint32_t));
+  budgets->columns = columns;
+  budgets->rows = rows;
+  budgets->redone_pixels = 0;
+
+  // The slowest escape probed in each tile, 0 if none did.
+  uint32_t* slowest = calloc(count, sizeof(uint32_t));
+  const double step = (double)FRACTAL_BUDGET_TILE / FRACTAL_BUDGET_SAMPLES;
+  for (uint32_t row = 0; row < rows; row++) {
+    for (uint32_t column = 0; column < columns; column++) {
+      uint32_t* tile = &slowest[(uintptr_t)row * columns + column];
+      for (unsigned sy = 0; sy < FRACTAL_BUDGET_SAMPLES; sy++) {
+        const double py = row * FRACTAL_BUDGET_TILE + (sy + 0.5) * step;
+        if (py >= ctx->height) {
+          break;
+        }
+        for (unsigned sx = 0; sx < FRACTAL_BUDGET_SAMPLES; sx++) {
+          const double px = column * FRACTAL_BUDGET_TILE + (sx + 0.5) * step;
+          if (px >= ctx->width) {
+            break;
+          }
+          const uint32_t iterations = fractal_ctx_probe(ctx, px, py, cap);
+          if (iterations < cap && iterations > *tile) {
+            *tile = iterations;
+          }
+        }
+      }
+    }
+  }
+
+  budgets->max = FRACTAL_BUDGET_MIN < cap ? FRACTAL_BUDGET_MIN : cap;
+  for (uint32_t row = 0; row < rows; row++) {
+    for (uint32_t column = 0; column < columns; column++) {
+      uint32_t need = 0;
+      for (uint32_t y = row ? row - 1 : 0; y <= row + 1 && y < rows; y++) {
+        for (uint32_t x = column ? column - 1 : 0;
+             x <= column + 1 && x < columns; x++) {
+          const uint32_t tile = slowest[(uintptr_t)y * columns + x];
+          need = tile > need ? tile : need;
+        }
+      }
+      const uint32_t budget =
+          budget_round((uint64_t)FRACTAL_BUDGET_MARGIN * need, cap);
+      budgets->budgets[(uintptr_t)row * columns + column] = budget;
+      budgets->max = budget > budgets->max ? budget : budgets->max;
+    }
+  }
+  free(slowest);
+
+  ctx->budgets = budgets->budgets;
+  ctx->budget_tile = FRACTAL_BUDGET_TILE;
+  ctx->budget_columns = columns;
+  ctx->max_iteration = budgets->max;
+}
+
+// Collects up to FRACTAL_BUDGET_BATCH runs of dark pixels within rows of
+// tiles below the largest budget into rects, starting at the pixel *next and
+// leaving it where it stopped.
+static uintptr_t budget_dark_rects(struct fractal_budgets const* budgets,
+                                   struct fractal_ctx const* ctx,
+                                   wq_rect_t* rects, uintptr_t* next) {
+  uint8_t const* buffer = ctx->buffer;
+  const uint32_t width = ctx->width;
+  const uintptr_t pixels = (uintptr_t)width * ctx->height;
+  uintptr_t nrects = 0;
+  uintptr_t i = *next;
+  while (i < pixels && nrects < FRACTAL_BUDGET_BATCH) {
+    const uint32_t row = i / width;
+    const uint32_t column = i % width;
+    const uint32_t tile_end =
+        (column / FRACTAL_BUDGET_TILE + 1) * FRACTAL_BUDGET_TILE;
+    const uintptr_t end =
+        (uintptr_t)row * width + (tile_end < width ? tile_end : width);
+    const uint32_t budget =
+        budgets->budgets[row / FRACTAL_BUDGET_TILE * budgets->columns +
+                         column / FRACTAL_BUDGET_TILE];
+    if (budget == budgets->max) {
+      i = end;
+      continue;
+    }
+    if (buffer[i] != 255) {
+      i++;
+      continue;
+    }
+    const uintptr_t begin = i;
+    while (i < end && buffer[i] == 255) {
+      i++;
+    }
+    rects[nrects++] = (wq_rect_t){.x = column,
+                                  .y = row,
+                                  .w = (uint32_t)(i - begin),
+                                  .h = 1};
+  }
+  *next = i;
+  return nrects;
+}
+
+void fractal_budgets_render(struct fractal_budgets* budgets,
+                            struct fractal_ctx* ctx, size_t worker_count) {
+  wq_rect_t* rects = malloc(FRACTAL_BUDGET_BATCH * sizeof(wq_rect_t));
+  // Without budgets every pixel runs up to max_iteration.
+  ctx->budgets = NULL;
+  uintptr_t next = 0;
+  uintptr_t nrects;
+  while ((nrects = budget_dark_rects(budgets, ctx, rects, &next)) != 0) {
+    for (uintptr_t i = 0; i < nrects; i++) {
+      budgets->redone_pixels += rects[i].w;
+    }
+    wq_t wq =
+        wq_create_rect("frak", (void*)fractal_worker, worker_count, nrects);
+    wq_push_rects(wq, nrects, rects);
+    wq_start(wq, ctx);
+    wq_wait(wq);
+    wq_destroy(wq);
+  }
+  ctx->budgets = budgets->budgets;
+  free(rects);
+}
+
+void fractal_budgets_destroy(struct fractal_budgets* budgets) {
+  free(budgets->budgets);
+  budgets->budgets = NULL;
+}
+
+unsigned fractal_budgets_histogram(struct fractal_budgets const* budgets,
+                                   uint64_t counts[32]) {
+  memset(counts, 0, 32 * sizeof(uint64_t));
+  unsigned highest = 0;
+  const uintptr_t count = (uintptr_t)budgets->columns * budgets->rows;
+  for (uintptr_t i = 0; i < count; i++) {
+    const unsigned bit = 31 - __builtin_clz(budgets->budgets[i]);
+    counts[bit] += 1;
+    highest = bit > highest ? bit : highest;
+  }
+  return highest;
+}
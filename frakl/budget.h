@@ -0,0 +1,53 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fractal.h"
+
+// Side of the tiles that get their own iteration budget, in pixels.
+#define FRACTAL_BUDGET_TILE 64
+// Probe points per tile along each axis.
+#define FRACTAL_BUDGET_SAMPLES 4
+// Budgets are this many times the slowest escape probed nearby, rounded up
+// to a power of 2 and at least FRACTAL_BUDGET_MIN.
+#define FRACTAL_BUDGET_MARGIN 8
+#define FRACTAL_BUDGET_MIN 256
+// How far points are probed, and so the largest budget.
+#define FRACTAL_BUDGET_CAP (1u << 16)
+
+struct fractal_budgets {
+  uint32_t* budgets;
+  uint32_t columns;
+  uint32_t rows;
+  // The largest budget, pixels are shaded against it.
+  uint32_t max;
+  // Dark pixels fractal_budgets_render ran again up to max.
+  uint64_t redone_pixels;
+};
+
+// Probes a few points of every tile up to cap iterations and picks each
+// tile's budget from the slowest escape among them and the surrounding
+// tiles' points, so filaments crossing into a tile are accounted for. Points
+// that never escape don't raise budgets. Pixels escaping later than the
+// margin allows come out dark until fractal_budgets_render redoes them. Sets
+// ctx->budgets and ctx->max_iteration to the largest budget. The kernel must
+// already be selected.
+void fractal_budgets_init(struct fractal_budgets* budgets,
+                          struct fractal_ctx* ctx, uint32_t cap);
+
+// Once every tile was rendered against its budget, runs the dark pixels of
+// tiles below the largest budget again up to it. The image is then the same
+// as one rendered with the largest budget everywhere.
+void fractal_budgets_render(struct fractal_budgets* budgets,
+                            struct fractal_ctx* ctx, size_t worker_count);
+
+void fractal_budgets_destroy(struct fractal_budgets* budgets);
+
+// How many tiles got each budget, which are powers of 2 as long as the cap
+// is. counts is indexed by log2 of the budget, returns the highest index
+// used.
+unsigned fractal_budgets_histogram(struct fractal_budgets const* budgets,
+                                   uint64_t counts[32]);
@@ -0,0 +1,244 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#include "escalate.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Pixels iterated together, both those the kernel keeps on the stack before
+// appending them to the list and those a work item carries on with. Enough
+// that the vector lanes rarely run dry.
+#define FRACTAL_ESCALATE_BATCH 256
+
+void fractal_escalate_init(struct fractal_ctx* ctx, uint32_t const* budgets,
+                           unsigned count) {
+  struct fractal_escalate* escalate = calloc(1, sizeof(*escalate));
+  escalate->budgets = budgets;
+  escalate->count = count;
+  escalate->unresolved = calloc(count, sizeof(uintptr_t));
+  pthread_mutex_init(&escalate->lock, NULL);
+  ctx->escalate = escalate;
+}
+
+void fractal_escalate_destroy(struct fractal_ctx* ctx) {
+  struct fractal_escalate* escalate = ctx->escalate;
+  if (!escalate) {
+    return;
+  }
+  pthread_mutex_destroy(&escalate->lock);
+  free(escalate->unresolved);
+  free(escalate->pixels);
+  free(escalate);
+  ctx->escalate = NULL;
+}
+
+// mandlebrot_iterate, picking up pixel's orbit where it left off and running
+// it up to max. Returns whether the pixel is done, i.e. escaped or was caught
+// cycling.
+static inline bool escalate_iterate(struct fractal_escalate_pixel* pixel,
+                                    double x, double y, uint32_t max,
+                                    const bool periodicity, double epssq,
+                                    bool* periodic) {
+  double zx = pixel->zx;
+  double zy = pixel->zy;
+  double tmp;
+  double magsq = zx * zx + zy * zy;
+  double sx = pixel->sx;
+  double sy = pixel->sy;
+  double dx;
+  double dy;
+  uint64_t check = pixel->check;
+  uint32_t result = pixel->iteration;
+
+  *periodic = false;
+  while (magsq <= 4.0 && result != max) {
+    tmp = zx * zx - zy * zy + x;
+    zy = 2 * zx * zy + y;
+    zx = tmp;
+    magsq = zx * zx + zy * zy;
+    result += 1;
+    if (periodicity) {
+      dx = zx - sx;
+      dy = zy - sy;
+      if (magsq <= 4.0 && dx * dx + dy * dy < epssq) {
+        *periodic = true;
+        break;
+      }
+      if (result == check) {
+        sx = zx;
+        sy = zy;
+        check *= 2;
+      }
+    }
+  }
+  pixel->zx = zx;
+  pixel->zy = zy;
+  pixel->sx = sx;
+  pixel->sy = sy;
+  pixel->check = check;
+  pixel->iteration = result;
+  return *periodic || magsq > 4.0;
+}
+
+void fractal_escalate_scalar(struct fractal_ctx* ctx,
+                             struct fractal_escalate_pixel* pixels,
+                             uintptr_t n) {
+  struct fractal_escalate const* escalate = ctx->escalate;
+  const uint32_t max = escalate->budgets[escalate->stage];
+  const bool periodicity = ctx->periodicity == fractal_periodicity_on;
+  uint8_t* const buffer = ctx->buffer;
+  uint64_t periodic_pixels = 0;
+  bool cycling;
+  for (uintptr_t i = 0; i < n; i++) {
+    struct fractal_escalate_pixel* pixel = &pixels[i];
+    pixel->done = escalate_iterate(pixel, pixel->x, pixel->y, max, periodicity,
+                                   ctx->periodicity_epssq, &cycling);
+    uint8_t* out = buffer + pixel->offset;
+    if (cycling) {
+      *out = 255;
+      periodic_pixels += 1;
+    } else if (pixel->done) {
+      *out = (255 * pixel->iteration) / ctx->max_iteration;
+    } else {
+      *out = 255;
+    }
+  }
+  atomic_fetch_add(&ctx->stats.periodic_pixels, periodic_pixels);
+}
+
+static void escalate_append(struct fractal_escalate* escalate,
+                            struct fractal_escalate_pixel const* pixels,
+                            unsigned n) {
+  if (!n) {
+    return;
+  }
+  pthread_mutex_lock(&escalate->lock);
+  if (escalate->length + n > escalate->capacity) {
+    escalate->capacity = 2 * (escalate->length + n);
+    escalate->pixels =
+        realloc(escalate->pixels,
+                escalate->capacity * sizeof(struct fractal_escalate_pixel));
+  }
+  memcpy(escalate->pixels + escalate->length, pixels,
+         n * sizeof(struct fractal_escalate_pixel));
+  escalate->length += n;
+  pthread_mutex_unlock(&escalate->lock);
+}
+
+// Iterates the batch against the first budget and keeps the pixels that hit
+// it.
+static void escalate_flush(struct fractal_ctx* ctx,
+                           struct fractal_escalate_pixel* batch,
+                           unsigned pending) {
+  if (!pending) {
+    return;
+  }
+  ctx->escalate->iterate(ctx, batch, pending);
+  unsigned kept = 0;
+  for (unsigned i = 0; i < pending; i++) {
+    if (!batch[i].done) {
+      batch[kept++] = batch[i];
+    }
+  }
+  escalate_append(ctx->escalate, batch, kept);
+}
+
+void fractal_escalate_kernel(struct fractal_ctx* ctx, wq_rect_t const* rect) {
+  struct fractal_escalate_pixel batch[FRACTAL_ESCALATE_BATCH];
+  unsigned pending = 0;
+  uint64_t interior_pixels = 0;
+
+  const uint32_t column_end = rect->x + rect->w;
+  const uint32_t row_end = rect->y + rect->h;
+  for (uint32_t row = rect->y; row != row_end; row++) {
+    const double y = fractal_ctx_row_y(ctx, row);
+    for (uint32_t column = rect->x; column != column_end; column++) {
+      const double x =
+          ctx->fwidth * (double)column / (double)ctx->width + ctx->fleft;
+      const uintptr_t offset = (uintptr_t)row * ctx->width + column;
+      // Like the lane refill cursor, so every kernel starts from the same
+      // pixels.
+      if (x * x + y * y > 4.0) {
+        ((uint8_t*)ctx->buffer)[offset] = 0;
+        continue;
+      }
+      if (ctx->interior_check && mandlebrot_in_main_bulbs(x, y)) {
+        ((uint8_t*)ctx->buffer)[offset] = 255;
+        interior_pixels += 1;
+        continue;
+      }
+      batch[pending] = (struct fractal_escalate_pixel){
+          .x = x,
+          .y = y,
+          .zx = x,
+          .zy = y,
+          .sx = x,
+          .sy = y,
+          .check = FRACTAL_PERIOD_FIRST_CHECK,
+          .offset = offset,
+      };
+      if (++pending == FRACTAL_ESCALATE_BATCH) {
+        escalate_flush(ctx, batch, pending);
+        pending = 0;
+      }
+    }
+  }
+  escalate_flush(ctx, batch, pending);
+  atomic_fetch_add(&ctx->stats.interior_pixels, interior_pixels);
+}
+
+// Each work item is the start of up to FRACTAL_ESCALATE_BATCH pixels.
+static void escalate_worker(void** work, unsigned n, struct fractal_ctx* ctx) {
+  struct fractal_escalate* escalate = ctx->escalate;
+  struct fractal_escalate_pixel const* end =
+      escalate->pixels + escalate->length;
+  for (unsigned i = 0; i < n; i++) {
+    struct fractal_escalate_pixel* pixels = work[i];
+    const uintptr_t left = (uintptr_t)(end - pixels);
+    escalate->iterate(
+        ctx, pixels,
+        left < FRACTAL_ESCALATE_BATCH ? left : FRACTAL_ESCALATE_BATCH);
+  }
+}
+
+// Drops the pixels that are done, keeping the list as long as the pixels
+// still iterating.
+static void escalate_compact(struct fractal_escalate* escalate) {
+  uintptr_t length = 0;
+  for (uintptr_t i = 0; i < escalate->length; i++) {
+    if (!escalate->pixels[i].done) {
+      escalate->pixels[length++] = escalate->pixels[i];
+    }
+  }
+  escalate->length = length;
+  escalate->capacity = length;
+  if (!length) {
+    free(escalate->pixels);
+    escalate->pixels = NULL;
+    return;
+  }
+  escalate->pixels = realloc(
+      escalate->pixels, length * sizeof(struct fractal_escalate_pixel));
+}
+
+void fractal_escalate_render(struct fractal_ctx* ctx, size_t worker_count) {
+  struct fractal_escalate* escalate = ctx->escalate;
+  escalate->unresolved[0] = escalate->length;
+  void** work = NULL;
+  while (++escalate->stage < escalate->count && escalate->length) {
+    const uintptr_t items = (escalate->length + FRACTAL_ESCALATE_BATCH - 1) /
+                            FRACTAL_ESCALATE_BATCH;
+    work = realloc(work, items * sizeof(void*));
+    for (uintptr_t i = 0; i < items; i++) {
+      work[i] = &escalate->pixels[i * FRACTAL_ESCALATE_BATCH];
+    }
+    wq_t wq = wq_create("frak", (void*)escalate_worker, worker_count, items);
+    wq_push_n(wq, items, work);
+    wq_start(wq, ctx);
+    wq_wait(wq);
+    wq_destroy(wq);
+    escalate_compact(escalate);
+    escalate->unresolved[escalate->stage] = escalate->length;
+  }
+  free(work);
+}
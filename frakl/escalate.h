@@ -0,0 +1,74 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fractal.h"
+
+// Raising max_iteration usually only changes the few pixels that hit it, yet
+// a fresh render iterates every pixel again. Instead the image is rendered
+// against a list of rising budgets, the last one being ctx->max_iteration.
+// Pixels still iterating when a budget runs out keep their orbit, and only
+// they carry on from there against the next budget.
+struct fractal_escalate_pixel {
+  // The pixel's c.
+  double x;
+  double y;
+  // The orbit at iteration, and the point periodicity compares it to.
+  double zx;
+  double zy;
+  double sx;
+  double sy;
+  uint64_t check;
+  uintptr_t offset;
+  uint32_t iteration;
+  bool done;
+};
+
+// Carries the orbits of n pixels on up to the current budget, writing out the
+// pixels that escape or cycle and marking them done. Pixels that hit the
+// budget are written out as if they never escape.
+typedef void (*fractal_escalate_fn_t)(struct fractal_ctx* ctx,
+                                      struct fractal_escalate_pixel* pixels,
+                                      uintptr_t n);
+
+struct fractal_escalate {
+  // Picked by fractal_ctx_select_kernel for ctx->kernel.
+  fractal_escalate_fn_t iterate;
+  uint32_t const* budgets;
+  unsigned count;
+  unsigned stage;
+  // The pixels that hit the last budget, in no particular order.
+  struct fractal_escalate_pixel* pixels;
+  uintptr_t length;
+  uintptr_t capacity;
+  pthread_mutex_t lock;
+  // How many pixels were left after each budget.
+  uintptr_t* unresolved;
+};
+
+// Allocates ctx->escalate for fractal_ctx_select_kernel to pick up. budgets
+// must be rising and end with ctx->max_iteration, and outlive the render.
+void fractal_escalate_init(struct fractal_ctx* ctx, uint32_t const* budgets,
+                           unsigned count);
+
+void fractal_escalate_destroy(struct fractal_ctx* ctx);
+
+// The scalar fractal_escalate_fn_t, the vector ones are in fractal.c and
+// stream pixels through their lanes like the lane refill kernels.
+void fractal_escalate_scalar(struct fractal_ctx* ctx,
+                             struct fractal_escalate_pixel* pixels,
+                             uintptr_t n);
+
+// The kernel fractal_ctx_select_kernel picks when ctx->escalate is set. It
+// iterates rect against the first budget, keeping the pixels that hit it.
+void fractal_escalate_kernel(struct fractal_ctx* ctx, wq_rect_t const* rect);
+
+// Once every rect went through fractal_escalate_kernel, iterates the pixels
+// kept against each of the remaining budgets in turn. The image is then the
+// same as one rendered with ctx->max_iteration from the start.
+void fractal_escalate_render(struct fractal_ctx* ctx, size_t worker_count);
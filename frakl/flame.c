@@ -0,0 +1,526 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#include "flame.h"
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wq.h"
+
+// Iterations a batch walks. Batches don't depend on the worker count so the
+// image doesn't either, and are long enough for the fuse not to matter.
+#define FRACTAL_FLAME_BATCH (1u << 16)
+// Pixels merged or tone mapped per work item.
+#define FRACTAL_FLAME_MERGE_PIXELS 16384
+// Keeps the variations dividing by the radius finite at the origin.
+#define FRACTAL_FLAME_EPS 1e-10
+// Points this far out, squared, or NaN have left the attractor for good and
+// their walker starts over.
+#define FRACTAL_FLAME_BAD 1e20
+
+static const char* const flame_variation_names[] = {
+    "linear",    "sinusoidal", "spherical", "swirl",
+    "horseshoe", "polar",      "heart",     "disc",
+};
+
+const char* fractal_flame_variation_name(
+    enum fractal_flame_variation variation) {
+  if (variation < fractal_flame_variation_count) {
+    return flame_variation_names[variation];
+  }
+  return "unknown";
+}
+
+// Parses the next token of the line as a double into *value.
+static bool flame_parse_double(char** save, double* value) {
+  const char* token = strtok_r(NULL, " \t\r\n", save);
+  if (!token) {
+    return false;
+  }
+  char* end;
+  *value = strtod(token, &end);
+  return *end == '\0' && isfinite(*value);
+}
+
+static const char* flame_parse_xform(struct fractal_flame_spec* spec,
+                                     unsigned line, char** save) {
+  if (spec->xform_count == FRACTAL_FLAME_MAX_XFORMS) {
+    snprintf(spec->error, sizeof(spec->error),
+             "line %u: flames can have at most %u xforms", line,
+             FRACTAL_FLAME_MAX_XFORMS);
+    return spec->error;
+  }
+  struct fractal_flame_xform* xform = &spec->xforms[spec->xform_count++];
+  memset(xform, 0, sizeof(*xform));
+  if (!flame_parse_double(save, &xform->weight) || xform->weight <= 0.0) {
+    snprintf(spec->error, sizeof(spec->error),
+             "line %u: expected a positive xform weight", line);
+    return spec->error;
+  }
+  if (!flame_parse_double(save, &xform->color) || xform->color < 0.0 ||
+      xform->color > 1.0) {
+    snprintf(spec->error, sizeof(spec->error),
+             "line %u: expected an xform color between 0 and 1", line);
+    return spec->error;
+  }
+  for (unsigned i = 0; i < 6; i++) {
+    if (!flame_parse_double(save, &xform->affine[i])) {
+      snprintf(spec->error, sizeof(spec->error),
+               "line %u: expected 6 affine coefficients", line);
+      return spec->error;
+    }
+  }
+  const char* name;
+  while ((name = strtok_r(NULL, " \t\r\n", save)) != NULL) {
+    unsigned variation = 0;
+    while (variation < fractal_flame_variation_count &&
+           strcmp(name, flame_variation_names[variation]) != 0) {
+      variation++;
+    }
+    if (variation == fractal_flame_variation_count) {
+      snprintf(spec->error, sizeof(spec->error),
+               "line %u: unknown variation '%s'", line, name);
+      return spec->error;
+    }
+    for (unsigned i = 0; i < xform->variation_count; i++) {
+      if (xform->variations[i] == variation) {
+        snprintf(spec->error, sizeof(spec->error),
+                 "line %u: variation '%s' given twice", line, name);
+        return spec->error;
+      }
+    }
+    const unsigned i = xform->variation_count++;
+    xform->variations[i] = variation;
+    if (!flame_parse_double(save, &xform->amounts[i])) {
+      snprintf(spec->error, sizeof(spec->error),
+               "line %u: expected an amount for variation '%s'", line, name);
+      return spec->error;
+    }
+  }
+  if (!xform->variation_count) {
+    xform->variation_count = 1;
+    xform->variations[0] = fractal_flame_linear;
+    xform->amounts[0] = 1.0;
+  }
+  return NULL;
+}
+
+// Blends the palette between the indices set, holding the first and last
+// one's color out to the ends.
+static void flame_fill_palette(struct fractal_flame_spec* spec,
+                               bool const* set) {
+  int previous = -1;
+  for (int i = 0; i < 256; i++) {
+    if (!set[i]) {
+      continue;
+    }
+    const int from = previous < 0 ? 0 : previous;
+    for (int j = from + 1; j < i; j++) {
+      const double t = previous < 0 ? 1.0 : (double)(j - from) / (i - from);
+      for (unsigned c = 0; c < 3; c++) {
+        spec->palette[j][c] = (uint8_t)lround(
+            spec->palette[from][c] * (1.0 - t) + spec->palette[i][c] * t);
+      }
+    }
+    if (previous < 0) {
+      memcpy(spec->palette[0], spec->palette[i], 3);
+    }
+    previous = i;
+  }
+  for (int j = previous + 1; j < 256; j++) {
+    memcpy(spec->palette[j], spec->palette[previous], 3);
+  }
+}
+
+const char* fractal_flame_load(struct fractal_flame_spec* spec,
+                               const char* path) {
+  memset(spec, 0, sizeof(*spec));
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    snprintf(spec->error, sizeof(spec->error), "Unable to open flame '%s'",
+             path);
+    return spec->error;
+  }
+  bool set[256] = {false};
+  const char* err = NULL;
+  char* text = NULL;
+  size_t capacity = 0;
+  unsigned line = 0;
+  while (!err && getline(&text, &capacity, file) != -1) {
+    line++;
+    char* comment = strchr(text, '#');
+    if (comment) {
+      *comment = '\0';
+    }
+    char* save;
+    const char* keyword = strtok_r(text, " \t\r\n", &save);
+    if (!keyword) {
+      continue;
+    }
+    if (strcmp(keyword, "xform") == 0) {
+      err = flame_parse_xform(spec, line, &save);
+    } else if (strcmp(keyword, "color") == 0) {
+      double values[4];
+      for (unsigned i = 0; i < 4 && !err; i++) {
+        if (!flame_parse_double(&save, &values[i]) || values[i] < 0.0 ||
+            values[i] > 255.0 || values[i] != floor(values[i])) {
+          snprintf(spec->error, sizeof(spec->error),
+                   "line %u: expected a color's index, red, green and blue"
+                   " from 0 to 255",
+                   line);
+          err = spec->error;
+        }
+      }
+      if (!err) {
+        const unsigned index = (unsigned)values[0];
+        set[index] = true;
+        for (unsigned c = 0; c < 3; c++) {
+          spec->palette[index][c] = (uint8_t)values[c + 1];
+        }
+      }
+    } else {
+      snprintf(spec->error, sizeof(spec->error),
+               "line %u: expected xform or color, got '%s'", line, keyword);
+      err = spec->error;
+    }
+  }
+  free(text);
+  fclose(file);
+  if (err) {
+    return err;
+  }
+  if (!spec->xform_count) {
+    snprintf(spec->error, sizeof(spec->error), "Flame '%s' has no xforms",
+             path);
+    return spec->error;
+  }
+  if (!memchr(set, true, sizeof(set))) {
+    static const uint8_t blue[3] = {16, 32, 160};
+    static const uint8_t orange[3] = {255, 160, 32};
+    memcpy(spec->palette[0], blue, 3);
+    memcpy(spec->palette[255], orange, 3);
+    set[0] = true;
+    set[255] = true;
+  }
+  flame_fill_palette(spec, set);
+  return NULL;
+}
+
+const char* fractal_flame_init(struct fractal_flame* flame,
+                               struct fractal_ctx const* ctx,
+                               struct fractal_flame_spec const* spec,
+                               uint32_t oversample, size_t worker_count) {
+  if (!oversample || oversample > FRACTAL_FLAME_MAX_OVERSAMPLE) {
+    return "Flames oversample 1 to 4 cells along each axis of a pixel";
+  }
+  if (!spec->xform_count) {
+    return "Flames need at least one xform";
+  }
+  memset(flame, 0, sizeof(*flame));
+  flame->ctx = ctx;
+  flame->spec = spec;
+  flame->oversample = oversample;
+
+  double total = 0.0;
+  for (unsigned i = 0; i < spec->xform_count; i++) {
+    total += spec->xforms[i].weight;
+  }
+  unsigned xform = 0;
+  double below = spec->xforms[0].weight;
+  for (unsigned i = 0; i < FRACTAL_FLAME_PICKS; i++) {
+    const double at = total * (i + 0.5) / FRACTAL_FLAME_PICKS;
+    while (at > below && xform + 1 < spec->xform_count) {
+      below += spec->xforms[++xform].weight;
+    }
+    flame->picks[i] = (uint8_t)xform;
+  }
+
+  flame->worker_count = worker_count ?: 1;
+  flame->workers =
+      aligned_alloc(64, flame->worker_count * sizeof(*flame->workers));
+  memset(flame->workers, 0, flame->worker_count * sizeof(*flame->workers));
+  const size_t cells =
+      (size_t)ctx->width * ctx->height * oversample * oversample;
+  for (size_t i = 0; i < flame->worker_count; i++) {
+    flame->workers[i].cells = calloc(cells, sizeof(struct fractal_flame_cell));
+  }
+  return NULL;
+}
+
+void fractal_flame_destroy(struct fractal_flame* flame) {
+  if (!flame->workers) {
+    return;
+  }
+  for (size_t i = 0; i < flame->worker_count; i++) {
+    free(flame->workers[i].cells);
+  }
+  free(flame->workers);
+  flame->workers = NULL;
+}
+
+// splitmix64, stepping *state and returning 64 random bits.
+static inline uint64_t flame_random(uint64_t* state) {
+  uint64_t x = (*state += 0x9e3779b97f4a7c15ull);
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+// A random point in [-1, 1] x [-1, 1] and color to start walking from.
+static inline void flame_start(uint64_t* state, double* x, double* y,
+                               double* color) {
+  const uint64_t bits = flame_random(state);
+  *x = (uint32_t)bits * 0x1p-31 - 1.0;
+  *y = (uint32_t)(bits >> 32) * 0x1p-31 - 1.0;
+  *color = (flame_random(state) >> 11) * 0x1p-53;
+}
+
+__attribute__((always_inline)) static inline void flame_apply(
+    struct fractal_flame_xform const* xform, double* x, double* y) {
+  double const* a = xform->affine;
+  const double tx = a[0] * *x + a[1] * *y + a[2];
+  const double ty = a[3] * *x + a[4] * *y + a[5];
+  double nx = 0.0;
+  double ny = 0.0;
+  for (unsigned i = 0; i < xform->variation_count; i++) {
+    const double amount = xform->amounts[i];
+    switch (xform->variations[i]) {
+      case fractal_flame_linear:
+        nx += amount * tx;
+        ny += amount * ty;
+        break;
+      case fractal_flame_sinusoidal:
+        nx += amount * sin(tx);
+        ny += amount * sin(ty);
+        break;
+      case fractal_flame_spherical: {
+        const double scale = amount / (tx * tx + ty * ty + FRACTAL_FLAME_EPS);
+        nx += scale * tx;
+        ny += scale * ty;
+        break;
+      }
+      case fractal_flame_swirl: {
+        const double r2 = tx * tx + ty * ty;
+        const double s = sin(r2);
+        const double c = cos(r2);
+        nx += amount * (tx * s - ty * c);
+        ny += amount * (tx * c + ty * s);
+        break;
+      }
+      case fractal_flame_horseshoe: {
+        const double scale =
+            amount / (sqrt(tx * tx + ty * ty) + FRACTAL_FLAME_EPS);
+        nx += scale * (tx - ty) * (tx + ty);
+        ny += scale * 2.0 * tx * ty;
+        break;
+      }
+      case fractal_flame_polar:
+        nx += amount * atan2(tx, ty) * M_1_PI;
+        ny += amount * (sqrt(tx * tx + ty * ty) - 1.0);
+        break;
+      case fractal_flame_heart: {
+        const double r = sqrt(tx * tx + ty * ty);
+        const double angle = atan2(tx, ty) * r;
+        nx += amount * r * sin(angle);
+        ny -= amount * r * cos(angle);
+        break;
+      }
+      case fractal_flame_disc: {
+        const double scale = amount * atan2(tx, ty) * M_1_PI;
+        const double r = M_PI * sqrt(tx * tx + ty * ty);
+        nx += scale * sin(r);
+        ny += scale * cos(r);
+        break;
+      }
+      case fractal_flame_variation_count:
+        break;
+    }
+  }
+  *x = nx;
+  *y = ny;
+}
+
+// Walks batch rect->y for rect->w iterations into the worker's own buffer.
+static void flame_walk_worker(wq_rect_t const* rect,
+                              struct fractal_flame* flame) {
+  struct fractal_flame_worker* worker =
+      &flame->workers[wq_get_worker_index()];
+  struct fractal_flame_cell* const cells = worker->cells;
+  struct fractal_ctx const* ctx = flame->ctx;
+  struct fractal_flame_spec const* spec = flame->spec;
+  uint8_t const* const picks = flame->picks;
+  const uint32_t cell_width = ctx->width * flame->oversample;
+  const uint32_t cell_height = ctx->height * flame->oversample;
+  const double xscale = cell_width / ctx->fwidth;
+  const double yscale = cell_height / ctx->fheight;
+  uint64_t hits = 0;
+
+  // Every batch walks the same points whichever worker takes it.
+  uint64_t state = (uint64_t)rect->y * 0xd1342543de82ef95ull;
+  double x;
+  double y;
+  double color;
+  flame_start(&state, &x, &y, &color);
+  uint32_t fuse = FRACTAL_FLAME_FUSE;
+  uint64_t bits = 0;
+  unsigned bytes = 0;
+  for (uint32_t i = 0; i < rect->w;) {
+    // One random byte picks each transform.
+    if (!bytes) {
+      bits = flame_random(&state);
+      bytes = 8;
+    }
+    struct fractal_flame_xform const* xform =
+        &spec->xforms[picks[bits & 0xff]];
+    bits >>= 8;
+    bytes--;
+    flame_apply(xform, &x, &y);
+    color = (color + xform->color) * 0.5;
+    if (fuse) {
+      fuse--;
+      continue;
+    }
+    i++;
+    if (!(x * x + y * y < FRACTAL_FLAME_BAD)) {
+      flame_start(&state, &x, &y, &color);
+      fuse = FRACTAL_FLAME_FUSE;
+      continue;
+    }
+    const double px = (x - ctx->fleft) * xscale;
+    const double py = (y - ctx->ftop) * yscale;
+    if (px >= 0.0 && px < cell_width && py >= 0.0 && py < cell_height) {
+      struct fractal_flame_cell* cell =
+          &cells[(uintptr_t)(uint32_t)py * cell_width + (uint32_t)px];
+      uint8_t const* rgb = spec->palette[(uint8_t)(color * 255.0)];
+      cell->count += 1;
+      cell->red += rgb[0];
+      cell->green += rgb[1];
+      cell->blue += rgb[2];
+      hits++;
+    }
+  }
+  worker->hits += hits;
+}
+
+// Sums the cells of rect's pixels, which wq_push_grid keeps within a row or
+// to whole rows, into the first worker's buffer and finds the largest count
+// of a pixel.
+static void flame_merge_worker(wq_rect_t const* rect,
+                               struct fractal_flame* flame) {
+  const uint32_t oversample = flame->oversample;
+  const uintptr_t cell_width = (uintptr_t)flame->ctx->width * oversample;
+  struct fractal_flame_cell* const cells = flame->workers[0].cells;
+  uint64_t max = 0;
+  for (uint32_t row = rect->y; row < rect->y + rect->h; row++) {
+    const uintptr_t begin =
+        row * oversample * cell_width + rect->x * oversample;
+    const uintptr_t span = (uintptr_t)rect->w * oversample;
+    for (uint32_t sub = 0; sub < oversample; sub++) {
+      struct fractal_flame_cell* const merged =
+          cells + begin + sub * cell_width;
+      for (size_t i = 1; i < flame->worker_count; i++) {
+        struct fractal_flame_cell const* const other =
+            flame->workers[i].cells + begin + sub * cell_width;
+        for (uintptr_t j = 0; j < span; j++) {
+          merged[j].count += other[j].count;
+          merged[j].red += other[j].red;
+          merged[j].green += other[j].green;
+          merged[j].blue += other[j].blue;
+        }
+      }
+    }
+    for (uint32_t column = 0; column < rect->w; column++) {
+      uint64_t count = 0;
+      for (uint32_t sub = 0; sub < oversample; sub++) {
+        struct fractal_flame_cell const* const cell =
+            cells + begin + sub * cell_width + column * oversample;
+        for (uint32_t k = 0; k < oversample; k++) {
+          count += cell[k].count;
+        }
+      }
+      max = count > max ? count : max;
+    }
+  }
+  uint64_t seen = atomic_load(&flame->max);
+  while (seen < max &&
+         !atomic_compare_exchange_weak(&flame->max, &seen, max)) {
+  }
+}
+
+// Shades rect's pixels by their cells' average color, scaled by the log of
+// their count over the log of the largest.
+static void flame_map_worker(wq_rect_t const* rect,
+                             struct fractal_flame* flame) {
+  struct fractal_ctx const* ctx = flame->ctx;
+  const uint32_t oversample = flame->oversample;
+  const uintptr_t cell_width = (uintptr_t)ctx->width * oversample;
+  struct fractal_flame_cell const* const cells = flame->workers[0].cells;
+  uint8_t* const buffer = ctx->buffer;
+  const uint64_t max = atomic_load(&flame->max);
+  const double log_max = log1p(max);
+  for (uint32_t row = rect->y; row < rect->y + rect->h; row++) {
+    for (uint32_t column = rect->x; column < rect->x + rect->w; column++) {
+      uint64_t sums[4] = {0};
+      for (uint32_t sub = 0; sub < oversample; sub++) {
+        struct fractal_flame_cell const* const cell =
+            cells + (row * oversample + sub) * cell_width + column * oversample;
+        for (uint32_t k = 0; k < oversample; k++) {
+          sums[0] += cell[k].count;
+          sums[1] += cell[k].red;
+          sums[2] += cell[k].green;
+          sums[3] += cell[k].blue;
+        }
+      }
+      uint8_t* const out = &buffer[3 * ((uintptr_t)row * ctx->width + column)];
+      if (!sums[0]) {
+        out[0] = out[1] = out[2] = 0;
+        continue;
+      }
+      const double alpha = log1p(sums[0]) / log_max;
+      const double scale = pow(alpha, 1.0 / FRACTAL_FLAME_GAMMA) / sums[0];
+      for (unsigned c = 0; c < 3; c++) {
+        out[c] = (uint8_t)lround(sums[c + 1] * scale);
+      }
+    }
+  }
+}
+
+// Runs cb over the view's pixels, FRACTAL_FLAME_MERGE_PIXELS at a time.
+static void flame_run_pixels(struct fractal_flame* flame, wq_rect_cb_t cb) {
+  struct fractal_ctx const* ctx = flame->ctx;
+  wq_t wq = wq_create_rect(
+      "frak", cb, flame->worker_count,
+      wq_grid_count(ctx->width, ctx->height, FRACTAL_FLAME_MERGE_PIXELS));
+  wq_push_grid(wq, ctx->width, ctx->height, FRACTAL_FLAME_MERGE_PIXELS);
+  wq_start(wq, flame);
+  wq_wait(wq);
+  wq_destroy(wq);
+}
+
+void fractal_flame_render(struct fractal_flame* flame, uint64_t iterations) {
+  const uint64_t batch = FRACTAL_FLAME_BATCH;
+  const uintptr_t batches = (iterations + batch - 1) / batch;
+  wq_t wq = wq_create_rect("frak", (void*)flame_walk_worker,
+                           flame->worker_count, batches);
+  for (uintptr_t i = 0; i < batches; i++) {
+    const uint64_t left = iterations - i * batch;
+    wq_push_rect(wq, (wq_rect_t){.x = 0,
+                                 .y = (uint32_t)i,
+                                 .w = left < batch ? left : batch,
+                                 .h = 1});
+  }
+  wq_start(wq, flame);
+  wq_wait(wq);
+  wq_destroy(wq);
+
+  flame->iterations = iterations;
+  flame->hits = 0;
+  for (size_t i = 0; i < flame->worker_count; i++) {
+    flame->hits += flame->workers[i].hits;
+  }
+  flame_run_pixels(flame, (void*)flame_merge_worker);
+  flame_run_pixels(flame, (void*)flame_map_worker);
+}
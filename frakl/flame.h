@@ -0,0 +1,123 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fractal.h"
+
+// Most transforms a flame can have.
+#define FRACTAL_FLAME_MAX_XFORMS 16
+// Entries of the table transforms are picked from, each transform gets a
+// share of them in proportion to its weight.
+#define FRACTAL_FLAME_PICKS 256
+// Iterations every walker runs before its points start counting, so they've
+// fallen onto the attractor.
+#define FRACTAL_FLAME_FUSE 20
+// Most cells along each axis of a pixel the accumulation buffers can have.
+#define FRACTAL_FLAME_MAX_OVERSAMPLE 4
+// Gamma the log density of each pixel is raised to the inverse of.
+#define FRACTAL_FLAME_GAMMA 2.2
+
+enum fractal_flame_variation {
+  fractal_flame_linear = 0,
+  fractal_flame_sinusoidal = 1,
+  fractal_flame_spherical = 2,
+  fractal_flame_swirl = 3,
+  fractal_flame_horseshoe = 4,
+  fractal_flame_polar = 5,
+  fractal_flame_heart = 6,
+  fractal_flame_disc = 7,
+  fractal_flame_variation_count = 8,
+};
+
+// x, y <- a x + b y + c, d x + e y + f followed by the weighted sum of its
+// variations of that point.
+struct fractal_flame_xform {
+  double weight;
+  // Where on the palette the transform pulls the color of its points.
+  double color;
+  double affine[6];
+  unsigned variation_count;
+  enum fractal_flame_variation variations[fractal_flame_variation_count];
+  double amounts[fractal_flame_variation_count];
+};
+
+// A flame as loaded from a text file of lines like
+//   # Sierpinski's triangle, with a swirl.
+//   xform 1 0.0 0.5 0 0    0 0.5 0.5
+//   xform 1 0.5 0.5 0 0.5  0 0.5 -0.5
+//   xform 1 1.0 0.5 0 -0.5 0 0.5 -0.5 linear 0.8 swirl 0.2
+//   color 0 255 64 0
+//   color 255 0 128 255
+// An xform line gives its weight, color in [0, 1] and a through f, then any
+// number of variations and their amounts, just linear 1 if there are none.
+// A color line gives a palette index and its red, green and blue, indices in
+// between are blended. Without any the palette runs from blue to orange.
+struct fractal_flame_spec {
+  struct fractal_flame_xform xforms[FRACTAL_FLAME_MAX_XFORMS];
+  unsigned xform_count;
+  uint8_t palette[256][3];
+  // Holds the message fractal_flame_load returns on failure.
+  char error[160];
+};
+
+// The accumulation buffer cells, summing the palette colors of the points
+// that landed in them. Every hit adds up to 255 to each color, which would
+// wrap 32 bits after about 16.8M hits, a count a hot cell passes well within
+// the 10^9+ iterations flames want, so the sums are 64 bits. That's 32 bytes
+// a cell, 32 oversample^2 bytes per pixel and worker.
+struct fractal_flame_cell {
+  uint64_t count;
+  uint64_t red;
+  uint64_t green;
+  uint64_t blue;
+};
+
+struct fractal_flame_worker {
+  // The worker's accumulation buffer, only ever touched by it until merged.
+  struct fractal_flame_cell* cells;
+  uint64_t hits;
+} __attribute__((aligned(64)));
+
+struct fractal_flame {
+  // The view, whose buffer gets 3 bytes per pixel.
+  struct fractal_ctx const* ctx;
+  struct fractal_flame_spec const* spec;
+  // Cells along each axis of a pixel.
+  uint32_t oversample;
+  // The transform to apply for each byte of randomness.
+  uint8_t picks[FRACTAL_FLAME_PICKS];
+  struct fractal_flame_worker* workers;
+  size_t worker_count;
+  // The largest count of a pixel's cells, tone mapping's white point.
+  _Atomic(uint64_t) max;
+  uint64_t iterations;
+  uint64_t hits;
+};
+
+// Loads the flame in the file at path. Returns an error, kept in
+// spec->error, if it can't be read or doesn't parse.
+const char* fractal_flame_load(struct fractal_flame_spec* spec,
+                               const char* path);
+
+// Sets flame up to render spec over ctx's view with a private accumulation
+// buffer of oversample x oversample cells per pixel for each worker.
+const char* fractal_flame_init(struct fractal_flame* flame,
+                               struct fractal_ctx const* ctx,
+                               struct fractal_flame_spec const* spec,
+                               uint32_t oversample, size_t worker_count);
+
+void fractal_flame_destroy(struct fractal_flame* flame);
+
+// Plays the chaos game for iterations steps, spread over batches on a wq
+// that each walk from a point of their own. Every worker accumulates into its
+// own buffer, so the hot path shares nothing. The buffers are then merged
+// and tone mapped into ctx->buffer, each pixel's average color scaled by its
+// log density against the densest pixel's. Batch i always walks the same
+// points, so the image doesn't depend on the worker count.
+void fractal_flame_render(struct fractal_flame* flame, uint64_t iterations);
+
+const char* fractal_flame_variation_name(
+    enum fractal_flame_variation variation);
@@ -1,49 +1,1621 @@
 // Copywrite (c) 2019 Dan Zimmerman
 
 #include "fractal.h"
+#include "bignum.h"
+#include "escalate.h"
+#include "lyapunov.h"
+#include "newton.h"
+#include "perturb.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FRACTAL_HAS_X86 1
+#else
+#define FRACTAL_HAS_X86 0
+#endif
+
+// The iterations pixels of rect may run, see fractal_ctx::budgets. rect must
+// lie within one budget tile.
+static inline uint32_t fractal_rect_budget(struct fractal_ctx const* ctx,
+                                           wq_rect_t const* rect) {
+  if (!ctx->budgets) {
+    return ctx->max_iteration;
+  }
+  const uint32_t tile = ctx->budget_tile;
+  return ctx->budgets[rect->y / tile * ctx->budget_columns + rect->x / tile];
+}
+
+// The byte for a pixel that ran result of max iterations, shaded against
+// shade. Pixels that ran out of iterations count as never escaping.
+static inline uint8_t fractal_shade(uint32_t result, uint32_t max,
+                                    uint32_t shade) {
+  return result == max ? 255 : (255 * result) / shade;
+}
 
 // c = x + iy
 // m_c(z) = z^2 + c
 //        = z_x^2 - z_y^2 + x + i(2z_x * z_y + y)
-static uint8_t mandlebrot_pixel(uint32_t column, uint32_t row, uint32_t width,
-                                uint32_t height, uint32_t max, double ftop,
-                                double fleft, double fwidth, double fheight) {
-  double x = fwidth * (double)column / (double)width + fleft;
-  double y = fheight * (double)row / (double)height + ftop;
-
+//
+// Returns the number of iterations run, setting *periodic if the orbit was
+// caught cycling, in which case the pixel counts as max.
+__attribute__((always_inline)) static inline uint32_t mandlebrot_iterate(
+    double x, double y, uint32_t max, const bool periodicity, double epssq,
+    bool* periodic) {
   double zx = x;
   double zy = y;
   double tmp;
   double magsq = zx * zx + zy * zy;
+  double sx = zx;
+  double sy = zy;
+  double dx;
+  double dy;
+  uint64_t check = FRACTAL_PERIOD_FIRST_CHECK;
   uint32_t result = 0;
 
+  *periodic = false;
   while (magsq <= 4.0 && result != max) {
     tmp = zx * zx - zy * zy + x;
     zy = 2 * zx * zy + y;
     zx = tmp;
     magsq = zx * zx + zy * zy;
     result += 1;
+    if (periodicity) {
+      dx = zx - sx;
+      dy = zy - sy;
+      if (magsq <= 4.0 && dx * dx + dy * dy < epssq) {
+        *periodic = true;
+        break;
+      }
+      if (result == check) {
+        sx = zx;
+        sy = zy;
+        check *= 2;
+      }
+    }
   }
-  return (255 * result) / max;
+  return result;
 }
 
-void fractal_worker(void** pixels, unsigned n, struct fractal_ctx* ctx) {
+// Iterations run between escape checks by the unrolled kernels. Their blocks
+// end on the iterations where periodicity re-saves the orbit point.
+#define FRACTAL_UNROLL 8
+_Static_assert(FRACTAL_PERIOD_FIRST_CHECK % FRACTAL_UNROLL == 0,
+               "unrolled blocks must line up with periodicity saves");
+
+// mandlebrot_iterate, but running FRACTAL_UNROLL iterations at a time with
+// the escape and periodicity tests folded into one branch per block. When it
+// fires the block is replayed from its saved z one iteration at a time, so
+// the count comes out exactly the same.
+__attribute__((always_inline)) static inline uint32_t
+mandlebrot_iterate_unrolled(double x, double y, uint32_t max,
+                            const bool periodicity, double epssq,
+                            bool* periodic) {
+  double zx = x;
+  double zy = y;
+  double xx = zx * zx;
+  double yy = zy * zy;
+  double tmp;
+  double magsq;
+  double sx = zx;
+  double sy = zy;
+  double dx;
+  double dy;
+  uint64_t check = FRACTAL_PERIOD_FIRST_CHECK;
+  uint32_t result = 0;
+
+  *periodic = false;
+  if (xx + yy > 4.0) {
+    return 0;
+  }
+  while (max - result >= FRACTAL_UNROLL) {
+    const double bx = zx;
+    const double by = zy;
+    bool stop = false;
+#pragma GCC unroll 8
+    for (unsigned k = 0; k != FRACTAL_UNROLL; k++) {
+      // The same operations as mandlebrot_iterate, so the same values.
+      tmp = xx - yy + x;
+      zy = 2 * zx * zy + y;
+      zx = tmp;
+      xx = zx * zx;
+      yy = zy * zy;
+      stop |= !(xx + yy <= 4.0);
+      if (periodicity) {
+        dx = zx - sx;
+        dy = zy - sy;
+        stop |= dx * dx + dy * dy < epssq;
+      }
+    }
+    if (stop) {
+      zx = bx;
+      zy = by;
+      break;
+    }
+    result += FRACTAL_UNROLL;
+    if (periodicity && result == check) {
+      sx = zx;
+      sy = zy;
+      check *= 2;
+    }
+  }
+
+  // The tail, or the block that stopped.
+  magsq = zx * zx + zy * zy;
+  while (magsq <= 4.0 && result != max) {
+    tmp = zx * zx - zy * zy + x;
+    zy = 2 * zx * zy + y;
+    zx = tmp;
+    magsq = zx * zx + zy * zy;
+    result += 1;
+    if (periodicity) {
+      dx = zx - sx;
+      dy = zy - sy;
+      if (magsq <= 4.0 && dx * dx + dy * dy < epssq) {
+        *periodic = true;
+        break;
+      }
+      if (result == check) {
+        sx = zx;
+        sy = zy;
+        check *= 2;
+      }
+    }
+  }
+  return result;
+}
+
+// Rects cover rect->w columns ctx->column_step apart, the column past the
+// last of them is returned.
+static inline uint32_t fractal_column_end(struct fractal_ctx const* ctx,
+                                          wq_rect_t const* rect) {
+  return rect->x + rect->w * (ctx->column_step ?: 1);
+}
+
+__attribute__((always_inline)) static inline void mandlebrot_scalar(
+    struct fractal_ctx* ctx, wq_rect_t const* rect, const bool periodicity,
+    const bool unrolled) {
   const uint32_t width = ctx->width;
-  const uint32_t height = ctx->height;
-  const uint32_t max = ctx->max_iteration;
-  const double ftop = ctx->ftop;
+  const uint32_t max = fractal_rect_budget(ctx, rect);
+  const uint32_t shade = ctx->max_iteration;
+  const double fleft = ctx->fleft;
+  const double fwidth = ctx->fwidth;
+  const double epssq = ctx->periodicity_epssq;
+  const bool interior_check = ctx->interior_check;
+  uint64_t interior_pixels = 0;
+  uint64_t periodic_pixels = 0;
+  bool periodic;
+
+  const uint32_t column_step = ctx->column_step ?: 1;
+  const uint32_t column_end = fractal_column_end(ctx, rect);
+  const uint32_t row_end = rect->y + rect->h;
+  uint8_t* line = (uint8_t*)ctx->buffer + (uintptr_t)rect->y * width;
+  for (uint32_t row = rect->y; row != row_end; row++, line += width) {
+    const double y = fractal_ctx_row_y(ctx, row);
+    for (uint32_t column = rect->x; column != column_end;
+         column += column_step) {
+      const double x = fwidth * (double)column / (double)width + fleft;
+      if (interior_check && mandlebrot_in_main_bulbs(x, y)) {
+        line[column] = 255;
+        interior_pixels += 1;
+        continue;
+      }
+      const uint32_t result =
+          unrolled ? mandlebrot_iterate_unrolled(x, y, max, periodicity, epssq,
+                                                 &periodic)
+                   : mandlebrot_iterate(x, y, max, periodicity, epssq,
+                                        &periodic);
+      if (periodic) {
+        line[column] = 255;
+        periodic_pixels += 1;
+      } else {
+        line[column] = fractal_shade(result, max, shade);
+      }
+    }
+  }
+  atomic_fetch_add(&ctx->stats.interior_pixels, interior_pixels);
+  atomic_fetch_add(&ctx->stats.periodic_pixels, periodic_pixels);
+}
+
+static void mandlebrot_scalar_plain(struct fractal_ctx* ctx,
+                                    wq_rect_t const* rect) {
+  mandlebrot_scalar(ctx, rect, false, false);
+}
+
+static void mandlebrot_scalar_periodic(struct fractal_ctx* ctx,
+                                       wq_rect_t const* rect) {
+  mandlebrot_scalar(ctx, rect, true, false);
+}
+
+static void mandlebrot_unrolled_scalar_plain(struct fractal_ctx* ctx,
+                                             wq_rect_t const* rect) {
+  mandlebrot_scalar(ctx, rect, false, true);
+}
+
+static void mandlebrot_unrolled_scalar_periodic(struct fractal_ctx* ctx,
+                                                wq_rect_t const* rect) {
+  mandlebrot_scalar(ctx, rect, true, true);
+}
+
+#define FRACTAL_FORMULA_SUFFIX scalar
+#define FRACTAL_FORMULA_T double
+#define FRACTAL_FORMULA_ATTRS __attribute__((always_inline)) static inline
+#define FRACTAL_FORMULA_ABS(v) fabs(v)
+#include "fractal_formula.h"
+
+// mandlebrot_iterate for any formula, from z = x + iy with c = cx + icy.
+__attribute__((always_inline)) static inline uint32_t formula_iterate(
+    double x, double y, double cx, double cy, uint32_t max,
+    const bool periodicity, double epssq, bool* periodic,
+    const enum fractal_formula formula, const uint32_t power) {
+  double zx = x;
+  double zy = y;
+  double magsq = zx * zx + zy * zy;
+  double sx = zx;
+  double sy = zy;
+  double dx;
+  double dy;
+  uint64_t check = FRACTAL_PERIOD_FIRST_CHECK;
+  uint32_t result = 0;
+
+  *periodic = false;
+  while (magsq <= 4.0 && result != max) {
+    formula_step_scalar(&zx, &zy, cx, cy, formula, power);
+    magsq = zx * zx + zy * zy;
+    result += 1;
+    if (periodicity) {
+      dx = zx - sx;
+      dy = zy - sy;
+      if (magsq <= 4.0 && dx * dx + dy * dy < epssq) {
+        *periodic = true;
+        break;
+      }
+      if (result == check) {
+        sx = zx;
+        sy = zy;
+        check *= 2;
+      }
+    }
+  }
+  return result;
+}
+
+__attribute__((always_inline)) static inline void formula_scalar(
+    struct fractal_ctx* ctx, wq_rect_t const* rect, const bool periodicity,
+    const enum fractal_formula formula, const uint32_t power) {
+  const uint32_t width = ctx->width;
+  const uint32_t max = fractal_rect_budget(ctx, rect);
+  const uint32_t shade = ctx->max_iteration;
   const double fleft = ctx->fleft;
   const double fwidth = ctx->fwidth;
-  const double fheight = ctx->fheight;
-
-  void** iter = pixels;
-  void* const* const end = iter + n;
-  do {
-    uint32_t i = (uint32_t)*iter;
-    void* pixel = ctx->buffer + i;
-    uint32_t row = i / width;
-    uint32_t column = i % width;
-    *(uint8_t*)pixel = mandlebrot_pixel(column, row, width, height, max, ftop,
-                                        fleft, fwidth, fheight);
-  } while (++iter != end);
+  const double epssq = ctx->periodicity_epssq;
+  const bool julia = ctx->julia;
+  uint64_t periodic_pixels = 0;
+  bool periodic;
+
+  const uint32_t column_step = ctx->column_step ?: 1;
+  const uint32_t column_end = fractal_column_end(ctx, rect);
+  const uint32_t row_end = rect->y + rect->h;
+  uint8_t* line = (uint8_t*)ctx->buffer + (uintptr_t)rect->y * width;
+  for (uint32_t row = rect->y; row != row_end; row++, line += width) {
+    const double y = fractal_ctx_row_y(ctx, row);
+    const double cy = julia ? ctx->julia_c[1] : y;
+    for (uint32_t column = rect->x; column != column_end;
+         column += column_step) {
+      const double x = fwidth * (double)column / (double)width + fleft;
+      const double cx = julia ? ctx->julia_c[0] : x;
+      const uint32_t result = formula_iterate(
+          x, y, cx, cy, max, periodicity, epssq, &periodic, formula, power);
+      if (periodic) {
+        line[column] = 255;
+        periodic_pixels += 1;
+      } else {
+        line[column] = fractal_shade(result, max, shade);
+      }
+    }
+  }
+  atomic_fetch_add(&ctx->stats.periodic_pixels, periodic_pixels);
+}
+
+// Formula kernels are specialized on the formula and Multibrot power as well
+// as periodicity. FRACTAL_FORMULA_KERNELS wraps kernel(ctx, rect,
+// periodicity, formula, power) for each and collects the wrappers in
+// kernel_table, indexed by fractal_ctx_formula_slot and periodicity.
+#define FRACTAL_FORMULA_SLOTS (4 + FRACTAL_MAX_POWER - 2)
+_Static_assert(FRACTAL_MAX_POWER == 8,
+               "FRACTAL_FORMULA_KERNELS lists the powers 3 to 8");
+
+#define FRACTAL_FORMULA_KERNEL(attrs, kernel, slot, formula, power)     \
+  attrs static void kernel##_##slot##_plain(struct fractal_ctx* ctx,    \
+                                            wq_rect_t const* rect) {    \
+    kernel(ctx, rect, false, formula, power);                           \
+  }                                                                     \
+  attrs static void kernel##_##slot##_periodic(struct fractal_ctx* ctx, \
+                                               wq_rect_t const* rect) { \
+    kernel(ctx, rect, true, formula, power);                            \
+  }
+
+#define FRACTAL_FORMULA_ROW(kernel, slot) \
+  { kernel##_##slot##_plain, kernel##_##slot##_periodic }
+
+#define FRACTAL_FORMULA_KERNELS_(attrs, kernel)                                \
+  FRACTAL_FORMULA_KERNEL(attrs, kernel, quadratic,                             \
+                         fractal_formula_mandlebrot, 2)                        \
+  FRACTAL_FORMULA_KERNEL(attrs, kernel, burning_ship,                          \
+                         fractal_formula_burning_ship, 2)                      \
+  FRACTAL_FORMULA_KERNEL(attrs, kernel, tricorn, fractal_formula_tricorn,      \
+                         2)                                                    \
+  FRACTAL_FORMULA_KERNEL(attrs, kernel, celtic, fractal_formula_celtic, 2)     \
+  FRACTAL_FORMULA_KERNEL(attrs, kernel, power3, fractal_formula_multibrot,     \
+                         3)                                                    \
+  FRACTAL_FORMULA_KERNEL(attrs, kernel, power4, fractal_formula_multibrot,     \
+                         4)                                                    \
+  FRACTAL_FORMULA_KERNEL(attrs, kernel, power5, fractal_formula_multibrot,     \
+                         5)                                                    \
+  FRACTAL_FORMULA_KERNEL(attrs, kernel, power6, fractal_formula_multibrot,     \
+                         6)                                                    \
+  FRACTAL_FORMULA_KERNEL(attrs, kernel, power7, fractal_formula_multibrot,     \
+                         7)                                                    \
+  FRACTAL_FORMULA_KERNEL(attrs, kernel, power8, fractal_formula_multibrot,     \
+                         8)                                                    \
+  static const fractal_kernel_fn_t                                             \
+      kernel##_table[FRACTAL_FORMULA_SLOTS][2] = {                             \
+          FRACTAL_FORMULA_ROW(kernel, quadratic),                              \
+          FRACTAL_FORMULA_ROW(kernel, burning_ship),                           \
+          FRACTAL_FORMULA_ROW(kernel, tricorn),                                \
+          FRACTAL_FORMULA_ROW(kernel, celtic),                                 \
+          FRACTAL_FORMULA_ROW(kernel, power3),                                 \
+          FRACTAL_FORMULA_ROW(kernel, power4),                                 \
+          FRACTAL_FORMULA_ROW(kernel, power5),                                 \
+          FRACTAL_FORMULA_ROW(kernel, power6),                                 \
+          FRACTAL_FORMULA_ROW(kernel, power7),                                 \
+          FRACTAL_FORMULA_ROW(kernel, power8),                                 \
+  };
+
+// Expands kernel first, so it can be a FRACTAL_SIMD_FN name.
+#define FRACTAL_FORMULA_KERNELS(attrs, kernel) \
+  FRACTAL_FORMULA_KERNELS_(attrs, kernel)
+
+FRACTAL_FORMULA_KERNELS(, formula_scalar)
+
+// The row of the formula kernel tables for ctx's formula. Multibrot with
+// power 2 is the Mandelbrot set's own formula.
+static unsigned fractal_ctx_formula_slot(struct fractal_ctx const* ctx) {
+  switch (ctx->formula) {
+    case fractal_formula_burning_ship:
+      return 1;
+    case fractal_formula_tricorn:
+      return 2;
+    case fractal_formula_celtic:
+      return 3;
+    case fractal_formula_multibrot:
+      return ctx->power == 2 ? 0 : 4 + ctx->power - 3;
+    default:
+      return 0;
+  }
+}
+
+#define FRACTAL_DD_SUFFIX scalar
+#define FRACTAL_DD_T double
+#define FRACTAL_DD_ATTRS __attribute__((always_inline)) static inline
+#define FRACTAL_DD_FMA(a, b, c) __builtin_fma(a, b, c)
+#include "fractal_dd.h"
+
+static inline bool mandlebrot_dd_in_main_bulbs(dd_scalar x, dd_scalar y) {
+  double cardioid;
+  double bulb;
+  dd_main_bulbs_scalar(x, y, &cardioid, &bulb);
+  return cardioid < 0.0 || bulb < 0.0;
+}
+
+// mandlebrot_iterate in double-double. Escape and periodicity only need the
+// high parts.
+__attribute__((always_inline)) static inline uint32_t mandlebrot_dd_iterate(
+    dd_scalar x, dd_scalar y, uint32_t max, const bool periodicity,
+    double epssq, bool* periodic) {
+  dd_scalar zx = x;
+  dd_scalar zy = y;
+  dd_scalar xx;
+  dd_scalar yy;
+  double magsq = zx.hi * zx.hi + zy.hi * zy.hi;
+  dd_scalar sx = zx;
+  dd_scalar sy = zy;
+  double dx;
+  double dy;
+  uint64_t check = FRACTAL_PERIOD_FIRST_CHECK;
+  uint32_t result = 0;
+
+  *periodic = false;
+  while (magsq <= 4.0 && result != max) {
+    xx = dd_sqr_scalar(zx);
+    yy = dd_sqr_scalar(zy);
+    zy = dd_add_scalar(dd_scale_scalar(dd_mul_scalar(zx, zy), 2.0), y);
+    zx = dd_add_scalar(dd_sub_scalar(xx, yy), x);
+    magsq = zx.hi * zx.hi + zy.hi * zy.hi;
+    result += 1;
+    if (periodicity) {
+      dx = dd_sub_scalar(zx, sx).hi;
+      dy = dd_sub_scalar(zy, sy).hi;
+      if (magsq <= 4.0 && dx * dx + dy * dy < epssq) {
+        *periodic = true;
+        break;
+      }
+      if (result == check) {
+        sx = zx;
+        sy = zy;
+        check *= 2;
+      }
+    }
+  }
+  return result;
+}
+
+static inline dd_scalar fractal_dd_column_x(struct fractal_ctx const* ctx,
+                                            double column) {
+  return dd_add_d_scalar((dd_scalar){ctx->fleft, ctx->fleft_lo},
+                         ctx->fwidth * column / (double)ctx->width);
+}
+
+// Rows measured from the axis row don't need a low part, the real axis being
+// in view makes ftop_lo smaller than the rounding of fheight.
+static inline dd_scalar fractal_dd_row_y(struct fractal_ctx const* ctx,
+                                         double row) {
+  if (!isnan(fractal_ctx_axis_row(ctx))) {
+    return (dd_scalar){fractal_ctx_row_y(ctx, row), 0.0};
+  }
+  return dd_add_d_scalar((dd_scalar){ctx->ftop, ctx->ftop_lo},
+                         ctx->fheight * row / (double)ctx->height);
+}
+
+__attribute__((always_inline)) static inline void mandlebrot_dd_scalar(
+    struct fractal_ctx* ctx, wq_rect_t const* rect, const bool periodicity) {
+  const uint32_t width = ctx->width;
+  const uint32_t max = fractal_rect_budget(ctx, rect);
+  const uint32_t shade = ctx->max_iteration;
+  const double epssq = ctx->periodicity_epssq;
+  const bool interior_check = ctx->interior_check;
+  uint64_t interior_pixels = 0;
+  uint64_t periodic_pixels = 0;
+  bool periodic;
+
+  const uint32_t column_step = ctx->column_step ?: 1;
+  const uint32_t column_end = fractal_column_end(ctx, rect);
+  const uint32_t row_end = rect->y + rect->h;
+  uint8_t* line = (uint8_t*)ctx->buffer + (uintptr_t)rect->y * width;
+  for (uint32_t row = rect->y; row != row_end; row++, line += width) {
+    const dd_scalar y = fractal_dd_row_y(ctx, row);
+    for (uint32_t column = rect->x; column != column_end;
+         column += column_step) {
+      const dd_scalar x = fractal_dd_column_x(ctx, column);
+      if (interior_check && mandlebrot_dd_in_main_bulbs(x, y)) {
+        line[column] = 255;
+        interior_pixels += 1;
+        continue;
+      }
+      const uint32_t result =
+          mandlebrot_dd_iterate(x, y, max, periodicity, epssq, &periodic);
+      if (periodic) {
+        line[column] = 255;
+        periodic_pixels += 1;
+      } else {
+        line[column] = fractal_shade(result, max, shade);
+      }
+    }
+  }
+  atomic_fetch_add(&ctx->stats.interior_pixels, interior_pixels);
+  atomic_fetch_add(&ctx->stats.periodic_pixels, periodic_pixels);
+}
+
+static void mandlebrot_dd_scalar_plain(struct fractal_ctx* ctx,
+                                       wq_rect_t const* rect) {
+  mandlebrot_dd_scalar(ctx, rect, false);
+}
+
+static void mandlebrot_dd_scalar_periodic(struct fractal_ctx* ctx,
+                                          wq_rect_t const* rect) {
+  mandlebrot_dd_scalar(ctx, rect, true);
+}
+
+// Float coordinates are rounded from double ones so the vector kernels can
+// compute them identically.
+#define FRACTAL_REAL_T float
+#define FRACTAL_REAL_SUFFIX float
+#define FRACTAL_REAL_COORD(base, base_lo, span, i, n) \
+  ((float)((span) * (double)(i) / (double)(n) + (base)))
+#include "fractal_real.h"
+
+#define FRACTAL_REAL_T long double
+#define FRACTAL_REAL_SUFFIX long_double
+#define FRACTAL_REAL_COORD(base, base_lo, span, i, n)     \
+  ((long double)(base) + (long double)(base_lo) +         \
+   (long double)(span) * (long double)(i) / (long double)(n))
+#include "fractal_real.h"
+
+// The fixed point kernels iterate in Q7.56, int64 with 56 fractional bits.
+// Every step is exact integer arithmetic, so the image is bit for bit the same
+// with any compiler at any optimization level. One iteration past |z| <= 2
+// with c inside [-4, 4] leaves |z|^2 <= 128, which the 7 integer bits hold
+// unsigned. Q4.59 would leave no room for the escape test.
+#define FRACTAL_FIXED_FRAC_BITS 56
+#define FRACTAL_FIXED_ONE ((uint64_t)1 << FRACTAL_FIXED_FRAC_BITS)
+#define FRACTAL_FIXED_FOUR (4 * FRACTAL_FIXED_ONE)
+#define FRACTAL_FIXED_LIMIT 4.0
+
+// Pixel i of n along an axis sits at base + floor(span * i / n), which is
+//   base + i * quot + i * rem / n
+// with span = quot * n + rem, all without 128-bit division.
+struct fractal_fixed_axis {
+  int64_t base;
+  uint64_t quot;
+  uint64_t rem;
+  uint64_t n;
+  // If set, coordinate i is 2 i - origin steps from 0 instead, see
+  // fractal_fixed_rows_init.
+  bool centered;
+  int64_t origin;
+};
+
+static inline struct fractal_fixed_axis fractal_fixed_axis_init(
+    double base, double base_lo, double span, uint32_t n) {
+  const uint64_t fspan = (uint64_t)ldexp(span, FRACTAL_FIXED_FRAC_BITS);
+  return (struct fractal_fixed_axis){
+      .base = (int64_t)ldexp(base, FRACTAL_FIXED_FRAC_BITS) +
+              (int64_t)ldexp(base_lo, FRACTAL_FIXED_FRAC_BITS),
+      .quot = fspan / n,
+      .rem = fspan % n,
+      .n = n,
+  };
+}
+
+// The rows of the view, measured in half rows from the axis row if there is
+// one, each side rounded toward it so mirrored rows get negated y.
+static inline struct fractal_fixed_axis fractal_fixed_rows_init(
+    struct fractal_ctx const* ctx) {
+  const double axis = fractal_ctx_axis_row(ctx);
+  if (isnan(axis)) {
+    return fractal_fixed_axis_init(ctx->ftop, ctx->ftop_lo, ctx->fheight,
+                                   ctx->height);
+  }
+  struct fractal_fixed_axis rows =
+      fractal_fixed_axis_init(0.0, 0.0, ctx->fheight, 2 * ctx->height);
+  rows.centered = true;
+  rows.origin = (int64_t)(2.0 * axis);
+  return rows;
+}
+
+static inline int64_t fractal_fixed_coord(
+    struct fractal_fixed_axis const* axis, uint32_t i) {
+  if (axis->centered) {
+    const int64_t k = 2 * (int64_t)i - axis->origin;
+    const uint64_t u = k < 0 ? -(uint64_t)k : (uint64_t)k;
+    const int64_t offset = (int64_t)(u * axis->quot + u * axis->rem / axis->n);
+    return k < 0 ? -offset : offset;
+  }
+  return axis->base + (int64_t)(i * axis->quot + i * axis->rem / axis->n);
+}
+
+static inline double fractal_fixed_to_double(int64_t a) {
+  return ldexp((double)a, -FRACTAL_FIXED_FRAC_BITS);
+}
+
+static inline uint64_t fractal_fixed_abs(int64_t a) {
+  return a < 0 ? -(uint64_t)a : (uint64_t)a;
+}
+
+// a^2, rounded down.
+static inline uint64_t fractal_fixed_sqr(int64_t a) {
+  const uint64_t u = fractal_fixed_abs(a);
+  return (uint64_t)(((unsigned __int128)u * u) >> FRACTAL_FIXED_FRAC_BITS);
+}
+
+// 2ab, rounded toward zero.
+static inline int64_t fractal_fixed_twice_mul(int64_t a, int64_t b) {
+  const unsigned __int128 p =
+      (unsigned __int128)fractal_fixed_abs(a) * fractal_fixed_abs(b);
+  const uint64_t twice = (uint64_t)(p >> (FRACTAL_FIXED_FRAC_BITS - 1));
+  return (a < 0) != (b < 0) ? (int64_t)-twice : (int64_t)twice;
+}
+
+// a^2 with |a| capped at 1 first, so the distance between an escaped orbit
+// and its saved point can't overflow. Periodicity only cares about tiny ones.
+static inline uint64_t fractal_fixed_sqr_capped(int64_t a) {
+  const uint64_t u = fractal_fixed_abs(a);
+  const uint64_t capped = u < FRACTAL_FIXED_ONE ? u : FRACTAL_FIXED_ONE;
+  return (uint64_t)(((unsigned __int128)capped * capped) >>
+                    FRACTAL_FIXED_FRAC_BITS);
+}
+
+// mandlebrot_iterate in fixed point.
+__attribute__((always_inline)) static inline uint32_t mandlebrot_fixed_iterate(
+    int64_t x, int64_t y, uint32_t max, const bool periodicity, uint64_t epssq,
+    bool* periodic) {
+  int64_t zx = x;
+  int64_t zy = y;
+  uint64_t xx = fractal_fixed_sqr(zx);
+  uint64_t yy = fractal_fixed_sqr(zy);
+  uint64_t magsq = xx + yy;
+  int64_t sx = zx;
+  int64_t sy = zy;
+  uint64_t check = FRACTAL_PERIOD_FIRST_CHECK;
+  uint32_t result = 0;
+
+  *periodic = false;
+  while (magsq <= FRACTAL_FIXED_FOUR && result != max) {
+    zy = fractal_fixed_twice_mul(zx, zy) + y;
+    zx = (int64_t)(xx - yy) + x;
+    xx = fractal_fixed_sqr(zx);
+    yy = fractal_fixed_sqr(zy);
+    magsq = xx + yy;
+    result += 1;
+    if (periodicity) {
+      const uint64_t dist =
+          fractal_fixed_sqr_capped(zx - sx) + fractal_fixed_sqr_capped(zy - sy);
+      if (magsq <= FRACTAL_FIXED_FOUR && dist < epssq) {
+        *periodic = true;
+        break;
+      }
+      if (result == check) {
+        sx = zx;
+        sy = zy;
+        check *= 2;
+      }
+    }
+  }
+  return result;
+}
+
+// The interior check runs on the coordinates converted to double, which is
+// just as reproducible.
+__attribute__((always_inline)) static inline void mandlebrot_fixed_scalar(
+    struct fractal_ctx* ctx, wq_rect_t const* rect, const bool periodicity) {
+  const uint32_t width = ctx->width;
+  const uint32_t max = fractal_rect_budget(ctx, rect);
+  const uint32_t shade = ctx->max_iteration;
+  const struct fractal_fixed_axis xs = fractal_fixed_axis_init(
+      ctx->fleft, ctx->fleft_lo, ctx->fwidth, ctx->width);
+  const struct fractal_fixed_axis ys = fractal_fixed_rows_init(ctx);
+  const uint64_t epssq =
+      (uint64_t)ldexp(ctx->periodicity_epssq, FRACTAL_FIXED_FRAC_BITS);
+  const bool interior_check = ctx->interior_check;
+  uint64_t interior_pixels = 0;
+  uint64_t periodic_pixels = 0;
+  bool periodic;
+
+  const uint32_t column_step = ctx->column_step ?: 1;
+  const uint32_t column_end = fractal_column_end(ctx, rect);
+  const uint32_t row_end = rect->y + rect->h;
+  uint8_t* line = (uint8_t*)ctx->buffer + (uintptr_t)rect->y * width;
+  for (uint32_t row = rect->y; row != row_end; row++, line += width) {
+    const int64_t y = fractal_fixed_coord(&ys, row);
+    for (uint32_t column = rect->x; column != column_end;
+         column += column_step) {
+      const int64_t x = fractal_fixed_coord(&xs, column);
+      if (interior_check &&
+          mandlebrot_in_main_bulbs(fractal_fixed_to_double(x),
+                                   fractal_fixed_to_double(y))) {
+        line[column] = 255;
+        interior_pixels += 1;
+        continue;
+      }
+      const uint32_t result =
+          mandlebrot_fixed_iterate(x, y, max, periodicity, epssq, &periodic);
+      if (periodic) {
+        line[column] = 255;
+        periodic_pixels += 1;
+      } else {
+        line[column] = fractal_shade(result, max, shade);
+      }
+    }
+  }
+  atomic_fetch_add(&ctx->stats.interior_pixels, interior_pixels);
+  atomic_fetch_add(&ctx->stats.periodic_pixels, periodic_pixels);
+}
+
+static void mandlebrot_fixed_scalar_plain(struct fractal_ctx* ctx,
+                                          wq_rect_t const* rect) {
+  mandlebrot_fixed_scalar(ctx, rect, false);
+}
+
+static void mandlebrot_fixed_scalar_periodic(struct fractal_ctx* ctx,
+                                             wq_rect_t const* rect) {
+  mandlebrot_fixed_scalar(ctx, rect, true);
+}
+
+// Walks the pixels of a rect in row-major order for the lane refill kernels.
+struct fractal_cursor {
+  uint32_t column;
+  uint32_t row;
+  uint32_t column_begin;
+  uint32_t column_end;
+  uint32_t column_step;
+  uint32_t row_end;
+  double y;
+  bool interior_check;
+  uint64_t interior_pixels;
+};
+
+static void fractal_cursor_init(struct fractal_ctx const* ctx,
+                                wq_rect_t const* rect,
+                                struct fractal_cursor* cursor) {
+  cursor->column = rect->x;
+  cursor->row = rect->y;
+  cursor->column_begin = rect->x;
+  cursor->column_end = fractal_column_end(ctx, rect);
+  cursor->column_step = ctx->column_step ?: 1;
+  cursor->row_end = rect->y + rect->h;
+  cursor->y = fractal_ctx_row_y(ctx, rect->y);
+  cursor->interior_check = ctx->interior_check;
+  cursor->interior_pixels = 0;
+}
+
+// Produces the next pixel that needs iterating. Pixels already outside the
+// escape radius or inside the main bulbs are written out and skipped. Returns
+// false once the rect is exhausted.
+static inline bool fractal_cursor_next(struct fractal_ctx const* ctx,
+                                       struct fractal_cursor* cursor,
+                                       double* x, double* y,
+                                       uintptr_t* offset) {
+  uint8_t* const buffer = ctx->buffer;
+  while (cursor->row != cursor->row_end &&
+         cursor->column_begin != cursor->column_end) {
+    const uint32_t column = cursor->column;
+    *x = ctx->fwidth * (double)column / (double)ctx->width + ctx->fleft;
+    *y = cursor->y;
+    *offset = (uintptr_t)cursor->row * ctx->width + column;
+    cursor->column += cursor->column_step;
+    if (cursor->column == cursor->column_end) {
+      cursor->column = cursor->column_begin;
+      if (++cursor->row != cursor->row_end) {
+        cursor->y = fractal_ctx_row_y(ctx, cursor->row);
+      }
+    }
+    if (*x * *x + *y * *y > 4.0) {
+      buffer[*offset] = 0;
+    } else if (cursor->interior_check && mandlebrot_in_main_bulbs(*x, *y)) {
+      buffer[*offset] = 255;
+      cursor->interior_pixels += 1;
+    } else {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The float-first kernels bound how far a float orbit strays from the double
+// one. Each float operation rounds by at most 2^-24 relative and each
+// iteration does a handful. The bound is itself computed in float, so its
+// growth factor gets some slack, with a floor in case z is near 0 and the
+// factor with it.
+#define FRACTAL_FLOAT_FIRST_ROUNDING 0x1p-21f
+#define FRACTAL_FLOAT_FIRST_SLACK (1.0f + 0x1p-10f)
+#define FRACTAL_FLOAT_FIRST_FLOOR 0x1p-12f
+// Pixels queued up for double before the lanes take them on.
+#define FRACTAL_FLOAT_FIRST_QUEUE 256
+
+#if FRACTAL_HAS_X86
+#define FRACTAL_SIMD_ISA sse2
+#define FRACTAL_SIMD_TARGET "sse2"
+#define FRACTAL_SIMD_LANES 2
+#define FRACTAL_SIMD_ANY(m) _mm_movemask_pd((__m128d)(m))
+#define FRACTAL_SIMD_ANY32(m) _mm_movemask_ps((__m128)(m))
+#define FRACTAL_SIMD_RSQRT32(v) (__typeof__(v)) _mm_rsqrt_ps((__m128)(v))
+#define FRACTAL_SIMD_MULU32(a, b) \
+  (__typeof__(a)) _mm_mul_epu32((__m128i)(a), (__m128i)(b))
+#include "fractal_simd.h"
+
+#define FRACTAL_SIMD_ISA avx2
+#define FRACTAL_SIMD_TARGET "avx2,fma"
+#define FRACTAL_SIMD_LANES 4
+#define FRACTAL_SIMD_ANY(m) _mm256_movemask_pd((__m256d)(m))
+#define FRACTAL_SIMD_ANY32(m) _mm256_movemask_ps((__m256)(m))
+#define FRACTAL_SIMD_RSQRT32(v) (__typeof__(v)) _mm256_rsqrt_ps((__m256)(v))
+#define FRACTAL_SIMD_MULU32(a, b) \
+  (__typeof__(a)) _mm256_mul_epu32((__m256i)(a), (__m256i)(b))
+#define FRACTAL_SIMD_FMA(a, b, c) \
+  (__typeof__(a)) _mm256_fmadd_pd((__m256d)(a), (__m256d)(b), (__m256d)(c))
+#include "fractal_simd.h"
+
+#define FRACTAL_SIMD_ISA avx512
+#define FRACTAL_SIMD_TARGET "avx512f"
+#define FRACTAL_SIMD_LANES 8
+#define FRACTAL_SIMD_ANY(m) _mm512_test_epi64_mask((__m512i)(m), (__m512i)(m))
+#define FRACTAL_SIMD_ANY32(m) \
+  _mm512_test_epi32_mask((__m512i)(m), (__m512i)(m))
+#define FRACTAL_SIMD_RSQRT32(v) \
+  (__typeof__(v)) _mm512_rsqrt14_ps((__m512)(v))
+#define FRACTAL_SIMD_MULU32(a, b) \
+  (__typeof__(a)) _mm512_mul_epu32((__m512i)(a), (__m512i)(b))
+#define FRACTAL_SIMD_FMA(a, b, c) \
+  (__typeof__(a)) _mm512_fmadd_pd((__m512d)(a), (__m512d)(b), (__m512d)(c))
+#include "fractal_simd.h"
+#endif
+
+#define FRACTAL_KERNEL_FN(name, periodicity) \
+  ((periodicity) ? name##_periodic : name##_plain)
+
+static fractal_kernel_fn_t get_kernel_fn(enum fractal_kernel kernel,
+                                         bool lane_refill, bool periodicity,
+                                         enum fractal_precision precision,
+                                         bool float_first, bool unroll) {
+  const bool dd = precision == fractal_precision_double_double;
+  const bool single = precision == fractal_precision_float;
+  const bool fixed = precision == fractal_precision_fixed;
+  if (precision == fractal_precision_long_double) {
+    return FRACTAL_KERNEL_FN(mandlebrot_scalar_long_double, periodicity);
+  }
+  switch (kernel) {
+#if FRACTAL_HAS_X86
+    case fractal_kernel_sse2:
+      return dd ? FRACTAL_KERNEL_FN(mandlebrot_dd_block_sse2, periodicity)
+             : float_first
+                 ? FRACTAL_KERNEL_FN(mandlebrot_float_first_sse2, periodicity)
+             : single
+                 ? FRACTAL_KERNEL_FN(mandlebrot_float_block_sse2, periodicity)
+             : fixed
+                 ? FRACTAL_KERNEL_FN(mandlebrot_fixed_block_sse2, periodicity)
+             : lane_refill
+                 ? FRACTAL_KERNEL_FN(mandlebrot_refill_sse2, periodicity)
+             : unroll
+                 ? FRACTAL_KERNEL_FN(mandlebrot_unrolled_sse2, periodicity)
+                 : FRACTAL_KERNEL_FN(mandlebrot_block_sse2, periodicity);
+    case fractal_kernel_avx2:
+      return dd ? FRACTAL_KERNEL_FN(mandlebrot_dd_block_avx2, periodicity)
+             : float_first
+                 ? FRACTAL_KERNEL_FN(mandlebrot_float_first_avx2, periodicity)
+             : single
+                 ? FRACTAL_KERNEL_FN(mandlebrot_float_block_avx2, periodicity)
+             : fixed
+                 ? FRACTAL_KERNEL_FN(mandlebrot_fixed_block_avx2, periodicity)
+             : lane_refill
+                 ? FRACTAL_KERNEL_FN(mandlebrot_refill_avx2, periodicity)
+             : unroll
+                 ? FRACTAL_KERNEL_FN(mandlebrot_unrolled_avx2, periodicity)
+                 : FRACTAL_KERNEL_FN(mandlebrot_block_avx2, periodicity);
+    case fractal_kernel_avx512:
+      return dd ? FRACTAL_KERNEL_FN(mandlebrot_dd_block_avx512, periodicity)
+             : float_first ? FRACTAL_KERNEL_FN(mandlebrot_float_first_avx512,
+                                               periodicity)
+             : single ? FRACTAL_KERNEL_FN(mandlebrot_float_block_avx512,
+                                          periodicity)
+             : fixed  ? FRACTAL_KERNEL_FN(mandlebrot_fixed_block_avx512,
+                                          periodicity)
+             : lane_refill
+                 ? FRACTAL_KERNEL_FN(mandlebrot_refill_avx512, periodicity)
+             : unroll
+                 ? FRACTAL_KERNEL_FN(mandlebrot_unrolled_avx512, periodicity)
+                 : FRACTAL_KERNEL_FN(mandlebrot_block_avx512, periodicity);
+#endif
+    default:
+      return dd ? FRACTAL_KERNEL_FN(mandlebrot_dd_scalar, periodicity)
+             : single
+                 ? FRACTAL_KERNEL_FN(mandlebrot_scalar_float, periodicity)
+             : fixed
+                 ? FRACTAL_KERNEL_FN(mandlebrot_fixed_scalar, periodicity)
+             : unroll
+                 ? FRACTAL_KERNEL_FN(mandlebrot_unrolled_scalar, periodicity)
+                 : FRACTAL_KERNEL_FN(mandlebrot_scalar, periodicity);
+  }
+}
+
+static fractal_escalate_fn_t get_escalate_fn(enum fractal_kernel kernel,
+                                             bool periodicity) {
+  switch (kernel) {
+#if FRACTAL_HAS_X86
+    case fractal_kernel_sse2:
+      return FRACTAL_KERNEL_FN(mandlebrot_escalate_sse2, periodicity);
+    case fractal_kernel_avx2:
+      return FRACTAL_KERNEL_FN(mandlebrot_escalate_avx2, periodicity);
+    case fractal_kernel_avx512:
+      return FRACTAL_KERNEL_FN(mandlebrot_escalate_avx512, periodicity);
+#endif
+    default:
+      return fractal_escalate_scalar;
+  }
+}
+
+static fractal_kernel_fn_t get_formula_kernel_fn(enum fractal_kernel kernel,
+                                                 unsigned slot,
+                                                 bool periodicity) {
+  switch (kernel) {
+#if FRACTAL_HAS_X86
+    case fractal_kernel_sse2:
+      return formula_block_sse2_table[slot][periodicity];
+    case fractal_kernel_avx2:
+      return formula_block_avx2_table[slot][periodicity];
+    case fractal_kernel_avx512:
+      return formula_block_avx512_table[slot][periodicity];
+#endif
+    default:
+      return formula_scalar_table[slot][periodicity];
+  }
+}
+
+// Orbit points within 1/FRACTAL_PERIOD_TOLERANCE of a pixel's width count as
+// the same point.
+#define FRACTAL_PERIOD_TOLERANCE 1024.0
+
+// Relative cost of an iteration with periodicity checks versus without.
+#define FRACTAL_PERIOD_OVERHEAD 1.3
+#define FRACTAL_PERIOD_PROBE 16
+
+// Iterates the point at column, row in pixels into the view in
+// ctx->precision, at the same coordinates the kernels compute whole pixels
+// at. Fixed point only has coordinates for whole pixels, so it takes the
+// pixel the point falls in. Returns false without iterating if the interior
+// check catches it.
+static bool fractal_probe_point(struct fractal_ctx const* ctx, double column,
+                                double row, uint32_t max, bool periodicity,
+                                uint32_t* iterations, bool* periodic) {
+  const enum fractal_precision precision = ctx->precision;
+  if (!fractal_ctx_is_mandlebrot(ctx)) {
+    const double x = ctx->fwidth * column / (double)ctx->width + ctx->fleft;
+    const double y = fractal_ctx_row_y(ctx, row);
+    *iterations = formula_iterate(x, y, ctx->julia ? ctx->julia_c[0] : x,
+                                  ctx->julia ? ctx->julia_c[1] : y, max,
+                                  periodicity, ctx->periodicity_epssq,
+                                  periodic, ctx->formula, ctx->power);
+  } else if (precision == fractal_precision_double_double) {
+    const dd_scalar x = fractal_dd_column_x(ctx, column);
+    const dd_scalar y = fractal_dd_row_y(ctx, row);
+    if (ctx->interior_check && mandlebrot_dd_in_main_bulbs(x, y)) {
+      return false;
+    }
+    *iterations = mandlebrot_dd_iterate(x, y, max, periodicity,
+                                        ctx->periodicity_epssq, periodic);
+  } else if (precision == fractal_precision_long_double) {
+    const long double x = fractal_column_x_long_double(ctx, column);
+    const long double y = fractal_row_y_long_double(ctx, row);
+    if (ctx->interior_check && mandlebrot_in_main_bulbs_long_double(x, y)) {
+      return false;
+    }
+    *iterations = mandlebrot_iterate_long_double(
+        x, y, max, periodicity, ctx->periodicity_epssq, periodic);
+  } else if (precision == fractal_precision_float) {
+    const float x = fractal_column_x_float(ctx, column);
+    const float y = fractal_row_y_float(ctx, row);
+    if (ctx->interior_check && mandlebrot_in_main_bulbs_float(x, y)) {
+      return false;
+    }
+    *iterations = mandlebrot_iterate_float(
+        x, y, max, periodicity, (float)ctx->periodicity_epssq, periodic);
+  } else if (precision == fractal_precision_fixed) {
+    const struct fractal_fixed_axis xs = fractal_fixed_axis_init(
+        ctx->fleft, ctx->fleft_lo, ctx->fwidth, ctx->width);
+    const struct fractal_fixed_axis ys = fractal_fixed_rows_init(ctx);
+    const int64_t x = fractal_fixed_coord(&xs, (uint32_t)column);
+    const int64_t y = fractal_fixed_coord(&ys, (uint32_t)row);
+    if (ctx->interior_check &&
+        mandlebrot_in_main_bulbs(fractal_fixed_to_double(x),
+                                 fractal_fixed_to_double(y))) {
+      return false;
+    }
+    *iterations = mandlebrot_fixed_iterate(
+        x, y, max, periodicity,
+        (uint64_t)ldexp(ctx->periodicity_epssq, FRACTAL_FIXED_FRAC_BITS),
+        periodic);
+  } else {
+    const double x = ctx->fwidth * column / (double)ctx->width + ctx->fleft;
+    const double y = fractal_ctx_row_y(ctx, row);
+    if (ctx->interior_check && mandlebrot_in_main_bulbs(x, y)) {
+      return false;
+    }
+    *iterations = mandlebrot_iterate(x, y, max, periodicity,
+                                     ctx->periodicity_epssq, periodic);
+  }
+  return true;
+}
+
+// Samples a coarse grid of the view and estimates whether the iterations
+// saved on cycling interior points outweigh the cost of checking every
+// iteration. Points the interior check already catches are free either way.
+static bool periodicity_pays_off(struct fractal_ctx const* ctx) {
+  const uint32_t max = ctx->max_iteration;
+  double cost_off = 0;
+  double cost_on = 0;
+  uint32_t iterations;
+  bool periodic;
+  for (unsigned py = 0; py < FRACTAL_PERIOD_PROBE; py++) {
+    const double row =
+        (double)ctx->height * (2 * py + 1) / (2 * FRACTAL_PERIOD_PROBE);
+    for (unsigned px = 0; px < FRACTAL_PERIOD_PROBE; px++) {
+      const double column =
+          (double)ctx->width * (2 * px + 1) / (2 * FRACTAL_PERIOD_PROBE);
+      if (!fractal_probe_point(ctx, column, row, max, true, &iterations,
+                               &periodic)) {
+        continue;
+      }
+      cost_off += periodic ? max : iterations;
+      cost_on += FRACTAL_PERIOD_OVERHEAD * iterations;
+    }
+  }
+  return cost_on < cost_off;
+}
+
+uint32_t fractal_ctx_probe(struct fractal_ctx const* ctx, double column,
+                           double row, uint32_t max) {
+  uint32_t iterations;
+  bool periodic;
+  if (!fractal_probe_point(ctx, column, row, max, true, &iterations,
+                           &periodic) ||
+      periodic) {
+    return max;
+  }
+  return iterations;
+}
+
+uint32_t fractal_ctx_probe_cost(struct fractal_ctx const* ctx, double column,
+                                double row) {
+  uint32_t iterations;
+  bool periodic;
+  if (!fractal_probe_point(ctx, column, row, ctx->max_iteration, true,
+                           &iterations, &periodic)) {
+    return 0;
+  }
+  if (periodic && ctx->periodicity != fractal_periodicity_on) {
+    return ctx->max_iteration;
+  }
+  return iterations;
+}
+
+bool fractal_kernel_is_supported(enum fractal_kernel kernel) {
+  switch (kernel) {
+    case fractal_kernel_auto:
+    case fractal_kernel_scalar:
+      return true;
+#if FRACTAL_HAS_X86
+    case fractal_kernel_sse2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse2");
+    case fractal_kernel_avx2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case fractal_kernel_avx512:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+      return false;
+  }
+}
+
+const char* fractal_periodicity_name(enum fractal_periodicity periodicity) {
+  switch (periodicity) {
+    case fractal_periodicity_auto:
+      return "auto";
+    case fractal_periodicity_off:
+      return "off";
+    case fractal_periodicity_on:
+      return "on";
+  }
+  return "unknown";
+}
+
+const char* fractal_precision_name(enum fractal_precision precision) {
+  switch (precision) {
+    case fractal_precision_auto:
+      return "auto";
+    case fractal_precision_double:
+      return "double";
+    case fractal_precision_double_double:
+      return "double-double";
+    case fractal_precision_float:
+      return "float";
+    case fractal_precision_long_double:
+      return "long-double";
+    case fractal_precision_fixed:
+      return "fixed";
+  }
+  return "unknown";
+}
+
+const char* fractal_formula_name(enum fractal_formula formula) {
+  switch (formula) {
+    case fractal_formula_mandlebrot:
+      return "mandlebrot";
+    case fractal_formula_multibrot:
+      return "multibrot";
+    case fractal_formula_burning_ship:
+      return "burning-ship";
+    case fractal_formula_tricorn:
+      return "tricorn";
+    case fractal_formula_celtic:
+      return "celtic";
+  }
+  return "unknown";
+}
+
+const char* fractal_kernel_name(enum fractal_kernel kernel) {
+  switch (kernel) {
+    case fractal_kernel_auto:
+      return "auto";
+    case fractal_kernel_scalar:
+      return "scalar";
+    case fractal_kernel_sse2:
+      return "sse2";
+    case fractal_kernel_avx2:
+      return "avx2";
+    case fractal_kernel_avx512:
+      return "avx512";
+  }
+  return "unknown";
+}
+
+// Enough for the low part of a double-double center.
+#define FRACTAL_CENTER_LIMBS 5
+
+const char* fractal_ctx_set_center(struct fractal_ctx* ctx,
+                                   const char* const center[2]) {
+  const double half[2] = {ctx->fwidth / 2.0, ctx->fheight / 2.0};
+  double* const edge[2] = {&ctx->fleft, &ctx->ftop};
+  double* const edge_lo[2] = {&ctx->fleft_lo, &ctx->ftop_lo};
+  struct bignum exact;
+  struct bignum tmp;
+  for (unsigned i = 0; i < 2; i++) {
+    const char* err =
+        bignum_from_decimal(&exact, center[i], FRACTAL_CENTER_LIMBS);
+    if (err) {
+      return err;
+    }
+    if (half[i] >= 0x1p31) {
+      return "View is too wide";
+    }
+    *edge[i] = strtod(center[i], NULL) - half[i];
+    bignum_from_double(&tmp, half[i], FRACTAL_CENTER_LIMBS);
+    bignum_sub(&exact, &exact, &tmp);
+    bignum_from_double(&tmp, *edge[i], FRACTAL_CENTER_LIMBS);
+    bignum_sub(&exact, &exact, &tmp);
+    *edge_lo[i] = bignum_to_double(&exact);
+  }
+  return NULL;
+}
+
+// The largest coordinate in view, which sets the exponent of the rounding
+// error.
+static double fractal_ctx_scale(struct fractal_ctx const* ctx) {
+  return fmax(fmax(fabs(ctx->fleft), fabs(ctx->fleft + ctx->fwidth)),
+              fmax(fabs(ctx->ftop), fabs(ctx->ftop + ctx->fheight)));
+}
+
+bool fractal_ctx_pixels_below(struct fractal_ctx const* ctx,
+                              double resolution) {
+  const double scale = fractal_ctx_scale(ctx);
+  return ctx->fwidth / ctx->width < scale * resolution ||
+         ctx->fheight / ctx->height < scale * resolution;
+}
+
+// Bits kept beyond the pixel size and the iteration count so rounding stays
+// well under a pixel.
+#define FRACTAL_PRECISION_GUARD_BITS 8
+
+unsigned fractal_ctx_precision_bits(struct fractal_ctx const* ctx) {
+  const double pixel =
+      fmin(ctx->fwidth / ctx->width, ctx->fheight / ctx->height);
+  // Each iteration can add about an ulp of error to z, so max iterations
+  // cost about log2(max) bits.
+  const double bits = log2(fractal_ctx_scale(ctx) / pixel) +
+                      log2(ctx->max_iteration ?: 1) +
+                      FRACTAL_PRECISION_GUARD_BITS;
+  return bits > 0 ? (unsigned)ceil(bits) : 0;
+}
+
+static enum fractal_precision fractal_ctx_auto_precision(
+    struct fractal_ctx const* ctx) {
+  const unsigned bits = fractal_ctx_precision_bits(ctx);
+  if (bits <= FLT_MANT_DIG) {
+    return fractal_precision_float;
+  } else if (bits <= DBL_MANT_DIG) {
+    return fractal_precision_double;
+  } else if (bits <= LDBL_MANT_DIG) {
+    return fractal_precision_long_double;
+  }
+  return fractal_precision_double_double;
+}
+
+// Resolves fractal_kernel_auto to the widest kernel the CPU supports.
+static const char* fractal_resolve_kernel(enum fractal_kernel* kernel) {
+  if (*kernel == fractal_kernel_auto) {
+    *kernel = fractal_kernel_avx512;
+    while (!fractal_kernel_is_supported(*kernel)) {
+      *kernel -= 1;
+    }
+  } else if (!fractal_kernel_is_supported(*kernel)) {
+    return "Requested kernel is not supported by this CPU";
+  }
+  return NULL;
+}
+
+const char* fractal_ctx_select_kernel(struct fractal_ctx* ctx) {
+  if (ctx->perturb) {
+    ctx->kernel = fractal_kernel_scalar;
+    ctx->periodicity = fractal_periodicity_off;
+    ctx->kernel_fn = fractal_perturb_kernel;
+    return NULL;
+  }
+
+  if (ctx->lyapunov || ctx->newton) {
+    if (ctx->precision != fractal_precision_auto &&
+        ctx->precision != fractal_precision_double) {
+      return ctx->lyapunov ? "Lyapunov fractals only run in double precision"
+                           : "Newton fractals only run in double precision";
+    }
+    ctx->precision = fractal_precision_double;
+    const char* err = fractal_resolve_kernel(&ctx->kernel);
+    if (err) {
+      return err;
+    }
+    ctx->lane_refill = false;
+    ctx->interior_check = false;
+    ctx->float_first = false;
+    ctx->unroll = false;
+    ctx->kernel_fn = ctx->lyapunov ? fractal_lyapunov_kernel_fn(ctx->kernel)
+                                   : fractal_newton_kernel_fn(ctx->kernel);
+    return NULL;
+  }
+
+  if (!fractal_ctx_is_mandlebrot(ctx)) {
+    if (ctx->formula == fractal_formula_multibrot &&
+        (ctx->power < 2 || ctx->power > FRACTAL_MAX_POWER)) {
+      return "Multibrot powers go from 2 to 8";
+    }
+    if (ctx->escalate) {
+      return "Escalation only supports the Mandelbrot set";
+    }
+    if (ctx->precision != fractal_precision_auto &&
+        ctx->precision != fractal_precision_double) {
+      return "Only the Mandelbrot set supports precisions other than double";
+    }
+    ctx->precision = fractal_precision_double;
+  }
+  if (ctx->escalate) {
+    // Only double keeps a pixel's orbit around between budgets.
+    if (ctx->precision != fractal_precision_auto &&
+        ctx->precision != fractal_precision_double) {
+      return "Escalation only supports double precision";
+    }
+    ctx->precision = fractal_precision_double;
+  }
+  if (ctx->precision == fractal_precision_auto) {
+    ctx->precision = fractal_ctx_auto_precision(ctx);
+    ctx->precision_auto = true;
+  }
+
+  if (ctx->precision == fractal_precision_fixed &&
+      fractal_ctx_scale(ctx) > FRACTAL_FIXED_LIMIT) {
+    return "Fixed point only covers views within [-4, 4]";
+  }
+
+  enum fractal_kernel kernel = ctx->kernel;
+  if (ctx->precision == fractal_precision_long_double) {
+    // There are no vector units for x87.
+    kernel = fractal_kernel_scalar;
+  } else {
+    const char* err = fractal_resolve_kernel(&kernel);
+    if (err) {
+      return err;
+    }
+  }
+  if (ctx->column_step > 1 && kernel != fractal_kernel_scalar) {
+    if (ctx->precision == fractal_precision_double &&
+        fractal_ctx_is_mandlebrot(ctx)) {
+      ctx->lane_refill = true;
+    } else {
+      kernel = fractal_kernel_scalar;
+    }
+  }
+  ctx->kernel = kernel;
+
+  // Orbits are only ever compared to a small fraction of a pixel.
+  const double eps = ctx->fwidth / ctx->width / FRACTAL_PERIOD_TOLERANCE;
+  ctx->periodicity_epssq = eps * eps;
+  if (ctx->periodicity == fractal_periodicity_auto) {
+    ctx->periodicity = periodicity_pays_off(ctx) ? fractal_periodicity_on
+                                                 : fractal_periodicity_off;
+    ctx->periodicity_auto = true;
+  }
+
+  ctx->float_first = ctx->float_first &&
+                     ctx->precision == fractal_precision_double &&
+                     kernel != fractal_kernel_scalar &&
+                     ctx->column_step <= 1 && !ctx->budgets;
+  ctx->unroll = ctx->unroll && ctx->precision == fractal_precision_double &&
+                !ctx->float_first && !ctx->lane_refill;
+  if (!fractal_ctx_is_mandlebrot(ctx)) {
+    ctx->lane_refill = false;
+    ctx->interior_check = false;
+    ctx->float_first = false;
+    ctx->unroll = false;
+    ctx->kernel_fn =
+        get_formula_kernel_fn(kernel, fractal_ctx_formula_slot(ctx),
+                              ctx->periodicity == fractal_periodicity_on);
+    return NULL;
+  }
+  if (ctx->escalate) {
+    ctx->float_first = false;
+    ctx->unroll = false;
+    ctx->escalate->iterate =
+        get_escalate_fn(kernel, ctx->periodicity == fractal_periodicity_on);
+    ctx->kernel_fn = fractal_escalate_kernel;
+    return NULL;
+  }
+  ctx->kernel_fn = get_kernel_fn(
+      kernel, ctx->lane_refill, ctx->periodicity == fractal_periodicity_on,
+      ctx->precision, ctx->float_first, ctx->unroll);
+  return NULL;
+}
+
+void fractal_worker(wq_rect_t const* rect, struct fractal_ctx* ctx) {
+  ctx->kernel_fn(ctx, rect);
+}
+
+static inline double fractal_column_x(struct fractal_ctx const* ctx,
+                                      int64_t column) {
+  return ctx->fwidth * (double)column / (double)ctx->width + ctx->fleft;
+}
+
+// At most one in this many columns of Julia rows may be left to compute for
+// the rows to be mirrored.
+#define FRACTAL_JULIA_UNPAIRED_MAX 16
+
+// Julia sets are symmetric about the origin, so column a of a row mirrors
+// column sum - a of the mirrored row, if their x are exact negations too.
+// Returns sum, or -1 if the formula isn't symmetric that way or x = 0 is out
+// of view. Julia sets are always iterated in double.
+static int64_t fractal_ctx_column_sum(struct fractal_ctx const* ctx) {
+  // f(-z) = f(z) for everything but odd powers, the Burning Ship included
+  // since it takes absolute values first.
+  if ((ctx->formula == fractal_formula_multibrot && ctx->power % 2 == 1) ||
+      ctx->fleft >= 0.0 || ctx->fleft + ctx->fwidth <= 0.0) {
+    return -1;
+  }
+  return (int64_t)nearbyint(-2.0 * ctx->fleft * ctx->width / ctx->fwidth);
+}
+
+// Counts the columns whose partner about sum is in view at exactly the
+// negated x, flagging them in paired unless it's NULL.
+static uint32_t fractal_ctx_pair_columns(struct fractal_ctx const* ctx,
+                                         int64_t sum, bool* paired) {
+  uint32_t count = 0;
+  for (uint32_t column = 0; column < ctx->width; column++) {
+    const int64_t other = sum - column;
+    const bool pair =
+        other >= 0 && other < ctx->width &&
+        fractal_column_x(ctx, column) == -fractal_column_x(ctx, other);
+    count += pair;
+    if (paired) {
+      paired[column] = pair;
+    }
+  }
+  return count;
+}
+
+uint32_t fractal_ctx_mirror_rows(struct fractal_ctx const* ctx,
+                                 uint32_t* source) {
+  const uint32_t height = ctx->height;
+  for (uint32_t row = 0; row < height; row++) {
+    source[row] = row;
+  }
+  // Perturbation iterates relative to a reference that isn't mirrored. The
+  // Burning Ship, Lyapunov and Newton fractals aren't symmetric about the
+  // real axis in general.
+  const double axis = fractal_ctx_axis_row(ctx);
+  if (ctx->perturb || ctx->lyapunov || ctx->newton || isnan(axis) ||
+      (!ctx->julia && ctx->formula == fractal_formula_burning_ship)) {
+    return 0;
+  }
+  if (ctx->julia) {
+    // Unpaired columns of mirrored rows are computed a few pixels at a time
+    // after the render, which is slower than computing the rows outright
+    // unless almost every column pairs up.
+    const int64_t columns = fractal_ctx_column_sum(ctx);
+    if (columns < 0 ||
+        fractal_ctx_pair_columns(ctx, columns, NULL) <
+            ctx->width - ctx->width / FRACTAL_JULIA_UNPAIRED_MAX) {
+      return 0;
+    }
+  }
+  // Rows a and b are at exactly opposite y when a + b is sum, every kernel
+  // rounding symmetrically, so the conjugate orbits take the same number of
+  // iterations.
+  const uint32_t sum = (uint32_t)(2.0 * axis);
+  uint32_t mirrored = 0;
+  for (uint32_t row = sum >= height ? sum - height + 1 : 0; 2 * row < sum;
+       row++) {
+    source[sum - row] = row;
+    mirrored += 1;
+  }
+  return mirrored;
+}
+
+void fractal_ctx_copy_mirrored_rows(struct fractal_ctx* ctx,
+                                    uint32_t const* source) {
+  uint8_t* const buffer = ctx->buffer;
+  const uint32_t width = ctx->width;
+  const int64_t sum = ctx->julia ? fractal_ctx_column_sum(ctx) : 0;
+  bool* paired = NULL;
+  if (ctx->julia) {
+    paired = malloc(width * sizeof(bool));
+    fractal_ctx_pair_columns(ctx, sum, paired);
+  }
+  for (uint32_t row = 0; row < ctx->height; row++) {
+    if (source[row] == row) {
+      continue;
+    }
+    uint8_t* const line = buffer + (uintptr_t)row * width;
+    uint8_t const* const from = buffer + (uintptr_t)source[row] * width;
+    if (!ctx->julia) {
+      memcpy(line, from, width);
+      continue;
+    }
+    // Runs of columns without a partner are computed.
+    for (uint32_t column = 0; column < width;) {
+      uint32_t end = column;
+      while (end < width && paired[end] == paired[column]) {
+        end++;
+      }
+      if (paired[column]) {
+        for (; column < end; column++) {
+          line[column] = from[sum - column];
+        }
+      } else {
+        fractal_worker(
+            &(wq_rect_t){.x = column, .y = row, .w = end - column, .h = 1},
+            ctx);
+      }
+      column = end;
+    }
+  }
+  free(paired);
+}
+
+// Rects thinner than this are cheaper to compute outright than to subdivide.
+#define FRACTAL_MARIANI_MIN 8
+
+// Computes the pixel at column, row like the scalar kernel and writes it out.
+// Returns the iterations it took to escape, max if it didn't within max, or
+// UINT32_MAX if it provably never does, the interior check catching it or its
+// orbit settling into a cycle. Without periodicity checks the pixels that hit
+// max are iterated again with them for the proof, their byte has to come
+// from running all the way to max like the kernel, which the checks can cut
+// short of an escape.
+static uint32_t mariani_pixel(struct fractal_ctx* ctx, uint32_t column,
+                              uint32_t row, uint32_t max,
+                              uint64_t* interior_pixels,
+                              uint64_t* periodic_pixels) {
+  const bool periodicity = ctx->periodicity == fractal_periodicity_on;
+  uint8_t* out = (uint8_t*)ctx->buffer + (uintptr_t)row * ctx->width + column;
+  uint32_t iterations;
+  bool periodic;
+  if (!fractal_probe_point(ctx, column, row, max, periodicity, &iterations,
+                           &periodic)) {
+    *out = 255;
+    *interior_pixels += 1;
+    return UINT32_MAX;
+  }
+  if (periodic) {
+    *out = 255;
+    *periodic_pixels += 1;
+    return UINT32_MAX;
+  }
+  *out = fractal_shade(iterations, max, ctx->max_iteration);
+  if (iterations == max && !periodicity &&
+      fractal_probe_point(ctx, column, row, max, true, &iterations,
+                          &periodic) &&
+      periodic) {
+    return UINT32_MAX;
+  }
+  return iterations;
+}
+
+typedef void (*mariani_border_fn_t)(struct fractal_ctx* ctx,
+                                    wq_rect_t const* rect, uint32_t max,
+                                    uint32_t* counts);
+
+// The vector border pass for ctx's kernel, NULL if there is none for its
+// precision or formula.
+static mariani_border_fn_t mariani_border_fn(struct fractal_ctx const* ctx) {
+  if (!fractal_ctx_is_mandlebrot(ctx) ||
+      ctx->precision != fractal_precision_double) {
+    return NULL;
+  }
+  const bool periodicity = ctx->periodicity == fractal_periodicity_on;
+  switch (ctx->kernel) {
+#if FRACTAL_HAS_X86
+    case fractal_kernel_sse2:
+      return FRACTAL_KERNEL_FN(mandlebrot_mariani_border_sse2, periodicity);
+    case fractal_kernel_avx2:
+      return FRACTAL_KERNEL_FN(mandlebrot_mariani_border_avx2, periodicity);
+    case fractal_kernel_avx512:
+      return FRACTAL_KERNEL_FN(mandlebrot_mariani_border_avx512, periodicity);
+#endif
+    default:
+      return NULL;
+  }
+}
+
+// Computes the border of rect, each pixel once, and returns whether its
+// interior can be filled with the border's color. That takes the iteration
+// counts behind the border to match, not just its bytes: a byte covers
+// max_iteration / 255 counts, and bands that wide hide minibrots and
+// filaments that slip between the border's pixels. Borders in the set only
+// count if every pixel provably is, rather than escaping slower than
+// max_iteration like the points around seahorse valley, where escaping
+// channels thinner than a pixel run through.
+static bool mariani_border_is_uniform(struct fractal_ctx* ctx,
+                                      wq_rect_t const* rect) {
+  const uint32_t max = fractal_rect_budget(ctx, rect);
+  const uintptr_t n = 2 * (uintptr_t)rect->w + 2 * (rect->h - 2);
+  uint32_t* counts = malloc(n * sizeof(uint32_t));
+  const mariani_border_fn_t border_fn = mariani_border_fn(ctx);
+  if (border_fn) {
+    border_fn(ctx, rect, max, counts);
+  } else {
+    const uint32_t right = rect->x + rect->w - 1;
+    const uint32_t low = rect->y + rect->h - 1;
+    uint64_t interior_pixels = 0;
+    uint64_t periodic_pixels = 0;
+    uintptr_t i = 0;
+    for (uint32_t column = rect->x; column <= right; column++) {
+      counts[i++] = mariani_pixel(ctx, column, rect->y, max,
+                                  &interior_pixels, &periodic_pixels);
+      counts[i++] = mariani_pixel(ctx, column, low, max, &interior_pixels,
+                                  &periodic_pixels);
+    }
+    for (uint32_t row = rect->y + 1; row < low; row++) {
+      counts[i++] = mariani_pixel(ctx, rect->x, row, max, &interior_pixels,
+                                  &periodic_pixels);
+      counts[i++] = mariani_pixel(ctx, right, row, max, &interior_pixels,
+                                  &periodic_pixels);
+    }
+    atomic_fetch_add(&ctx->stats.interior_pixels, interior_pixels);
+    atomic_fetch_add(&ctx->stats.periodic_pixels, periodic_pixels);
+  }
+
+  bool uniform = counts[0] != max;
+  for (uintptr_t i = 1; uniform && i < n; i++) {
+    uniform = counts[i] == counts[0];
+  }
+  free(counts);
+  return uniform;
+}
+
+void fractal_mariani_worker(wq_rect_t const* rect, struct fractal_ctx* ctx) {
+  const fractal_kernel_fn_t kernel_fn = ctx->kernel_fn;
+  if (rect->w < FRACTAL_MARIANI_MIN || rect->h < FRACTAL_MARIANI_MIN) {
+    kernel_fn(ctx, rect);
+    return;
+  }
+
+  const uint32_t x = rect->x;
+  const uint32_t y = rect->y;
+  const uint32_t w = rect->w;
+  const uint32_t h = rect->h;
+  if (mariani_border_is_uniform(ctx, rect)) {
+    const uint32_t width = ctx->width;
+    const uint8_t value = *((uint8_t*)ctx->buffer + (uintptr_t)y * width + x);
+    uint8_t* line = (uint8_t*)ctx->buffer + (uintptr_t)(y + 1) * width + x + 1;
+    for (uint32_t i = 1; i < h - 1; i++, line += width) {
+      memset(line, value, w - 2);
+    }
+    atomic_fetch_add(&ctx->stats.filled_pixels, (uint64_t)(w - 2) * (h - 2));
+    return;
+  }
+
+  // Each quadrant computes its own border within this one's, so every pixel
+  // is still computed once.
+  const uint32_t lw = (w - 2) / 2;
+  const uint32_t th = (h - 2) / 2;
+  const wq_rect_t quadrants[4] = {
+      {.x = x + 1, .y = y + 1, .w = lw, .h = th},
+      {.x = x + 1 + lw, .y = y + 1, .w = w - 2 - lw, .h = th},
+      {.x = x + 1, .y = y + 1 + th, .w = lw, .h = h - 2 - th},
+      {.x = x + 1 + lw, .y = y + 1 + th, .w = w - 2 - lw, .h = h - 2 - th},
+  };
+  // If the queue is full just do the work here.
+  for (unsigned i = wq_push_rects(ctx->wq, 4, quadrants); i < 4; i++) {
+    fractal_mariani_worker(&quadrants[i], ctx);
+  }
 }
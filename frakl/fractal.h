@@ -2,17 +2,314 @@
 
 #pragma once
 
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "wq.h"
+
+enum fractal_kernel {
+  fractal_kernel_auto = 0,
+  fractal_kernel_scalar = 1,
+  fractal_kernel_sse2 = 2,
+  fractal_kernel_avx2 = 3,
+  fractal_kernel_avx512 = 4,
+};
+
+enum fractal_periodicity {
+  fractal_periodicity_auto = 0,
+  fractal_periodicity_off = 1,
+  fractal_periodicity_on = 2,
+};
+
+enum fractal_algorithm {
+  // Iterate every pixel.
+  fractal_algorithm_brute = 0,
+  // Mariani-Silver subdivision, see fractal_mariani_worker.
+  fractal_algorithm_mariani = 1,
+};
+
+enum fractal_precision {
+  fractal_precision_auto = 0,
+  fractal_precision_double = 1,
+  // Unevaluated sums of two doubles, about 106 bits of mantissa.
+  fractal_precision_double_double = 2,
+  // Twice the lanes of double for views wide enough not to need more.
+  fractal_precision_float = 3,
+  // x87 extended precision, 64 bits of mantissa. Scalar only.
+  fractal_precision_long_double = 4,
+  // Q7.56 fixed point in int64, reproducible bit for bit on any compiler.
+  // About as fine as double near |z| = 2, only for views within [-4, 4].
+  fractal_precision_fixed = 5,
+};
+
+// The map iterated from z = the pixel. Everything but the plain Mandelbrot
+// set, c = the pixel without ctx->julia, only runs in double.
+enum fractal_formula {
+  // z^2 + c
+  fractal_formula_mandlebrot = 0,
+  // z^n + c, n = ctx->power
+  fractal_formula_multibrot = 1,
+  // (|Re z| + i|Im z|)^2 + c
+  fractal_formula_burning_ship = 2,
+  // conj(z)^2 + c
+  fractal_formula_tricorn = 3,
+  // |Re z^2| + i Im z^2 + c
+  fractal_formula_celtic = 4,
+};
+
+// Multibrot powers get a kernel each, from 3 up to this.
+#define FRACTAL_MAX_POWER 8
+
+// Pixels narrower than this fraction of the view's coordinates are past what
+// double-double resolves with bits to spare.
+#define FRACTAL_DOUBLE_DOUBLE_RESOLUTION 0x1p-90
+
+enum fractal_perturbation {
+  fractal_perturbation_auto = 0,
+  fractal_perturbation_off = 1,
+  fractal_perturbation_on = 2,
+};
+
+struct fractal_ctx;
+struct fractal_perturb;
+struct fractal_escalate;
+struct fractal_lyapunov;
+struct fractal_newton;
+
+// Computes every pixel of rect, writing one byte per pixel to ctx->buffer.
+typedef void (*fractal_kernel_fn_t)(struct fractal_ctx* ctx,
+                                    wq_rect_t const* rect);
+
+// Counters shared by all workers, each kernel flushes them once per rect.
+struct fractal_stats {
+  // Lane iterations spent on pixels that were still iterating.
+  _Atomic(uint64_t) lane_iterations;
+  // Lane iterations issued, including masked off or idle lanes.
+  _Atomic(uint64_t) lane_slots;
+  // Pixels classified as inside the main cardioid or period-2 bulb without
+  // iterating.
+  _Atomic(uint64_t) interior_pixels;
+  // Pixels whose orbit was caught cycling before max.
+  _Atomic(uint64_t) periodic_pixels;
+  // Pixels filled in from a uniform Mariani-Silver border.
+  _Atomic(uint64_t) filled_pixels;
+  // Pixels rendered by the float-first kernels, and those of them the float
+  // pass left to double.
+  _Atomic(uint64_t) float_first_pixels;
+  _Atomic(uint64_t) fallback_pixels;
+};
+
 struct fractal_ctx {
   uint32_t width;
   uint32_t height;
   uint32_t max_iteration;
+  // Per tile iteration budgets, at most max_iteration, budget_columns tiles
+  // of budget_tile x budget_tile pixels to a row. Pixels still iterating at
+  // their tile's budget count as never escaping, the rest are shaded against
+  // max_iteration. Every rect must lie within one tile. NULL to run every
+  // pixel up to max_iteration.
+  uint32_t const* budgets;
+  uint32_t budget_tile;
+  uint32_t budget_columns;
   double fwidth;
   double fheight;
   double ftop;
   double fleft;
+  // What fleft and ftop lost to rounding, for the double-double kernels.
+  double fleft_lo;
+  double ftop_lo;
   void* buffer;
+  enum fractal_formula formula;
+  uint32_t power;
+  // Iterate with c = julia_c instead of the pixel, rendering a Julia set.
+  bool julia;
+  double julia_c[2];
+  // Kernels compute rect->w pixels per row this many columns apart, starting
+  // at rect->x. 0 counts as 1. Set it above 1 before selecting the kernel to
+  // get one that supports steps, after that it may change between renders.
+  uint32_t column_step;
+  enum fractal_kernel kernel;
+  // Refill each vector lane with the next pixel of the rect as soon as its
+  // current pixel finishes, instead of waiting for the whole vector.
+  bool lane_refill;
+  // Skip iterating pixels inside the main cardioid and period-2 bulb. Only
+  // applies to the Mandelbrot set.
+  bool interior_check;
+  // Detect orbits settling onto an attracting cycle and stop iterating them.
+  // fractal_periodicity_auto is resolved to on or off per render.
+  enum fractal_periodicity periodicity;
+  bool periodicity_auto;
+  double periodicity_epssq;
+  // The arithmetic pixels are iterated in. fractal_precision_auto is resolved
+  // from the pixel size.
+  enum fractal_precision precision;
+  bool precision_auto;
+  // With double precision and a vector kernel, iterate every pixel in float
+  // first and only redo in double those float can't be trusted with. The
+  // image is identical to a double render.
+  bool float_first;
+  // Check for escape only every few iterations, replaying the last block
+  // when one fires. Only applies to double precision without lane refill.
+  bool unroll;
+  // Iterate pixels as offsets from high precision reference orbits for zooms
+  // past double precision, see perturb.h.
+  enum fractal_perturbation perturbation;
+  bool perturbation_auto;
+  struct fractal_perturb* perturb;
+  // Iterate against rising budgets, carrying on only with the pixels that
+  // hit the last one, see escalate.h.
+  struct fractal_escalate* escalate;
+  // Render the Lyapunov fractal of this sequence instead, the view's x and y
+  // being the logistic map's a and b, see lyapunov.h.
+  struct fractal_lyapunov const* lyapunov;
+  // Render the basins of Newton's method for this polynomial instead, see
+  // newton.h.
+  struct fractal_newton const* newton;
+  fractal_kernel_fn_t kernel_fn;
+  // The wq running fractal_mariani_worker, sub-rects are pushed onto it.
+  wq_t wq;
+  struct fractal_stats stats;
 };
 
-void fractal_worker(void** pixels, unsigned n, struct fractal_ctx* ctx);
+// Points inside the main cardioid or the period-2 bulb never escape, so they
+// can be classified without iterating. The cardioid test is
+//   q(q + x - 1/4) < y^2 / 4, where q = (x - 1/4)^2 + y^2
+// and the bulb is the disc of radius 1/4 around -1.
+static inline bool mandlebrot_in_main_bulbs(double x, double y) {
+  const double xq = x - 0.25;
+  const double ysq = y * y;
+  const double q = xq * xq + ysq;
+  const double xb = x + 1.0;
+  return q * (q + xq) < 0.25 * ysq || xb * xb + ysq < 0.0625;
+}
+
+// Periodicity checks compare z against an orbit point saved at iteration
+// FRACTAL_PERIOD_FIRST_CHECK, re-saving it whenever the iteration count
+// reaches double the last save (Brent's cycle detection). An orbit that comes
+// back within the tolerance has settled onto an attracting cycle and won't
+// escape.
+#define FRACTAL_PERIOD_FIRST_CHECK 8
+
+// Whether ctx iterates the plain Mandelbrot set, which every precision,
+// perturbation and interior check support.
+static inline bool fractal_ctx_is_mandlebrot(struct fractal_ctx const* ctx) {
+  return ctx->formula == fractal_formula_mandlebrot && !ctx->julia;
+}
+
+// Rows within this fraction of a row of a whole or half row from y = 0 are
+// snapped to it, see fractal_ctx_axis_row.
+#define FRACTAL_AXIS_SNAP 1e-6
+
+// The whole or half row at which y = 0, or NAN if the real axis is out of
+// view or doesn't fall within FRACTAL_AXIS_SNAP of one. Rows of views with an
+// axis row are measured from it, so the rows at the same distance above and
+// below it get exactly negated y by construction, and render as mirror
+// images.
+static inline double fractal_ctx_axis_row(struct fractal_ctx const* ctx) {
+  if (ctx->ftop >= 0.0 || ctx->ftop + ctx->fheight <= 0.0) {
+    return NAN;
+  }
+  const double axis = -ctx->ftop * (double)ctx->height / ctx->fheight;
+  const double half = nearbyint(2.0 * axis) / 2.0;
+  return fabs(axis - half) < FRACTAL_AXIS_SNAP ? half : NAN;
+}
+
+// The y of row in double, which every kernel iterating in double uses. Probes
+// pass fractional rows.
+static inline double fractal_ctx_row_y(struct fractal_ctx const* ctx,
+                                       double row) {
+  const double axis = fractal_ctx_axis_row(ctx);
+  if (!isnan(axis)) {
+    return ctx->fheight * (row - axis) / (double)ctx->height;
+  }
+  return ctx->fheight * row / (double)ctx->height + ctx->ftop;
+}
+
+bool fractal_kernel_is_supported(enum fractal_kernel kernel);
+
+const char* fractal_kernel_name(enum fractal_kernel kernel);
+
+const char* fractal_periodicity_name(enum fractal_periodicity periodicity);
+
+const char* fractal_precision_name(enum fractal_precision precision);
+
+const char* fractal_formula_name(enum fractal_formula formula);
+
+// Sets fleft, ftop and their low parts from a center given as decimal
+// strings. fwidth and fheight must already be set.
+const char* fractal_ctx_set_center(struct fractal_ctx* ctx,
+                                   const char* const center[2]);
+
+// The mantissa bits needed to tell neighbouring pixels apart anywhere in view,
+// plus guard bits for the rounding error that piles up over max_iteration
+// iterations.
+unsigned fractal_ctx_precision_bits(struct fractal_ctx const* ctx);
+
+// Whether pixels are narrower than resolution times the largest coordinate
+// in view.
+bool fractal_ctx_pixels_below(struct fractal_ctx const* ctx,
+                              double resolution);
+
+// Picks ctx->kernel_fn based on ctx->kernel, ctx->lane_refill,
+// ctx->periodicity and ctx->precision, resolving fractal_kernel_auto to the
+// widest kernel the running CPU supports, fractal_precision_auto to the
+// narrowest type with fractal_ctx_precision_bits of mantissa and
+// fractal_periodicity_auto by probing the view. Float, fixed point and
+// double-double kernels don't have a lane refill variant, and long double
+// always runs on the scalar kernel. Only the scalar and lane refill kernels
+// take column steps, so ctx->column_step above 1 picks one of those. Formulas
+// other than the Mandelbrot set get the scalar or plain vector kernel
+// specialized for them, in double precision.
+// ctx->float_first and ctx->unroll are cleared if they don't apply, the
+// former also with ctx->budgets. Returns an error if the requested kernel
+// can't run on this CPU or the view is out of fixed point's range. With
+// ctx->perturb set the scalar perturbation kernel is always used, with
+// ctx->escalate the escalation kernel in double precision, which carries
+// orbits on with ctx->kernel. With ctx->lyapunov or ctx->newton that
+// fractal's kernel for ctx->kernel is used, in double.
+const char* fractal_ctx_select_kernel(struct fractal_ctx* ctx);
+
+void fractal_worker(wq_rect_t const* rect, struct fractal_ctx* ctx);
+
+// Iterates the point at column, row in pixels, which may be fractional, up
+// to max in ctx->precision with periodicity checks, returning how many
+// iterations it took to escape, or max if it never does. The kernel must
+// already be selected.
+uint32_t fractal_ctx_probe(struct fractal_ctx const* ctx, double column,
+                           double row, uint32_t max);
+
+// Roughly how many iterations the selected kernel spends on the point at
+// column, row in pixels: none for points the interior check catches, up to
+// ctx->max_iteration otherwise, cut short by periodicity checks if enabled.
+uint32_t fractal_ctx_probe_cost(struct fractal_ctx const* ctx, double column,
+                                double row);
+
+// Finds rows that are mirror images of rows above them, the set being
+// symmetric about the real axis. Julia sets are symmetric about the origin
+// instead, so their rows are rotated copies, for the columns that pair up
+// about x = 0 exactly as well. The Burning Ship set and odd Multibrot Julia
+// sets have neither symmetry, nor do Lyapunov and Newton fractals. Rows only
+// mirror in views with an axis row, see fractal_ctx_axis_row, every row whose
+// partner about it is in view then having exactly the negated y in any
+// precision, so copying it gives the same image bit for bit. Those rows are
+// the ones below the axis row whose partner is in view, all in one range.
+// Sets source[row] to the row to copy from, or to row if it has to be
+// computed, and returns how many rows can be copied. The kernel must already
+// be selected.
+uint32_t fractal_ctx_mirror_rows(struct fractal_ctx const* ctx,
+                                 uint32_t* source);
+
+// Fills in every row of ctx->buffer whose source isn't itself. Julia rows
+// are copied reversed, and the columns without an exact partner in view are
+// computed with fractal_worker.
+void fractal_ctx_copy_mirrored_rows(struct fractal_ctx* ctx,
+                                    uint32_t const* source);
+
+// Computes the border of rect, each pixel once, keeping its iteration counts
+// aside. If every border pixel took the same number of iterations, or
+// provably never escapes, the interior is filled with the border's value
+// without iterating, otherwise the interior is split into quadrants which are
+// pushed onto ctx->wq. Rects too thin to split go to ctx->kernel_fn.
+void fractal_mariani_worker(wq_rect_t const* rect, struct fractal_ctx* ctx);
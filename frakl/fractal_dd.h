@@ -0,0 +1,124 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+// Template for double-double arithmetic, an unevaluated sum hi + lo of two
+// doubles giving about 106 bits of mantissa. Included once for scalars and
+// once per vector ISA after defining:
+//   FRACTAL_DD_SUFFIX    suffix of the generated type and functions
+//   FRACTAL_DD_T         double or a vector of doubles
+//   FRACTAL_DD_ATTRS     function attributes
+//   FRACTAL_DD_FMA(a, b, c)  fused a * b + c, leave undefined to fall back to
+//                            Dekker's split
+//
+// Everything is built on error-free transforms: two_sum and two_prod return
+// both the rounded result and the exact rounding error.
+
+#define FRACTAL_DD_CONCAT_(a, b) a##_##b
+#define FRACTAL_DD_CONCAT(a, b) FRACTAL_DD_CONCAT_(a, b)
+#define FRACTAL_DD_FN(name) FRACTAL_DD_CONCAT(name, FRACTAL_DD_SUFFIX)
+
+typedef struct FRACTAL_DD_FN(dd) {
+  FRACTAL_DD_T hi;
+  FRACTAL_DD_T lo;
+} FRACTAL_DD_FN(dd);
+
+FRACTAL_DD_ATTRS FRACTAL_DD_FN(dd)
+    FRACTAL_DD_FN(dd_two_sum)(FRACTAL_DD_T a, FRACTAL_DD_T b) {
+  const FRACTAL_DD_T s = a + b;
+  const FRACTAL_DD_T bb = s - a;
+  return (FRACTAL_DD_FN(dd)){s, (a - (s - bb)) + (b - bb)};
+}
+
+// Only exact when |a| >= |b|.
+FRACTAL_DD_ATTRS FRACTAL_DD_FN(dd)
+    FRACTAL_DD_FN(dd_quick_two_sum)(FRACTAL_DD_T a, FRACTAL_DD_T b) {
+  const FRACTAL_DD_T s = a + b;
+  return (FRACTAL_DD_FN(dd)){s, b - (s - a)};
+}
+
+FRACTAL_DD_ATTRS FRACTAL_DD_FN(dd)
+    FRACTAL_DD_FN(dd_two_prod)(FRACTAL_DD_T a, FRACTAL_DD_T b) {
+  const FRACTAL_DD_T p = a * b;
+#ifdef FRACTAL_DD_FMA
+  return (FRACTAL_DD_FN(dd)){p, FRACTAL_DD_FMA(a, b, -p)};
+#else
+  // Split each factor into 26 bit halves whose products are all exact.
+  const FRACTAL_DD_T split = (FRACTAL_DD_T){0} + 134217729.0;
+  const FRACTAL_DD_T at = split * a;
+  const FRACTAL_DD_T ahi = at - (at - a);
+  const FRACTAL_DD_T alo = a - ahi;
+  const FRACTAL_DD_T bt = split * b;
+  const FRACTAL_DD_T bhi = bt - (bt - b);
+  const FRACTAL_DD_T blo = b - bhi;
+  return (FRACTAL_DD_FN(dd)){
+      p, ((ahi * bhi - p) + ahi * blo + alo * bhi) + alo * blo};
+#endif
+}
+
+FRACTAL_DD_ATTRS FRACTAL_DD_FN(dd)
+    FRACTAL_DD_FN(dd_add)(FRACTAL_DD_FN(dd) a, FRACTAL_DD_FN(dd) b) {
+  FRACTAL_DD_FN(dd) s = FRACTAL_DD_FN(dd_two_sum)(a.hi, b.hi);
+  const FRACTAL_DD_FN(dd) t = FRACTAL_DD_FN(dd_two_sum)(a.lo, b.lo);
+  s = FRACTAL_DD_FN(dd_quick_two_sum)(s.hi, s.lo + t.hi);
+  return FRACTAL_DD_FN(dd_quick_two_sum)(s.hi, s.lo + t.lo);
+}
+
+FRACTAL_DD_ATTRS FRACTAL_DD_FN(dd)
+    FRACTAL_DD_FN(dd_sub)(FRACTAL_DD_FN(dd) a, FRACTAL_DD_FN(dd) b) {
+  return FRACTAL_DD_FN(dd_add)(a, (FRACTAL_DD_FN(dd)){-b.hi, -b.lo});
+}
+
+FRACTAL_DD_ATTRS FRACTAL_DD_FN(dd)
+    FRACTAL_DD_FN(dd_add_d)(FRACTAL_DD_FN(dd) a, FRACTAL_DD_T b) {
+  const FRACTAL_DD_FN(dd) s = FRACTAL_DD_FN(dd_two_sum)(a.hi, b);
+  return FRACTAL_DD_FN(dd_quick_two_sum)(s.hi, s.lo + a.lo);
+}
+
+FRACTAL_DD_ATTRS FRACTAL_DD_FN(dd)
+    FRACTAL_DD_FN(dd_mul)(FRACTAL_DD_FN(dd) a, FRACTAL_DD_FN(dd) b) {
+  const FRACTAL_DD_FN(dd) p = FRACTAL_DD_FN(dd_two_prod)(a.hi, b.hi);
+  return FRACTAL_DD_FN(dd_quick_two_sum)(
+      p.hi, p.lo + (a.hi * b.lo + a.lo * b.hi));
+}
+
+FRACTAL_DD_ATTRS FRACTAL_DD_FN(dd) FRACTAL_DD_FN(dd_sqr)(FRACTAL_DD_FN(dd) a) {
+  const FRACTAL_DD_FN(dd) p = FRACTAL_DD_FN(dd_two_prod)(a.hi, a.hi);
+  return FRACTAL_DD_FN(dd_quick_two_sum)(p.hi, p.lo + 2.0 * a.hi * a.lo);
+}
+
+// Scaling by a power of two is exact.
+FRACTAL_DD_ATTRS FRACTAL_DD_FN(dd)
+    FRACTAL_DD_FN(dd_scale)(FRACTAL_DD_FN(dd) a, double pow2) {
+  return (FRACTAL_DD_FN(dd)){a.hi * pow2, a.lo * pow2};
+}
+
+// The sign of the mandlebrot_in_main_bulbs expressions, evaluated in full
+// precision since pixels can be far closer to the boundary than a double
+// resolves. Returns the two expressions, each negative inside.
+FRACTAL_DD_ATTRS void FRACTAL_DD_FN(dd_main_bulbs)(FRACTAL_DD_FN(dd) x,
+                                                   FRACTAL_DD_FN(dd) y,
+                                                   FRACTAL_DD_T* cardioid,
+                                                   FRACTAL_DD_T* bulb) {
+  const FRACTAL_DD_FN(dd) ysq = FRACTAL_DD_FN(dd_sqr)(y);
+  const FRACTAL_DD_FN(dd) xq =
+      FRACTAL_DD_FN(dd_add_d)(x, (FRACTAL_DD_T){0} - 0.25);
+  const FRACTAL_DD_FN(dd) q =
+      FRACTAL_DD_FN(dd_add)(FRACTAL_DD_FN(dd_sqr)(xq), ysq);
+  *cardioid = FRACTAL_DD_FN(dd_sub)(
+                  FRACTAL_DD_FN(dd_mul)(q, FRACTAL_DD_FN(dd_add)(q, xq)),
+                  FRACTAL_DD_FN(dd_scale)(ysq, 0.25))
+                  .hi;
+  const FRACTAL_DD_FN(dd) xb =
+      FRACTAL_DD_FN(dd_add_d)(x, (FRACTAL_DD_T){0} + 1.0);
+  *bulb = FRACTAL_DD_FN(dd_add_d)(
+              FRACTAL_DD_FN(dd_add)(FRACTAL_DD_FN(dd_sqr)(xb), ysq),
+              (FRACTAL_DD_T){0} - 0.0625)
+              .hi;
+}
+
+#undef FRACTAL_DD_FN
+#undef FRACTAL_DD_CONCAT
+#undef FRACTAL_DD_CONCAT_
+#undef FRACTAL_DD_SUFFIX
+#undef FRACTAL_DD_T
+#undef FRACTAL_DD_ATTRS
+#undef FRACTAL_DD_FMA
@@ -0,0 +1,81 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+// Template for one iteration of the escape-time formulas, see
+// enum fractal_formula. Included once for scalars and once per vector ISA
+// after defining:
+//   FRACTAL_FORMULA_SUFFIX  suffix of the generated functions
+//   FRACTAL_FORMULA_T       double or a vector of doubles
+//   FRACTAL_FORMULA_ATTRS   function attributes
+//   FRACTAL_FORMULA_ABS(v)  v with its sign cleared
+//
+// Kernels pass the formula and power as constants, so each one only keeps
+// its own formula's arithmetic in its loop. Every instantiation does the same
+// operations in the same order, so scalar and vector kernels match.
+
+#define FRACTAL_FORMULA_CONCAT_(a, b) a##_##b
+#define FRACTAL_FORMULA_CONCAT(a, b) FRACTAL_FORMULA_CONCAT_(a, b)
+#define FRACTAL_FORMULA_FN(name) \
+  FRACTAL_FORMULA_CONCAT(name, FRACTAL_FORMULA_SUFFIX)
+
+// z^power by squaring, from the highest bit of power down.
+FRACTAL_FORMULA_ATTRS void FRACTAL_FORMULA_FN(formula_pow)(
+    FRACTAL_FORMULA_T* zx, FRACTAL_FORMULA_T* zy, const uint32_t power) {
+  const FRACTAL_FORMULA_T bx = *zx;
+  const FRACTAL_FORMULA_T by = *zy;
+  FRACTAL_FORMULA_T rx = bx;
+  FRACTAL_FORMULA_T ry = by;
+  FRACTAL_FORMULA_T tmp;
+  for (int bit = 30 - __builtin_clz(power); bit >= 0; bit--) {
+    tmp = rx * rx - ry * ry;
+    ry = 2.0 * rx * ry;
+    rx = tmp;
+    if (power & (1u << bit)) {
+      tmp = rx * bx - ry * by;
+      ry = rx * by + ry * bx;
+      rx = tmp;
+    }
+  }
+  *zx = rx;
+  *zy = ry;
+}
+
+// z <- f(z) + c. The quadratic formulas square the same way as
+// mandlebrot_iterate.
+FRACTAL_FORMULA_ATTRS void FRACTAL_FORMULA_FN(formula_step)(
+    FRACTAL_FORMULA_T* zx, FRACTAL_FORMULA_T* zy, FRACTAL_FORMULA_T cx,
+    FRACTAL_FORMULA_T cy, const enum fractal_formula formula,
+    const uint32_t power) {
+  FRACTAL_FORMULA_T x = *zx;
+  FRACTAL_FORMULA_T y = *zy;
+  FRACTAL_FORMULA_T tmp;
+  switch (formula) {
+    case fractal_formula_multibrot:
+      FRACTAL_FORMULA_FN(formula_pow)(&x, &y, power);
+      *zx = x + cx;
+      *zy = y + cy;
+      return;
+    case fractal_formula_burning_ship:
+      x = FRACTAL_FORMULA_ABS(x);
+      y = FRACTAL_FORMULA_ABS(y);
+      break;
+    case fractal_formula_tricorn:
+      y = -y;
+      break;
+    default:
+      break;
+  }
+  tmp = x * x - y * y;
+  if (formula == fractal_formula_celtic) {
+    tmp = FRACTAL_FORMULA_ABS(tmp);
+  }
+  *zy = 2.0 * x * y + cy;
+  *zx = tmp + cx;
+}
+
+#undef FRACTAL_FORMULA_FN
+#undef FRACTAL_FORMULA_CONCAT
+#undef FRACTAL_FORMULA_CONCAT_
+#undef FRACTAL_FORMULA_SUFFIX
+#undef FRACTAL_FORMULA_T
+#undef FRACTAL_FORMULA_ATTRS
+#undef FRACTAL_FORMULA_ABS
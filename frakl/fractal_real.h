@@ -0,0 +1,139 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+// Template for the scalar escape-time kernel in floating point types other
+// than double. fractal.c includes this once per type after defining:
+//   FRACTAL_REAL_T       the floating point type, e.g. float
+//   FRACTAL_REAL_SUFFIX  suffix of the generated functions, e.g. float
+//   FRACTAL_REAL_COORD(base, base_lo, span, i, n)
+//                        the coordinate of pixel i of n across a view
+//                        starting at base + base_lo and span wide
+//
+// The generated functions mirror mandlebrot_in_main_bulbs,
+// mandlebrot_iterate and mandlebrot_scalar.
+
+#define FRACTAL_REAL_CONCAT_(a, b) a##_##b
+#define FRACTAL_REAL_CONCAT(a, b) FRACTAL_REAL_CONCAT_(a, b)
+#define FRACTAL_REAL_FN(name) FRACTAL_REAL_CONCAT(name, FRACTAL_REAL_SUFFIX)
+
+static inline bool FRACTAL_REAL_FN(mandlebrot_in_main_bulbs)(
+    FRACTAL_REAL_T x, FRACTAL_REAL_T y) {
+  const FRACTAL_REAL_T xq = x - (FRACTAL_REAL_T)0.25;
+  const FRACTAL_REAL_T ysq = y * y;
+  const FRACTAL_REAL_T q = xq * xq + ysq;
+  const FRACTAL_REAL_T xb = x + (FRACTAL_REAL_T)1.0;
+  return q * (q + xq) < (FRACTAL_REAL_T)0.25 * ysq ||
+         xb * xb + ysq < (FRACTAL_REAL_T)0.0625;
+}
+
+__attribute__((always_inline)) static inline uint32_t FRACTAL_REAL_FN(
+    mandlebrot_iterate)(FRACTAL_REAL_T x, FRACTAL_REAL_T y, uint32_t max,
+                        const bool periodicity, FRACTAL_REAL_T epssq,
+                        bool* periodic) {
+  FRACTAL_REAL_T zx = x;
+  FRACTAL_REAL_T zy = y;
+  FRACTAL_REAL_T tmp;
+  FRACTAL_REAL_T magsq = zx * zx + zy * zy;
+  FRACTAL_REAL_T sx = zx;
+  FRACTAL_REAL_T sy = zy;
+  FRACTAL_REAL_T dx;
+  FRACTAL_REAL_T dy;
+  uint64_t check = FRACTAL_PERIOD_FIRST_CHECK;
+  uint32_t result = 0;
+
+  *periodic = false;
+  while (magsq <= 4 && result != max) {
+    tmp = zx * zx - zy * zy + x;
+    zy = 2 * zx * zy + y;
+    zx = tmp;
+    magsq = zx * zx + zy * zy;
+    result += 1;
+    if (periodicity) {
+      dx = zx - sx;
+      dy = zy - sy;
+      if (magsq <= 4 && dx * dx + dy * dy < epssq) {
+        *periodic = true;
+        break;
+      }
+      if (result == check) {
+        sx = zx;
+        sy = zy;
+        check *= 2;
+      }
+    }
+  }
+  return result;
+}
+
+static inline FRACTAL_REAL_T FRACTAL_REAL_FN(fractal_column_x)(
+    struct fractal_ctx const* ctx, double column) {
+  return FRACTAL_REAL_COORD(ctx->fleft, ctx->fleft_lo, ctx->fwidth, column,
+                            ctx->width);
+}
+
+static inline FRACTAL_REAL_T FRACTAL_REAL_FN(fractal_row_y)(
+    struct fractal_ctx const* ctx, double row) {
+  const double axis = fractal_ctx_axis_row(ctx);
+  if (!isnan(axis)) {
+    return FRACTAL_REAL_COORD(0.0, 0.0, ctx->fheight, row - axis,
+                              ctx->height);
+  }
+  return FRACTAL_REAL_COORD(ctx->ftop, ctx->ftop_lo, ctx->fheight, row,
+                            ctx->height);
+}
+
+__attribute__((always_inline)) static inline void FRACTAL_REAL_FN(
+    mandlebrot_scalar)(struct fractal_ctx* ctx, wq_rect_t const* rect,
+                       const bool periodicity) {
+  const uint32_t width = ctx->width;
+  const uint32_t max = fractal_rect_budget(ctx, rect);
+  const uint32_t shade = ctx->max_iteration;
+  const FRACTAL_REAL_T epssq = ctx->periodicity_epssq;
+  const bool interior_check = ctx->interior_check;
+  uint64_t interior_pixels = 0;
+  uint64_t periodic_pixels = 0;
+  bool periodic;
+
+  const uint32_t column_step = ctx->column_step ?: 1;
+  const uint32_t column_end = fractal_column_end(ctx, rect);
+  const uint32_t row_end = rect->y + rect->h;
+  uint8_t* line = (uint8_t*)ctx->buffer + (uintptr_t)rect->y * width;
+  for (uint32_t row = rect->y; row != row_end; row++, line += width) {
+    const FRACTAL_REAL_T y = FRACTAL_REAL_FN(fractal_row_y)(ctx, row);
+    for (uint32_t column = rect->x; column != column_end;
+         column += column_step) {
+      const FRACTAL_REAL_T x = FRACTAL_REAL_FN(fractal_column_x)(ctx, column);
+      if (interior_check && FRACTAL_REAL_FN(mandlebrot_in_main_bulbs)(x, y)) {
+        line[column] = 255;
+        interior_pixels += 1;
+        continue;
+      }
+      const uint32_t result = FRACTAL_REAL_FN(mandlebrot_iterate)(
+          x, y, max, periodicity, epssq, &periodic);
+      if (periodic) {
+        line[column] = 255;
+        periodic_pixels += 1;
+      } else {
+        line[column] = fractal_shade(result, max, shade);
+      }
+    }
+  }
+  atomic_fetch_add(&ctx->stats.interior_pixels, interior_pixels);
+  atomic_fetch_add(&ctx->stats.periodic_pixels, periodic_pixels);
+}
+
+static void FRACTAL_REAL_CONCAT(FRACTAL_REAL_FN(mandlebrot_scalar), plain)(
+    struct fractal_ctx* ctx, wq_rect_t const* rect) {
+  FRACTAL_REAL_FN(mandlebrot_scalar)(ctx, rect, false);
+}
+
+static void FRACTAL_REAL_CONCAT(FRACTAL_REAL_FN(mandlebrot_scalar), periodic)(
+    struct fractal_ctx* ctx, wq_rect_t const* rect) {
+  FRACTAL_REAL_FN(mandlebrot_scalar)(ctx, rect, true);
+}
+
+#undef FRACTAL_REAL_FN
+#undef FRACTAL_REAL_CONCAT
+#undef FRACTAL_REAL_CONCAT_
+#undef FRACTAL_REAL_T
+#undef FRACTAL_REAL_SUFFIX
+#undef FRACTAL_REAL_COORD
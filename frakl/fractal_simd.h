@@ -0,0 +1,1415 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+// Template for the vectorized escape-time kernels. fractal.c includes this
+// once per ISA after defining:
+//   FRACTAL_SIMD_ISA    suffix of the generated kernels, e.g. avx2
+//   FRACTAL_SIMD_TARGET target attribute string, e.g. "avx2"
+//   FRACTAL_SIMD_LANES  number of doubles per vector
+//   FRACTAL_SIMD_ANY(m) non-zero if any lane of the int64 mask m is set
+//   FRACTAL_SIMD_ANY32(m) the same for the int32 mask m
+//   FRACTAL_SIMD_RSQRT32(v) estimate of 1 / sqrt of each lane of the float
+//                          vector v, within 2^-11 relative
+//   FRACTAL_SIMD_MULU32(a, b) full 64-bit products of the low 32 bits of each
+//                            lane of the uint64 vectors a and b
+//   FRACTAL_SIMD_FMA(a, b, c) optional, fused a * b + c on vectors
+//
+// Every kernel matches mandlebrot_iterate lane for lane, including the
+// periodicity checks, so all of them produce the same image.
+
+#define FRACTAL_SIMD_CONCAT_(a, b) a##_##b
+#define FRACTAL_SIMD_CONCAT(a, b) FRACTAL_SIMD_CONCAT_(a, b)
+#define FRACTAL_SIMD_FN(name) FRACTAL_SIMD_CONCAT(name, FRACTAL_SIMD_ISA)
+#define FRACTAL_SIMD_ATTRS \
+  __attribute__((target(FRACTAL_SIMD_TARGET), always_inline)) static inline
+
+typedef double FRACTAL_SIMD_FN(vd)
+    __attribute__((vector_size(FRACTAL_SIMD_LANES * 8)));
+typedef int64_t FRACTAL_SIMD_FN(vi)
+    __attribute__((vector_size(FRACTAL_SIMD_LANES * 8)));
+// Float vectors of the same width hold twice the lanes.
+typedef float FRACTAL_SIMD_FN(vf)
+    __attribute__((vector_size(FRACTAL_SIMD_LANES * 8)));
+typedef int32_t FRACTAL_SIMD_FN(vi32)
+    __attribute__((vector_size(FRACTAL_SIMD_LANES * 8)));
+typedef uint64_t FRACTAL_SIMD_FN(vu)
+    __attribute__((vector_size(FRACTAL_SIMD_LANES * 8)));
+
+#define FRACTAL_DD_SUFFIX FRACTAL_SIMD_ISA
+#define FRACTAL_DD_T FRACTAL_SIMD_FN(vd)
+#define FRACTAL_DD_ATTRS FRACTAL_SIMD_ATTRS
+#ifdef FRACTAL_SIMD_FMA
+#define FRACTAL_DD_FMA FRACTAL_SIMD_FMA
+#endif
+#include "fractal_dd.h"
+
+#define FRACTAL_FORMULA_SUFFIX FRACTAL_SIMD_ISA
+#define FRACTAL_FORMULA_T FRACTAL_SIMD_FN(vd)
+#define FRACTAL_FORMULA_ATTRS FRACTAL_SIMD_ATTRS
+#define FRACTAL_FORMULA_ABS(v) \
+  ((FRACTAL_SIMD_FN(vd))((FRACTAL_SIMD_FN(vi))(v) & INT64_MAX))
+#include "fractal_formula.h"
+
+// Iterates FRACTAL_SIMD_LANES adjacent pixels of a row together until the
+// slowest of them escapes, only checking whether any lane is still going
+// every steps iterations. Each lane's count stays exact either way since
+// escaped lanes are masked off every iteration.
+FRACTAL_SIMD_ATTRS void FRACTAL_SIMD_FN(mandlebrot_block_steps)(
+    struct fractal_ctx* ctx, wq_rect_t const* rect, const bool periodicity,
+    const uint32_t steps) {
+  typedef FRACTAL_SIMD_FN(vd) vd;
+  typedef FRACTAL_SIMD_FN(vi) vi;
+
+  const uint32_t max = fractal_rect_budget(ctx, rect);
+  const uint32_t shade = ctx->max_iteration;
+  const uint32_t n = rect->w;
+  const vd fwidth = (vd){0} + ctx->fwidth;
+  const vd fleft = (vd){0} + ctx->fleft;
+  const vd width = (vd){0} + (double)ctx->width;
+  const vd four = (vd){0} + 4.0;
+  const vd epssq = (vd){0} + ctx->periodicity_epssq;
+  const vi interior_check = (vi){0} - (int64_t)ctx->interior_check;
+  uint64_t lane_iterations = 0;
+  uint64_t lane_slots = 0;
+  uint64_t interior_pixels = 0;
+  uint64_t periodic_pixels = 0;
+
+  const uint32_t row_end = rect->y + rect->h;
+  uint8_t* out = (uint8_t*)ctx->buffer + (uintptr_t)rect->y * ctx->width;
+  for (uint32_t row = rect->y; row != row_end; row++, out += ctx->width) {
+    const double y = fractal_ctx_row_y(ctx, row);
+    const vd yv = (vd){0} + y;
+    const vd ysq = yv * yv;
+
+    for (uint32_t i = 0; i < n; i += FRACTAL_SIMD_LANES) {
+      const uint32_t column = rect->x + i;
+      const uint32_t cnt =
+          n - i < FRACTAL_SIMD_LANES ? n - i : FRACTAL_SIMD_LANES;
+      vd columns;
+      for (unsigned l = 0; l < FRACTAL_SIMD_LANES; l++) {
+        // Pad the tail by repeating the last pixel, it never runs longer.
+        columns[l] = (double)(column + (l < cnt ? l : cnt - 1));
+      }
+      const vd x = fwidth * columns / width + fleft;
+
+      // See mandlebrot_in_main_bulbs.
+      const vd xq = x - 0.25;
+      const vd q = xq * xq + ysq;
+      const vd xb = x + 1.0;
+      const vi interior = ((vi)(q * (q + xq) < 0.25 * ysq) |
+                           (vi)(xb * xb + ysq < 0.0625)) &
+                          interior_check;
+
+      vd zx = x;
+      vd zy = yv;
+      vd tmp;
+      vd magsq = zx * zx + zy * zy;
+      vd sx = zx;
+      vd sy = zy;
+      vd dx;
+      vd dy;
+      uint64_t check = FRACTAL_PERIOD_FIRST_CHECK;
+      vi result = (vi){0};
+      vi periodic = (vi){0};
+      vi active = (vi)(magsq <= four) & ~interior;
+
+      // Every lane starts together, so an active lane's count is always iter.
+      uint32_t iter = 0;
+      while (iter != max && FRACTAL_SIMD_ANY(active)) {
+        const uint32_t block = max - iter >= steps ? steps : max - iter;
+#pragma GCC unroll 8
+        for (uint32_t k = 0; k != block; k++, iter++) {
+          tmp = zx * zx - zy * zy + x;
+          zy = 2.0 * zx * zy + yv;
+          zx = tmp;
+          magsq = zx * zx + zy * zy;
+          // Active lanes are all ones, i.e. -1.
+          result -= active;
+          active &= (vi)(magsq <= four);
+          if (periodicity) {
+            dx = zx - sx;
+            dy = zy - sy;
+            const vi cycle = active & (vi)(dx * dx + dy * dy < epssq);
+            periodic |= cycle;
+            active &= ~cycle;
+            if (iter + 1 == check) {
+              sx = zx;
+              sy = zy;
+              check *= 2;
+            }
+          }
+        }
+      }
+
+      lane_slots += (uint64_t)iter * FRACTAL_SIMD_LANES;
+      for (unsigned l = 0; l < cnt; l++) {
+        lane_iterations += result[l];
+        if (interior[l]) {
+          interior_pixels += 1;
+          out[column + l] = 255;
+        } else if (periodic[l]) {
+          periodic_pixels += 1;
+          out[column + l] = 255;
+        } else {
+          out[column + l] = fractal_shade(result[l], max, shade);
+        }
+      }
+    }
+  }
+  atomic_fetch_add(&ctx->stats.lane_iterations, lane_iterations);
+  atomic_fetch_add(&ctx->stats.lane_slots, lane_slots);
+  atomic_fetch_add(&ctx->stats.interior_pixels, interior_pixels);
+  atomic_fetch_add(&ctx->stats.periodic_pixels, periodic_pixels);
+}
+
+FRACTAL_SIMD_ATTRS void FRACTAL_SIMD_FN(mandlebrot_block)(
+    struct fractal_ctx* ctx, wq_rect_t const* rect, const bool periodicity) {
+  FRACTAL_SIMD_FN(mandlebrot_block_steps)(ctx, rect, periodicity, 1);
+}
+
+// Leaves FRACTAL_UNROLL iterations between the branches on whether to go on,
+// so they don't break up the chain of multiplies.
+FRACTAL_SIMD_ATTRS void FRACTAL_SIMD_FN(mandlebrot_unrolled)(
+    struct fractal_ctx* ctx, wq_rect_t const* rect, const bool periodicity) {
+  FRACTAL_SIMD_FN(mandlebrot_block_steps)(ctx, rect, periodicity,
+                                          FRACTAL_UNROLL);
+}
+
+// mandlebrot_block in double-double, matching mandlebrot_dd_iterate.
+FRACTAL_SIMD_ATTRS void FRACTAL_SIMD_FN(mandlebrot_dd_block)(
+    struct fractal_ctx* ctx, wq_rect_t const* rect, const bool periodicity) {
+  typedef FRACTAL_SIMD_FN(vd) vd;
+  typedef FRACTAL_SIMD_FN(vi) vi;
+  typedef FRACTAL_SIMD_FN(dd) dd;
+
+  const uint32_t max = fractal_rect_budget(ctx, rect);
+  const uint32_t shade = ctx->max_iteration;
+  const uint32_t n = rect->w;
+  const vd zero = (vd){0};
+  const vd fwidth = zero + ctx->fwidth;
+  const vd width = zero + (double)ctx->width;
+  const dd fleft = {zero + ctx->fleft, zero + ctx->fleft_lo};
+  const vd four = zero + 4.0;
+  const vd epssq = zero + ctx->periodicity_epssq;
+  const vi interior_check = (vi){0} - (int64_t)ctx->interior_check;
+  uint64_t lane_iterations = 0;
+  uint64_t lane_slots = 0;
+  uint64_t interior_pixels = 0;
+  uint64_t periodic_pixels = 0;
+
+  const uint32_t row_end = rect->y + rect->h;
+  uint8_t* out = (uint8_t*)ctx->buffer + (uintptr_t)rect->y * ctx->width;
+  for (uint32_t row = rect->y; row != row_end; row++, out += ctx->width) {
+    const dd_scalar ys = fractal_dd_row_y(ctx, row);
+    const dd y = {zero + ys.hi, zero + ys.lo};
+
+    for (uint32_t i = 0; i < n; i += FRACTAL_SIMD_LANES) {
+      const uint32_t column = rect->x + i;
+      const uint32_t cnt =
+          n - i < FRACTAL_SIMD_LANES ? n - i : FRACTAL_SIMD_LANES;
+      vd columns;
+      for (unsigned l = 0; l < FRACTAL_SIMD_LANES; l++) {
+        columns[l] = (double)(column + (l < cnt ? l : cnt - 1));
+      }
+      const dd x = FRACTAL_SIMD_FN(dd_add_d)(fleft, fwidth * columns / width);
+
+      vd cardioid;
+      vd bulb;
+      FRACTAL_SIMD_FN(dd_main_bulbs)(x, y, &cardioid, &bulb);
+      const vi interior =
+          ((vi)(cardioid < 0.0) | (vi)(bulb < 0.0)) & interior_check;
+
+      dd zx = x;
+      dd zy = y;
+      dd xx;
+      dd yy;
+      vd magsq = zx.hi * zx.hi + zy.hi * zy.hi;
+      dd sx = zx;
+      dd sy = zy;
+      vd dx;
+      vd dy;
+      uint64_t check = FRACTAL_PERIOD_FIRST_CHECK;
+      vi result = (vi){0};
+      vi periodic = (vi){0};
+      vi active = (vi)(magsq <= four) & ~interior;
+
+      uint32_t iter;
+      for (iter = 0; iter != max && FRACTAL_SIMD_ANY(active); iter++) {
+        xx = FRACTAL_SIMD_FN(dd_sqr)(zx);
+        yy = FRACTAL_SIMD_FN(dd_sqr)(zy);
+        zy = FRACTAL_SIMD_FN(dd_add)(
+            FRACTAL_SIMD_FN(dd_scale)(FRACTAL_SIMD_FN(dd_mul)(zx, zy), 2.0),
+            y);
+        zx = FRACTAL_SIMD_FN(dd_add)(FRACTAL_SIMD_FN(dd_sub)(xx, yy), x);
+        magsq = zx.hi * zx.hi + zy.hi * zy.hi;
+        result -= active;
+        active &= (vi)(magsq <= four);
+        if (periodicity) {
+          dx = FRACTAL_SIMD_FN(dd_sub)(zx, sx).hi;
+          dy = FRACTAL_SIMD_FN(dd_sub)(zy, sy).hi;
+          const vi cycle = active & (vi)(dx * dx + dy * dy < epssq);
+          periodic |= cycle;
+          active &= ~cycle;
+          if (iter + 1 == check) {
+            sx = zx;
+            sy = zy;
+            check *= 2;
+          }
+        }
+      }
+
+      lane_slots += (uint64_t)iter * FRACTAL_SIMD_LANES;
+      for (unsigned l = 0; l < cnt; l++) {
+        lane_iterations += result[l];
+        if (interior[l]) {
+          interior_pixels += 1;
+          out[column + l] = 255;
+        } else if (periodic[l]) {
+          periodic_pixels += 1;
+          out[column + l] = 255;
+        } else {
+          out[column + l] = fractal_shade(result[l], max, shade);
+        }
+      }
+    }
+  }
+  atomic_fetch_add(&ctx->stats.lane_iterations, lane_iterations);
+  atomic_fetch_add(&ctx->stats.lane_slots, lane_slots);
+  atomic_fetch_add(&ctx->stats.interior_pixels, interior_pixels);
+  atomic_fetch_add(&ctx->stats.periodic_pixels, periodic_pixels);
+}
+
+// mandlebrot_block in float, matching mandlebrot_iterate_float.
+FRACTAL_SIMD_ATTRS void FRACTAL_SIMD_FN(mandlebrot_float_block)(
+    struct fractal_ctx* ctx, wq_rect_t const* rect, const bool periodicity) {
+  typedef FRACTAL_SIMD_FN(vd) vd;
+  typedef FRACTAL_SIMD_FN(vf) vf;
+  typedef FRACTAL_SIMD_FN(vi32) vi;
+  enum { lanes = 2 * FRACTAL_SIMD_LANES };
+
+  const uint32_t max = fractal_rect_budget(ctx, rect);
+  const uint32_t shade = ctx->max_iteration;
+  const uint32_t n = rect->w;
+  const vd fwidth = (vd){0} + ctx->fwidth;
+  const vd fleft = (vd){0} + ctx->fleft;
+  const vd width = (vd){0} + (double)ctx->width;
+  const vf four = (vf){0} + 4.0f;
+  const vf epssq = (vf){0} + (float)ctx->periodicity_epssq;
+  const vi interior_check = (vi){0} - (int32_t)ctx->interior_check;
+  uint64_t lane_iterations = 0;
+  uint64_t lane_slots = 0;
+  uint64_t interior_pixels = 0;
+  uint64_t periodic_pixels = 0;
+
+  const uint32_t row_end = rect->y + rect->h;
+  uint8_t* out = (uint8_t*)ctx->buffer + (uintptr_t)rect->y * ctx->width;
+  for (uint32_t row = rect->y; row != row_end; row++, out += ctx->width) {
+    const vf yv = (vf){0} + fractal_row_y_float(ctx, row);
+    const vf ysq = yv * yv;
+
+    for (uint32_t i = 0; i < n; i += lanes) {
+      const uint32_t column = rect->x + i;
+      const uint32_t cnt = n - i < lanes ? n - i : lanes;
+      // Coordinates are computed in double and rounded, as in
+      // fractal_column_x_float.
+      vf x;
+      for (unsigned h = 0; h < lanes; h += FRACTAL_SIMD_LANES) {
+        vd columns;
+        for (unsigned l = 0; l < FRACTAL_SIMD_LANES; l++) {
+          columns[l] = (double)(column + (h + l < cnt ? h + l : cnt - 1));
+        }
+        const vd xd = fwidth * columns / width + fleft;
+        for (unsigned l = 0; l < FRACTAL_SIMD_LANES; l++) {
+          x[h + l] = (float)xd[l];
+        }
+      }
+
+      const vf xq = x - 0.25f;
+      const vf q = xq * xq + ysq;
+      const vf xb = x + 1.0f;
+      const vi interior = ((vi)(q * (q + xq) < 0.25f * ysq) |
+                           (vi)(xb * xb + ysq < 0.0625f)) &
+                          interior_check;
+
+      vf zx = x;
+      vf zy = yv;
+      vf tmp;
+      vf magsq = zx * zx + zy * zy;
+      vf sx = zx;
+      vf sy = zy;
+      vf dx;
+      vf dy;
+      uint64_t check = FRACTAL_PERIOD_FIRST_CHECK;
+      vi result = (vi){0};
+      vi periodic = (vi){0};
+      vi active = (vi)(magsq <= four) & ~interior;
+
+      uint32_t iter;
+      for (iter = 0; iter != max && FRACTAL_SIMD_ANY32(active); iter++) {
+        tmp = zx * zx - zy * zy + x;
+        zy = 2.0f * zx * zy + yv;
+        zx = tmp;
+        magsq = zx * zx + zy * zy;
+        result -= active;
+        active &= (vi)(magsq <= four);
+        if (periodicity) {
+          dx = zx - sx;
+          dy = zy - sy;
+          const vi cycle = active & (vi)(dx * dx + dy * dy < epssq);
+          periodic |= cycle;
+          active &= ~cycle;
+          if (iter + 1 == check) {
+            sx = zx;
+            sy = zy;
+            check *= 2;
+          }
+        }
+      }
+
+      lane_slots += (uint64_t)iter * lanes;
+      for (unsigned l = 0; l < cnt; l++) {
+        lane_iterations += result[l];
+        if (interior[l]) {
+          interior_pixels += 1;
+          out[column + l] = 255;
+        } else if (periodic[l]) {
+          periodic_pixels += 1;
+          out[column + l] = 255;
+        } else {
+          out[column + l] = fractal_shade(result[l], max, shade);
+        }
+      }
+    }
+  }
+  atomic_fetch_add(&ctx->stats.lane_iterations, lane_iterations);
+  atomic_fetch_add(&ctx->stats.lane_slots, lane_slots);
+  atomic_fetch_add(&ctx->stats.interior_pixels, interior_pixels);
+  atomic_fetch_add(&ctx->stats.periodic_pixels, periodic_pixels);
+}
+
+struct FRACTAL_SIMD_FN(lanes) {
+  FRACTAL_SIMD_FN(vd) x;
+  FRACTAL_SIMD_FN(vd) y;
+  FRACTAL_SIMD_FN(vd) zx;
+  FRACTAL_SIMD_FN(vd) zy;
+  // Saved orbit point and the iteration the next one is saved at.
+  FRACTAL_SIMD_FN(vd) sx;
+  FRACTAL_SIMD_FN(vd) sy;
+  FRACTAL_SIMD_FN(vi) check;
+  FRACTAL_SIMD_FN(vi) result;
+  // All ones for lanes holding a pixel.
+  FRACTAL_SIMD_FN(vi) live;
+  uintptr_t offsets[FRACTAL_SIMD_LANES];
+};
+
+FRACTAL_SIMD_ATTRS void FRACTAL_SIMD_FN(refill_lane)(
+    struct fractal_ctx* ctx, struct fractal_cursor* cursor,
+    struct FRACTAL_SIMD_FN(lanes) * lanes, unsigned l) {
+  double x;
+  double y;
+  uintptr_t offset;
+  if (fractal_cursor_next(ctx, cursor, &x, &y, &offset)) {
+    lanes->x[l] = lanes->zx[l] = lanes->sx[l] = x;
+    lanes->y[l] = lanes->zy[l] = lanes->sy[l] = y;
+    lanes->check[l] = FRACTAL_PERIOD_FIRST_CHECK;
+    lanes->result[l] = 0;
+    lanes->live[l] = -1;
+    lanes->offsets[l] = offset;
+  } else {
+    lanes->x[l] = lanes->zx[l] = lanes->sx[l] = 0.0;
+    lanes->y[l] = lanes->zy[l] = lanes->sy[l] = 0.0;
+    lanes->live[l] = 0;
+  }
+}
+
+// Streams the pixels of rect through the lanes in row-major order. Whenever a
+// lane's pixel escapes or hits max it's written out and the lane picks up the
+// next pending pixel, so lanes only idle once the rect runs dry.
+FRACTAL_SIMD_ATTRS void FRACTAL_SIMD_FN(mandlebrot_refill)(
+    struct fractal_ctx* ctx, wq_rect_t const* rect, const bool periodicity) {
+  typedef FRACTAL_SIMD_FN(vd) vd;
+  typedef FRACTAL_SIMD_FN(vi) vi;
+
+  const uint32_t max = fractal_rect_budget(ctx, rect);
+  const uint32_t shade = ctx->max_iteration;
+  const vd four = (vd){0} + 4.0;
+  const vd epssq = (vd){0} + ctx->periodicity_epssq;
+  const vi maxv = (vi){0} + (int64_t)max;
+  uint8_t* const buffer = ctx->buffer;
+  uint64_t lane_iterations = 0;
+  uint64_t lane_slots = 0;
+  uint64_t periodic_pixels = 0;
+
+  struct fractal_cursor cursor;
+  fractal_cursor_init(ctx, rect, &cursor);
+  struct FRACTAL_SIMD_FN(lanes) lanes;
+  lanes.check = lanes.result = (vi){0};
+  for (unsigned l = 0; l < FRACTAL_SIMD_LANES; l++) {
+    FRACTAL_SIMD_FN(refill_lane)(ctx, &cursor, &lanes, l);
+  }
+
+  vd x = lanes.x;
+  vd y = lanes.y;
+  vd zx = lanes.zx;
+  vd zy = lanes.zy;
+  vd sx = lanes.sx;
+  vd sy = lanes.sy;
+  vd tmp;
+  vd magsq;
+  vd dx;
+  vd dy;
+  vi check = lanes.check;
+  vi result = lanes.result;
+  vi live = lanes.live;
+  vi cycle = (vi){0};
+  vi done;
+
+  while (FRACTAL_SIMD_ANY(live)) {
+    tmp = zx * zx - zy * zy + x;
+    zy = 2.0 * zx * zy + y;
+    zx = tmp;
+    magsq = zx * zx + zy * zy;
+    result -= live;
+    lane_slots += FRACTAL_SIMD_LANES;
+
+    const vi bounded = (vi)(magsq <= four);
+    done = ~bounded | (vi)(result == maxv);
+    if (periodicity) {
+      dx = zx - sx;
+      dy = zy - sy;
+      cycle = bounded & (vi)(dx * dx + dy * dy < epssq);
+      done |= cycle;
+      const vi save = (vi)(result == check);
+      sx = (vd)(((vi)zx & save) | ((vi)sx & ~save));
+      sy = (vd)(((vi)zy & save) | ((vi)sy & ~save));
+      check += check & save;
+    }
+    done &= live;
+    if (!FRACTAL_SIMD_ANY(done)) {
+      continue;
+    }
+    lanes.x = x;
+    lanes.y = y;
+    lanes.zx = zx;
+    lanes.zy = zy;
+    lanes.sx = sx;
+    lanes.sy = sy;
+    lanes.check = check;
+    lanes.result = result;
+    lanes.live = live;
+    for (unsigned l = 0; l < FRACTAL_SIMD_LANES; l++) {
+      if (!done[l]) {
+        continue;
+      }
+      lane_iterations += result[l];
+      if (periodicity && cycle[l]) {
+        periodic_pixels += 1;
+        buffer[lanes.offsets[l]] = 255;
+      } else {
+        buffer[lanes.offsets[l]] = fractal_shade(result[l], max, shade);
+      }
+      FRACTAL_SIMD_FN(refill_lane)(ctx, &cursor, &lanes, l);
+    }
+    x = lanes.x;
+    y = lanes.y;
+    zx = lanes.zx;
+    zy = lanes.zy;
+    sx = lanes.sx;
+    sy = lanes.sy;
+    check = lanes.check;
+    result = lanes.result;
+    live = lanes.live;
+  }
+  atomic_fetch_add(&ctx->stats.lane_iterations, lane_iterations);
+  atomic_fetch_add(&ctx->stats.lane_slots, lane_slots);
+  atomic_fetch_add(&ctx->stats.interior_pixels, cursor.interior_pixels);
+  atomic_fetch_add(&ctx->stats.periodic_pixels, periodic_pixels);
+}
+
+// mandlebrot_refill for the pixels fractal_escalate keeps: each lane picks up
+// a pixel's orbit where the last budget left it and hands it back once the
+// pixel escapes, cycles or hits the current budget, so the next budget can
+// carry on from there. Matches escalate_iterate lane for lane.
+FRACTAL_SIMD_ATTRS void FRACTAL_SIMD_FN(mandlebrot_escalate)(
+    struct fractal_ctx* ctx, struct fractal_escalate_pixel* pixels,
+    uintptr_t n, const bool periodicity) {
+  typedef FRACTAL_SIMD_FN(vd) vd;
+  typedef FRACTAL_SIMD_FN(vi) vi;
+
+  struct fractal_escalate const* escalate = ctx->escalate;
+  const uint32_t max = escalate->budgets[escalate->stage];
+  const uint32_t shade = ctx->max_iteration;
+  const vd four = (vd){0} + 4.0;
+  const vd epssq = (vd){0} + ctx->periodicity_epssq;
+  const vi maxv = (vi){0} + (int64_t)max;
+  uint8_t* const buffer = ctx->buffer;
+  uint64_t lane_iterations = 0;
+  uint64_t lane_slots = 0;
+  uint64_t periodic_pixels = 0;
+
+  vd x = (vd){0};
+  vd y = (vd){0};
+  vd zx = (vd){0};
+  vd zy = (vd){0};
+  vd sx = (vd){0};
+  vd sy = (vd){0};
+  vd tmp;
+  vd magsq = (vd){0};
+  vd dx;
+  vd dy;
+  vi check = (vi){0};
+  vi result = (vi){0};
+  vi live = (vi){0};
+  vi cycle = (vi){0};
+  vi done = (vi){0} - 1;
+  // The pixel each lane holds and the iteration it was picked up at.
+  struct fractal_escalate_pixel* held[FRACTAL_SIMD_LANES] = {0};
+  uint32_t start[FRACTAL_SIMD_LANES] = {0};
+  uintptr_t next = 0;
+
+  for (;;) {
+    for (unsigned l = 0; l < FRACTAL_SIMD_LANES; l++) {
+      if (!done[l]) {
+        continue;
+      }
+      struct fractal_escalate_pixel* pixel = held[l];
+      if (pixel) {
+        const bool escaped = !(magsq[l] <= 4.0);
+        pixel->zx = zx[l];
+        pixel->zy = zy[l];
+        pixel->sx = sx[l];
+        pixel->sy = sy[l];
+        pixel->check = check[l];
+        pixel->iteration = result[l];
+        pixel->done = escaped || (periodicity && cycle[l]);
+        lane_iterations += result[l] - start[l];
+        if (escaped) {
+          buffer[pixel->offset] = (255 * pixel->iteration) / shade;
+        } else {
+          buffer[pixel->offset] = 255;
+          periodic_pixels += pixel->done;
+        }
+      }
+      if (next == n) {
+        held[l] = NULL;
+        x[l] = y[l] = zx[l] = zy[l] = sx[l] = sy[l] = 0.0;
+        live[l] = 0;
+        continue;
+      }
+      pixel = held[l] = &pixels[next++];
+      x[l] = pixel->x;
+      y[l] = pixel->y;
+      zx[l] = pixel->zx;
+      zy[l] = pixel->zy;
+      sx[l] = pixel->sx;
+      sy[l] = pixel->sy;
+      check[l] = pixel->check;
+      result[l] = start[l] = pixel->iteration;
+      live[l] = -1;
+    }
+    if (!FRACTAL_SIMD_ANY(live)) {
+      break;
+    }
+
+    do {
+      tmp = zx * zx - zy * zy + x;
+      zy = 2.0 * zx * zy + y;
+      zx = tmp;
+      magsq = zx * zx + zy * zy;
+      result -= live;
+      lane_slots += FRACTAL_SIMD_LANES;
+
+      const vi bounded = (vi)(magsq <= four);
+      done = ~bounded | (vi)(result == maxv);
+      if (periodicity) {
+        dx = zx - sx;
+        dy = zy - sy;
+        cycle = bounded & (vi)(dx * dx + dy * dy < epssq);
+        done |= cycle;
+        const vi save = (vi)(result == check);
+        sx = (vd)(((vi)zx & save) | ((vi)sx & ~save));
+        sy = (vd)(((vi)zy & save) | ((vi)sy & ~save));
+        check += check & save;
+      }
+      done &= live;
+    } while (!FRACTAL_SIMD_ANY(done));
+  }
+  atomic_fetch_add(&ctx->stats.lane_iterations, lane_iterations);
+  atomic_fetch_add(&ctx->stats.lane_slots, lane_slots);
+  atomic_fetch_add(&ctx->stats.periodic_pixels, periodic_pixels);
+}
+
+// The border of rect for fractal_mariani_worker, streamed through the lanes
+// like mandlebrot_refill: the top and bottom rows, then the left and right
+// columns between them. Writes each pixel out and its count to counts in that
+// order, see mariani_pixel. Without periodicity the checks still run, only
+// noting a cycle instead of stopping there, so the byte comes from running
+// up to max like the kernel and the count from the cycle.
+FRACTAL_SIMD_ATTRS void FRACTAL_SIMD_FN(mandlebrot_mariani_border)(
+    struct fractal_ctx* ctx, wq_rect_t const* rect, uint32_t max,
+    uint32_t* counts, const bool periodicity) {
+  typedef FRACTAL_SIMD_FN(vd) vd;
+  typedef FRACTAL_SIMD_FN(vi) vi;
+
+  const uint32_t shade = ctx->max_iteration;
+  const vd four = (vd){0} + 4.0;
+  const vd epssq = (vd){0} + ctx->periodicity_epssq;
+  const vi maxv = (vi){0} + (int64_t)max;
+  uint8_t* const buffer = ctx->buffer;
+  uint64_t lane_iterations = 0;
+  uint64_t lane_slots = 0;
+  uint64_t interior_pixels = 0;
+  uint64_t periodic_pixels = 0;
+
+  vd x = (vd){0};
+  vd y = (vd){0};
+  vd zx = (vd){0};
+  vd zy = (vd){0};
+  vd sx = (vd){0};
+  vd sy = (vd){0};
+  vd tmp;
+  vd magsq = (vd){0};
+  vd dx;
+  vd dy;
+  vi check = (vi){0};
+  vi result = (vi){0};
+  vi live = (vi){0};
+  vi cycle = (vi){0};
+  // Lanes whose orbit came back around without periodicity stopping them.
+  vi cycled = (vi){0};
+  vi done = (vi){0} - 1;
+  // The index into counts and the offset of the pixel each lane holds.
+  uintptr_t held[FRACTAL_SIMD_LANES];
+  uintptr_t offsets[FRACTAL_SIMD_LANES];
+  const uintptr_t n = 2 * (uintptr_t)rect->w + 2 * (rect->h - 2);
+  uintptr_t next = 0;
+
+  for (;;) {
+    for (unsigned l = 0; l < FRACTAL_SIMD_LANES; l++) {
+      if (!done[l]) {
+        continue;
+      }
+      if (live[l]) {
+        const uintptr_t i = held[l];
+        lane_iterations += result[l];
+        if (!(magsq[l] <= 4.0)) {
+          buffer[offsets[l]] = fractal_shade(result[l], max, shade);
+          counts[i] = result[l];
+        } else if (periodicity && cycle[l]) {
+          buffer[offsets[l]] = 255;
+          counts[i] = UINT32_MAX;
+          periodic_pixels += 1;
+        } else {
+          buffer[offsets[l]] = 255;
+          counts[i] = cycled[l] ? UINT32_MAX : max;
+        }
+      }
+      live[l] = 0;
+      x[l] = y[l] = zx[l] = zy[l] = sx[l] = sy[l] = 0.0;
+      while (next != n) {
+        const uintptr_t i = next++;
+        uint32_t column;
+        uint32_t row;
+        if (i < 2 * (uintptr_t)rect->w) {
+          column = rect->x + (uint32_t)(i >> 1);
+          row = i & 1 ? rect->y + rect->h - 1 : rect->y;
+        } else {
+          const uintptr_t j = i - 2 * (uintptr_t)rect->w;
+          column = j & 1 ? rect->x + rect->w - 1 : rect->x;
+          row = rect->y + 1 + (uint32_t)(j >> 1);
+        }
+        const double px =
+            ctx->fwidth * (double)column / (double)ctx->width + ctx->fleft;
+        const double py = fractal_ctx_row_y(ctx, row);
+        const uintptr_t offset = (uintptr_t)row * ctx->width + column;
+        if (px * px + py * py > 4.0) {
+          buffer[offset] = 0;
+          counts[i] = 0;
+          continue;
+        }
+        if (ctx->interior_check && mandlebrot_in_main_bulbs(px, py)) {
+          buffer[offset] = 255;
+          counts[i] = UINT32_MAX;
+          interior_pixels += 1;
+          continue;
+        }
+        x[l] = zx[l] = sx[l] = px;
+        y[l] = zy[l] = sy[l] = py;
+        check[l] = FRACTAL_PERIOD_FIRST_CHECK;
+        result[l] = 0;
+        cycled[l] = 0;
+        live[l] = -1;
+        held[l] = i;
+        offsets[l] = offset;
+        break;
+      }
+    }
+    if (!FRACTAL_SIMD_ANY(live)) {
+      break;
+    }
+
+    do {
+      tmp = zx * zx - zy * zy + x;
+      zy = 2.0 * zx * zy + y;
+      zx = tmp;
+      magsq = zx * zx + zy * zy;
+      result -= live;
+      lane_slots += FRACTAL_SIMD_LANES;
+
+      const vi bounded = (vi)(magsq <= four);
+      done = ~bounded | (vi)(result == maxv);
+      dx = zx - sx;
+      dy = zy - sy;
+      cycle = bounded & (vi)(dx * dx + dy * dy < epssq);
+      if (periodicity) {
+        done |= cycle;
+      } else {
+        cycled |= cycle;
+      }
+      const vi save = (vi)(result == check);
+      sx = (vd)(((vi)zx & save) | ((vi)sx & ~save));
+      sy = (vd)(((vi)zy & save) | ((vi)sy & ~save));
+      check += check & save;
+      done &= live;
+    } while (!FRACTAL_SIMD_ANY(done));
+  }
+  atomic_fetch_add(&ctx->stats.lane_iterations, lane_iterations);
+  atomic_fetch_add(&ctx->stats.lane_slots, lane_slots);
+  atomic_fetch_add(&ctx->stats.interior_pixels, interior_pixels);
+  atomic_fetch_add(&ctx->stats.periodic_pixels, periodic_pixels);
+}
+
+// State of mandlebrot_float_first across a rect: its counters, the pixels the
+// float pass left to double queued up, and the lanes redoing them.
+struct FRACTAL_SIMD_FN(float_first) {
+  uint64_t lane_iterations;
+  uint64_t lane_slots;
+  uint64_t interior_pixels;
+  uint64_t periodic_pixels;
+  uint64_t fallback_pixels;
+  unsigned pending;
+  double x[FRACTAL_FLOAT_FIRST_QUEUE];
+  double y[FRACTAL_FLOAT_FIRST_QUEUE];
+  uintptr_t offsets[FRACTAL_FLOAT_FIRST_QUEUE];
+  struct FRACTAL_SIMD_FN(lanes) lanes;
+};
+
+// The float pass of mandlebrot_float_first for up to 2 * FRACTAL_SIMD_LANES
+// pixels starting at column. Alongside each orbit it keeps a bound on how far
+// the float orbit can be from the double one, and a pixel only keeps its
+// float result if every escape and periodicity comparison cleared its
+// threshold by more than that. Returns a mask of the pixels that didn't.
+FRACTAL_SIMD_ATTRS FRACTAL_SIMD_FN(vi32) FRACTAL_SIMD_FN(float_first_pass)(
+    struct fractal_ctx* ctx, struct FRACTAL_SIMD_FN(float_first) * state,
+    uint32_t column, uint32_t cnt, double y, uint8_t* out,
+    const bool periodicity) {
+  typedef FRACTAL_SIMD_FN(vd) vd;
+  typedef FRACTAL_SIMD_FN(vi) vi64;
+  typedef FRACTAL_SIMD_FN(vf) vf;
+  typedef FRACTAL_SIMD_FN(vi32) vi;
+  typedef float half __attribute__((vector_size(FRACTAL_SIMD_LANES * 4)));
+  typedef int32_t half_mask
+      __attribute__((vector_size(FRACTAL_SIMD_LANES * 4)));
+  enum { lanes = 2 * FRACTAL_SIMD_LANES };
+
+  const uint32_t max = ctx->max_iteration;
+  const vf zero = (vf){0};
+  const vf four = zero + 4.0f;
+  const vf epssq = zero + (float)ctx->periodicity_epssq;
+  const vf round = zero + FRACTAL_FLOAT_FIRST_ROUNDING;
+  const vf slack = zero + FRACTAL_FLOAT_FIRST_SLACK;
+  // 2|z| with the slack for the bound's own rounding, and its floor for when
+  // z is near 0.
+  const vf twice = zero + 2.0f * FRACTAL_FLOAT_FIRST_SLACK;
+  const vf floor = zero + FRACTAL_FLOAT_FIRST_FLOOR;
+  const vf escape_round = zero + (1.0f - FRACTAL_FLOAT_FIRST_ROUNDING);
+  const vf stay = zero + (4.0f - 4.0f * FRACTAL_FLOAT_FIRST_ROUNDING);
+  const vd yd = (vd){0} + y;
+  const vd ysq = yd * yd;
+  const vf yv = zero + (float)y;
+
+  // The interior and first escape checks are done in double, exactly as
+  // mandlebrot_block does them.
+  vf x;
+  vf dc;
+  vi interior;
+  vi active;
+  for (unsigned h = 0; h < lanes; h += FRACTAL_SIMD_LANES) {
+    vd columns;
+    for (unsigned l = 0; l < FRACTAL_SIMD_LANES; l++) {
+      columns[l] = (double)(column + (h + l < cnt ? h + l : cnt - 1));
+    }
+    const vd xd = (vd){0} + ctx->fwidth * columns / (double)ctx->width +
+                  ctx->fleft;
+    const vd xq = xd - 0.25;
+    const vd q = xq * xq + ysq;
+    const vd xb = xd + 1.0;
+    const vi64 inside = ((vi64)(q * (q + xq) < 0.25 * ysq) |
+                         (vi64)(xb * xb + ysq < 0.0625)) &
+                        ((vi64){0} - (int64_t)ctx->interior_check);
+    const vi64 bounded = (vi64)(xd * xd + ysq <= 4.0);
+    const half xh = __builtin_convertvector(xd, half);
+    const vd dcd = (vd)((vi64)(xd - __builtin_convertvector(xh, vd)) &
+                        (INT64_MAX + (vi64){0})) +
+                   fabs(y - (float)y);
+    const half dch = __builtin_convertvector(dcd, half);
+    const half_mask interior_h = __builtin_convertvector(inside, half_mask);
+    const half_mask active_h =
+        __builtin_convertvector(bounded & ~inside, half_mask);
+    memcpy((float*)&x + h, &xh, sizeof(xh));
+    memcpy((float*)&dc + h, &dch, sizeof(dch));
+    memcpy((int32_t*)&interior + h, &interior_h, sizeof(interior_h));
+    memcpy((int32_t*)&active + h, &active_h, sizeof(active_h));
+  }
+  // Active lanes have |z|^2 <= 4 and |c| <= 2 sqrt(2), so each iteration's
+  // rounding adds at most this much on top of what c's rounding does.
+  const vf step = (dc + round * 7.0f) * slack;
+
+  vf zx = x;
+  vf zy = yv;
+  vf tmp;
+  vf magsq = zx * zx + zy * zy;
+  vf bound = dc * slack;
+  // |z^2 - w^2| = |z - w| |z + w| <= bound (2|z| + bound), which is both how
+  // far apart |z|^2 can be and what squaring adds to the bound next iteration.
+  vf err =
+      (magsq * FRACTAL_SIMD_RSQRT32(magsq) * twice + floor + bound) * bound;
+  vf sx = zx;
+  vf sy = zy;
+  vf sbound = bound;
+  vf dx;
+  vf dy;
+  uint64_t check = FRACTAL_PERIOD_FIRST_CHECK;
+  vi result = (vi){0};
+  vi periodic = (vi){0};
+  vi unsure = (vi){0};
+
+  uint32_t iter;
+  for (iter = 0; iter != max && FRACTAL_SIMD_ANY32(active); iter++) {
+    bound = err + step;
+    tmp = zx * zx - zy * zy + x;
+    zy = 2.0f * zx * zy + yv;
+    zx = tmp;
+    magsq = zx * zx + zy * zy;
+    err = (magsq * FRACTAL_SIMD_RSQRT32(magsq) * twice + floor + bound) *
+          bound;
+    result -= active;
+    // Only lanes that escape or stay with all of err to spare keep their
+    // float result, NaN counts as neither.
+    const vi stays = (vi)(magsq + err <= stay);
+    const vi escapes = (vi)(magsq * escape_round > four + err);
+    unsure |= active & ~(stays | escapes);
+    active &= stays;
+    if (periodicity) {
+      dx = zx - sx;
+      dy = zy - sy;
+      const vf dist = dx * dx + dy * dy;
+      const vf dbound = bound + sbound;
+      const vf dabs = dist * FRACTAL_SIMD_RSQRT32(dist);
+      const vf dist_err =
+          (dabs * twice + floor + dbound) * dbound + round * (dist + epssq);
+      const vf dmargin = dist - epssq;
+      const vi cycle_unsure =
+          active & ~((vi)(dmargin > dist_err) | (vi)(-dmargin > dist_err));
+      unsure |= cycle_unsure;
+      active &= ~cycle_unsure;
+      const vi cycle = active & (vi)(dist < epssq);
+      periodic |= cycle;
+      active &= ~cycle;
+      if (iter + 1 == check) {
+        sx = zx;
+        sy = zy;
+        sbound = bound;
+        check *= 2;
+      }
+    }
+  }
+
+  state->lane_slots += (uint64_t)iter * lanes;
+  for (unsigned l = 0; l < cnt; l++) {
+    state->lane_iterations += result[l];
+    if (unsure[l]) {
+      continue;
+    } else if (interior[l]) {
+      state->interior_pixels += 1;
+      out[column + l] = 255;
+    } else if (periodic[l]) {
+      state->periodic_pixels += 1;
+      out[column + l] = 255;
+    } else {
+      out[column + l] = (255 * (uint32_t)result[l]) / max;
+    }
+  }
+  return unsure;
+}
+
+FRACTAL_SIMD_ATTRS void FRACTAL_SIMD_FN(float_first_load)(
+    struct FRACTAL_SIMD_FN(float_first) * state, unsigned l, unsigned i) {
+  struct FRACTAL_SIMD_FN(lanes)* const lanes = &state->lanes;
+  lanes->x[l] = lanes->zx[l] = lanes->sx[l] = state->x[i];
+  lanes->y[l] = lanes->zy[l] = lanes->sy[l] = state->y[i];
+  lanes->check[l] = FRACTAL_PERIOD_FIRST_CHECK;
+  lanes->result[l] = 0;
+  lanes->live[l] = -1;
+  lanes->offsets[l] = state->offsets[i];
+}
+
+// Streams the queued pixels through the lanes in double, matching
+// mandlebrot_refill. Unless finish is set it returns once the queue runs dry,
+// leaving the lanes mid-orbit for the next call.
+FRACTAL_SIMD_ATTRS void FRACTAL_SIMD_FN(float_first_redo)(
+    struct fractal_ctx* ctx, struct FRACTAL_SIMD_FN(float_first) * state,
+    const bool periodicity, const bool finish) {
+  typedef FRACTAL_SIMD_FN(vd) vd;
+  typedef FRACTAL_SIMD_FN(vi) vi;
+
+  const uint32_t max = ctx->max_iteration;
+  const vd four = (vd){0} + 4.0;
+  const vd epssq = (vd){0} + ctx->periodicity_epssq;
+  const vi maxv = (vi){0} + (int64_t)max;
+  uint8_t* const buffer = ctx->buffer;
+  struct FRACTAL_SIMD_FN(lanes)* const lanes = &state->lanes;
+
+  unsigned next = 0;
+  for (unsigned l = 0; l < FRACTAL_SIMD_LANES && next < state->pending; l++) {
+    if (!lanes->live[l]) {
+      FRACTAL_SIMD_FN(float_first_load)(state, l, next++);
+    }
+  }
+  state->fallback_pixels += state->pending;
+
+  vd x = lanes->x;
+  vd y = lanes->y;
+  vd zx = lanes->zx;
+  vd zy = lanes->zy;
+  vd sx = lanes->sx;
+  vd sy = lanes->sy;
+  vd tmp;
+  vd magsq;
+  vd dx;
+  vd dy;
+  vi check = lanes->check;
+  vi result = lanes->result;
+  vi live = lanes->live;
+  vi cycle = (vi){0};
+  vi done;
+
+  while (FRACTAL_SIMD_ANY(live)) {
+    tmp = zx * zx - zy * zy + x;
+    zy = 2.0 * zx * zy + y;
+    zx = tmp;
+    magsq = zx * zx + zy * zy;
+    result -= live;
+    state->lane_slots += FRACTAL_SIMD_LANES;
+
+    const vi bounded = (vi)(magsq <= four);
+    done = ~bounded | (vi)(result == maxv);
+    if (periodicity) {
+      dx = zx - sx;
+      dy = zy - sy;
+      cycle = bounded & (vi)(dx * dx + dy * dy < epssq);
+      done |= cycle;
+      const vi save = (vi)(result == check);
+      sx = (vd)(((vi)zx & save) | ((vi)sx & ~save));
+      sy = (vd)(((vi)zy & save) | ((vi)sy & ~save));
+      check += check & save;
+    }
+    done &= live;
+    if (!FRACTAL_SIMD_ANY(done)) {
+      continue;
+    }
+    lanes->x = x;
+    lanes->y = y;
+    lanes->zx = zx;
+    lanes->zy = zy;
+    lanes->sx = sx;
+    lanes->sy = sy;
+    lanes->check = check;
+    lanes->result = result;
+    lanes->live = live;
+    for (unsigned l = 0; l < FRACTAL_SIMD_LANES; l++) {
+      if (!done[l]) {
+        continue;
+      }
+      state->lane_iterations += result[l];
+      if (periodicity && cycle[l]) {
+        state->periodic_pixels += 1;
+        buffer[lanes->offsets[l]] = 255;
+      } else {
+        buffer[lanes->offsets[l]] = (255 * (uint32_t)result[l]) / max;
+      }
+      if (next < state->pending) {
+        FRACTAL_SIMD_FN(float_first_load)(state, l, next++);
+      } else {
+        lanes->x[l] = lanes->zx[l] = lanes->sx[l] = 0.0;
+        lanes->y[l] = lanes->zy[l] = lanes->sy[l] = 0.0;
+        lanes->live[l] = 0;
+      }
+    }
+    x = lanes->x;
+    y = lanes->y;
+    zx = lanes->zx;
+    zy = lanes->zy;
+    sx = lanes->sx;
+    sy = lanes->sy;
+    check = lanes->check;
+    result = lanes->result;
+    live = lanes->live;
+    if (!finish && next == state->pending) {
+      break;
+    }
+  }
+  state->pending = 0;
+}
+
+// Renders rect in float, then redoes in double just the pixels the float pass
+// couldn't vouch for, see float_first_pass. The image matches mandlebrot_block
+// exactly.
+FRACTAL_SIMD_ATTRS void FRACTAL_SIMD_FN(mandlebrot_float_first)(
+    struct fractal_ctx* ctx, wq_rect_t const* rect, const bool periodicity) {
+  enum { lanes = 2 * FRACTAL_SIMD_LANES };
+
+  const uint32_t n = rect->w;
+  struct FRACTAL_SIMD_FN(float_first) state = {0};
+  state.lanes.check = state.lanes.result = state.lanes.live =
+      (FRACTAL_SIMD_FN(vi)){0};
+
+  const uint32_t row_end = rect->y + rect->h;
+  uint8_t* out = (uint8_t*)ctx->buffer + (uintptr_t)rect->y * ctx->width;
+  for (uint32_t row = rect->y; row != row_end; row++, out += ctx->width) {
+    const double y = fractal_ctx_row_y(ctx, row);
+    for (uint32_t i = 0; i < n; i += lanes) {
+      const uint32_t column = rect->x + i;
+      const uint32_t cnt = n - i < lanes ? n - i : lanes;
+      const FRACTAL_SIMD_FN(vi32) unsure = FRACTAL_SIMD_FN(float_first_pass)(
+          ctx, &state, column, cnt, y, out, periodicity);
+      if (!FRACTAL_SIMD_ANY32(unsure)) {
+        continue;
+      }
+      for (unsigned l = 0; l < cnt; l++) {
+        if (!unsure[l]) {
+          continue;
+        }
+        state.x[state.pending] =
+            ctx->fwidth * (double)(column + l) / (double)ctx->width +
+            ctx->fleft;
+        state.y[state.pending] = y;
+        state.offsets[state.pending] = (uintptr_t)row * ctx->width + column + l;
+        if (++state.pending == FRACTAL_FLOAT_FIRST_QUEUE) {
+          FRACTAL_SIMD_FN(float_first_redo)(ctx, &state, periodicity, false);
+        }
+      }
+    }
+  }
+  FRACTAL_SIMD_FN(float_first_redo)(ctx, &state, periodicity, true);
+  atomic_fetch_add(&ctx->stats.lane_iterations, state.lane_iterations);
+  atomic_fetch_add(&ctx->stats.lane_slots, state.lane_slots);
+  atomic_fetch_add(&ctx->stats.interior_pixels, state.interior_pixels);
+  atomic_fetch_add(&ctx->stats.periodic_pixels, state.periodic_pixels);
+  atomic_fetch_add(&ctx->stats.float_first_pixels, (uint64_t)n * rect->h);
+  atomic_fetch_add(&ctx->stats.fallback_pixels, state.fallback_pixels);
+}
+
+// (a * b) >> shift for shift < 64, truncated to 64 bits just like the scalar
+// fixed point helpers' 128-bit products, pieced together from 32x32 bit
+// multiplies since no vector unit has a 64x64 bit one.
+FRACTAL_SIMD_ATTRS FRACTAL_SIMD_FN(vu)
+    FRACTAL_SIMD_FN(fixed_mul)(FRACTAL_SIMD_FN(vu) a, FRACTAL_SIMD_FN(vu) b,
+                               const unsigned shift) {
+  typedef FRACTAL_SIMD_FN(vu) vu;
+  const vu low = (vu){0} + 0xffffffffu;
+  const vu ah = a >> 32;
+  const vu bh = b >> 32;
+  const vu ll = FRACTAL_SIMD_MULU32(a, b);
+  const vu hl = FRACTAL_SIMD_MULU32(ah, b);
+  const vu lh = FRACTAL_SIMD_MULU32(a, bh);
+  const vu hh = FRACTAL_SIMD_MULU32(ah, bh);
+  const vu mid = (ll >> 32) + (hl & low) + (lh & low);
+  const vu hi = hh + (hl >> 32) + (lh >> 32) + (mid >> 32);
+  const vu lo = (mid << 32) | (ll & low);
+  return (hi << (64 - shift)) | (lo >> shift);
+}
+
+// mandlebrot_block in fixed point, matching mandlebrot_fixed_iterate. The
+// coordinates and interior check are set up per lane with the scalar helpers.
+FRACTAL_SIMD_ATTRS void FRACTAL_SIMD_FN(mandlebrot_fixed_block)(
+    struct fractal_ctx* ctx, wq_rect_t const* rect, const bool periodicity) {
+  typedef FRACTAL_SIMD_FN(vi) vi;
+  typedef FRACTAL_SIMD_FN(vu) vu;
+
+  const uint32_t max = fractal_rect_budget(ctx, rect);
+  const uint32_t shade = ctx->max_iteration;
+  const uint32_t n = rect->w;
+  const struct fractal_fixed_axis xs = fractal_fixed_axis_init(
+      ctx->fleft, ctx->fleft_lo, ctx->fwidth, ctx->width);
+  const struct fractal_fixed_axis ys = fractal_fixed_rows_init(ctx);
+  const vu four = (vu){0} + FRACTAL_FIXED_FOUR;
+  const vu one = (vu){0} + FRACTAL_FIXED_ONE;
+  const vu epssq = (vu){0} + (uint64_t)ldexp(ctx->periodicity_epssq,
+                                             FRACTAL_FIXED_FRAC_BITS);
+  const bool interior_check = ctx->interior_check;
+  uint64_t lane_iterations = 0;
+  uint64_t lane_slots = 0;
+  uint64_t interior_pixels = 0;
+  uint64_t periodic_pixels = 0;
+
+  const uint32_t row_end = rect->y + rect->h;
+  uint8_t* out = (uint8_t*)ctx->buffer + (uintptr_t)rect->y * ctx->width;
+  for (uint32_t row = rect->y; row != row_end; row++, out += ctx->width) {
+    const int64_t y = fractal_fixed_coord(&ys, row);
+    const double yd = fractal_fixed_to_double(y);
+    const vi yv = (vi){0} + y;
+
+    for (uint32_t i = 0; i < n; i += FRACTAL_SIMD_LANES) {
+      const uint32_t column = rect->x + i;
+      const uint32_t cnt =
+          n - i < FRACTAL_SIMD_LANES ? n - i : FRACTAL_SIMD_LANES;
+      vi x = (vi){0};
+      vi interior = (vi){0};
+      for (unsigned l = 0; l < FRACTAL_SIMD_LANES; l++) {
+        // Pad the tail by repeating the last pixel, it never runs longer.
+        x[l] = fractal_fixed_coord(&xs, column + (l < cnt ? l : cnt - 1));
+        interior[l] =
+            -(int64_t)(interior_check &&
+                       mandlebrot_in_main_bulbs(fractal_fixed_to_double(x[l]),
+                                                yd));
+      }
+
+      // Lanes that escaped keep iterating on garbage, which unsigned
+      // arithmetic lets wrap harmlessly.
+      vi zx = x;
+      vi zy = yv;
+      vi sign = (vi)(zx < 0);
+      vu ax = (vu)((zx ^ sign) - sign);
+      sign = (vi)(zy < 0);
+      vu ay = (vu)((zy ^ sign) - sign);
+      vu xx = FRACTAL_SIMD_FN(fixed_mul)(ax, ax, FRACTAL_FIXED_FRAC_BITS);
+      vu yy = FRACTAL_SIMD_FN(fixed_mul)(ay, ay, FRACTAL_FIXED_FRAC_BITS);
+      vu magsq = xx + yy;
+      vi sx = zx;
+      vi sy = zy;
+      uint64_t check = FRACTAL_PERIOD_FIRST_CHECK;
+      vi result = (vi){0};
+      vi periodic = (vi){0};
+      vi active = (vi)(magsq <= four) & ~interior;
+
+      uint32_t iter;
+      for (iter = 0; iter != max && FRACTAL_SIMD_ANY(active); iter++) {
+        // See fractal_fixed_twice_mul.
+        const vu xy = FRACTAL_SIMD_FN(fixed_mul)(ax, ay,
+                                                 FRACTAL_FIXED_FRAC_BITS - 1);
+        const vu xy_sign = (vu)((zx ^ zy) < 0);
+        zy = (vi)((xy ^ xy_sign) - xy_sign + (vu)yv);
+        zx = (vi)(xx - yy + (vu)x);
+        sign = (vi)(zx < 0);
+        ax = (vu)((zx ^ sign) - sign);
+        sign = (vi)(zy < 0);
+        ay = (vu)((zy ^ sign) - sign);
+        xx = FRACTAL_SIMD_FN(fixed_mul)(ax, ax, FRACTAL_FIXED_FRAC_BITS);
+        yy = FRACTAL_SIMD_FN(fixed_mul)(ay, ay, FRACTAL_FIXED_FRAC_BITS);
+        magsq = xx + yy;
+        result -= active;
+        active &= (vi)(magsq <= four);
+        if (periodicity) {
+          // See fractal_fixed_sqr_capped.
+          const vi dx = (vi)((vu)zx - (vu)sx);
+          const vi dy = (vi)((vu)zy - (vu)sy);
+          sign = (vi)(dx < 0);
+          vu adx = (vu)((dx ^ sign) - sign);
+          sign = (vi)(dy < 0);
+          vu ady = (vu)((dy ^ sign) - sign);
+          vu below = (vu)(adx < one);
+          adx = (adx & below) | (one & ~below);
+          below = (vu)(ady < one);
+          ady = (ady & below) | (one & ~below);
+          const vu dist =
+              FRACTAL_SIMD_FN(fixed_mul)(adx, adx, FRACTAL_FIXED_FRAC_BITS) +
+              FRACTAL_SIMD_FN(fixed_mul)(ady, ady, FRACTAL_FIXED_FRAC_BITS);
+          const vi cycle = active & (vi)(dist < epssq);
+          periodic |= cycle;
+          active &= ~cycle;
+          if (iter + 1 == check) {
+            sx = zx;
+            sy = zy;
+            check *= 2;
+          }
+        }
+      }
+
+      lane_slots += (uint64_t)iter * FRACTAL_SIMD_LANES;
+      for (unsigned l = 0; l < cnt; l++) {
+        lane_iterations += result[l];
+        if (interior[l]) {
+          interior_pixels += 1;
+          out[column + l] = 255;
+        } else if (periodic[l]) {
+          periodic_pixels += 1;
+          out[column + l] = 255;
+        } else {
+          out[column + l] = fractal_shade(result[l], max, shade);
+        }
+      }
+    }
+  }
+  atomic_fetch_add(&ctx->stats.lane_iterations, lane_iterations);
+  atomic_fetch_add(&ctx->stats.lane_slots, lane_slots);
+  atomic_fetch_add(&ctx->stats.interior_pixels, interior_pixels);
+  atomic_fetch_add(&ctx->stats.periodic_pixels, periodic_pixels);
+}
+
+// mandlebrot_block for any formula, matching formula_iterate. There's no
+// interior check outside the Mandelbrot set.
+FRACTAL_SIMD_ATTRS void FRACTAL_SIMD_FN(formula_block)(
+    struct fractal_ctx* ctx, wq_rect_t const* rect, const bool periodicity,
+    const enum fractal_formula formula, const uint32_t power) {
+  typedef FRACTAL_SIMD_FN(vd) vd;
+  typedef FRACTAL_SIMD_FN(vi) vi;
+
+  const uint32_t max = fractal_rect_budget(ctx, rect);
+  const uint32_t shade = ctx->max_iteration;
+  const uint32_t n = rect->w;
+  const vd fwidth = (vd){0} + ctx->fwidth;
+  const vd fleft = (vd){0} + ctx->fleft;
+  const vd width = (vd){0} + (double)ctx->width;
+  const vd four = (vd){0} + 4.0;
+  const vd epssq = (vd){0} + ctx->periodicity_epssq;
+  const bool julia = ctx->julia;
+  const vd julia_x = (vd){0} + ctx->julia_c[0];
+  const vd julia_y = (vd){0} + ctx->julia_c[1];
+  uint64_t lane_iterations = 0;
+  uint64_t lane_slots = 0;
+  uint64_t periodic_pixels = 0;
+
+  const uint32_t row_end = rect->y + rect->h;
+  uint8_t* out = (uint8_t*)ctx->buffer + (uintptr_t)rect->y * ctx->width;
+  for (uint32_t row = rect->y; row != row_end; row++, out += ctx->width) {
+    const double y = fractal_ctx_row_y(ctx, row);
+    const vd yv = (vd){0} + y;
+    const vd cy = julia ? julia_y : yv;
+
+    for (uint32_t i = 0; i < n; i += FRACTAL_SIMD_LANES) {
+      const uint32_t column = rect->x + i;
+      const uint32_t cnt =
+          n - i < FRACTAL_SIMD_LANES ? n - i : FRACTAL_SIMD_LANES;
+      vd columns;
+      for (unsigned l = 0; l < FRACTAL_SIMD_LANES; l++) {
+        columns[l] = (double)(column + (l < cnt ? l : cnt - 1));
+      }
+      const vd x = fwidth * columns / width + fleft;
+      const vd cx = julia ? julia_x : x;
+
+      vd zx = x;
+      vd zy = yv;
+      vd magsq = zx * zx + zy * zy;
+      vd sx = zx;
+      vd sy = zy;
+      vd dx;
+      vd dy;
+      uint64_t check = FRACTAL_PERIOD_FIRST_CHECK;
+      vi result = (vi){0};
+      vi periodic = (vi){0};
+      vi active = (vi)(magsq <= four);
+
+      uint32_t iter = 0;
+      for (; iter != max && FRACTAL_SIMD_ANY(active); iter++) {
+        FRACTAL_SIMD_FN(formula_step)(&zx, &zy, cx, cy, formula, power);
+        magsq = zx * zx + zy * zy;
+        result -= active;
+        active &= (vi)(magsq <= four);
+        if (periodicity) {
+          dx = zx - sx;
+          dy = zy - sy;
+          const vi cycle = active & (vi)(dx * dx + dy * dy < epssq);
+          periodic |= cycle;
+          active &= ~cycle;
+          if (iter + 1 == check) {
+            sx = zx;
+            sy = zy;
+            check *= 2;
+          }
+        }
+      }
+
+      lane_slots += (uint64_t)iter * FRACTAL_SIMD_LANES;
+      for (unsigned l = 0; l < cnt; l++) {
+        lane_iterations += result[l];
+        if (periodic[l]) {
+          periodic_pixels += 1;
+          out[column + l] = 255;
+        } else {
+          out[column + l] = fractal_shade(result[l], max, shade);
+        }
+      }
+    }
+  }
+  atomic_fetch_add(&ctx->stats.lane_iterations, lane_iterations);
+  atomic_fetch_add(&ctx->stats.lane_slots, lane_slots);
+  atomic_fetch_add(&ctx->stats.periodic_pixels, periodic_pixels);
+}
+
+FRACTAL_FORMULA_KERNELS(__attribute__((target(FRACTAL_SIMD_TARGET))),
+                        FRACTAL_SIMD_FN(formula_block))
+
+// Specializes each kernel on periodicity, e.g. mandlebrot_block_avx2_periodic.
+#define FRACTAL_SIMD_KERNEL(name, suffix, periodicity)                \
+  __attribute__((target(FRACTAL_SIMD_TARGET))) static void           \
+      FRACTAL_SIMD_CONCAT(FRACTAL_SIMD_FN(name), suffix)(            \
+          struct fractal_ctx * ctx, wq_rect_t const* rect) {         \
+    FRACTAL_SIMD_FN(name)(ctx, rect, periodicity);                    \
+  }
+
+FRACTAL_SIMD_KERNEL(mandlebrot_block, plain, false)
+FRACTAL_SIMD_KERNEL(mandlebrot_block, periodic, true)
+FRACTAL_SIMD_KERNEL(mandlebrot_unrolled, plain, false)
+FRACTAL_SIMD_KERNEL(mandlebrot_unrolled, periodic, true)
+FRACTAL_SIMD_KERNEL(mandlebrot_refill, plain, false)
+FRACTAL_SIMD_KERNEL(mandlebrot_refill, periodic, true)
+FRACTAL_SIMD_KERNEL(mandlebrot_dd_block, plain, false)
+FRACTAL_SIMD_KERNEL(mandlebrot_dd_block, periodic, true)
+FRACTAL_SIMD_KERNEL(mandlebrot_float_block, plain, false)
+FRACTAL_SIMD_KERNEL(mandlebrot_float_block, periodic, true)
+FRACTAL_SIMD_KERNEL(mandlebrot_float_first, plain, false)
+FRACTAL_SIMD_KERNEL(mandlebrot_float_first, periodic, true)
+FRACTAL_SIMD_KERNEL(mandlebrot_fixed_block, plain, false)
+FRACTAL_SIMD_KERNEL(mandlebrot_fixed_block, periodic, true)
+
+#define FRACTAL_SIMD_ESCALATE(suffix, periodicity)                       \
+  __attribute__((target(FRACTAL_SIMD_TARGET))) static void              \
+      FRACTAL_SIMD_CONCAT(FRACTAL_SIMD_FN(mandlebrot_escalate), suffix)( \
+          struct fractal_ctx * ctx, struct fractal_escalate_pixel * pixels, \
+          uintptr_t n) {                                                \
+    FRACTAL_SIMD_FN(mandlebrot_escalate)(ctx, pixels, n, periodicity);   \
+  }
+
+FRACTAL_SIMD_ESCALATE(plain, false)
+FRACTAL_SIMD_ESCALATE(periodic, true)
+
+#undef FRACTAL_SIMD_ESCALATE
+
+#define FRACTAL_SIMD_MARIANI(suffix, periodicity)                        \
+  __attribute__((target(FRACTAL_SIMD_TARGET))) static void              \
+      FRACTAL_SIMD_CONCAT(FRACTAL_SIMD_FN(mandlebrot_mariani_border),   \
+                          suffix)(struct fractal_ctx * ctx,             \
+                                  wq_rect_t const* rect, uint32_t max,  \
+                                  uint32_t* counts) {                   \
+    FRACTAL_SIMD_FN(mandlebrot_mariani_border)(ctx, rect, max, counts,  \
+                                               periodicity);            \
+  }
+
+FRACTAL_SIMD_MARIANI(plain, false)
+FRACTAL_SIMD_MARIANI(periodic, true)
+
+#undef FRACTAL_SIMD_MARIANI
+
+#undef FRACTAL_SIMD_KERNEL
+#undef FRACTAL_SIMD_ATTRS
+#undef FRACTAL_SIMD_FN
+#undef FRACTAL_SIMD_CONCAT
+#undef FRACTAL_SIMD_CONCAT_
+#undef FRACTAL_SIMD_ISA
+#undef FRACTAL_SIMD_TARGET
+#undef FRACTAL_SIMD_LANES
+#undef FRACTAL_SIMD_ANY
+#undef FRACTAL_SIMD_ANY32
+#undef FRACTAL_SIMD_RSQRT32
+#undef FRACTAL_SIMD_MULU32
+#undef FRACTAL_SIMD_FMA
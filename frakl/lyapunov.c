@@ -0,0 +1,166 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#include "lyapunov.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FRACTAL_HAS_X86 1
+#else
+#define FRACTAL_HAS_X86 0
+#endif
+
+const char* fractal_lyapunov_init(struct fractal_lyapunov* lyapunov,
+                                  const char* sequence, uint32_t iterations) {
+  const uint32_t length = (uint32_t)strlen(sequence);
+  if (!length) {
+    return "The Lyapunov sequence can't be empty";
+  }
+  for (uint32_t i = 0; i < length; i++) {
+    if (sequence[i] != 'A' && sequence[i] != 'B') {
+      return "The Lyapunov sequence may only hold A's and B's";
+    }
+  }
+  const uint32_t repeats =
+      length < FRACTAL_LYAPUNOV_BLOCK
+          ? (FRACTAL_LYAPUNOV_BLOCK + length - 1) / length
+          : 1;
+  const uint32_t round = length * repeats;
+  lyapunov->sequence = sequence;
+  lyapunov->round = round;
+  // Every step could start a run of its own.
+  lyapunov->runs = malloc(round * sizeof(*lyapunov->runs));
+  lyapunov->run_count = 0;
+  struct fractal_lyapunov_run* run = NULL;
+  for (uint32_t i = 0; i < round; i++) {
+    const bool b = sequence[i % length] == 'B';
+    if (!run || run->b != b || run->log) {
+      run = &lyapunov->runs[lyapunov->run_count++];
+      *run = (struct fractal_lyapunov_run){.b = b};
+    }
+    run->count += 1;
+    run->log = (i + 1) % FRACTAL_LYAPUNOV_BLOCK == 0 || i + 1 == round;
+  }
+  lyapunov->rounds = (iterations + round - 1) / round ?: 1;
+  lyapunov->warmup_rounds = (iterations / 4 + round - 1) / round;
+  return NULL;
+}
+
+void fractal_lyapunov_destroy(struct fractal_lyapunov* lyapunov) {
+  free(lyapunov->runs);
+  lyapunov->runs = NULL;
+}
+
+// The byte for a pixel with the exponent lambda, which is NaN if the orbit
+// left [0, 1] on the way.
+static inline uint8_t lyapunov_shade(double lambda) {
+  if (!(lambda < 0.0)) {
+    return 0;
+  }
+  const double level = -lambda / FRACTAL_LYAPUNOV_RANGE;
+  return 1 + (uint8_t)lround(254.0 * (level < 1.0 ? level : 1.0));
+}
+
+static inline int64_t lyapunov_bits(double v) {
+  int64_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  return bits;
+}
+
+static inline double lyapunov_doubles(int64_t bits) {
+  double v;
+  memcpy(&v, &bits, sizeof(v));
+  return v;
+}
+
+#define FRACTAL_LYAPUNOV_SUFFIX scalar
+#define FRACTAL_LYAPUNOV_T double
+#define FRACTAL_LYAPUNOV_I int64_t
+#define FRACTAL_LYAPUNOV_LANES 1
+#define FRACTAL_LYAPUNOV_ATTRS
+#define FRACTAL_LYAPUNOV_BITS(v) lyapunov_bits(v)
+#define FRACTAL_LYAPUNOV_DOUBLES(i) lyapunov_doubles(i)
+#define FRACTAL_LYAPUNOV_ABS(v) fabs(v)
+// The same NaN handling as minpd and maxpd.
+#define FRACTAL_LYAPUNOV_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define FRACTAL_LYAPUNOV_MAX(a, b) ((a) > (b) ? (a) : (b))
+#define FRACTAL_LYAPUNOV_SET(v, l, x) ((void)(l), (v) = (x))
+#define FRACTAL_LYAPUNOV_GET(v, l) ((void)(l), (v))
+#include "lyapunov_kernel.h"
+
+#if FRACTAL_HAS_X86
+typedef double lyapunov_vd_sse2 __attribute__((vector_size(16)));
+typedef int64_t lyapunov_vi_sse2 __attribute__((vector_size(16)));
+#define FRACTAL_LYAPUNOV_SUFFIX sse2
+#define FRACTAL_LYAPUNOV_T lyapunov_vd_sse2
+#define FRACTAL_LYAPUNOV_I lyapunov_vi_sse2
+#define FRACTAL_LYAPUNOV_LANES 2
+#define FRACTAL_LYAPUNOV_ATTRS __attribute__((target("sse2")))
+#define FRACTAL_LYAPUNOV_BITS(v) ((lyapunov_vi_sse2)(v))
+#define FRACTAL_LYAPUNOV_DOUBLES(i) ((lyapunov_vd_sse2)(i))
+#define FRACTAL_LYAPUNOV_ABS(v) \
+  ((lyapunov_vd_sse2)((lyapunov_vi_sse2)(v) & INT64_MAX))
+#define FRACTAL_LYAPUNOV_MIN(a, b) \
+  ((lyapunov_vd_sse2)_mm_min_pd((__m128d)(a), (__m128d)(b)))
+#define FRACTAL_LYAPUNOV_MAX(a, b) \
+  ((lyapunov_vd_sse2)_mm_max_pd((__m128d)(a), (__m128d)(b)))
+#define FRACTAL_LYAPUNOV_SET(v, l, x) ((v)[l] = (x))
+#define FRACTAL_LYAPUNOV_GET(v, l) ((v)[l])
+#include "lyapunov_kernel.h"
+
+typedef double lyapunov_vd_avx2 __attribute__((vector_size(32)));
+typedef int64_t lyapunov_vi_avx2 __attribute__((vector_size(32)));
+#define FRACTAL_LYAPUNOV_SUFFIX avx2
+#define FRACTAL_LYAPUNOV_T lyapunov_vd_avx2
+#define FRACTAL_LYAPUNOV_I lyapunov_vi_avx2
+#define FRACTAL_LYAPUNOV_LANES 4
+#define FRACTAL_LYAPUNOV_ATTRS __attribute__((target("avx2")))
+#define FRACTAL_LYAPUNOV_BITS(v) ((lyapunov_vi_avx2)(v))
+#define FRACTAL_LYAPUNOV_DOUBLES(i) ((lyapunov_vd_avx2)(i))
+#define FRACTAL_LYAPUNOV_ABS(v) \
+  ((lyapunov_vd_avx2)((lyapunov_vi_avx2)(v) & INT64_MAX))
+#define FRACTAL_LYAPUNOV_MIN(a, b) \
+  ((lyapunov_vd_avx2)_mm256_min_pd((__m256d)(a), (__m256d)(b)))
+#define FRACTAL_LYAPUNOV_MAX(a, b) \
+  ((lyapunov_vd_avx2)_mm256_max_pd((__m256d)(a), (__m256d)(b)))
+#define FRACTAL_LYAPUNOV_SET(v, l, x) ((v)[l] = (x))
+#define FRACTAL_LYAPUNOV_GET(v, l) ((v)[l])
+#include "lyapunov_kernel.h"
+
+typedef double lyapunov_vd_avx512 __attribute__((vector_size(64)));
+typedef int64_t lyapunov_vi_avx512 __attribute__((vector_size(64)));
+#define FRACTAL_LYAPUNOV_SUFFIX avx512
+#define FRACTAL_LYAPUNOV_T lyapunov_vd_avx512
+#define FRACTAL_LYAPUNOV_I lyapunov_vi_avx512
+#define FRACTAL_LYAPUNOV_LANES 8
+#define FRACTAL_LYAPUNOV_ATTRS __attribute__((target("avx512f")))
+#define FRACTAL_LYAPUNOV_BITS(v) ((lyapunov_vi_avx512)(v))
+#define FRACTAL_LYAPUNOV_DOUBLES(i) ((lyapunov_vd_avx512)(i))
+#define FRACTAL_LYAPUNOV_ABS(v) \
+  ((lyapunov_vd_avx512)((lyapunov_vi_avx512)(v) & INT64_MAX))
+#define FRACTAL_LYAPUNOV_MIN(a, b) \
+  ((lyapunov_vd_avx512)_mm512_min_pd((__m512d)(a), (__m512d)(b)))
+#define FRACTAL_LYAPUNOV_MAX(a, b) \
+  ((lyapunov_vd_avx512)_mm512_max_pd((__m512d)(a), (__m512d)(b)))
+#define FRACTAL_LYAPUNOV_SET(v, l, x) ((v)[l] = (x))
+#define FRACTAL_LYAPUNOV_GET(v, l) ((v)[l])
+#include "lyapunov_kernel.h"
+#endif
+
+fractal_kernel_fn_t fractal_lyapunov_kernel_fn(enum fractal_kernel kernel) {
+  switch (kernel) {
+#if FRACTAL_HAS_X86
+    case fractal_kernel_sse2:
+      return lyapunov_kernel_sse2;
+    case fractal_kernel_avx2:
+      return lyapunov_kernel_avx2;
+    case fractal_kernel_avx512:
+      return lyapunov_kernel_avx512;
+#endif
+    default:
+      return lyapunov_kernel_scalar;
+  }
+}
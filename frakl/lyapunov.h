@@ -0,0 +1,56 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#pragma once
+
+#include <stdint.h>
+
+#include "fractal.h"
+
+// Steps whose derivatives are multiplied together before taking one log of
+// the product. Each is clamped to [2^-30, 2^30], so the product stays well
+// within a double.
+#define FRACTAL_LYAPUNOV_BLOCK 32
+// Clamp bounds of each step's derivative, see FRACTAL_LYAPUNOV_BLOCK.
+#define FRACTAL_LYAPUNOV_FLOOR 0x1p-30
+#define FRACTAL_LYAPUNOV_CEIL 0x1p30
+// Exponents from this far below 0 up to 0 get a shade each, stabler pixels
+// all get the brightest.
+#define FRACTAL_LYAPUNOV_RANGE 2.0
+
+// A stretch of steps all iterating with the same r, a or b.
+struct fractal_lyapunov_run {
+  bool b;
+  uint32_t count;
+  // Take the log of the product after this run.
+  bool log;
+};
+
+// The logistic map x <- r x (1 - x) from x = 1/2, r following sequence with
+// A the pixel's x coordinate and B its y, iterated for a warm-up and then
+// for the steps its Lyapunov exponent is averaged over.
+struct fractal_lyapunov {
+  const char* sequence;
+  // One round of the sequence unrolled into runs, repeated until it's at
+  // least FRACTAL_LYAPUNOV_BLOCK steps long, with a log after every
+  // FRACTAL_LYAPUNOV_BLOCK steps and at its end.
+  struct fractal_lyapunov_run* runs;
+  uint32_t run_count;
+  uint32_t round;
+  uint32_t warmup_rounds;
+  uint32_t rounds;
+};
+
+// Unrolls sequence, a string of A's and B's, into runs and sizes the rounds
+// so the exponent is averaged over at least iterations steps after a quarter
+// as many to warm up. Returns an error if sequence is empty or has other
+// letters.
+const char* fractal_lyapunov_init(struct fractal_lyapunov* lyapunov,
+                                  const char* sequence, uint32_t iterations);
+
+void fractal_lyapunov_destroy(struct fractal_lyapunov* lyapunov);
+
+// The kernel rendering ctx->lyapunov with kernel, which must be resolved.
+// Every kernel computes the same exponents, and all of them take column
+// steps. Pixels with a negative exponent, where the orbit settles onto a
+// stable cycle, are shaded 1 to 255 by how negative it is, chaotic ones 0.
+fractal_kernel_fn_t fractal_lyapunov_kernel_fn(enum fractal_kernel kernel);
@@ -0,0 +1,150 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+// Template for the Lyapunov kernels. lyapunov.c includes this once for
+// scalars and once per vector ISA after defining:
+//   FRACTAL_LYAPUNOV_SUFFIX      suffix of the generated functions
+//   FRACTAL_LYAPUNOV_T           double or a vector of doubles
+//   FRACTAL_LYAPUNOV_I           int64_t or a vector of them as wide as T
+//   FRACTAL_LYAPUNOV_LANES       number of doubles in T
+//   FRACTAL_LYAPUNOV_ATTRS       attributes of the generated functions
+//   FRACTAL_LYAPUNOV_BITS(v)     the bits of v as an I
+//   FRACTAL_LYAPUNOV_DOUBLES(i)  the bits i as a T
+//   FRACTAL_LYAPUNOV_ABS(v)      v with its sign cleared
+//   FRACTAL_LYAPUNOV_MIN(a, b)   the smaller of a and b, lane by lane, b if
+//                                a is NaN
+//   FRACTAL_LYAPUNOV_MAX(a, b)   the larger of a and b, lane by lane, b if
+//                                a is NaN
+//   FRACTAL_LYAPUNOV_SET(v, l, x) sets lane l of v to x
+//   FRACTAL_LYAPUNOV_GET(v, l)   lane l of v
+//
+// Every pixel runs the same steps whatever its lane, so the vector kernels
+// never mask anything off, and every instantiation does the same operations
+// in the same order so they all compute the same exponents.
+
+#define FRACTAL_LYAPUNOV_CONCAT_(a, b) a##_##b
+#define FRACTAL_LYAPUNOV_CONCAT(a, b) FRACTAL_LYAPUNOV_CONCAT_(a, b)
+#define FRACTAL_LYAPUNOV_FN(name) \
+  FRACTAL_LYAPUNOV_CONCAT(name, FRACTAL_LYAPUNOV_SUFFIX)
+
+// log2 of every lane of the positive, finite v: its exponent plus the
+// series 2 atanh(t) / ln 2 with t = (m - 1) / (m + 1) for its mantissa m in
+// [1, 2), within 2^-22.
+FRACTAL_LYAPUNOV_ATTRS __attribute__((always_inline)) static inline
+    FRACTAL_LYAPUNOV_T
+    FRACTAL_LYAPUNOV_FN(lyapunov_log2)(FRACTAL_LYAPUNOV_T v) {
+  typedef FRACTAL_LYAPUNOV_T T;
+  const FRACTAL_LYAPUNOV_I bits = FRACTAL_LYAPUNOV_BITS(v);
+  // The biased exponent becomes the low bits of 2^52's mantissa.
+  const T e = FRACTAL_LYAPUNOV_DOUBLES((bits >> 52) | 0x4330000000000000) -
+              (0x1p52 + 1023.0);
+  const T m = FRACTAL_LYAPUNOV_DOUBLES((bits & 0xfffffffffffff) |
+                                       0x3ff0000000000000);
+  const T t = (m - 1.0) / (m + 1.0);
+  const T t2 = t * t;
+  return e + t * (2.0 / M_LN2 +
+                  t2 * (2.0 / (3.0 * M_LN2) +
+                        t2 * (2.0 / (5.0 * M_LN2) +
+                              t2 * (2.0 / (7.0 * M_LN2) +
+                                    t2 * (2.0 / (9.0 * M_LN2) +
+                                          t2 * (2.0 / (11.0 * M_LN2)))))));
+}
+
+FRACTAL_LYAPUNOV_ATTRS static void FRACTAL_LYAPUNOV_FN(lyapunov_kernel)(
+    struct fractal_ctx* ctx, wq_rect_t const* rect) {
+  typedef FRACTAL_LYAPUNOV_T T;
+  struct fractal_lyapunov const* lyapunov = ctx->lyapunov;
+  struct fractal_lyapunov_run const* const runs = lyapunov->runs;
+  struct fractal_lyapunov_run const* const runs_end =
+      runs + lyapunov->run_count;
+  const uint32_t step = ctx->column_step ?: 1;
+  const uint32_t n = rect->w;
+  // Turns the sum of log2's into the average natural log.
+  const double scale =
+      M_LN2 / ((double)lyapunov->rounds * (double)lyapunov->round);
+  const T low = (T){0} + FRACTAL_LYAPUNOV_FLOOR;
+  const T high = (T){0} + FRACTAL_LYAPUNOV_CEIL;
+  uint64_t lane_iterations = 0;
+  uint64_t lane_slots = 0;
+
+  const uint32_t row_end = rect->y + rect->h;
+  uint8_t* out = (uint8_t*)ctx->buffer + (uintptr_t)rect->y * ctx->width;
+  for (uint32_t row = rect->y; row != row_end; row++, out += ctx->width) {
+    const T b = (T){0} + (ctx->fheight * (double)row / (double)ctx->height +
+                          ctx->ftop);
+
+    for (uint32_t i = 0; i < n; i += FRACTAL_LYAPUNOV_LANES) {
+      const uint32_t cnt =
+          n - i < FRACTAL_LYAPUNOV_LANES ? n - i : FRACTAL_LYAPUNOV_LANES;
+      T a = (T){0};
+      for (unsigned l = 0; l < FRACTAL_LYAPUNOV_LANES; l++) {
+        // Pad the tail by repeating the last pixel.
+        const uint32_t column = rect->x + (i + (l < cnt ? l : cnt - 1)) * step;
+        FRACTAL_LYAPUNOV_SET(a, l,
+                             ctx->fwidth * (double)column /
+                                     (double)ctx->width +
+                                 ctx->fleft);
+      }
+
+      T x = (T){0} + 0.5;
+      for (uint32_t pass = 0; pass < lyapunov->warmup_rounds; pass++) {
+        for (struct fractal_lyapunov_run const* run = runs; run != runs_end;
+             run++) {
+          const T r = run->b ? b : a;
+          for (uint32_t k = 0; k < run->count; k++) {
+            x = r * x * (1.0 - x);
+          }
+        }
+      }
+
+      // The derivative of the map at x, multiplied up over a block.
+      T product = (T){0} + 1.0;
+      T sum = (T){0};
+      for (uint32_t pass = 0; pass < lyapunov->rounds; pass++) {
+        for (struct fractal_lyapunov_run const* run = runs; run != runs_end;
+             run++) {
+          const T r = run->b ? b : a;
+          for (uint32_t k = 0; k < run->count; k++) {
+            const T derivative = FRACTAL_LYAPUNOV_ABS(r * (1.0 - 2.0 * x));
+            product *= FRACTAL_LYAPUNOV_MIN(
+                FRACTAL_LYAPUNOV_MAX(derivative, low), high);
+            x = r * x * (1.0 - x);
+          }
+          if (run->log) {
+            sum += FRACTAL_LYAPUNOV_FN(lyapunov_log2)(product);
+            product = (T){0} + 1.0;
+          }
+        }
+      }
+
+      for (unsigned l = 0; l < cnt; l++) {
+        out[rect->x + (i + l) * step] =
+            lyapunov_shade(FRACTAL_LYAPUNOV_GET(sum, l) * scale);
+      }
+      lane_iterations += cnt;
+      lane_slots += FRACTAL_LYAPUNOV_LANES;
+    }
+  }
+  if (FRACTAL_LYAPUNOV_LANES > 1) {
+    const uint64_t steps = (uint64_t)(lyapunov->warmup_rounds +
+                                      lyapunov->rounds) *
+                           lyapunov->round;
+    atomic_fetch_add(&ctx->stats.lane_iterations, lane_iterations * steps);
+    atomic_fetch_add(&ctx->stats.lane_slots, lane_slots * steps);
+  }
+}
+
+#undef FRACTAL_LYAPUNOV_FN
+#undef FRACTAL_LYAPUNOV_CONCAT
+#undef FRACTAL_LYAPUNOV_CONCAT_
+#undef FRACTAL_LYAPUNOV_SUFFIX
+#undef FRACTAL_LYAPUNOV_T
+#undef FRACTAL_LYAPUNOV_I
+#undef FRACTAL_LYAPUNOV_LANES
+#undef FRACTAL_LYAPUNOV_ATTRS
+#undef FRACTAL_LYAPUNOV_BITS
+#undef FRACTAL_LYAPUNOV_DOUBLES
+#undef FRACTAL_LYAPUNOV_ABS
+#undef FRACTAL_LYAPUNOV_MIN
+#undef FRACTAL_LYAPUNOV_MAX
+#undef FRACTAL_LYAPUNOV_SET
+#undef FRACTAL_LYAPUNOV_GET
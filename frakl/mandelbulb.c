@@ -0,0 +1,382 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#include "mandelbulb.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FRACTAL_HAS_X86 1
+#else
+#define FRACTAL_HAS_X86 0
+#endif
+
+// |w|^2 past which w counts as escaped.
+#define FRACTAL_MANDELBULB_ESCAPE 256.0
+// The camera sits above and to the side of the bulb, looking down at its
+// middle, in radians.
+#define FRACTAL_MANDELBULB_YAW 0.6
+#define FRACTAL_MANDELBULB_PITCH 0.45
+// Cells of the depth pre-pass per work item.
+#define FRACTAL_MANDELBULB_PREPASS_CELLS 256
+
+struct mandelbulb_ray {
+  double dir[3];
+  // The stretch of the ray within the bounding sphere, empty if it misses.
+  double start;
+  double far;
+};
+
+#define FRACTAL_MANDELBULB_SUFFIX scalar
+#define FRACTAL_MANDELBULB_T double
+#define FRACTAL_MANDELBULB_ATTRS __attribute__((always_inline)) static inline
+#define FRACTAL_MANDELBULB_SQRT(v) sqrt(v)
+#define FRACTAL_MANDELBULB_MAX(a, b) fmax(a, b)
+#include "mandelbulb_formula.h"
+
+// Hubbard-Douady's estimate of the distance to the bulb from the final |w|^2
+// and derivative, negative inside.
+static inline double mandelbulb_estimate(double m, double dr) {
+  return 0.25 * log(m) * sqrt(m) / dr;
+}
+
+// Roughly how far p is from the bulb.
+static double mandelbulb_distance_scalar(double px, double py, double pz) {
+  double wx = px;
+  double wy = py;
+  double wz = pz;
+  double m = wx * wx + wy * wy + wz * wz;
+  double dr = 1.0;
+  for (unsigned i = 0;
+       i != FRACTAL_MANDELBULB_ITERATIONS && m <= FRACTAL_MANDELBULB_ESCAPE;
+       i++) {
+    mandelbulb_step_scalar(&wx, &wy, &wz, px, py, pz);
+    dr = mandelbulb_derivative_scalar(m, dr);
+    m = wx * wx + wy * wy + wz * wz;
+  }
+  return mandelbulb_estimate(m, dr);
+}
+
+// The ray through the point column, row of the view.
+static void mandelbulb_ray(struct fractal_mandelbulb const* mandelbulb,
+                           double column, double row,
+                           struct mandelbulb_ray* ray) {
+  struct fractal_ctx const* ctx = mandelbulb->ctx;
+  const double x = ctx->fwidth * column / ctx->width + ctx->fleft;
+  // Rows run down the image, up runs up.
+  const double y = -(ctx->fheight * row / ctx->height + ctx->ftop);
+  double len = 0.0;
+  for (unsigned i = 0; i < 3; i++) {
+    ray->dir[i] = FRACTAL_MANDELBULB_DISTANCE * mandelbulb->forward[i] +
+                  x * mandelbulb->right[i] + y * mandelbulb->up[i];
+    len += ray->dir[i] * ray->dir[i];
+  }
+  len = sqrt(len);
+  double b = 0.0;
+  double c = -FRACTAL_MANDELBULB_BOUND * FRACTAL_MANDELBULB_BOUND;
+  for (unsigned i = 0; i < 3; i++) {
+    ray->dir[i] /= len;
+    b += mandelbulb->eye[i] * ray->dir[i];
+    c += mandelbulb->eye[i] * mandelbulb->eye[i];
+  }
+  // |eye + t dir| = bound, dir being a unit vector.
+  const double disc = b * b - c;
+  if (disc < 0.0) {
+    ray->start = 0.0;
+    ray->far = 0.0;
+    return;
+  }
+  const double root = sqrt(disc);
+  ray->start = fmax(-b - root, 0.0);
+  ray->far = -b + root;
+}
+
+// mandelbulb_ray for a pixel, starting where the depth pre-pass found its
+// cell empty up to.
+__attribute__((always_inline)) static inline void mandelbulb_pixel_ray(
+    struct fractal_mandelbulb const* mandelbulb, uint32_t column, uint32_t row,
+    struct mandelbulb_ray* ray) {
+  mandelbulb_ray(mandelbulb, column, row, ray);
+  if (mandelbulb->starts) {
+    const double start =
+        mandelbulb->starts[(uintptr_t)(row / FRACTAL_MANDELBULB_PREPASS) *
+                               mandelbulb->prepass_columns +
+                           column / FRACTAL_MANDELBULB_PREPASS];
+    ray->start = fmax(ray->start, start);
+  }
+}
+
+// The difference quotient step for a ray that stopped at t, about a pixel.
+__attribute__((always_inline)) static inline double mandelbulb_gradient_step(
+    struct fractal_mandelbulb const* mandelbulb, double t) {
+  return fmax(0.5 * mandelbulb->pixel_angle * t, 0x1p-40);
+}
+
+// The shade of a pixel whose ray hit after steps steps, lit from behind the
+// camera's left shoulder. gradient is the distance estimate's change across
+// the hit point along each axis, the direction of the surface's normal.
+static uint8_t mandelbulb_shade(struct fractal_mandelbulb const* mandelbulb,
+                                double const gradient[3], bool hit,
+                                uint32_t steps) {
+  if (!hit) {
+    return 0;
+  }
+  double len = 0.0;
+  double light = 0.0;
+  for (unsigned i = 0; i < 3; i++) {
+    len += gradient[i] * gradient[i];
+    light += gradient[i] * (mandelbulb->up[i] - mandelbulb->forward[i] -
+                            mandelbulb->right[i]);
+  }
+  // up - forward - right is sqrt(3) long.
+  const double diffuse = len > 0.0 ? fmax(light / sqrt(3.0 * len), 0.0) : 0.0;
+  // Rays creeping along the surface into crevices take many steps, shade
+  // them as occluded.
+  const double occlusion = 1.0 - (double)steps / FRACTAL_MANDELBULB_STEPS;
+  return 1 + (uint8_t)lround(254.0 * (0.2 + 0.8 * diffuse) * occlusion);
+}
+
+static void mandelbulb_flush_stats(struct fractal_mandelbulb const* mandelbulb,
+                                   uint64_t rays, uint64_t hits,
+                                   uint64_t steps, uint64_t lane_slots) {
+  // Only the counters change, the rest stays put while rendering.
+  struct fractal_mandelbulb* stats = (struct fractal_mandelbulb*)mandelbulb;
+  atomic_fetch_add_explicit(&stats->rays, rays, memory_order_relaxed);
+  atomic_fetch_add_explicit(&stats->hits, hits, memory_order_relaxed);
+  atomic_fetch_add_explicit(&stats->steps, steps, memory_order_relaxed);
+  atomic_fetch_add_explicit(&stats->lane_slots, lane_slots,
+                            memory_order_relaxed);
+}
+
+// Marches every pixel of rect on its own.
+static void mandelbulb_scalar(struct fractal_mandelbulb const* mandelbulb,
+                              wq_rect_t const* rect) {
+  struct fractal_ctx const* ctx = mandelbulb->ctx;
+  const double tolerance = 0.5 * mandelbulb->pixel_angle;
+  uint64_t hits = 0;
+  uint64_t steps = 0;
+
+  const uint32_t row_end = rect->y + rect->h;
+  const uint32_t column_end = rect->x + rect->w;
+  uint8_t* out = (uint8_t*)ctx->buffer + (uintptr_t)rect->y * ctx->width;
+  for (uint32_t row = rect->y; row != row_end; row++, out += ctx->width) {
+    for (uint32_t column = rect->x; column != column_end; column++) {
+      struct mandelbulb_ray ray;
+      mandelbulb_pixel_ray(mandelbulb, column, row, &ray);
+      double t = ray.start;
+      uint32_t marched = 0;
+      bool hit = false;
+      while (t < ray.far && marched < FRACTAL_MANDELBULB_STEPS) {
+        const double de = mandelbulb_distance_scalar(
+            mandelbulb->eye[0] + t * ray.dir[0],
+            mandelbulb->eye[1] + t * ray.dir[1],
+            mandelbulb->eye[2] + t * ray.dir[2]);
+        if (de < tolerance * t) {
+          hit = true;
+          break;
+        }
+        t += de;
+        marched++;
+      }
+      double gradient[3] = {0.0, 0.0, 0.0};
+      if (hit) {
+        const double h = mandelbulb_gradient_step(mandelbulb, t);
+        double p[3];
+        for (unsigned k = 0; k < 3; k++) {
+          p[k] = mandelbulb->eye[k] + t * ray.dir[k];
+        }
+        gradient[0] = mandelbulb_distance_scalar(p[0] + h, p[1], p[2]) -
+                      mandelbulb_distance_scalar(p[0] - h, p[1], p[2]);
+        gradient[1] = mandelbulb_distance_scalar(p[0], p[1] + h, p[2]) -
+                      mandelbulb_distance_scalar(p[0], p[1] - h, p[2]);
+        gradient[2] = mandelbulb_distance_scalar(p[0], p[1], p[2] + h) -
+                      mandelbulb_distance_scalar(p[0], p[1], p[2] - h);
+      }
+      out[column] = mandelbulb_shade(mandelbulb, gradient, hit, marched);
+      hits += hit;
+      steps += marched + hit;
+    }
+  }
+  mandelbulb_flush_stats(mandelbulb, (uint64_t)rect->w * rect->h, hits, steps,
+                         steps);
+}
+
+#if FRACTAL_HAS_X86
+#define FRACTAL_MANDELBULB_SIMD_ISA sse2
+#define FRACTAL_MANDELBULB_SIMD_TARGET "sse2"
+#define FRACTAL_MANDELBULB_SIMD_LANES 2
+#define FRACTAL_MANDELBULB_SIMD_ANY(m) _mm_movemask_pd((__m128d)(m))
+#define FRACTAL_MANDELBULB_SIMD_SQRT(v) \
+  (__typeof__(v)) _mm_sqrt_pd((__m128d)(v))
+#define FRACTAL_MANDELBULB_SIMD_MAX(a, b) \
+  (__typeof__(a)) _mm_max_pd((__m128d)(a), (__m128d)(b))
+#include "mandelbulb_simd.h"
+
+#define FRACTAL_MANDELBULB_SIMD_ISA avx2
+#define FRACTAL_MANDELBULB_SIMD_TARGET "avx2"
+#define FRACTAL_MANDELBULB_SIMD_LANES 4
+#define FRACTAL_MANDELBULB_SIMD_ANY(m) _mm256_movemask_pd((__m256d)(m))
+#define FRACTAL_MANDELBULB_SIMD_SQRT(v) \
+  (__typeof__(v)) _mm256_sqrt_pd((__m256d)(v))
+#define FRACTAL_MANDELBULB_SIMD_MAX(a, b) \
+  (__typeof__(a)) _mm256_max_pd((__m256d)(a), (__m256d)(b))
+#include "mandelbulb_simd.h"
+
+#define FRACTAL_MANDELBULB_SIMD_ISA avx512
+#define FRACTAL_MANDELBULB_SIMD_TARGET "avx512f"
+#define FRACTAL_MANDELBULB_SIMD_LANES 8
+#define FRACTAL_MANDELBULB_SIMD_ANY(m) \
+  _mm512_test_epi64_mask((__m512i)(m), (__m512i)(m))
+#define FRACTAL_MANDELBULB_SIMD_SQRT(v) \
+  (__typeof__(v)) _mm512_sqrt_pd((__m512d)(v))
+#define FRACTAL_MANDELBULB_SIMD_MAX(a, b) \
+  (__typeof__(a)) _mm512_max_pd((__m512d)(a), (__m512d)(b))
+#include "mandelbulb_simd.h"
+#endif
+
+static fractal_mandelbulb_fn_t mandelbulb_kernel_fn(
+    enum fractal_kernel kernel) {
+  switch (kernel) {
+#if FRACTAL_HAS_X86
+    case fractal_kernel_sse2:
+      return mandelbulb_packets_sse2;
+    case fractal_kernel_avx2:
+      return mandelbulb_packets_avx2;
+    case fractal_kernel_avx512:
+      return mandelbulb_packets_avx512;
+#endif
+    default:
+      return mandelbulb_scalar;
+  }
+}
+
+const char* fractal_mandelbulb_init(struct fractal_mandelbulb* mandelbulb,
+                                    struct fractal_ctx* ctx, bool prepass) {
+  if (ctx->kernel == fractal_kernel_auto) {
+    ctx->kernel = fractal_kernel_avx512;
+    while (!fractal_kernel_is_supported(ctx->kernel)) {
+      ctx->kernel -= 1;
+    }
+  } else if (!fractal_kernel_is_supported(ctx->kernel)) {
+    return "Requested kernel is not supported by this CPU";
+  }
+  mandelbulb->ctx = ctx;
+  mandelbulb->kernel_fn = mandelbulb_kernel_fn(ctx->kernel);
+
+  const double cy = cos(FRACTAL_MANDELBULB_YAW);
+  const double sy = sin(FRACTAL_MANDELBULB_YAW);
+  const double cp = cos(FRACTAL_MANDELBULB_PITCH);
+  const double sp = sin(FRACTAL_MANDELBULB_PITCH);
+  const double forward[3] = {sy * cp, -sp, cy * cp};
+  const double right[3] = {cy, 0.0, -sy};
+  const double up[3] = {sy * sp, cp, cy * sp};
+  for (unsigned i = 0; i < 3; i++) {
+    mandelbulb->forward[i] = forward[i];
+    mandelbulb->right[i] = right[i];
+    mandelbulb->up[i] = up[i];
+    mandelbulb->eye[i] = -FRACTAL_MANDELBULB_DISTANCE * forward[i];
+  }
+  mandelbulb->pixel_angle =
+      ctx->fwidth / ctx->width / FRACTAL_MANDELBULB_DISTANCE;
+
+  mandelbulb->starts = NULL;
+  mandelbulb->prepass_columns = 0;
+  mandelbulb->prepass_rows = 0;
+  if (prepass) {
+    mandelbulb->prepass_columns =
+        (ctx->width + FRACTAL_MANDELBULB_PREPASS - 1) /
+        FRACTAL_MANDELBULB_PREPASS;
+    mandelbulb->prepass_rows = (ctx->height + FRACTAL_MANDELBULB_PREPASS - 1) /
+                               FRACTAL_MANDELBULB_PREPASS;
+    mandelbulb->starts =
+        calloc((uintptr_t)mandelbulb->prepass_columns *
+                   mandelbulb->prepass_rows,
+               sizeof(double));
+  }
+  atomic_init(&mandelbulb->rays, 0);
+  atomic_init(&mandelbulb->hits, 0);
+  atomic_init(&mandelbulb->steps, 0);
+  atomic_init(&mandelbulb->lane_slots, 0);
+  atomic_init(&mandelbulb->prepass_steps, 0);
+  return NULL;
+}
+
+void fractal_mandelbulb_destroy(struct fractal_mandelbulb* mandelbulb) {
+  free(mandelbulb->starts);
+  mandelbulb->starts = NULL;
+}
+
+void fractal_mandelbulb_worker(wq_rect_t const* rect,
+                               struct fractal_mandelbulb const* mandelbulb) {
+  mandelbulb->kernel_fn(mandelbulb, rect);
+}
+
+// Marches a cone through the middle of every cell of rect, wide enough to
+// hold the rays of all of the cell's pixels, and stores how far it got
+// before the bulb came within its radius. Each step only goes as far as the
+// ball around the cone's axis the distance estimate clears covers the whole
+// cone, so the pixels' rays can skip straight to there.
+static void mandelbulb_prepass_worker(
+    wq_rect_t const* rect, struct fractal_mandelbulb const* mandelbulb) {
+  // A cell's rays are at most its width from the axis, at the distance of
+  // the view's plane.
+  const double spread = FRACTAL_MANDELBULB_PREPASS * mandelbulb->pixel_angle;
+  const double middle = (FRACTAL_MANDELBULB_PREPASS - 1) / 2.0;
+  uint64_t steps = 0;
+  for (uint32_t row = rect->y; row != rect->y + rect->h; row++) {
+    for (uint32_t column = rect->x; column != rect->x + rect->w; column++) {
+      struct mandelbulb_ray ray;
+      mandelbulb_ray(mandelbulb, column * FRACTAL_MANDELBULB_PREPASS + middle,
+                     row * FRACTAL_MANDELBULB_PREPASS + middle, &ray);
+      double t = ray.start;
+      uint32_t marched = 0;
+      while (t < ray.far && marched < FRACTAL_MANDELBULB_STEPS) {
+        const double de = mandelbulb_distance_scalar(
+            mandelbulb->eye[0] + t * ray.dir[0],
+            mandelbulb->eye[1] + t * ray.dir[1],
+            mandelbulb->eye[2] + t * ray.dir[2]);
+        const double radius = t * spread;
+        marched++;
+        if (de < 2.0 * radius) {
+          break;
+        }
+        t += (de - radius) / (1.0 + spread);
+      }
+      // Cones missing the bounding sphere say nothing about rays at their
+      // edge that don't.
+      mandelbulb->starts[(uintptr_t)row * mandelbulb->prepass_columns +
+                         column] = ray.far > 0.0 ? t : 0.0;
+      steps += marched;
+    }
+  }
+  struct fractal_mandelbulb* stats = (struct fractal_mandelbulb*)mandelbulb;
+  atomic_fetch_add_explicit(&stats->prepass_steps, steps,
+                            memory_order_relaxed);
+}
+
+uintptr_t fractal_mandelbulb_render(struct fractal_mandelbulb* mandelbulb,
+                                    size_t worker_count, uint32_t tile_size,
+                                    enum wq_tile_order order) {
+  struct fractal_ctx const* ctx = mandelbulb->ctx;
+  if (mandelbulb->starts) {
+    const uint32_t columns = mandelbulb->prepass_columns;
+    const uint32_t rows = mandelbulb->prepass_rows;
+    wq_t wq = wq_create_rect(
+        "frak", (void*)mandelbulb_prepass_worker, worker_count,
+        wq_grid_count(columns, rows, FRACTAL_MANDELBULB_PREPASS_CELLS));
+    wq_push_grid(wq, columns, rows, FRACTAL_MANDELBULB_PREPASS_CELLS);
+    wq_start(wq, mandelbulb);
+    wq_wait(wq);
+    wq_destroy(wq);
+  }
+  const uintptr_t count =
+      wq_tile_count(ctx->width, ctx->height, tile_size, tile_size);
+  wq_t wq = wq_create_rect("frak", (void*)fractal_mandelbulb_worker,
+                           worker_count, count);
+  wq_push_tiles(wq, ctx->width, 0, ctx->height, tile_size, tile_size, order);
+  wq_start(wq, mandelbulb);
+  wq_wait(wq);
+  wq_destroy(wq);
+  return count;
+}
@@ -0,0 +1,79 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fractal.h"
+#include "wq.h"
+
+// Iterations of w <- w^8 + p the distance estimator runs before counting p
+// as inside the bulb.
+#define FRACTAL_MANDELBULB_ITERATIONS 10
+// Steps a ray marches before it's given up on as background.
+#define FRACTAL_MANDELBULB_STEPS 256
+// Radius of the sphere around the origin the bulb fits in, rays only march
+// through it.
+#define FRACTAL_MANDELBULB_BOUND 1.25
+// Distance from the camera to the plane through the origin the view's
+// coordinates lie in.
+#define FRACTAL_MANDELBULB_DISTANCE 2.5
+// Side of the cells of pixels the depth pre-pass marches one cone for.
+#define FRACTAL_MANDELBULB_PREPASS 8
+
+struct fractal_mandelbulb;
+
+// Marches every pixel of rect, writing its shade to the view's buffer.
+typedef void (*fractal_mandelbulb_fn_t)(
+    struct fractal_mandelbulb const* mandelbulb, wq_rect_t const* rect);
+
+struct fractal_mandelbulb {
+  struct fractal_ctx const* ctx;
+  fractal_mandelbulb_fn_t kernel_fn;
+  double eye[3];
+  // The camera looks along forward, the view's x and y run along right and
+  // up.
+  double forward[3];
+  double right[3];
+  double up[3];
+  // The angle a pixel spans at the middle of the view, rays stop within half
+  // of it at their distance from the camera.
+  double pixel_angle;
+  // Where each cell's cone of rays may start marching from, NULL without the
+  // depth pre-pass. prepass_columns cells to a row.
+  double* starts;
+  uint32_t prepass_columns;
+  uint32_t prepass_rows;
+  _Atomic(uint64_t) rays;
+  _Atomic(uint64_t) hits;
+  // Distance estimates the rays took, and the lanes packets of them ran
+  // including masked off ones.
+  _Atomic(uint64_t) steps;
+  _Atomic(uint64_t) lane_slots;
+  _Atomic(uint64_t) prepass_steps;
+};
+
+// Sets mandelbulb up to render ctx's view, resolving ctx->kernel to the
+// widest the CPU supports if it's fractal_kernel_auto. The view's center
+// and width pan and zoom across the plane through the origin facing the
+// camera. Returns an error if the requested kernel can't run on this CPU.
+const char* fractal_mandelbulb_init(struct fractal_mandelbulb* mandelbulb,
+                                    struct fractal_ctx* ctx, bool prepass);
+
+void fractal_mandelbulb_destroy(struct fractal_mandelbulb* mandelbulb);
+
+// Marches the rays of rect's pixels in packets of the kernel's lanes, each
+// lane masked off once its ray hits the bulb or leaves its bounding sphere.
+// Hits are shaded by their surface's angle to the light, darkened by the
+// steps it took to get there, as 1 to 255. 0 is background.
+void fractal_mandelbulb_worker(wq_rect_t const* rect,
+                               struct fractal_mandelbulb const* mandelbulb);
+
+// Runs the depth pre-pass if mandelbulb has one, then fractal_mandelbulb_worker
+// over tiles of tile_size in order on a wq. Returns how many tiles there were.
+uintptr_t fractal_mandelbulb_render(struct fractal_mandelbulb* mandelbulb,
+                                    size_t worker_count, uint32_t tile_size,
+                                    enum wq_tile_order order);
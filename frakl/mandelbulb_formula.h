@@ -0,0 +1,66 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+// Template for one iteration of the power-8 Mandelbulb's distance estimator.
+// Included once for scalars and once per vector ISA after defining:
+//   FRACTAL_MANDELBULB_SUFFIX   suffix of the generated functions
+//   FRACTAL_MANDELBULB_T        double or a vector of doubles
+//   FRACTAL_MANDELBULB_ATTRS    function attributes
+//   FRACTAL_MANDELBULB_SQRT(v)  square root of every lane of v
+//   FRACTAL_MANDELBULB_MAX(a, b) the larger of a and b, lane by lane
+//
+// Every instantiation does the same operations in the same order, so scalar
+// and vector kernels march their rays to the same distances.
+
+#define FRACTAL_MANDELBULB_CONCAT_(a, b) a##_##b
+#define FRACTAL_MANDELBULB_CONCAT(a, b) FRACTAL_MANDELBULB_CONCAT_(a, b)
+#define FRACTAL_MANDELBULB_FN(name) \
+  FRACTAL_MANDELBULB_CONCAT(name, FRACTAL_MANDELBULB_SUFFIX)
+
+// w <- w^8 + p in the spherical coordinates of the White-Nylander formula,
+// expanded into polynomials so it needs no trigonometry. y is the axis the
+// bulb is symmetric about. Points within 2^-50 of the axis are pulled onto
+// that circle, the polynomials divide by a power of their distance to it.
+FRACTAL_MANDELBULB_ATTRS void FRACTAL_MANDELBULB_FN(mandelbulb_step)(
+    FRACTAL_MANDELBULB_T* wx, FRACTAL_MANDELBULB_T* wy,
+    FRACTAL_MANDELBULB_T* wz, FRACTAL_MANDELBULB_T px,
+    FRACTAL_MANDELBULB_T py, FRACTAL_MANDELBULB_T pz) {
+  typedef FRACTAL_MANDELBULB_T T;
+  const T x = *wx;
+  const T y = *wy;
+  const T z = *wz;
+  const T x2 = x * x;
+  const T y2 = y * y;
+  const T z2 = z * z;
+  const T x4 = x2 * x2;
+  const T y4 = y2 * y2;
+  const T z4 = z2 * z2;
+  const T k3 = x2 + z2;
+  const T k3f = FRACTAL_MANDELBULB_MAX(k3, (T){0} + 0x1p-100);
+  const T k3f2 = k3f * k3f;
+  const T k2 = 1.0 / FRACTAL_MANDELBULB_SQRT(k3f2 * k3f2 * k3f2 * k3f);
+  const T k1 = x4 + y4 + z4 - 6.0 * y2 * z2 - 6.0 * x2 * y2 + 2.0 * z2 * x2;
+  const T k4 = x2 - y2 + z2;
+  *wx = px + 64.0 * x * y * z * (x2 - z2) * k4 * (x4 - 6.0 * x2 * z2 + z4) *
+                 k1 * k2;
+  *wy = py + -16.0 * y2 * k3 * k4 * k4 + k1 * k1;
+  *wz = pz + -8.0 * y * k4 *
+                 (x4 * x4 - 28.0 * x4 * x2 * z2 + 70.0 * x4 * z4 -
+                  28.0 * x2 * z2 * z4 + z4 * z4) *
+                 k1 * k2;
+}
+
+// The running derivative |dw/dp| <- 8|w|^7 |dw/dp| + 1, m being |w|^2
+// before the step.
+FRACTAL_MANDELBULB_ATTRS FRACTAL_MANDELBULB_T FRACTAL_MANDELBULB_FN(
+    mandelbulb_derivative)(FRACTAL_MANDELBULB_T m, FRACTAL_MANDELBULB_T dr) {
+  return 8.0 * (m * m * m * FRACTAL_MANDELBULB_SQRT(m)) * dr + 1.0;
+}
+
+#undef FRACTAL_MANDELBULB_FN
+#undef FRACTAL_MANDELBULB_CONCAT
+#undef FRACTAL_MANDELBULB_CONCAT_
+#undef FRACTAL_MANDELBULB_SUFFIX
+#undef FRACTAL_MANDELBULB_T
+#undef FRACTAL_MANDELBULB_ATTRS
+#undef FRACTAL_MANDELBULB_SQRT
+#undef FRACTAL_MANDELBULB_MAX
@@ -0,0 +1,179 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+// Template for the vectorized Mandelbulb ray marcher. mandelbulb.c includes
+// this once per ISA after defining:
+//   FRACTAL_MANDELBULB_SIMD_ISA    suffix of the generated kernels, e.g. avx2
+//   FRACTAL_MANDELBULB_SIMD_TARGET target attribute string, e.g. "avx2"
+//   FRACTAL_MANDELBULB_SIMD_LANES  number of doubles per vector
+//   FRACTAL_MANDELBULB_SIMD_ANY(m) non-zero if any lane of the int64 mask m
+//                                  is set
+//   FRACTAL_MANDELBULB_SIMD_SQRT(v) square root of every lane of v
+//   FRACTAL_MANDELBULB_SIMD_MAX(a, b) the larger of a and b, lane by lane
+//
+// Every lane marches the same steps mandelbulb_scalar does for its pixel, so
+// all kernels produce the same image.
+
+#define FRACTAL_MANDELBULB_SIMD_CONCAT_(a, b) a##_##b
+#define FRACTAL_MANDELBULB_SIMD_CONCAT(a, b) \
+  FRACTAL_MANDELBULB_SIMD_CONCAT_(a, b)
+#define FRACTAL_MANDELBULB_SIMD_FN(name) \
+  FRACTAL_MANDELBULB_SIMD_CONCAT(name, FRACTAL_MANDELBULB_SIMD_ISA)
+#define FRACTAL_MANDELBULB_SIMD_ATTRS                                  \
+  __attribute__((target(FRACTAL_MANDELBULB_SIMD_TARGET), always_inline)) \
+  static inline
+
+typedef double FRACTAL_MANDELBULB_SIMD_FN(bd)
+    __attribute__((vector_size(FRACTAL_MANDELBULB_SIMD_LANES * 8)));
+typedef int64_t FRACTAL_MANDELBULB_SIMD_FN(bi)
+    __attribute__((vector_size(FRACTAL_MANDELBULB_SIMD_LANES * 8)));
+
+#define FRACTAL_MANDELBULB_SUFFIX FRACTAL_MANDELBULB_SIMD_ISA
+#define FRACTAL_MANDELBULB_T FRACTAL_MANDELBULB_SIMD_FN(bd)
+#define FRACTAL_MANDELBULB_ATTRS FRACTAL_MANDELBULB_SIMD_ATTRS
+#define FRACTAL_MANDELBULB_SQRT FRACTAL_MANDELBULB_SIMD_SQRT
+#define FRACTAL_MANDELBULB_MAX FRACTAL_MANDELBULB_SIMD_MAX
+#include "mandelbulb_formula.h"
+
+// mandelbulb_distance for FRACTAL_MANDELBULB_SIMD_LANES points at once. Lanes
+// whose w escaped keep it while the rest carry on.
+FRACTAL_MANDELBULB_SIMD_ATTRS FRACTAL_MANDELBULB_SIMD_FN(bd)
+    FRACTAL_MANDELBULB_SIMD_FN(mandelbulb_distance)(
+        FRACTAL_MANDELBULB_SIMD_FN(bd) px, FRACTAL_MANDELBULB_SIMD_FN(bd) py,
+        FRACTAL_MANDELBULB_SIMD_FN(bd) pz) {
+  typedef FRACTAL_MANDELBULB_SIMD_FN(bd) bd;
+  typedef FRACTAL_MANDELBULB_SIMD_FN(bi) bi;
+
+  const bd escape = (bd){0} + FRACTAL_MANDELBULB_ESCAPE;
+  bd wx = px;
+  bd wy = py;
+  bd wz = pz;
+  bd m = wx * wx + wy * wy + wz * wz;
+  bd dr = (bd){0} + 1.0;
+  bi live = (bi)(m <= escape);
+  for (unsigned i = 0;
+       i != FRACTAL_MANDELBULB_ITERATIONS && FRACTAL_MANDELBULB_SIMD_ANY(live);
+       i++) {
+    bd nx = wx;
+    bd ny = wy;
+    bd nz = wz;
+    FRACTAL_MANDELBULB_SIMD_FN(mandelbulb_step)(&nx, &ny, &nz, px, py, pz);
+    const bd ndr = FRACTAL_MANDELBULB_SIMD_FN(mandelbulb_derivative)(m, dr);
+    const bd nm = nx * nx + ny * ny + nz * nz;
+    wx = (bd)(((bi)nx & live) | ((bi)wx & ~live));
+    wy = (bd)(((bi)ny & live) | ((bi)wy & ~live));
+    wz = (bd)(((bi)nz & live) | ((bi)wz & ~live));
+    dr = (bd)(((bi)ndr & live) | ((bi)dr & ~live));
+    m = (bd)(((bi)nm & live) | ((bi)m & ~live));
+    live &= (bi)(m <= escape);
+  }
+  bd res = (bd){0};
+  for (unsigned l = 0; l < FRACTAL_MANDELBULB_SIMD_LANES; l++) {
+    res[l] = mandelbulb_estimate(m[l], dr[l]);
+  }
+  return res;
+}
+
+// Marches FRACTAL_MANDELBULB_SIMD_LANES adjacent pixels of a row together
+// until the last of their rays hits or leaves the bounding sphere.
+__attribute__((target(FRACTAL_MANDELBULB_SIMD_TARGET))) static void
+    FRACTAL_MANDELBULB_SIMD_FN(mandelbulb_packets)(
+        struct fractal_mandelbulb const* mandelbulb, wq_rect_t const* rect) {
+  typedef FRACTAL_MANDELBULB_SIMD_FN(bd) bd;
+  typedef FRACTAL_MANDELBULB_SIMD_FN(bi) bi;
+
+  struct fractal_ctx const* ctx = mandelbulb->ctx;
+  const bd ex = (bd){0} + mandelbulb->eye[0];
+  const bd ey = (bd){0} + mandelbulb->eye[1];
+  const bd ez = (bd){0} + mandelbulb->eye[2];
+  const bd tolerance = (bd){0} + 0.5 * mandelbulb->pixel_angle;
+  const bi max_steps = (bi){0} + FRACTAL_MANDELBULB_STEPS;
+  const uint32_t n = rect->w;
+  uint64_t ray_count = 0;
+  uint64_t hits = 0;
+  uint64_t steps = 0;
+  uint64_t lane_slots = 0;
+
+  const uint32_t row_end = rect->y + rect->h;
+  uint8_t* out = (uint8_t*)ctx->buffer + (uintptr_t)rect->y * ctx->width;
+  for (uint32_t row = rect->y; row != row_end; row++, out += ctx->width) {
+    for (uint32_t i = 0; i < n; i += FRACTAL_MANDELBULB_SIMD_LANES) {
+      const uint32_t column = rect->x + i;
+      const uint32_t cnt = n - i < FRACTAL_MANDELBULB_SIMD_LANES
+                               ? n - i
+                               : FRACTAL_MANDELBULB_SIMD_LANES;
+      struct mandelbulb_ray lanes[FRACTAL_MANDELBULB_SIMD_LANES];
+      bd dx;
+      bd dy;
+      bd dz;
+      bd t;
+      bd far;
+      for (unsigned l = 0; l < FRACTAL_MANDELBULB_SIMD_LANES; l++) {
+        // Pad the tail by repeating the last pixel, it never marches longer.
+        mandelbulb_pixel_ray(mandelbulb, column + (l < cnt ? l : cnt - 1),
+                             row, &lanes[l]);
+        dx[l] = lanes[l].dir[0];
+        dy[l] = lanes[l].dir[1];
+        dz[l] = lanes[l].dir[2];
+        t[l] = lanes[l].start;
+        far[l] = lanes[l].far;
+      }
+
+      bi active = (bi)(t < far);
+      bi hit = (bi){0};
+      bi marched = (bi){0};
+      while (FRACTAL_MANDELBULB_SIMD_ANY(active)) {
+        const bd de = FRACTAL_MANDELBULB_SIMD_FN(mandelbulb_distance)(
+            ex + t * dx, ey + t * dy, ez + t * dz);
+        const bi near = active & (bi)(de < tolerance * t);
+        hit |= near;
+        active &= ~near;
+        t += (bd)((bi)de & active);
+        // Active lanes are all ones, i.e. -1.
+        marched -= active;
+        active &= (bi)(t < far) & (bi)(marched < max_steps);
+        lane_slots += FRACTAL_MANDELBULB_SIMD_LANES;
+      }
+
+      // The gradients of the lanes that hit, the rest are never shaded.
+      bd gx = (bd){0};
+      bd gy = (bd){0};
+      bd gz = (bd){0};
+      if (FRACTAL_MANDELBULB_SIMD_ANY(hit)) {
+        bd h;
+        for (unsigned l = 0; l < FRACTAL_MANDELBULB_SIMD_LANES; l++) {
+          h[l] = mandelbulb_gradient_step(mandelbulb, t[l]);
+        }
+        const bd px = ex + t * dx;
+        const bd py = ey + t * dy;
+        const bd pz = ez + t * dz;
+        gx = FRACTAL_MANDELBULB_SIMD_FN(mandelbulb_distance)(px + h, py, pz) -
+             FRACTAL_MANDELBULB_SIMD_FN(mandelbulb_distance)(px - h, py, pz);
+        gy = FRACTAL_MANDELBULB_SIMD_FN(mandelbulb_distance)(px, py + h, pz) -
+             FRACTAL_MANDELBULB_SIMD_FN(mandelbulb_distance)(px, py - h, pz);
+        gz = FRACTAL_MANDELBULB_SIMD_FN(mandelbulb_distance)(px, py, pz + h) -
+             FRACTAL_MANDELBULB_SIMD_FN(mandelbulb_distance)(px, py, pz - h);
+      }
+
+      for (unsigned l = 0; l < cnt; l++) {
+        const double gradient[3] = {gx[l], gy[l], gz[l]};
+        out[column + l] = mandelbulb_shade(mandelbulb, gradient, hit[l] != 0,
+                                           (uint32_t)marched[l]);
+        hits += hit[l] != 0;
+        steps += (uint64_t)marched[l] + (hit[l] != 0);
+      }
+      ray_count += cnt;
+    }
+  }
+  mandelbulb_flush_stats(mandelbulb, ray_count, hits, steps, lane_slots);
+}
+
+#undef FRACTAL_MANDELBULB_SIMD_ATTRS
+#undef FRACTAL_MANDELBULB_SIMD_FN
+#undef FRACTAL_MANDELBULB_SIMD_CONCAT
+#undef FRACTAL_MANDELBULB_SIMD_CONCAT_
+#undef FRACTAL_MANDELBULB_SIMD_ISA
+#undef FRACTAL_MANDELBULB_SIMD_TARGET
+#undef FRACTAL_MANDELBULB_SIMD_LANES
+#undef FRACTAL_MANDELBULB_SIMD_ANY
+#undef FRACTAL_MANDELBULB_SIMD_SQRT
+#undef FRACTAL_MANDELBULB_SIMD_MAX
@@ -0,0 +1,154 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#include "newton.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FRACTAL_HAS_X86 1
+#else
+#define FRACTAL_HAS_X86 0
+#endif
+
+const char* fractal_newton_init(struct fractal_newton* newton,
+                                double const (*roots)[2],
+                                uint32_t root_count) {
+  if (!root_count) {
+    return "Newton fractals need at least one root";
+  }
+  if (root_count > FRACTAL_NEWTON_MAX_ROOTS) {
+    return "Newton fractals can have at most 8 roots";
+  }
+  memset(newton, 0, sizeof(*newton));
+  newton->root_count = root_count;
+  memcpy(newton->roots, roots, root_count * sizeof(*roots));
+  // Multiply (z - root) in one root at a time, coefficients[k] holding the
+  // one of degree k - 1 below the leading 1 as it grows.
+  double(*c)[2] = newton->coefficients;
+  for (uint32_t i = 0; i < root_count; i++) {
+    const double rx = roots[i][0];
+    const double ry = roots[i][1];
+    for (uint32_t k = i + 1; k-- > 0;) {
+      const double hx = k ? c[k - 1][0] : 1.0;
+      const double hy = k ? c[k - 1][1] : 0.0;
+      const double lx = k < i ? c[k][0] : 0.0;
+      const double ly = k < i ? c[k][1] : 0.0;
+      c[k][0] = lx - (hx * rx - hy * ry);
+      c[k][1] = ly - (hx * ry + hy * rx);
+    }
+  }
+  return NULL;
+}
+
+// The byte for a pixel that converged to x, y after iterations steps: the
+// band of the nearest root, faded by iterations.
+static inline uint8_t newton_shade(struct fractal_newton const* newton,
+                                   double x, double y, uint32_t iterations) {
+  uint32_t nearest = 0;
+  double nearest_distance = INFINITY;
+  for (uint32_t i = 0; i < newton->root_count; i++) {
+    const double dx = x - newton->roots[i][0];
+    const double dy = y - newton->roots[i][1];
+    const double distance = dx * dx + dy * dy;
+    if (distance < nearest_distance) {
+      nearest = i;
+      nearest_distance = distance;
+    }
+  }
+  const uint32_t band = 255 / newton->root_count;
+  const uint32_t fade =
+      iterations < FRACTAL_NEWTON_FADE ? iterations : FRACTAL_NEWTON_FADE;
+  return (uint8_t)(1 + nearest * band +
+                   (band - 1) * (FRACTAL_NEWTON_FADE - fade) /
+                       FRACTAL_NEWTON_FADE);
+}
+
+static inline int64_t newton_bits(double v) {
+  int64_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  return bits;
+}
+
+static inline double newton_doubles(int64_t bits) {
+  double v;
+  memcpy(&v, &bits, sizeof(v));
+  return v;
+}
+
+#define FRACTAL_NEWTON_SUFFIX scalar
+#define FRACTAL_NEWTON_T double
+#define FRACTAL_NEWTON_I int64_t
+#define FRACTAL_NEWTON_LANES 1
+#define FRACTAL_NEWTON_ATTRS
+#define FRACTAL_NEWTON_BITS(v) newton_bits(v)
+#define FRACTAL_NEWTON_DOUBLES(i) newton_doubles(i)
+#define FRACTAL_NEWTON_LT(a, b) (-(int64_t)((a) < (b)))
+#define FRACTAL_NEWTON_ANY(m) (m)
+#define FRACTAL_NEWTON_SET(v, l, x) ((void)(l), (v) = (x))
+#define FRACTAL_NEWTON_GET(v, l) ((void)(l), (v))
+#include "newton_kernel.h"
+
+#if FRACTAL_HAS_X86
+typedef double newton_vd_sse2 __attribute__((vector_size(16)));
+typedef int64_t newton_vi_sse2 __attribute__((vector_size(16)));
+#define FRACTAL_NEWTON_SUFFIX sse2
+#define FRACTAL_NEWTON_T newton_vd_sse2
+#define FRACTAL_NEWTON_I newton_vi_sse2
+#define FRACTAL_NEWTON_LANES 2
+#define FRACTAL_NEWTON_ATTRS __attribute__((target("sse2")))
+#define FRACTAL_NEWTON_BITS(v) ((newton_vi_sse2)(v))
+#define FRACTAL_NEWTON_DOUBLES(i) ((newton_vd_sse2)(i))
+#define FRACTAL_NEWTON_LT(a, b) ((a) < (b))
+#define FRACTAL_NEWTON_ANY(m) _mm_movemask_pd((__m128d)(m))
+#define FRACTAL_NEWTON_SET(v, l, x) ((v)[l] = (x))
+#define FRACTAL_NEWTON_GET(v, l) ((v)[l])
+#include "newton_kernel.h"
+
+typedef double newton_vd_avx2 __attribute__((vector_size(32)));
+typedef int64_t newton_vi_avx2 __attribute__((vector_size(32)));
+#define FRACTAL_NEWTON_SUFFIX avx2
+#define FRACTAL_NEWTON_T newton_vd_avx2
+#define FRACTAL_NEWTON_I newton_vi_avx2
+#define FRACTAL_NEWTON_LANES 4
+#define FRACTAL_NEWTON_ATTRS __attribute__((target("avx2")))
+#define FRACTAL_NEWTON_BITS(v) ((newton_vi_avx2)(v))
+#define FRACTAL_NEWTON_DOUBLES(i) ((newton_vd_avx2)(i))
+#define FRACTAL_NEWTON_LT(a, b) ((a) < (b))
+#define FRACTAL_NEWTON_ANY(m) _mm256_movemask_pd((__m256d)(m))
+#define FRACTAL_NEWTON_SET(v, l, x) ((v)[l] = (x))
+#define FRACTAL_NEWTON_GET(v, l) ((v)[l])
+#include "newton_kernel.h"
+
+typedef double newton_vd_avx512 __attribute__((vector_size(64)));
+typedef int64_t newton_vi_avx512 __attribute__((vector_size(64)));
+#define FRACTAL_NEWTON_SUFFIX avx512
+#define FRACTAL_NEWTON_T newton_vd_avx512
+#define FRACTAL_NEWTON_I newton_vi_avx512
+#define FRACTAL_NEWTON_LANES 8
+#define FRACTAL_NEWTON_ATTRS __attribute__((target("avx512f")))
+#define FRACTAL_NEWTON_BITS(v) ((newton_vi_avx512)(v))
+#define FRACTAL_NEWTON_DOUBLES(i) ((newton_vd_avx512)(i))
+#define FRACTAL_NEWTON_LT(a, b) ((a) < (b))
+#define FRACTAL_NEWTON_ANY(m) \
+  _mm512_test_epi64_mask((__m512i)(m), (__m512i)(m))
+#define FRACTAL_NEWTON_SET(v, l, x) ((v)[l] = (x))
+#define FRACTAL_NEWTON_GET(v, l) ((v)[l])
+#include "newton_kernel.h"
+#endif
+
+fractal_kernel_fn_t fractal_newton_kernel_fn(enum fractal_kernel kernel) {
+  switch (kernel) {
+#if FRACTAL_HAS_X86
+    case fractal_kernel_sse2:
+      return newton_kernel_sse2;
+    case fractal_kernel_avx2:
+      return newton_kernel_avx2;
+    case fractal_kernel_avx512:
+      return newton_kernel_avx512;
+#endif
+    default:
+      return newton_kernel_scalar;
+  }
+}
@@ -0,0 +1,38 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#pragma once
+
+#include <stdint.h>
+
+#include "fractal.h"
+
+// Most roots a polynomial can have, each gets a band of at least 31 shades.
+#define FRACTAL_NEWTON_MAX_ROOTS 8
+// A pixel has converged once a step moves it less than the square root of
+// this.
+#define FRACTAL_NEWTON_TOLERANCE 1e-12
+// Iterations over which a root's band fades from brightest to darkest,
+// slower pixels all get the darkest.
+#define FRACTAL_NEWTON_FADE 32
+
+// Newton's method z <- z - p(z) / p'(z) from each pixel for the monic
+// polynomial p with these roots.
+struct fractal_newton {
+  uint32_t root_count;
+  double roots[FRACTAL_NEWTON_MAX_ROOTS][2];
+  // p's coefficients below its leading 1, highest degree first.
+  double coefficients[FRACTAL_NEWTON_MAX_ROOTS][2];
+};
+
+// Expands the polynomial with the root_count roots. Returns an error if
+// there are none or more than FRACTAL_NEWTON_MAX_ROOTS.
+const char* fractal_newton_init(struct fractal_newton* newton,
+                                double const (*roots)[2], uint32_t root_count);
+
+// The kernel rendering ctx->newton with kernel, which must be resolved. The
+// vector kernels step every lane without branching, masking off lanes as
+// they converge, and move on once all of them have. Every kernel computes
+// the same pixels, and all of them take column steps. Pixels that converge
+// within ctx->max_iteration are shaded in their nearest root's band, brighter
+// the fewer steps they took, the rest 0.
+fractal_kernel_fn_t fractal_newton_kernel_fn(enum fractal_kernel kernel);
@@ -0,0 +1,125 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+// Template for the Newton kernels. newton.c includes this once for scalars
+// and once per vector ISA after defining:
+//   FRACTAL_NEWTON_SUFFIX      suffix of the generated functions
+//   FRACTAL_NEWTON_T           double or a vector of doubles
+//   FRACTAL_NEWTON_I           int64_t or a vector of them as wide as T
+//   FRACTAL_NEWTON_LANES       number of doubles in T
+//   FRACTAL_NEWTON_ATTRS       attributes of the generated functions
+//   FRACTAL_NEWTON_BITS(v)     the bits of v as an I
+//   FRACTAL_NEWTON_DOUBLES(i)  the bits i as a T
+//   FRACTAL_NEWTON_LT(a, b)    -1 in the lanes where a < b, 0 elsewhere
+//   FRACTAL_NEWTON_ANY(m)      non-zero if any lane of the mask m is set
+//   FRACTAL_NEWTON_SET(v, l, x) sets lane l of v to x
+//   FRACTAL_NEWTON_GET(v, l)   lane l of v
+//
+// Every instantiation does the same operations in the same order, lanes only
+// differing in which steps are masked off, so they all compute the same
+// pixels.
+
+#define FRACTAL_NEWTON_CONCAT_(a, b) a##_##b
+#define FRACTAL_NEWTON_CONCAT(a, b) FRACTAL_NEWTON_CONCAT_(a, b)
+#define FRACTAL_NEWTON_FN(name) \
+  FRACTAL_NEWTON_CONCAT(name, FRACTAL_NEWTON_SUFFIX)
+
+FRACTAL_NEWTON_ATTRS static void FRACTAL_NEWTON_FN(newton_kernel)(
+    struct fractal_ctx* ctx, wq_rect_t const* rect) {
+  typedef FRACTAL_NEWTON_T T;
+  typedef FRACTAL_NEWTON_I I;
+  struct fractal_newton const* newton = ctx->newton;
+  const uint32_t degree = newton->root_count;
+  const uint32_t max = ctx->max_iteration;
+  const uint32_t step = ctx->column_step ?: 1;
+  const uint32_t n = rect->w;
+  const T tolerance = (T){0} + FRACTAL_NEWTON_TOLERANCE;
+  const T infinity = (T){0} + INFINITY;
+  uint64_t lane_iterations = 0;
+  uint64_t lane_slots = 0;
+
+  const uint32_t row_end = rect->y + rect->h;
+  uint8_t* out = (uint8_t*)ctx->buffer + (uintptr_t)rect->y * ctx->width;
+  for (uint32_t row = rect->y; row != row_end; row++, out += ctx->width) {
+    const double y =
+        ctx->fheight * (double)row / (double)ctx->height + ctx->ftop;
+
+    for (uint32_t i = 0; i < n; i += FRACTAL_NEWTON_LANES) {
+      const uint32_t cnt =
+          n - i < FRACTAL_NEWTON_LANES ? n - i : FRACTAL_NEWTON_LANES;
+      T zx = (T){0};
+      T zy = (T){0} + y;
+      for (unsigned l = 0; l < FRACTAL_NEWTON_LANES; l++) {
+        // Pad the tail by repeating the last pixel.
+        const uint32_t column = rect->x + (i + (l < cnt ? l : cnt - 1)) * step;
+        FRACTAL_NEWTON_SET(
+            zx, l, ctx->fwidth * (double)column / (double)ctx->width +
+                       ctx->fleft);
+      }
+
+      I active = (I){0} - 1;
+      I converged = (I){0};
+      I iterations = (I){0};
+      uint32_t iter;
+      for (iter = 0; iter != max && FRACTAL_NEWTON_ANY(active); iter++) {
+        // p(z) and p'(z) by Horner's rule.
+        T px = (T){0} + 1.0;
+        T py = (T){0};
+        T dx = (T){0};
+        T dy = (T){0};
+        for (uint32_t k = 0; k < degree; k++) {
+          const T ndx = dx * zx - dy * zy + px;
+          const T ndy = dx * zy + dy * zx + py;
+          const T npx = px * zx - py * zy + newton->coefficients[k][0];
+          const T npy = px * zy + py * zx + newton->coefficients[k][1];
+          dx = ndx;
+          dy = ndy;
+          px = npx;
+          py = npy;
+        }
+        // p / p' as p times the conjugate of p' over |p'|^2, with one
+        // division. It's infinite or NaN where p' vanishes.
+        const T scale = 1.0 / (dx * dx + dy * dy);
+        const T qx = (px * dx + py * dy) * scale;
+        const T qy = (py * dx - px * dy) * scale;
+        const T length = qx * qx + qy * qy;
+        zx -= FRACTAL_NEWTON_DOUBLES(FRACTAL_NEWTON_BITS(qx) & active);
+        zy -= FRACTAL_NEWTON_DOUBLES(FRACTAL_NEWTON_BITS(qy) & active);
+        iterations -= active;
+        const I close = FRACTAL_NEWTON_LT(length, tolerance);
+        converged |= active & close;
+        active &= ~close & FRACTAL_NEWTON_LT(length, infinity);
+      }
+
+      for (unsigned l = 0; l < cnt; l++) {
+        uint8_t shade = 0;
+        if (FRACTAL_NEWTON_GET(converged, l)) {
+          shade = newton_shade(newton, FRACTAL_NEWTON_GET(zx, l),
+                               FRACTAL_NEWTON_GET(zy, l),
+                               (uint32_t)FRACTAL_NEWTON_GET(iterations, l));
+        }
+        out[rect->x + (i + l) * step] = shade;
+        lane_iterations += (uint64_t)FRACTAL_NEWTON_GET(iterations, l);
+      }
+      lane_slots += (uint64_t)iter * FRACTAL_NEWTON_LANES;
+    }
+  }
+  if (FRACTAL_NEWTON_LANES > 1) {
+    atomic_fetch_add(&ctx->stats.lane_iterations, lane_iterations);
+    atomic_fetch_add(&ctx->stats.lane_slots, lane_slots);
+  }
+}
+
+#undef FRACTAL_NEWTON_FN
+#undef FRACTAL_NEWTON_CONCAT
+#undef FRACTAL_NEWTON_CONCAT_
+#undef FRACTAL_NEWTON_SUFFIX
+#undef FRACTAL_NEWTON_T
+#undef FRACTAL_NEWTON_I
+#undef FRACTAL_NEWTON_LANES
+#undef FRACTAL_NEWTON_ATTRS
+#undef FRACTAL_NEWTON_BITS
+#undef FRACTAL_NEWTON_DOUBLES
+#undef FRACTAL_NEWTON_LT
+#undef FRACTAL_NEWTON_ANY
+#undef FRACTAL_NEWTON_SET
+#undef FRACTAL_NEWTON_GET
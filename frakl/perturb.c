@@ -0,0 +1,281 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#include "perturb.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Extra bits on top of the pixel size, so the reference orbit stays accurate
+// to well below a pixel for many iterations.
+#define FRACTAL_PERTURB_GUARD_BITS 64
+
+// Pixels whose |z|^2 drops below this fraction of |Z|^2 are glitched
+// (Pauldelbrot's criterion, a tolerance of 1e-3).
+#define FRACTAL_PERTURB_GLITCH_TOLERANCE 1e-6
+
+#define FRACTAL_PERTURB_MAX_REFERENCES 32
+
+// Most runs of glitched pixels redone at once, so the rects take a bounded
+// amount of memory however many pixels glitch.
+#define FRACTAL_PERTURB_BATCH 65536
+
+const char* fractal_perturbation_name(
+    enum fractal_perturbation perturbation) {
+  switch (perturbation) {
+    case fractal_perturbation_auto:
+      return "auto";
+    case fractal_perturbation_off:
+      return "off";
+    case fractal_perturbation_on:
+      return "on";
+  }
+  return "unknown";
+}
+
+const char* fractal_perturb_init(struct fractal_ctx* ctx,
+                                 const char* const center[2]) {
+  const double step = ctx->fwidth / ctx->width;
+  if (ctx->perturbation == fractal_perturbation_auto) {
+    ctx->perturbation =
+        ctx->precision == fractal_precision_auto &&
+                fractal_ctx_is_mandlebrot(ctx) &&
+                fractal_ctx_pixels_below(ctx, FRACTAL_DOUBLE_DOUBLE_RESOLUTION)
+            ? fractal_perturbation_on
+            : fractal_perturbation_off;
+    ctx->perturbation_auto = true;
+  }
+  if (ctx->perturbation != fractal_perturbation_on) {
+    return NULL;
+  }
+  if (!fractal_ctx_is_mandlebrot(ctx)) {
+    return "Perturbation only supports the Mandelbrot set";
+  }
+
+  const unsigned len = bignum_limbs_for(step, FRACTAL_PERTURB_GUARD_BITS);
+  if (len == 0) {
+    return "Zoom is too deep for perturbation";
+  }
+  struct fractal_perturb* perturb = calloc(1, sizeof(*perturb));
+  for (unsigned i = 0; i < 2; i++) {
+    const char* err = bignum_from_decimal(&perturb->center[i], center[i], len);
+    if (err) {
+      free(perturb);
+      return err;
+    }
+  }
+  const size_t orbit_len = (size_t)ctx->max_iteration + 1;
+  perturb->zx = malloc(orbit_len * sizeof(double));
+  perturb->zy = malloc(orbit_len * sizeof(double));
+  perturb->glitch_magsq = malloc(orbit_len * sizeof(double));
+  perturb->glitched = calloc((size_t)ctx->width * ctx->height, 1);
+  ctx->perturb = perturb;
+  return NULL;
+}
+
+void fractal_perturb_destroy(struct fractal_ctx* ctx) {
+  struct fractal_perturb* perturb = ctx->perturb;
+  if (!perturb) {
+    return;
+  }
+  free(perturb->zx);
+  free(perturb->zy);
+  free(perturb->glitch_magsq);
+  free(perturb->glitched);
+  free(perturb);
+  ctx->perturb = NULL;
+}
+
+void fractal_perturb_reference(struct fractal_ctx* ctx, double dx, double dy) {
+  struct fractal_perturb* perturb = ctx->perturb;
+  const unsigned len = perturb->center[0].len;
+  const uint32_t max = ctx->max_iteration;
+  struct bignum cx;
+  struct bignum cy;
+  struct bignum zx;
+  struct bignum zy;
+  struct bignum xx;
+  struct bignum yy;
+  struct bignum xy;
+
+  bignum_from_double(&cx, dx, len);
+  bignum_from_double(&cy, dy, len);
+  bignum_add(&cx, &cx, &perturb->center[0]);
+  bignum_add(&cy, &cy, &perturb->center[1]);
+  zx = cx;
+  zy = cy;
+
+  uint32_t n = 0;
+  for (;;) {
+    const double x = bignum_to_double(&zx);
+    const double y = bignum_to_double(&zy);
+    const double magsq = x * x + y * y;
+    perturb->zx[n] = x;
+    perturb->zy[n] = y;
+    perturb->glitch_magsq[n] = FRACTAL_PERTURB_GLITCH_TOLERANCE * magsq;
+    if (magsq > 4.0 || n == max) {
+      break;
+    }
+    bignum_mul(&xx, &zx, &zx);
+    bignum_mul(&yy, &zy, &zy);
+    bignum_mul(&xy, &zx, &zy);
+    bignum_sub(&zx, &xx, &yy);
+    bignum_add(&zx, &zx, &cx);
+    bignum_add(&zy, &xy, &xy);
+    bignum_add(&zy, &zy, &cy);
+    n += 1;
+  }
+  perturb->length = n + 1;
+  perturb->ref_column = ctx->width / 2.0 + dx * ctx->width / ctx->fwidth;
+  perturb->ref_row = ctx->height / 2.0 + dy * ctx->height / ctx->fheight;
+  perturb->references += 1;
+}
+
+// Returns the number of iterations run like mandlebrot_iterate, setting
+// *glitched if d lost too much precision or the reference escaped first.
+static inline uint32_t perturb_iterate(struct fractal_perturb const* perturb,
+                                       double dcx, double dcy, uint32_t max,
+                                       bool* glitched) {
+  double const* zx = perturb->zx;
+  double const* zy = perturb->zy;
+  double const* glitch_magsq = perturb->glitch_magsq;
+  const uint32_t last = perturb->length - 1;
+  double dx = dcx;
+  double dy = dcy;
+  double tmp;
+  uint32_t n = 0;
+
+  *glitched = false;
+  for (;;) {
+    const double x = zx[n] + dx;
+    const double y = zy[n] + dy;
+    const double magsq = x * x + y * y;
+    if (magsq > 4.0 || n == max) {
+      return n;
+    }
+    if (magsq < glitch_magsq[n] || n == last) {
+      *glitched = true;
+      return n;
+    }
+    tmp = 2 * (zx[n] * dx - zy[n] * dy) + dx * dx - dy * dy + dcx;
+    dy = 2 * (zx[n] * dy + zy[n] * dx) + 2 * dx * dy + dcy;
+    dx = tmp;
+    n += 1;
+  }
+}
+
+void fractal_perturb_kernel(struct fractal_ctx* ctx, wq_rect_t const* rect) {
+  struct fractal_perturb const* perturb = ctx->perturb;
+  const uint32_t width = ctx->width;
+  const uint32_t height = ctx->height;
+  const uint32_t max = ctx->max_iteration;
+  const double fwidth = ctx->fwidth;
+  const double fheight = ctx->fheight;
+  uint8_t* const glitched = perturb->glitched;
+  bool glitch;
+
+  const uint32_t column_end = rect->x + rect->w;
+  const uint32_t row_end = rect->y + rect->h;
+  uint8_t* line = (uint8_t*)ctx->buffer + (uintptr_t)rect->y * width;
+  for (uint32_t row = rect->y; row != row_end; row++, line += width) {
+    const double dcy = fheight * ((double)row - perturb->ref_row) / height;
+    for (uint32_t column = rect->x; column != column_end; column++) {
+      const double dcx =
+          fwidth * ((double)column - perturb->ref_column) / width;
+      const uint32_t result = perturb_iterate(perturb, dcx, dcy, max, &glitch);
+      // Glitched pixels keep their guess in case they run out of references.
+      line[column] = (255 * (uint64_t)result) / max;
+      glitched[(uintptr_t)row * width + column] = glitch;
+    }
+  }
+}
+
+static void perturb_run(struct fractal_ctx* ctx, size_t worker_count,
+                        wq_rect_t const* rects, uintptr_t count,
+                        uint32_t pixels_per_item) {
+  wq_t wq = wq_create_rect(
+      "frak", (void*)fractal_worker, worker_count,
+      rects ? count : wq_grid_count(ctx->width, ctx->height, pixels_per_item));
+  if (rects) {
+    wq_push_rects(wq, count, rects);
+  } else {
+    wq_push_grid(wq, ctx->width, ctx->height, pixels_per_item);
+  }
+  wq_start(wq, ctx);
+  wq_wait(wq);
+  wq_destroy(wq);
+}
+
+// Counts the glitched pixels, leaving the middle one in *pick.
+static uint64_t perturb_count_glitched(struct fractal_ctx const* ctx,
+                                       uintptr_t* pick) {
+  uint8_t const* glitched = ctx->perturb->glitched;
+  const uintptr_t pixels = (uintptr_t)ctx->width * ctx->height;
+  uint64_t count = 0;
+  for (uintptr_t i = 0; i < pixels; i++) {
+    count += glitched[i];
+  }
+  uint64_t middle = count / 2;
+  for (uintptr_t i = 0; i < pixels; i++) {
+    if (glitched[i] && middle-- == 0) {
+      *pick = i;
+      break;
+    }
+  }
+  return count;
+}
+
+// Collects up to FRACTAL_PERTURB_BATCH runs of glitched pixels within rows
+// into rects, starting at the pixel *next and leaving it where it stopped.
+static uintptr_t perturb_glitched_rects(struct fractal_ctx const* ctx,
+                                        wq_rect_t* rects, uintptr_t* next) {
+  uint8_t const* glitched = ctx->perturb->glitched;
+  const uint32_t width = ctx->width;
+  const uintptr_t pixels = (uintptr_t)width * ctx->height;
+  uintptr_t nrects = 0;
+  uintptr_t i = *next;
+  while (i < pixels && nrects < FRACTAL_PERTURB_BATCH) {
+    if (!glitched[i]) {
+      i++;
+      continue;
+    }
+    const uintptr_t begin = i;
+    const uintptr_t row_end = (begin / width + 1) * width;
+    while (i < row_end && glitched[i]) {
+      i++;
+    }
+    rects[nrects++] = (wq_rect_t){.x = (uint32_t)(begin % width),
+                                  .y = (uint32_t)(begin / width),
+                                  .w = (uint32_t)(i - begin),
+                                  .h = 1};
+  }
+  *next = i;
+  return nrects;
+}
+
+void fractal_perturb_render(struct fractal_ctx* ctx, size_t worker_count,
+                            uint32_t pixels_per_item) {
+  struct fractal_perturb* perturb = ctx->perturb;
+  fractal_perturb_reference(ctx, 0.0, 0.0);
+  perturb_run(ctx, worker_count, NULL, 0, pixels_per_item);
+
+  wq_rect_t* rects = malloc(FRACTAL_PERTURB_BATCH * sizeof(wq_rect_t));
+  uint64_t count;
+  uintptr_t pick = 0;
+  while ((count = perturb_count_glitched(ctx, &pick)) != 0 &&
+         perturb->references < FRACTAL_PERTURB_MAX_REFERENCES) {
+    const double column = pick % ctx->width;
+    const double row = pick / ctx->width;
+    fractal_perturb_reference(
+        ctx, ctx->fwidth * (column - ctx->width / 2.0) / ctx->width,
+        ctx->fheight * (row - ctx->height / 2.0) / ctx->height);
+    perturb->glitched_pixels += count;
+    // Rendering a batch only touches the flags of pixels already collected.
+    uintptr_t next = 0;
+    uintptr_t nrects;
+    while ((nrects = perturb_glitched_rects(ctx, rects, &next)) != 0) {
+      perturb_run(ctx, worker_count, rects, nrects, pixels_per_item);
+    }
+  }
+  free(rects);
+}
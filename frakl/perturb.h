@@ -0,0 +1,60 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bignum.h"
+#include "fractal.h"
+
+// Deep zooms run out of double precision long before the interesting detail
+// does. Instead one reference orbit Z_n is computed with bignums, and every
+// pixel only iterates its offset from it in doubles:
+//   d_{n+1} = 2 Z_n d_n + d_n^2 + dc
+// When z = Z + d gets too small relative to Z, d has lost its precision and
+// the pixel is flagged as glitched, to be redone against a new reference.
+struct fractal_perturb {
+  // The view's center, at full precision.
+  struct bignum center[2];
+  // The reference orbit from Z_1 = C, ending with the first point outside
+  // the escape radius or Z_max.
+  double* zx;
+  double* zy;
+  // |Z_n|^2 scaled by the glitch tolerance, pixels below it are glitched.
+  double* glitch_magsq;
+  uint32_t length;
+  // Where C sits, in pixels.
+  double ref_column;
+  double ref_row;
+  // One flag per pixel, set by the kernel when the pixel glitched.
+  uint8_t* glitched;
+  // Reference orbits computed and pixels redone so far.
+  uint32_t references;
+  uint64_t glitched_pixels;
+};
+
+const char* fractal_perturbation_name(
+    enum fractal_perturbation perturbation);
+
+// Resolves ctx->perturbation, turning it on once pixels are too small even
+// for double-double unless ctx->precision was set explicitly. center is given
+// as decimal strings so it can be more precise than a double. If it's on,
+// allocates ctx->perturb for fractal_ctx_select_kernel to pick up. The view
+// must already be set.
+const char* fractal_perturb_init(struct fractal_ctx* ctx,
+                                 const char* const center[2]);
+
+void fractal_perturb_destroy(struct fractal_ctx* ctx);
+
+// Computes the reference orbit at C = center + (dx, dy).
+void fractal_perturb_reference(struct fractal_ctx* ctx, double dx, double dy);
+
+// The kernel fractal_ctx_select_kernel picks when ctx->perturb is set.
+void fractal_perturb_kernel(struct fractal_ctx* ctx, wq_rect_t const* rect);
+
+// Renders the whole image against a reference at the center, then keeps
+// picking a new reference among the glitched pixels and redoing just those,
+// up to FRACTAL_PERTURB_MAX_REFERENCES times.
+void fractal_perturb_render(struct fractal_ctx* ctx, size_t worker_count,
+                            uint32_t pixels_per_item);
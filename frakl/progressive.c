@@ -0,0 +1,98 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#include "progressive.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Appends the rect of the columns from x to the end of row, step apart.
+static inline uintptr_t progressive_push(wq_rect_t* rects, uintptr_t count,
+                                         uint32_t width, uint32_t x,
+                                         uint32_t row, uint32_t step) {
+  if (x < width) {
+    rects[count++] = (wq_rect_t){
+        .x = x, .y = row, .w = (width - x + step - 1) / step, .h = 1};
+  }
+  return count;
+}
+
+// Collects the rects of the pixels pass computes. Past the first pass they
+// all step twice the pass's step: rows the previous pass sampled only need
+// the columns between its samples, the rows in between need both those and
+// the columns it sampled.
+static uintptr_t progressive_rects(struct fractal_ctx const* ctx,
+                                   unsigned pass, wq_rect_t* rects) {
+  const uint32_t step = fractal_progressive_step(pass);
+  const uint32_t width = ctx->width;
+  uintptr_t count = 0;
+  for (uint32_t row = 0; row < ctx->height; row += step) {
+    if (pass == 0) {
+      count = progressive_push(rects, count, width, 0, row, step);
+      continue;
+    }
+    if (row % (2 * step) != 0) {
+      count = progressive_push(rects, count, width, 0, row, 2 * step);
+    }
+    count = progressive_push(rects, count, width, step, row, 2 * step);
+  }
+  return count;
+}
+
+// The sample nearest to i, of those step apart below n. Ties go to the one
+// before.
+static inline uint32_t progressive_nearest(uint32_t i, uint32_t step,
+                                           uint32_t n) {
+  const uint32_t below = i - i % step;
+  const uint32_t above = below + step;
+  return i % step > step / 2 && above < n ? above : below;
+}
+
+// Fills every pixel that isn't a sample of step with its nearest sample.
+// Samples only ever read themselves, so this can be done in place.
+static void progressive_fill(struct fractal_ctx const* ctx, uint32_t step,
+                             uint32_t* columns) {
+  const uint32_t width = ctx->width;
+  const uint32_t height = ctx->height;
+  uint8_t* const buffer = ctx->buffer;
+  for (uint32_t column = 0; column < width; column++) {
+    columns[column] = progressive_nearest(column, step, width);
+  }
+  for (uint32_t row = 0; row < height; row += step) {
+    uint8_t* line = buffer + (uintptr_t)row * width;
+    for (uint32_t column = 0; column < width; column++) {
+      line[column] = line[columns[column]];
+    }
+  }
+  for (uint32_t row = 0; row < height; row++) {
+    const uint32_t source = progressive_nearest(row, step, height);
+    if (source != row) {
+      memcpy(buffer + (uintptr_t)row * width,
+             buffer + (uintptr_t)source * width, width);
+    }
+  }
+}
+
+void fractal_progressive_render(
+    struct fractal_ctx* ctx, size_t worker_count,
+    struct timespec pass_done[FRACTAL_PROGRESSIVE_PASSES]) {
+  // No pass has more than two rects per row.
+  wq_rect_t* rects = malloc(2 * (uintptr_t)ctx->height * sizeof(wq_rect_t));
+  uint32_t* columns = malloc(ctx->width * sizeof(uint32_t));
+  for (unsigned pass = 0; pass < FRACTAL_PROGRESSIVE_PASSES; pass++) {
+    const uint32_t step = fractal_progressive_step(pass);
+    const uintptr_t count = progressive_rects(ctx, pass, rects);
+    ctx->column_step = pass == 0 ? step : 2 * step;
+    wq_t wq = wq_create_rect("frak", (void*)fractal_worker, worker_count,
+                             count ?: 1);
+    wq_push_rects(wq, count, rects);
+    wq_start(wq, ctx);
+    wq_wait(wq);
+    wq_destroy(wq);
+    if (step > 1) {
+      progressive_fill(ctx, step, columns);
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &pass_done[pass]);
+  }
+  free(columns);
+  free(rects);
+}
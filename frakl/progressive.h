@@ -0,0 +1,29 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "fractal.h"
+
+// Passes sample every 8th, 4th, 2nd and finally every pixel in each
+// direction.
+#define FRACTAL_PROGRESSIVE_PASSES 4
+#define FRACTAL_PROGRESSIVE_FIRST_STEP (1u << (FRACTAL_PROGRESSIVE_PASSES - 1))
+
+// The distance between the pixels sampled once pass is done.
+static inline uint32_t fractal_progressive_step(unsigned pass) {
+  return FRACTAL_PROGRESSIVE_FIRST_STEP >> pass;
+}
+
+// Renders ctx->buffer coarse to fine. Each pass only computes the pixels no
+// earlier pass did, then fills every other pixel from its nearest sample so
+// the buffer always holds a complete image. The final image is the same as
+// one rendered in a single pass. Stores the time each pass was done in
+// pass_done. ctx->column_step must be set to FRACTAL_PROGRESSIVE_FIRST_STEP
+// before selecting the kernel.
+void fractal_progressive_render(
+    struct fractal_ctx* ctx, size_t worker_count,
+    struct timespec pass_done[FRACTAL_PROGRESSIVE_PASSES]);
@@ -4,6 +4,7 @@
 #include "utils.h"
 
 #include <assert.h>
+#include <sched.h>
 #include <stdatomic.h>
 #include <stdio.h>
 #include <strings.h>
@@ -12,7 +13,13 @@ struct q_cell;
 typedef struct q_cell* q_cell_t;
 
 struct q_cell {
-  void* data;
+  // Set once a pusher has written the cell, cleared once a popper has read it.
+  // Reserving a cell and filling it aren't atomic, so both sides wait on this.
+  _Atomic(bool) full;
+  union {
+    void* data;
+    struct queue_rect rect;
+  };
 };
 
 struct queue {
@@ -43,6 +50,12 @@ void queue_destroy(queue_t q) {
   free(q);
 }
 
+static inline void q_cell_wait(struct q_cell* cell, bool full) {
+  while (atomic_load_explicit(&cell->full, memory_order_acquire) != full) {
+    sched_yield();
+  }
+}
+
 uintptr_t atomic_fetch_inc_and(_Atomic(uintptr_t) * value, uintptr_t mask) {
   uintptr_t val = atomic_fetch_add(value, 1) + 1;
   if (val != (val & mask)) {
@@ -52,7 +65,9 @@ uintptr_t atomic_fetch_inc_and(_Atomic(uintptr_t) * value, uintptr_t mask) {
   return (val - 1) & mask;
 }
 
-unsigned queue_push_n(queue_t q, unsigned n, void* data[]) {
+// Reserves up to n cells at the head, returning the range [*start, *end).
+static unsigned queue_reserve_push(queue_t q, unsigned n, uintptr_t* start,
+                                   uintptr_t* end) {
   uintptr_t head = atomic_load(&q->head);
   const uintptr_t tail = atomic_load(&q->tail);
   const uintptr_t cap_mask = q->cap_mask;
@@ -60,22 +75,20 @@ unsigned queue_push_n(queue_t q, unsigned n, void* data[]) {
   uintptr_t left;
   uintptr_t new_head;
   do {
-    left = head >= tail ? cap - head + tail - 1 : tail - head;
+    left = head >= tail ? cap - head + tail - 1 : tail - head - 1;
     new_head = (head + (n < left ? n : left)) & cap_mask;
     if (new_head == head) {
       return 0;
     }
   } while (!atomic_compare_exchange_weak(&q->head, &head, new_head));
-  void** data_iter = data;
-  unsigned res = 0;
-  for (uintptr_t i = head; i != new_head; i = ((i + 1) & cap_mask)) {
-    q->cells[i].data = data ? *data_iter++ : (void*)(uintptr_t)res;
-    res += 1;
-  }
-  return res;
+  *start = head;
+  *end = new_head;
+  return (new_head - head) & cap_mask;
 }
 
-unsigned queue_pop_n(queue_t q, unsigned n, void* results[]) {
+// Claims up to n cells at the tail, returning the range [*start, *end).
+static unsigned queue_reserve_pop(queue_t q, unsigned n, uintptr_t* start,
+                                  uintptr_t* end) {
   const uintptr_t head = atomic_load(&q->head);
   uintptr_t tail = atomic_load(&q->tail);
   const uintptr_t cap_mask = q->cap_mask;
@@ -89,13 +102,85 @@ unsigned queue_pop_n(queue_t q, unsigned n, void* results[]) {
     len = head > tail ? head - tail : cap + head - tail;
     new_tail = (tail + (n < len ? n : len)) & cap_mask;
   } while (!atomic_compare_exchange_weak(&q->tail, &tail, new_tail));
+  *start = tail;
+  *end = new_tail;
+  return (new_tail - tail) & cap_mask;
+}
+
+unsigned queue_push_n(queue_t q, unsigned n, void* data[]) {
+  uintptr_t head;
+  uintptr_t new_head;
+  if (!queue_reserve_push(q, n, &head, &new_head)) {
+    return 0;
+  }
+  const uintptr_t cap_mask = q->cap_mask;
+  void** data_iter = data;
+  unsigned res = 0;
+  for (uintptr_t i = head; i != new_head; i = ((i + 1) & cap_mask)) {
+    struct q_cell* cell = &q->cells[i];
+    q_cell_wait(cell, false);
+    cell->data = data ? *data_iter++ : (void*)(uintptr_t)res;
+    atomic_store_explicit(&cell->full, true, memory_order_release);
+    res += 1;
+  }
+  return res;
+}
+
+unsigned queue_pop_n(queue_t q, unsigned n, void* results[]) {
+  uintptr_t tail;
+  uintptr_t new_tail;
+  if (!queue_reserve_pop(q, n, &tail, &new_tail)) {
+    return 0;
+  }
+  const uintptr_t cap_mask = q->cap_mask;
   void** results_iter = results;
   unsigned res = 0;
   for (uintptr_t i = tail; i != new_tail; i = ((i + 1) & cap_mask)) {
     res += 1;
     struct q_cell* cell = &q->cells[i];
+    q_cell_wait(cell, true);
     *results_iter++ = cell->data;
     cell->data = NULL;
+    atomic_store_explicit(&cell->full, false, memory_order_release);
+  }
+  return res;
+}
+
+unsigned queue_push_rects(queue_t q, unsigned n,
+                          struct queue_rect const rects[]) {
+  uintptr_t head;
+  uintptr_t new_head;
+  if (!queue_reserve_push(q, n, &head, &new_head)) {
+    return 0;
+  }
+  const uintptr_t cap_mask = q->cap_mask;
+  struct queue_rect const* rects_iter = rects;
+  unsigned res = 0;
+  for (uintptr_t i = head; i != new_head; i = ((i + 1) & cap_mask)) {
+    struct q_cell* cell = &q->cells[i];
+    q_cell_wait(cell, false);
+    cell->rect = *rects_iter++;
+    atomic_store_explicit(&cell->full, true, memory_order_release);
+    res += 1;
+  }
+  return res;
+}
+
+unsigned queue_pop_rects(queue_t q, unsigned n, struct queue_rect results[]) {
+  uintptr_t tail;
+  uintptr_t new_tail;
+  if (!queue_reserve_pop(q, n, &tail, &new_tail)) {
+    return 0;
+  }
+  const uintptr_t cap_mask = q->cap_mask;
+  struct queue_rect* results_iter = results;
+  unsigned res = 0;
+  for (uintptr_t i = tail; i != new_tail; i = ((i + 1) & cap_mask)) {
+    res += 1;
+    struct q_cell* cell = &q->cells[i];
+    q_cell_wait(cell, true);
+    *results_iter++ = cell->rect;
+    atomic_store_explicit(&cell->full, false, memory_order_release);
   }
   return res;
 }
@@ -9,6 +9,14 @@
 struct queue;
 typedef struct queue* queue_t;
 
+// A compact rectangular work item. Rows [y, y + h) and columns [x, x + w).
+struct queue_rect {
+  uint32_t x;
+  uint32_t y;
+  uint32_t w;
+  uint32_t h;
+};
+
 queue_t queue_create(uintptr_t max_cap);
 
 void queue_destroy(queue_t q);
@@ -27,6 +35,13 @@ static inline void* queue_pop(queue_t q) {
   return queue_pop_n(q, 1, buffer) == 1 ? buffer[0] : NULL;
 }
 
+// Rects and pointers share the same cells, a single queue should only ever
+// hold one or the other.
+unsigned queue_push_rects(queue_t q, unsigned n,
+                          struct queue_rect const rects[]);
+
+unsigned queue_pop_rects(queue_t q, unsigned n, struct queue_rect results[]);
+
 void queue_dump(queue_t q);
 
 bool queue_is_empty(queue_t q);
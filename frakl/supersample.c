@@ -0,0 +1,166 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#include "supersample.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+const char* fractal_supersample_init(struct fractal_supersample* supersample,
+                                     struct fractal_ctx const* ctx,
+                                     uint32_t grid, uint32_t threshold) {
+  memset(supersample, 0, sizeof(*supersample));
+  supersample->grid = grid;
+  supersample->threshold = threshold;
+
+  // Samples grid times finer than ctx's pixels, so periodicity's tolerance
+  // and the precision fit them. Escalation forces the scalar kernel, samples
+  // don't need it. Runs are short, lane refill keeps the lanes busy across
+  // their rows of samples.
+  struct fractal_ctx* sample_ctx = &supersample->sample_ctx;
+  sample_ctx->width = ctx->width * grid;
+  sample_ctx->height = ctx->height * grid;
+  sample_ctx->max_iteration = ctx->max_iteration;
+  sample_ctx->formula = ctx->formula;
+  sample_ctx->power = ctx->power;
+  sample_ctx->julia = ctx->julia;
+  sample_ctx->julia_c[0] = ctx->julia_c[0];
+  sample_ctx->julia_c[1] = ctx->julia_c[1];
+  sample_ctx->lyapunov = ctx->lyapunov;
+  sample_ctx->newton = ctx->newton;
+  sample_ctx->fwidth = ctx->fwidth;
+  sample_ctx->fheight = ctx->fheight;
+  sample_ctx->ftop = ctx->ftop;
+  sample_ctx->fleft = ctx->fleft;
+  sample_ctx->fleft_lo = ctx->fleft_lo;
+  sample_ctx->ftop_lo = ctx->ftop_lo;
+  sample_ctx->kernel = ctx->escalate ? fractal_kernel_auto : ctx->kernel;
+  sample_ctx->lane_refill = true;
+  sample_ctx->interior_check = ctx->interior_check;
+  sample_ctx->periodicity = ctx->periodicity;
+  sample_ctx->precision =
+      ctx->precision_auto ? fractal_precision_auto : ctx->precision;
+  sample_ctx->float_first = ctx->float_first;
+  sample_ctx->unroll = ctx->unroll;
+  return fractal_ctx_select_kernel(sample_ctx);
+}
+
+// base + offset, keeping what rounding lost in *lo.
+static inline double supersample_add(double base, double offset, double* lo) {
+  const double sum = base + offset;
+  const double b = sum - base;
+  *lo += (base - (sum - b)) + (offset - b);
+  return sum;
+}
+
+// Renders the samples of a run of pixels within a row and averages them into
+// the image.
+static void supersample_worker(wq_rect_t const* rect,
+                               struct fractal_supersample* supersample) {
+  uint8_t samples[FRACTAL_SUPERSAMPLE_RUN * FRACTAL_SUPERSAMPLE_MAX_GRID *
+                  FRACTAL_SUPERSAMPLE_MAX_GRID];
+  struct fractal_ctx const* image = supersample->image;
+  const uint32_t grid = supersample->grid;
+
+  // A view just covering the run's samples, the first of each pixel sitting
+  // half a sample in from its corner and the pixel centered on its point.
+  struct fractal_ctx ctx;
+  memcpy(&ctx, &supersample->sample_ctx, sizeof(ctx));
+  memset(&ctx.stats, 0, sizeof(ctx.stats));
+  ctx.width = rect->w * grid;
+  ctx.height = grid;
+  ctx.fwidth = image->fwidth * rect->w / image->width;
+  ctx.fheight = image->fheight / image->height;
+  const double corner = 0.5 / grid - 0.5;
+  ctx.fleft = supersample_add(
+      image->fleft, image->fwidth * (rect->x + corner) / image->width,
+      &ctx.fleft_lo);
+  ctx.ftop = supersample_add(
+      image->ftop, image->fheight * (rect->y + corner) / image->height,
+      &ctx.ftop_lo);
+  ctx.buffer = samples;
+  ctx.kernel_fn(&ctx, &(wq_rect_t){.w = ctx.width, .h = ctx.height});
+
+  uint8_t* out = (uint8_t*)image->buffer +
+                 (uintptr_t)rect->y * image->width + rect->x;
+  const uint32_t count = grid * grid;
+  for (uint32_t i = 0; i < rect->w; i++) {
+    uint32_t sum = 0;
+    for (uint32_t sy = 0; sy < grid; sy++) {
+      uint8_t const* line = samples + sy * ctx.width + i * grid;
+      for (uint32_t sx = 0; sx < grid; sx++) {
+        sum += line[sx];
+      }
+    }
+    out[i] = (sum + count / 2) / count;
+  }
+}
+
+static inline bool supersample_contrasts(uint8_t a, uint8_t b,
+                                         uint32_t threshold) {
+  return (uint32_t)(a > b ? a - b : b - a) > threshold;
+}
+
+// Collects runs of pixels that differ from a 4-neighbour by more than the
+// threshold, at most FRACTAL_SUPERSAMPLE_RUN long. rects is grown as needed.
+static uintptr_t supersample_runs(struct fractal_ctx const* ctx,
+                                  uint32_t threshold, wq_rect_t** rects,
+                                  uintptr_t* capacity) {
+  uint8_t const* buffer = ctx->buffer;
+  const uint32_t width = ctx->width;
+  const uint32_t height = ctx->height;
+  uintptr_t count = 0;
+  for (uint32_t row = 0; row < height; row++) {
+    uint8_t const* line = buffer + (uintptr_t)row * width;
+    wq_rect_t* run = NULL;
+    for (uint32_t column = 0; column < width; column++) {
+      uint8_t const* pixel = line + column;
+      const bool refine =
+          (column > 0 && supersample_contrasts(*pixel, pixel[-1], threshold)) ||
+          (column + 1 < width &&
+           supersample_contrasts(*pixel, pixel[1], threshold)) ||
+          (row > 0 &&
+           supersample_contrasts(*pixel, *(pixel - width), threshold)) ||
+          (row + 1 < height &&
+           supersample_contrasts(*pixel, pixel[width], threshold));
+      if (!refine) {
+        run = NULL;
+        continue;
+      }
+      if (run && run->w < FRACTAL_SUPERSAMPLE_RUN) {
+        run->w += 1;
+        continue;
+      }
+      if (count == *capacity) {
+        *capacity = *capacity ? 2 * *capacity : 1024;
+        *rects = realloc(*rects, *capacity * sizeof(wq_rect_t));
+      }
+      run = &(*rects)[count++];
+      *run = (wq_rect_t){.x = column, .y = row, .w = 1, .h = 1};
+    }
+  }
+  return count;
+}
+
+void fractal_supersample_render(struct fractal_supersample* supersample,
+                                struct fractal_ctx const* ctx,
+                                size_t worker_count) {
+  wq_rect_t* rects = NULL;
+  uintptr_t capacity = 0;
+  const uintptr_t count =
+      supersample_runs(ctx, supersample->threshold, &rects, &capacity);
+  supersample->refined_pixels = 0;
+  for (uintptr_t i = 0; i < count; i++) {
+    supersample->refined_pixels += rects[i].w;
+  }
+  if (count) {
+    supersample->image = ctx;
+    wq_t wq = wq_create_rect("frak", (void*)supersample_worker, worker_count,
+                             count);
+    wq_push_rects(wq, count, rects);
+    wq_start(wq, supersample);
+    wq_wait(wq);
+    wq_destroy(wq);
+    supersample->image = NULL;
+  }
+  free(rects);
+}
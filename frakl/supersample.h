@@ -0,0 +1,40 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fractal.h"
+
+// Pixels refined at once, a grid x grid block of samples each.
+#define FRACTAL_SUPERSAMPLE_RUN 64
+#define FRACTAL_SUPERSAMPLE_MAX_GRID 8
+
+struct fractal_supersample {
+  // Samples per pixel along each axis.
+  uint32_t grid;
+  // Pixels differing from a neighbour by more than this many shades are
+  // refined.
+  uint32_t threshold;
+  // Renders the samples, selected from the ctx being refined.
+  struct fractal_ctx sample_ctx;
+  // The ctx being refined while fractal_supersample_render runs.
+  struct fractal_ctx const* image;
+  uint64_t refined_pixels;
+};
+
+// Prepares supersample to refine the image ctx renders, resolving the kernel
+// for samples grid times finer than its pixels. grid must be at most
+// FRACTAL_SUPERSAMPLE_MAX_GRID.
+const char* fractal_supersample_init(struct fractal_supersample* supersample,
+                                     struct fractal_ctx const* ctx,
+                                     uint32_t grid, uint32_t threshold);
+
+// Once ctx->buffer holds the image, finds the pixels that differ from a
+// neighbour by more than the threshold and replaces each with the average
+// of a grid x grid block of samples spread across it. Only those pixels'
+// samples are ever held, a run of them at a time.
+void fractal_supersample_render(struct fractal_supersample* supersample,
+                                struct fractal_ctx const* ctx,
+                                size_t worker_count);
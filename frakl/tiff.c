@@ -17,6 +17,7 @@ enum ifd_entry_tag {
   Compression = 0x0103,
   PhotometricInterpretation = 0x0106,
   StripOffsets = 0x0111,
+  SamplesPerPixel = 0x0115,
   RowsPerStrip = 0x0116,
   StripByteCounts = 0x0117,
   XResolution = 0x011A,
@@ -50,6 +51,8 @@ static uint32_t compute_image_data_len(tiff_spec_t spec) {
   if (spec->type == tiff_bilevel) {
     uint32_t wadder = ((spec->width & 0x7) != 0) ? 1 : 0;
     return ((spec->width >> 3) + wadder) * spec->height;
+  } else if (spec->type == tiff_rgb) {
+    return 3 * spec->width * spec->height;
   } else {
     return spec->width * spec->height;
   }
@@ -57,9 +60,11 @@ static uint32_t compute_image_data_len(tiff_spec_t spec) {
 
 static uint32_t compute_resolution_off(tiff_spec_t spec) {
   return 8 + 2 + 10 * 12 + 4 + (spec->type != tiff_bilevel ? 12 : 0) +
-         (spec->type == tiff_palette ? 12 : 0);
+         (spec->type == tiff_palette || spec->type == tiff_rgb ? 12 : 0);
 }
 
+// Where the palette goes, or the bits of each sample for tiff_rgb, which
+// don't fit in their entry.
 static uint32_t compute_palette_off(tiff_spec_t spec) {
   return compute_resolution_off(spec) + 2 * 2 * 4;
 }
@@ -68,6 +73,8 @@ static uint32_t compute_image_data_off(tiff_spec_t spec) {
   uint32_t res = compute_palette_off(spec);
   if (spec->type == tiff_palette) {
     res += 3 * 256 * sizeof(uint16_t);
+  } else if (spec->type == tiff_rgb) {
+    res += 4 * sizeof(uint16_t);
   }
   return res;
 }
@@ -117,6 +124,9 @@ static uint16_t compute_pmi(tiff_spec_t spec) {
   if (spec->type == tiff_palette) {
     return 3;
   }
+  if (spec->type == tiff_rgb) {
+    return 2;
+  }
   return 1;
 }
 
@@ -135,7 +145,7 @@ static uint16_t compute_ifd_count(tiff_spec_t spec) {
   uint16_t res = 10;
   if (spec->type != tiff_bilevel) {
     res += 1;
-    if (spec->type == tiff_palette) {
+    if (spec->type == tiff_palette || spec->type == tiff_rgb) {
       res += 1;
     }
   }
@@ -150,22 +160,25 @@ void* tiff_spec_write_metadata(tiff_spec_t spec, void* buf) {
   buf = write_entry(write_entry(buf, ImageWidth, IFD_LONG, 1, spec->width),
                     ImageLength, IFD_LONG, 1, spec->height);
 
-  if (spec->type != tiff_bilevel) {
+  if (spec->type == tiff_rgb) {
+    buf = write_entry(buf, BitsPerSample, IFD_SHORT, 3,
+                      compute_palette_off(spec));
+  } else if (spec->type != tiff_bilevel) {
     buf = write_entry(buf, BitsPerSample, IFD_LONG, 1, 8);
   }
 
+  buf = write_entry(
+      write_entry(write_entry(buf, Compression, IFD_SHORT, 1, 1),
+                  PhotometricInterpretation, IFD_SHORT, 1, compute_pmi(spec)),
+      StripOffsets, IFD_LONG, 1, compute_image_data_off(spec));
+  if (spec->type == tiff_rgb) {
+    buf = write_entry(buf, SamplesPerPixel, IFD_SHORT, 1, 3);
+  }
   buf = write_entry(
       write_entry(
           write_entry(
               write_entry(
-                  write_entry(
-                      write_entry(write_entry(write_entry(buf, Compression,
-                                                          IFD_SHORT, 1, 1),
-                                              PhotometricInterpretation,
-                                              IFD_SHORT, 1, compute_pmi(spec)),
-                                  StripOffsets, IFD_LONG, 1,
-                                  compute_image_data_off(spec)),
-                      RowsPerStrip, IFD_LONG, 1, spec->height),
+                  write_entry(buf, RowsPerStrip, IFD_LONG, 1, spec->height),
                   StripByteCounts, IFD_LONG, 1, compute_image_data_len(spec)),
               XResolution, IFD_RATIONAL, 1, compute_resolution_off(spec)),
           YResolution, IFD_RATIONAL, 1, compute_resolution_off(spec) + 8),
@@ -181,6 +194,8 @@ void* tiff_spec_write_metadata(tiff_spec_t spec, void* buf) {
 
   if (spec->type == tiff_palette) {
     buf = write_palette(buf, spec->palette);
+  } else if (spec->type == tiff_rgb) {
+    buf = write_short(write_short(write_short(write_short(buf, 8), 8), 8), 0);
   }
 
   return buf;
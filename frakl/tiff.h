@@ -8,6 +8,8 @@ enum tiff_spec_type {
   tiff_bilevel,
   tiff_gray,
   tiff_palette,
+  // 8 bit red, green and blue samples per pixel, interleaved.
+  tiff_rgb,
 };
 
 struct tiff_palette_color {
@@ -3,11 +3,12 @@
 #include "wq.h"
 
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
-#include "queue.h"
-
 struct wq {
   char* name;
   queue_t queue;
@@ -16,10 +17,22 @@ struct wq {
   bool computed_cache_size;
   pthread_t* workers;
   wq_cb_t cb;
+  wq_rect_cb_t rect_cb;
   void* ctx;
+  // Items pushed but not yet finished. Callbacks may push more work, so an
+  // empty queue alone doesn't mean the workers are done.
+  _Atomic(uintptr_t) pending;
+  // Time callbacks, adding up the nanoseconds each worker spent in them into
+  // busy_ns, indexed in the order the workers came up, as they exit.
+  bool timing;
+  uint64_t* busy_ns;
+  _Atomic(size_t) next_worker;
 };
 
-static size_t get_reasonable_worker_count(void) {
+// The index the calling worker took from next_worker.
+static _Thread_local size_t wq_worker_index;
+
+size_t wq_get_default_worker_count(void) {
   return 4 * sysconf(_SC_NPROCESSORS_ONLN) / 3;
 }
 
@@ -29,13 +42,25 @@ wq_t wq_create(const char* name, wq_cb_t cb, size_t worker_count,
   res->name = strdup(name);
   res->queue = queue_create(queue_cap_shift);
   if (!worker_count) {
-    worker_count = get_reasonable_worker_count();
+    worker_count = wq_get_default_worker_count();
   }
   res->worker_count = worker_count;
   res->workers = NULL;
   res->cb = cb;
+  res->rect_cb = NULL;
   res->ctx = NULL;
   res->local_cache_size = (uint32_t)-1;
+  atomic_init(&res->pending, 0);
+  res->timing = false;
+  res->busy_ns = calloc(worker_count, sizeof(uint64_t));
+  atomic_init(&res->next_worker, 0);
+  return res;
+}
+
+wq_t wq_create_rect(const char* name, wq_rect_cb_t cb, size_t worker_count,
+                    uintptr_t queue_max_cap) {
+  wq_t res = wq_create(name, NULL, worker_count, queue_max_cap);
+  res->rect_cb = cb;
   return res;
 }
 
@@ -43,10 +68,245 @@ void wq_set_worker_cache_size(wq_t wq, uint32_t size) {
   wq->local_cache_size = size;
 }
 
+void wq_set_timing(wq_t wq, bool timing) { wq->timing = timing; }
+
 const char* wq_get_name(wq_t wq) { return wq->name; }
 
 unsigned wq_push_n(wq_t wq, unsigned n, void* work[]) {
-  return queue_push_n(wq->queue, n, work);
+  atomic_fetch_add(&wq->pending, n);
+  const unsigned res = queue_push_n(wq->queue, n, work);
+  atomic_fetch_sub(&wq->pending, n - res);
+  return res;
+}
+
+unsigned wq_push_rects(wq_t wq, unsigned n, wq_rect_t const rects[]) {
+  atomic_fetch_add(&wq->pending, n);
+  const unsigned res = queue_push_rects(wq->queue, n, rects);
+  atomic_fetch_sub(&wq->pending, n - res);
+  return res;
+}
+
+// Called when the queue comes up empty. Returns true once all pushed work has
+// finished, otherwise gives other workers a chance to push more.
+static bool wq_worker_should_exit(wq_t wq) {
+  if (atomic_load(&wq->pending) == 0) {
+    return true;
+  }
+  sched_yield();
+  return false;
+}
+
+uintptr_t wq_grid_count(uint32_t width, uint32_t height,
+                        uint32_t pixels_per_item) {
+  if (!width || !height) {
+    return 0;
+  }
+  if (!pixels_per_item) {
+    pixels_per_item = 1;
+  }
+  if (pixels_per_item >= width) {
+    const uint32_t rows = pixels_per_item / width;
+    return (height + rows - 1) / rows;
+  }
+  const uintptr_t per_row = (width + pixels_per_item - 1) / pixels_per_item;
+  return per_row * height;
+}
+
+unsigned wq_push_grid(wq_t wq, uint32_t width, uint32_t height,
+                      uint32_t pixels_per_item) {
+  return wq_push_grid_rows(wq, width, 0, height, pixels_per_item);
+}
+
+unsigned wq_push_grid_rows(wq_t wq, uint32_t width, uint32_t y,
+                           uint32_t height, uint32_t pixels_per_item) {
+  if (!width || !height) {
+    return 0;
+  }
+  const uint32_t y_end = y + height;
+  if (!pixels_per_item) {
+    pixels_per_item = 1;
+  }
+  unsigned res = 0;
+  wq_rect_t rect;
+  if (pixels_per_item >= width) {
+    const uint32_t rows = pixels_per_item / width;
+    rect.x = 0;
+    rect.w = width;
+    for (rect.y = y; rect.y < y_end; rect.y += rows) {
+      rect.h = y_end - rect.y < rows ? y_end - rect.y : rows;
+      if (!wq_push_rect(wq, rect)) {
+        break;
+      }
+      res += 1;
+    }
+  } else {
+    rect.h = 1;
+    for (rect.y = y; rect.y < y_end; rect.y++) {
+      for (rect.x = 0; rect.x < width; rect.x += pixels_per_item) {
+        rect.w = width - rect.x < pixels_per_item ? width - rect.x
+                                                  : pixels_per_item;
+        if (!wq_push_rect(wq, rect)) {
+          return res;
+        }
+        res += 1;
+      }
+    }
+  }
+  return res;
+}
+
+// Every other bit of d, the x coordinate of the d-th cell along a Z curve.
+static uint32_t morton_compact(uint64_t d) {
+  d &= 0x5555555555555555ull;
+  d = (d | (d >> 1)) & 0x3333333333333333ull;
+  d = (d | (d >> 2)) & 0x0f0f0f0f0f0f0f0full;
+  d = (d | (d >> 4)) & 0x00ff00ff00ff00ffull;
+  d = (d | (d >> 8)) & 0x0000ffff0000ffffull;
+  d = (d | (d >> 16)) & 0x00000000ffffffffull;
+  return (uint32_t)d;
+}
+
+// The d-th cell along a Hilbert curve filling an n x n grid, n a power of 2.
+static void hilbert_cell(uint32_t n, uint64_t d, uint32_t* x, uint32_t* y) {
+  uint32_t tx = 0;
+  uint32_t ty = 0;
+  for (uint32_t s = 1; s < n; s *= 2) {
+    const uint32_t rx = 1 & (uint32_t)(d / 2);
+    const uint32_t ry = 1 & (uint32_t)(d ^ rx);
+    if (ry == 0) {
+      if (rx == 1) {
+        tx = s - 1 - tx;
+        ty = s - 1 - ty;
+      }
+      const uint32_t tmp = tx;
+      tx = ty;
+      ty = tmp;
+    }
+    tx += s * rx;
+    ty += s * ry;
+    d /= 4;
+  }
+  *x = tx;
+  *y = ty;
+}
+
+uintptr_t wq_tile_count(uint32_t width, uint32_t height, uint32_t tile_w,
+                        uint32_t tile_h) {
+  if (!tile_w || !tile_h) {
+    return 0;
+  }
+  return (uintptr_t)((width + tile_w - 1) / tile_w) *
+         ((height + tile_h - 1) / tile_h);
+}
+
+unsigned wq_push_tiles(wq_t wq, uint32_t width, uint32_t y, uint32_t height,
+                       uint32_t tile_w, uint32_t tile_h,
+                       enum wq_tile_order order) {
+  const uint32_t columns = tile_w ? (width + tile_w - 1) / tile_w : 0;
+  const uint32_t rows = tile_h ? (height + tile_h - 1) / tile_h : 0;
+  if (!columns || !rows) {
+    return 0;
+  }
+  // Curves cover the smallest power of 2 square around the tiles, the cells
+  // outside of it are skipped.
+  uint32_t side = 1;
+  while (side < columns || side < rows) {
+    side *= 2;
+  }
+  const uint64_t cells =
+      order == wq_tile_order_row_major ? (uint64_t)columns * rows
+                                       : (uint64_t)side * side;
+  unsigned res = 0;
+  for (uint64_t d = 0; d < cells; d++) {
+    uint32_t tx;
+    uint32_t ty;
+    switch (order) {
+      case wq_tile_order_morton:
+        tx = morton_compact(d);
+        ty = morton_compact(d >> 1);
+        break;
+      case wq_tile_order_hilbert:
+        hilbert_cell(side, d, &tx, &ty);
+        break;
+      default:
+        tx = (uint32_t)(d % columns);
+        ty = (uint32_t)(d / columns);
+        break;
+    }
+    if (tx >= columns || ty >= rows) {
+      continue;
+    }
+    const wq_rect_t rect = {
+        .x = tx * tile_w,
+        .y = y + ty * tile_h,
+        .w = width - tx * tile_w < tile_w ? width - tx * tile_w : tile_w,
+        .h = height - ty * tile_h < tile_h ? height - ty * tile_h : tile_h,
+    };
+    if (!wq_push_rect(wq, rect)) {
+      break;
+    }
+    res += 1;
+  }
+  return res;
+}
+
+// A multiple of every kernel's vector width.
+#define WQ_TILE_MIN 16
+// Enough tiles per worker that the last ones to finish don't hold the rest
+// up for long.
+#define WQ_TILES_PER_WORKER 16
+
+uint32_t wq_auto_tile_size(uint32_t width, uint32_t height,
+                           size_t worker_count) {
+  long l1 = -1;
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+  l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+#endif
+  if (l1 <= 0) {
+    l1 = 32 * 1024;
+  }
+  // The largest square tile whose bytes fit in L1.
+  uint32_t size = WQ_TILE_MIN;
+  while ((uint64_t)(2 * size) * (2 * size) <= (uint64_t)l1) {
+    size *= 2;
+  }
+  while (size > WQ_TILE_MIN &&
+         wq_tile_count(width, height, size, size) <
+             WQ_TILES_PER_WORKER * worker_count) {
+    size /= 2;
+  }
+  return size;
+}
+
+static uint64_t wq_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void* wq_rect_worker(wq_t wq) {
+  queue_t q = wq->queue;
+  wq_rect_cb_t cb = wq->rect_cb;
+  void* ctx = wq->ctx;
+  const bool timing = wq->timing;
+  wq_worker_index = atomic_fetch_add(&wq->next_worker, 1);
+  uint64_t busy = 0;
+
+  wq_rect_t rect;
+  for (;;) {
+    if (queue_pop_rects(q, 1, &rect) != 0) {
+      const uint64_t start = timing ? wq_now_ns() : 0;
+      cb(&rect, ctx);
+      if (timing) {
+        busy += wq_now_ns() - start;
+      }
+      atomic_fetch_sub(&wq->pending, 1);
+    } else if (wq_worker_should_exit(wq)) {
+      break;
+    }
+  }
+  wq->busy_ns[wq_worker_index] = busy;
+  return NULL;
 }
 
 static void* wq_worker(wq_t wq) {
@@ -56,11 +316,24 @@ static void* wq_worker(wq_t wq) {
 
   const uint32_t cache_size = wq->local_cache_size ?: 10;
   void** cache = calloc(cache_size, sizeof(struct wq_item*));
+  const bool timing = wq->timing;
+  wq_worker_index = atomic_fetch_add(&wq->next_worker, 1);
+  uint64_t busy = 0;
 
   unsigned n;
-  while ((n = queue_pop_n(q, cache_size, cache)) != 0) {
-    cb(cache, n, ctx);
+  for (;;) {
+    if ((n = queue_pop_n(q, cache_size, cache)) != 0) {
+      const uint64_t start = timing ? wq_now_ns() : 0;
+      cb(cache, n, ctx);
+      if (timing) {
+        busy += wq_now_ns() - start;
+      }
+      atomic_fetch_sub(&wq->pending, n);
+    } else if (wq_worker_should_exit(wq)) {
+      break;
+    }
   }
+  wq->busy_ns[wq_worker_index] = busy;
   free(cache);
   return NULL;
 }
@@ -72,6 +345,9 @@ void wq_start(wq_t wq, void* ctx) {
   const size_t worker_count = wq->worker_count;
   wq->workers = calloc(worker_count, sizeof(pthread_t));
   wq->ctx = ctx;
+  memset(wq->busy_ns, 0, worker_count * sizeof(uint64_t));
+  atomic_store(&wq->next_worker, 0);
+  void* (*worker)(wq_t) = wq->rect_cb ? wq_rect_worker : wq_worker;
   if (wq->local_cache_size == (uint32_t)-1) {
     wq->local_cache_size = queue_get_length(wq->queue) / (8 * worker_count);
     wq->computed_cache_size = true;
@@ -79,7 +355,7 @@ void wq_start(wq_t wq, void* ctx) {
     wq->computed_cache_size = false;
   }
   for (size_t i = 0; i < worker_count; i++) {
-    pthread_create(&wq->workers[i], NULL, (void*)&wq_worker, wq);
+    pthread_create(&wq->workers[i], NULL, (void*)worker, wq);
   }
 }
 
@@ -99,6 +375,7 @@ void wq_wait(wq_t wq) {
 void wq_destroy(wq_t wq) {
   free(wq->name);
   queue_destroy(wq->queue);
+  free(wq->busy_ns);
   if (wq->workers) {
     free(wq->workers);
   }
@@ -106,3 +383,9 @@ void wq_destroy(wq_t wq) {
 }
 
 bool wq_is_running(wq_t wq) { return wq->workers != NULL; }
+
+size_t wq_get_worker_count(wq_t wq) { return wq->worker_count; }
+
+size_t wq_get_worker_index(void) { return wq_worker_index; }
+
+uint64_t const* wq_get_busy_ns(wq_t wq) { return wq->busy_ns; }
@@ -6,18 +6,37 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include "queue.h"
+
 struct wq;
 typedef struct wq* wq_t;
 typedef void (*wq_cb_t)(void** work, unsigned n, void* ctx);
 
+typedef struct queue_rect wq_rect_t;
+typedef void (*wq_rect_cb_t)(wq_rect_t const* rect, void* ctx);
+
 // Pass worker_count = 0 for default
 wq_t wq_create(const char* name, wq_cb_t cb, size_t worker_count,
                uintptr_t queue_max_cap);
 
+// Like wq_create, but the queue holds wq_rect_t's which are handed to cb one
+// at a time. Each rect is expected to be a whole chunk of work, so the worker
+// cache size is ignored.
+wq_t wq_create_rect(const char* name, wq_rect_cb_t cb, size_t worker_count,
+                    uintptr_t queue_max_cap);
+
+size_t wq_get_default_worker_count(void);
+
 void wq_set_worker_cache_size(wq_t wq, uint32_t size);
 
+// Whether to time the callbacks for wq_get_busy_ns, off by default so
+// renders nobody measures don't read the clock around every item.
+void wq_set_timing(wq_t wq, bool timing);
+
 const char* wq_get_name(wq_t wq);
 
+// Safe to call from within a callback while the wq is running, workers keep
+// going until every pushed item has been handled.
 unsigned wq_push_n(wq_t wq, unsigned n, void* work[]);
 
 static inline bool wq_push(wq_t wq, void* work) {
@@ -25,6 +44,50 @@ static inline bool wq_push(wq_t wq, void* work) {
   return wq_push_n(wq, 1, buffer) == 1;
 }
 
+unsigned wq_push_rects(wq_t wq, unsigned n, wq_rect_t const rects[]);
+
+static inline bool wq_push_rect(wq_t wq, wq_rect_t rect) {
+  return wq_push_rects(wq, 1, &rect) == 1;
+}
+
+// The number of rects wq_push_grid will push for the given parameters.
+uintptr_t wq_grid_count(uint32_t width, uint32_t height,
+                        uint32_t pixels_per_item);
+
+// Splits a width x height grid into rects holding roughly pixels_per_item
+// pixels each and pushes them in row-major order. Items are whole rows when
+// pixels_per_item >= width, otherwise segments of a single row.
+unsigned wq_push_grid(wq_t wq, uint32_t width, uint32_t height,
+                      uint32_t pixels_per_item);
+
+// wq_push_grid for just rows [y, y + height) of the grid.
+unsigned wq_push_grid_rows(wq_t wq, uint32_t width, uint32_t y,
+                           uint32_t height, uint32_t pixels_per_item);
+
+enum wq_tile_order {
+  wq_tile_order_row_major = 0,
+  // Z-order, tiles close in the order are close in the image.
+  wq_tile_order_morton = 1,
+  // Like Morton but without its long jumps between quadrants.
+  wq_tile_order_hilbert = 2,
+};
+
+// The number of rects wq_push_tiles will push for a width x height grid.
+uintptr_t wq_tile_count(uint32_t width, uint32_t height, uint32_t tile_w,
+                        uint32_t tile_h);
+
+// Splits rows [y, y + height) of a grid width wide into tile_w x tile_h
+// tiles, clipped at the edges, and pushes them in the given order.
+unsigned wq_push_tiles(wq_t wq, uint32_t width, uint32_t y, uint32_t height,
+                       uint32_t tile_w, uint32_t tile_h,
+                       enum wq_tile_order order);
+
+// The side of a square tile for a width x height grid of bytes: as large as
+// fits in the L1 data cache, but small enough that every worker gets plenty
+// of tiles.
+uint32_t wq_auto_tile_size(uint32_t width, uint32_t height,
+                           size_t worker_count);
+
 void wq_start(wq_t wq, void* ctx);
 
 void wq_wait(wq_t wq);
@@ -32,3 +95,14 @@ void wq_wait(wq_t wq);
 void wq_destroy(wq_t wq);
 
 bool wq_is_running(wq_t wq);
+
+size_t wq_get_worker_count(wq_t wq);
+
+// The index of the worker running the calling callback, below
+// wq_get_worker_count, for callbacks keeping per worker state.
+size_t wq_get_worker_index(void);
+
+// Nanoseconds each of the wq_get_worker_count workers spent in callbacks
+// during the last run, in no particular order, all 0 without wq_set_timing.
+// Read it after wq_wait.
+uint64_t const* wq_get_busy_ns(wq_t wq);
@@ -15,11 +15,25 @@
 #endif
 
 #include "frak_args.h"
+#include "frakl/balance.h"
+#include "frakl/buddhabrot.h"
+#include "frakl/budget.h"
+#include "frakl/escalate.h"
+#include "frakl/flame.h"
 #include "frakl/fractal.h"
+#include "frakl/lyapunov.h"
+#include "frakl/mandelbulb.h"
+#include "frakl/newton.h"
+#include "frakl/perturb.h"
+#include "frakl/progressive.h"
+#include "frakl/supersample.h"
 #include "frakl/tiff.h"
 #include "frakl/time_utils.h"
 #include "frakl/wq.h"
 
+// Workers fall back to computing sub-rects inline once this fills up.
+#define FRAK_MARIANI_QUEUE_CAP 4096
+
 static void fill_random(void* buffer, size_t len) {
 #if __APPLE__
   arc4random_buf(buffer, len);
@@ -33,8 +47,9 @@ static void fill_random(void* buffer, size_t len) {
   long int buf;
   while (iter < end) {
     buf = random();
-    unsigned len = ((long)sizeof(long int) < (end - iter)) ? sizeof(long int)
-                                                           : (end - iter);
+    unsigned len = ((long)sizeof(long int) < (end - iter))
+                       ? (unsigned)sizeof(long int)
+                       : (unsigned)(end - iter);
     memcpy(iter, &buf, len);
     iter += len;
   }
@@ -88,6 +103,12 @@ static inline void tiff_spec_init_from_frak_args(tiff_spec_t spec,
   spec->width = args->width;
   spec->height = args->height;
   spec->ppi = args->ppi;
+  if (args->design == frak_design_nebulabrot ||
+      args->design == frak_design_flame) {
+    spec->type = tiff_rgb;
+    spec->palette = NULL;
+    return;
+  }
   switch (args->palette) {
     case frak_palette_color:
     case frak_palette_custom: {
@@ -131,6 +152,142 @@ static inline void tiff_spec_init_from_frak_args(tiff_spec_t spec,
   }
 }
 
+// Pushes the work for rows [y, y + height), tiles of tile_size if args asks
+// for them and the usual grid of chunk_size otherwise. Only counts the rects
+// it would push if wq is NULL. With balance the rows are added to its chunks
+// instead, which are all pushed at once by fractal_balance_push.
+static uintptr_t push_rows(wq_t wq, struct frak_args const* args,
+                           struct fractal_balance* balance, uint32_t y,
+                           uint32_t height, uint32_t chunk_size,
+                           uint32_t tile_size) {
+  if (balance) {
+    return wq ? 0 : fractal_balance_add_rows(balance, y, height);
+  }
+  if (args->tiles != frak_tiles_off) {
+    return wq ? wq_push_tiles(wq, args->width, y, height, tile_size,
+                              tile_size,
+                              (enum wq_tile_order)(args->tiles - 1))
+              : wq_tile_count(args->width, height, tile_size, tile_size);
+  }
+  return wq ? wq_push_grid_rows(wq, args->width, y, height, chunk_size)
+            : wq_grid_count(args->width, height, chunk_size);
+}
+
+// Pushes the rows that aren't mirrored from others, see
+// fractal_ctx_mirror_rows, or all of them if source is NULL. The mirrored rows
+// are one range, so the rows above and below it are each cut into whole tiles.
+static uintptr_t push_computed_rows(wq_t wq, struct frak_args const* args,
+                                    struct fractal_balance* balance,
+                                    uint32_t const* source,
+                                    uint32_t chunk_size, uint32_t tile_size) {
+  if (!source) {
+    return push_rows(wq, args, balance, 0, args->height, chunk_size,
+                     tile_size);
+  }
+  uint32_t begin = 0;
+  while (begin < args->height && source[begin] == begin) {
+    begin++;
+  }
+  uint32_t end = begin;
+  while (end < args->height && source[end] != end) {
+    end++;
+  }
+  uintptr_t count =
+      push_rows(wq, args, balance, 0, begin, chunk_size, tile_size);
+  if (end < args->height) {
+    count += push_rows(wq, args, balance, end, args->height - end, chunk_size,
+                       tile_size);
+  }
+  return count;
+}
+
+static enum fractal_formula formula_for_design(enum frak_design design) {
+  switch (design) {
+    case frak_design_multibrot:
+      return fractal_formula_multibrot;
+    case frak_design_burning_ship:
+      return fractal_formula_burning_ship;
+    case frak_design_tricorn:
+      return fractal_formula_tricorn;
+    case frak_design_celtic:
+      return fractal_formula_celtic;
+    default:
+      return fractal_formula_mandlebrot;
+  }
+}
+
+static int busy_sort(const void* a, const void* b) {
+  const uint64_t ua = *(uint64_t const*)a;
+  const uint64_t ub = *(uint64_t const*)b;
+  return ua < ub ? 1 : ua > ub ? -1 : 0;
+}
+
+// Prints how busy each worker was, busiest first, in ms after multiplying
+// by ns_per_unit.
+static void print_busy(uint64_t* busy, size_t count, double ns_per_unit) {
+  qsort(busy, count, sizeof(uint64_t), busy_sort);
+  for (size_t i = 0; i < count; i++) {
+    printf("%s%.0f", i ? "/" : "", busy[i] * ns_per_unit / 1e6);
+  }
+  printf(" ms");
+}
+
+// Renders the view again in double into a scratch buffer, for --compare.
+// Returns how long it took and how many pixels differ from ctx's render.
+static const char* compare_with_double(struct fractal_ctx const* ctx,
+                                       struct frak_args const* args,
+                                       size_t worker_count,
+                                       uint32_t chunk_size,
+                                       struct timespec* elapsed,
+                                       uint64_t* differ) {
+  struct fractal_ctx dctx = {
+      .width = ctx->width,
+      .height = ctx->height,
+      .max_iteration = ctx->max_iteration,
+      .formula = ctx->formula,
+      .power = ctx->power,
+      .julia = ctx->julia,
+      .julia_c = {ctx->julia_c[0], ctx->julia_c[1]},
+      .fwidth = ctx->fwidth,
+      .fheight = ctx->fheight,
+      .ftop = ctx->ftop,
+      .fleft = ctx->fleft,
+      .fleft_lo = ctx->fleft_lo,
+      .ftop_lo = ctx->ftop_lo,
+      .kernel = args->kernel,
+      .lane_refill = args->lane_refill,
+      .interior_check = ctx->interior_check,
+      .periodicity = args->periodicity,
+      .precision = fractal_precision_double,
+  };
+  const char* err = fractal_ctx_select_kernel(&dctx);
+  if (err) {
+    return err;
+  }
+  const size_t len = (size_t)ctx->width * ctx->height;
+  dctx.buffer = malloc(len);
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+  wq_t wq = wq_create_rect("frak", (void*)fractal_worker, worker_count,
+                           wq_grid_count(ctx->width, ctx->height, chunk_size));
+  wq_push_grid(wq, ctx->width, ctx->height, chunk_size);
+  wq_start(wq, &dctx);
+  wq_wait(wq);
+  wq_destroy(wq);
+  clock_gettime(CLOCK_MONOTONIC_RAW, elapsed);
+  timespec_minus(elapsed, &start);
+
+  uint8_t const* a = ctx->buffer;
+  uint8_t const* b = dctx.buffer;
+  *differ = 0;
+  for (size_t i = 0; i < len; i++) {
+    *differ += a[i] != b[i];
+  }
+  free(dctx.buffer);
+  return NULL;
+}
+
 int main(int argc, const char* argv[]) {
   int rc = 0;
   int fd = -1;
@@ -140,7 +297,7 @@ int main(int argc, const char* argv[]) {
   struct tiff_spec spec;
   size_t len;
   int o_flags = 0;
-  struct fractal_ctx ctx;
+  struct fractal_ctx ctx = {.kernel = fractal_kernel_auto};
 
   struct timespec start;
   struct timespec init;
@@ -148,6 +305,28 @@ int main(int argc, const char* argv[]) {
   struct timespec meta;
   struct timespec init_queue;
   struct timespec compute_data;
+  struct timespec compare_data;
+  uint64_t compare_differ = 0;
+  bool compared = false;
+  uint32_t* mirror_source = NULL;
+  uint32_t mirrored_rows = 0;
+  uint32_t tile_size = 0;
+  uintptr_t tile_count = 0;
+  struct timespec pass_done[FRACTAL_PROGRESSIVE_PASSES];
+  bool progressive = false;
+  struct fractal_supersample supersample;
+  struct timespec aa_data;
+  bool supersampled = false;
+  struct fractal_budgets budgets = {0};
+  struct fractal_balance balance = {0};
+  uint64_t* busy_ns = NULL;
+  size_t busy_workers = 0;
+  struct fractal_buddhabrot buddhabrot = {0};
+  struct fractal_mandelbulb mandelbulb = {0};
+  struct fractal_flame_spec flame_spec;
+  struct fractal_flame flame = {0};
+  struct fractal_lyapunov lyapunov = {0};
+  struct fractal_newton newton = {0};
 
   clock_gettime(CLOCK_MONOTONIC_RAW, &start);
   frak_args_init(&args);
@@ -223,29 +402,254 @@ int main(int argc, const char* argv[]) {
     ctx.height = args.height;
     ctx.fwidth = args.fwidth;
     ctx.fheight = args.fwidth * (double)args.height / (double)args.width;
-    ctx.fleft = args.center[0] - ctx.fwidth / 2.0;
-    ctx.ftop = args.center[1] - ctx.fheight / 2.0;
     ctx.buffer = data;
-    ctx.max_iteration = args.max_iteration;
-
-    const uintptr_t work_count = args.width * args.height;
-    wq_t wq =
-        wq_create("frak", (void*)fractal_worker, args.worker_count, work_count);
-    wq_set_worker_cache_size(wq, args.worker_cache_size);
-    wq_push_n(wq, work_count, NULL);
-    if (args.stats) {
-      clock_gettime(CLOCK_MONOTONIC_RAW, &init_queue);
+    ctx.formula = formula_for_design(args.design);
+    ctx.power = args.power;
+    ctx.julia = !isnan(args.julia_c[0]);
+    ctx.julia_c[0] = args.julia_c[0];
+    ctx.julia_c[1] = args.julia_c[1];
+    // Budgets are picked once the view is known, probing up to the cap.
+    const bool auto_budgets = args.max_iteration == FRAK_MAX_ITERATION_AUTO;
+    ctx.max_iteration = auto_budgets ? FRACTAL_BUDGET_CAP : args.max_iteration;
+    ctx.kernel = args.kernel;
+    ctx.lane_refill = args.lane_refill;
+    // Buddhabrots, flames and the Mandelbulb only take the view and kernel
+    // from ctx.
+    const bool density = args.design == frak_design_buddhabrot ||
+                         args.design == frak_design_nebulabrot;
+    const bool bulb = args.design == frak_design_mandelbulb;
+    const bool ifs = args.design == frak_design_flame;
+    ctx.interior_check =
+        !args.no_interior_check && !density && !bulb && !ifs;
+    ctx.periodicity = args.periodicity;
+    ctx.precision = args.precision;
+    ctx.float_first = args.float_first;
+    ctx.unroll = args.unroll;
+    ctx.perturbation = args.perturbation;
+    const char* setup_err = fractal_ctx_set_center(&ctx, args.center);
+    if (!setup_err && args.design == frak_design_lyapunov) {
+      setup_err = fractal_lyapunov_init(&lyapunov, args.sequence,
+                                        args.max_iteration);
+      ctx.lyapunov = &lyapunov;
+    }
+    if (!setup_err && args.design == frak_design_newton) {
+      setup_err = fractal_newton_init(
+          &newton, (double const(*)[2])args.roots->roots, args.roots->count);
+      ctx.newton = &newton;
+    }
+    if (!setup_err && ifs) {
+      setup_err = fractal_flame_load(&flame_spec, args.flame);
+    }
+    if (!setup_err && !density && !bulb && !ifs && !ctx.lyapunov &&
+        !ctx.newton) {
+      setup_err = fractal_perturb_init(&ctx, args.center);
+    }
+    if (!setup_err && args.escalate && !ctx.perturb) {
+      fractal_escalate_init(&ctx, args.escalate->budgets,
+                            args.escalate->count);
+    }
+    if (!setup_err && args.progressive && !ctx.perturb) {
+      ctx.column_step = FRACTAL_PROGRESSIVE_FIRST_STEP;
+    }
+    if (!setup_err && !density && !bulb && !ifs) {
+      setup_err = fractal_ctx_select_kernel(&ctx);
+    }
+    if (!setup_err && bulb) {
+      setup_err =
+          fractal_mandelbulb_init(&mandelbulb, &ctx, args.depth_prepass);
+    }
+    if (!setup_err && auto_budgets) {
+      if (ctx.perturb) {
+        setup_err = "--max-iter auto doesn't support perturbation";
+      } else {
+        fractal_budgets_init(&budgets, &ctx, FRACTAL_BUDGET_CAP);
+      }
+    }
+    if (!setup_err && args.aa == frak_aa_adaptive && !ctx.perturb) {
+      setup_err = fractal_supersample_init(&supersample, &ctx, args.aa_grid,
+                                           args.aa_threshold);
+    }
+    if (setup_err) {
+      fprintf(stderr, "%s\n", setup_err);
+      rc = 1;
+      goto out;
     }
 
-    if (!args.no_compute) {
-      wq_start(wq, &ctx);
-      wq_wait(wq);
+    const size_t worker_count =
+        args.worker_count ?: wq_get_default_worker_count();
+    uint32_t chunk_size = args.worker_cache_size;
+    if (chunk_size == (uint32_t)-1) {
+      chunk_size = args.width * args.height / (8 * worker_count) ?: 1;
     }
+    if (density) {
+      const uint32_t* limits =
+          args.design == frak_design_nebulabrot ? args.limits
+                                                : &args.max_iteration;
+      setup_err = fractal_buddhabrot_init(
+          &buddhabrot, &ctx, limits,
+          args.design == frak_design_nebulabrot ? FRACTAL_BUDDHABROT_CHANNELS
+                                                : 1,
+          args.histogram, worker_count);
+      if (setup_err) {
+        fprintf(stderr, "%s\n", setup_err);
+        rc = 1;
+        goto out;
+      }
+      if (args.stats) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &init_queue);
+      }
+      if (!args.no_compute) {
+        fractal_buddhabrot_render(&buddhabrot, args.samples * 1000000ull);
+      }
+      if (args.stats) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &compute_data);
+      }
+    } else if (ifs) {
+      setup_err = fractal_flame_init(&flame, &ctx, &flame_spec,
+                                     args.oversample, worker_count);
+      if (setup_err) {
+        fprintf(stderr, "%s\n", setup_err);
+        rc = 1;
+        goto out;
+      }
+      if (args.stats) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &init_queue);
+      }
+      if (!args.no_compute) {
+        fractal_flame_render(&flame, args.samples * 1000000ull);
+      }
+      if (args.stats) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &compute_data);
+      }
+    } else if (bulb) {
+      // The depth pre-pass gets a wq of its own.
+      tile_size = args.tile_size ?: wq_auto_tile_size(args.width, args.height,
+                                                      worker_count);
+      if (args.stats) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &init_queue);
+      }
+      if (!args.no_compute) {
+        tile_count = fractal_mandelbulb_render(
+            &mandelbulb, worker_count, tile_size,
+            (enum wq_tile_order)(args.tiles - 1));
+      }
+      if (args.stats) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &compute_data);
+      }
+    } else if (ctx.perturb) {
+      // Each round of references gets its own wq.
+      if (args.stats) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &init_queue);
+      }
+      if (!args.no_compute) {
+        fractal_perturb_render(&ctx, worker_count, chunk_size);
+      }
+      if (args.stats) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &compute_data);
+      }
+    } else if (ctx.column_step) {
+      // Each pass gets its own wq.
+      if (args.stats) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &init_queue);
+      }
+      if (!args.no_compute) {
+        fractal_progressive_render(&ctx, worker_count, pass_done);
+        progressive = true;
+      }
+      if (args.stats) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &compute_data);
+      }
+    } else {
+      wq_t wq;
+      if (args.algorithm == fractal_algorithm_mariani) {
+        // Sub-rects are pushed as the image is subdivided, so start with one.
+        wq = wq_create_rect("frak", (void*)fractal_mariani_worker,
+                            worker_count, FRAK_MARIANI_QUEUE_CAP);
+        wq_push_rect(wq, (wq_rect_t){.x = 0,
+                                     .y = 0,
+                                     .w = args.width,
+                                     .h = args.height});
+      } else {
+        if (!args.no_symmetry) {
+          mirror_source = malloc(args.height * sizeof(uint32_t));
+          mirrored_rows = fractal_ctx_mirror_rows(&ctx, mirror_source);
+          if (!mirrored_rows) {
+            free(mirror_source);
+            mirror_source = NULL;
+          }
+        }
+        if (args.tiles != frak_tiles_off) {
+          tile_size = args.tile_size ?: wq_auto_tile_size(args.width,
+                                                          args.height,
+                                                          worker_count);
+        }
+        if (args.balance) {
+          fractal_balance_init(&balance, &ctx, worker_count);
+        }
+        // Only the rows that aren't mirror images of others are computed.
+        tile_count = push_computed_rows(NULL, &args,
+                                        args.balance ? &balance : NULL,
+                                        mirror_source, chunk_size, tile_size);
+        wq = wq_create_rect("frak", (void*)fractal_worker, worker_count,
+                            tile_count);
+        if (args.balance) {
+          fractal_balance_push(&balance, wq);
+        } else {
+          push_computed_rows(wq, &args, NULL, mirror_source, chunk_size,
+                             tile_size);
+        }
+      }
+      ctx.wq = wq;
+      // Only the stats and balance report how busy the workers were.
+      const bool timing = args.stats || args.balance;
+      wq_set_timing(wq, timing);
+      if (args.stats) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &init_queue);
+      }
 
-    if (args.stats) {
-      clock_gettime(CLOCK_MONOTONIC_RAW, &compute_data);
+      if (!args.no_compute) {
+        wq_start(wq, &ctx);
+        wq_wait(wq);
+        if (timing) {
+          busy_workers = wq_get_worker_count(wq);
+          busy_ns = malloc(busy_workers * sizeof(uint64_t));
+          memcpy(busy_ns, wq_get_busy_ns(wq),
+                 busy_workers * sizeof(uint64_t));
+        }
+        if (ctx.escalate) {
+          fractal_escalate_render(&ctx, worker_count);
+        }
+        if (budgets.budgets) {
+          fractal_budgets_render(&budgets, &ctx, worker_count);
+        }
+        if (mirrored_rows) {
+          fractal_ctx_copy_mirrored_rows(&ctx, mirror_source);
+        }
+      }
+
+      if (args.stats) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &compute_data);
+      }
+      wq_destroy(wq);
+    }
+    if (args.aa == frak_aa_adaptive && !args.no_compute && !ctx.perturb) {
+      struct timespec aa_start;
+      clock_gettime(CLOCK_MONOTONIC_RAW, &aa_start);
+      fractal_supersample_render(&supersample, &ctx, worker_count);
+      clock_gettime(CLOCK_MONOTONIC_RAW, &aa_data);
+      timespec_minus(&aa_data, &aa_start);
+      supersampled = true;
+    }
+    if (args.compare && !args.no_compute && !ctx.perturb) {
+      const char* compare_err =
+          compare_with_double(&ctx, &args, worker_count, chunk_size,
+                              &compare_data, &compare_differ);
+      if (compare_err) {
+        fprintf(stderr, "%s\n", compare_err);
+      } else {
+        compared = true;
+      }
     }
-    wq_destroy(wq);
   }
 
 out:
@@ -261,7 +665,12 @@ out:
   if (spec.palette) {
     free(spec.palette);
   }
+  free(mirror_source);
   if (args.stats) {
+    for (unsigned pass = 0; progressive && pass < FRACTAL_PROGRESSIVE_PASSES;
+         pass++) {
+      timespec_minus(&pass_done[pass], &init_queue);
+    }
     timespec_minus(&compute_data, &init_queue);
     timespec_minus(&init_queue, &meta);
     timespec_minus(&meta, &mmap_img);
@@ -290,6 +699,196 @@ out:
         ndigits, timespec_to_ms(&init), ndigits, timespec_to_ms(&mmap_img),
         ndigits, timespec_to_ms(&meta), ndigits, timespec_to_ms(&init_queue),
         ndigits, timespec_to_ms(&compute_data));
+    if (ctx.kernel != fractal_kernel_auto) {
+      printf("Kernel: %s%s%s\n", fractal_kernel_name(ctx.kernel),
+             ctx.lane_refill && ctx.kernel != fractal_kernel_scalar
+                 ? " (lane refill)"
+                 : "",
+             ctx.unroll ? " (unrolled)" : "");
+    }
+    if (!fractal_ctx_is_mandlebrot(&ctx)) {
+      printf("Formula: %s", fractal_formula_name(ctx.formula));
+      if (ctx.formula == fractal_formula_multibrot) {
+        printf(" z^%u", ctx.power);
+      }
+      if (ctx.julia) {
+        printf(", Julia set of %g,%g", ctx.julia_c[0], ctx.julia_c[1]);
+      }
+      printf("\n");
+    }
+    if (ctx.lyapunov) {
+      printf("Lyapunov: sequence %s, %u steps after %u to warm up\n",
+             lyapunov.sequence, lyapunov.rounds * lyapunov.round,
+             lyapunov.warmup_rounds * lyapunov.round);
+    }
+    if (ctx.newton) {
+      printf("Newton: %u roots\n", newton.root_count);
+    }
+    if (buddhabrot.samples) {
+      const double ms = compute_data.tv_sec * 1e3 + compute_data.tv_nsec / 1e6;
+      printf("%s: %lu samples, %.1f%% escaped, %lu hits in view, %.1f "
+             "Msamples/s\n",
+             buddhabrot.channels == 1 ? "Buddhabrot" : "Nebulabrot",
+             (unsigned long)buddhabrot.samples,
+             100.0 * buddhabrot.escaped / buddhabrot.samples,
+             (unsigned long)buddhabrot.hits,
+             ms > 0 ? buddhabrot.samples / ms / 1e3 : 0.0);
+      const double mb = (double)sizeof(*buddhabrot.counts) * args.width *
+                        args.height * buddhabrot.channels / (1 << 20);
+      if (buddhabrot.histogram == fractal_histogram_private) {
+        printf("Histogram: private, %zu x %.1f MB\n",
+               buddhabrot.worker_count, mb);
+      } else {
+        printf("Histogram: %s, %.1f MB\n",
+               fractal_histogram_name(buddhabrot.histogram), mb);
+      }
+    }
+    if (flame.iterations) {
+      const double ms = compute_data.tv_sec * 1e3 + compute_data.tv_nsec / 1e6;
+      printf("Flame: %u xforms, %lu iterations, %lu hits in view, %.1f "
+             "Miterations/s\n",
+             flame_spec.xform_count, (unsigned long)flame.iterations,
+             (unsigned long)flame.hits,
+             ms > 0 ? flame.iterations / ms / 1e3 : 0.0);
+      printf("Accumulation: private, %zu x %.1f MB\n", flame.worker_count,
+             (double)sizeof(struct fractal_flame_cell) * args.width *
+                 args.height * flame.oversample * flame.oversample /
+                 (1 << 20));
+    }
+    const uint64_t rays = atomic_load(&mandelbulb.rays);
+    if (rays) {
+      printf("Mandelbulb: %.1f%% of %lu rays hit, %.1f steps per ray",
+             100.0 * atomic_load(&mandelbulb.hits) / rays, (unsigned long)rays,
+             (double)atomic_load(&mandelbulb.steps) / rays);
+      if (mandelbulb.starts) {
+        printf(", pre-pass %.2f steps per ray",
+               (double)atomic_load(&mandelbulb.prepass_steps) / rays);
+      }
+      printf(", lanes %.1f%% utilized\n",
+             100.0 * atomic_load(&mandelbulb.steps) /
+                 atomic_load(&mandelbulb.lane_slots));
+    }
+    if (ctx.perturb) {
+      printf("Precision: perturbation%s\n",
+             ctx.perturbation_auto ? " (auto)" : "");
+    } else if (ctx.precision != fractal_precision_auto) {
+      printf("Precision: %s%s\n", fractal_precision_name(ctx.precision),
+             ctx.precision_auto ? " (auto)" : "");
+    }
+    if (ctx.float_first) {
+      const uint64_t pixels = atomic_load(&ctx.stats.float_first_pixels);
+      printf("Float first: %.1f%% of %lu pixels redone in double\n",
+             pixels ? 100.0 * atomic_load(&ctx.stats.fallback_pixels) / pixels
+                    : 0.0,
+             (unsigned long)pixels);
+    }
+    const uint64_t lane_slots = atomic_load(&ctx.stats.lane_slots);
+    if (lane_slots) {
+      printf("Lanes: %.1f%% utilized\n",
+             100.0 * atomic_load(&ctx.stats.lane_iterations) / lane_slots);
+    }
+    if (ctx.interior_check) {
+      printf("Interior: %lu pixels short-circuited\n",
+             (unsigned long)atomic_load(&ctx.stats.interior_pixels));
+    }
+    if (ctx.periodicity != fractal_periodicity_auto) {
+      printf("Periodicity: %s%s, %lu pixels caught cycling\n",
+             fractal_periodicity_name(ctx.periodicity),
+             ctx.periodicity_auto ? " (auto)" : "",
+             (unsigned long)atomic_load(&ctx.stats.periodic_pixels));
+    }
+    if (ctx.perturb) {
+      printf("Perturbation: %s%s, %u references, %lu glitched pixels redone\n",
+             fractal_perturbation_name(ctx.perturbation),
+             ctx.perturbation_auto ? " (auto)" : "", ctx.perturb->references,
+             (unsigned long)ctx.perturb->glitched_pixels);
+    } else if (args.algorithm == fractal_algorithm_mariani) {
+      printf("Mariani: %lu pixels filled\n",
+             (unsigned long)atomic_load(&ctx.stats.filled_pixels));
+    }
+    if (mirrored_rows) {
+      printf("Symmetry: %u of %u rows mirrored\n", mirrored_rows, args.height);
+    }
+    if (ctx.escalate && !args.no_compute) {
+      printf("Escalate:");
+      for (unsigned i = 0; i < ctx.escalate->count; i++) {
+        printf("%s %lu pixels left at %u", i ? "," : "",
+               (unsigned long)ctx.escalate->unresolved[i],
+               ctx.escalate->budgets[i]);
+      }
+      printf("\n");
+    }
+    if (supersampled) {
+      const double pixels = (double)args.width * args.height;
+      const uint64_t refined = supersample.refined_pixels;
+      printf("AA: %ux%u adaptive, %.1f%% of pixels refined, %.2f samples per "
+             "pixel, %lu ms\n",
+             supersample.grid, supersample.grid, 100.0 * refined / pixels,
+             (pixels + (double)refined * supersample.grid * supersample.grid) /
+                 pixels,
+             timespec_to_ms(&aa_data));
+    }
+    if (progressive) {
+      printf("Progressive:");
+      for (unsigned pass = 0; pass < FRACTAL_PROGRESSIVE_PASSES; pass++) {
+        printf("%s 1/%u done at %lu ms", pass ? "," : "",
+               fractal_progressive_step(pass),
+               timespec_to_ms(&pass_done[pass]));
+      }
+      printf("\n");
+    }
+    if (tile_size) {
+      const uint64_t pixels =
+          (uint64_t)(args.height - mirrored_rows) * args.width;
+      const double ms = compute_data.tv_sec * 1e3 + compute_data.tv_nsec / 1e6;
+      printf("Tiles: %ux%u %s, %lu tiles, %.1f Mpixels/s\n", tile_size,
+             tile_size, frak_tiles_name(args.tiles), (unsigned long)tile_count,
+             ms > 0 ? pixels / ms / 1e3 : 0.0);
+    }
+  }
+  if (budgets.budgets) {
+    uint64_t counts[32];
+    const unsigned highest = fractal_budgets_histogram(&budgets, counts);
+    printf("Budgets:");
+    const char* sep = " ";
+    for (unsigned bit = 0; bit <= highest; bit++) {
+      if (counts[bit]) {
+        printf("%s%u x %lu tiles", sep, 1u << bit, (unsigned long)counts[bit]);
+        sep = ", ";
+      }
+    }
+    printf("; %lu dark pixels redone\n", (unsigned long)budgets.redone_pixels);
+  }
+  if (busy_ns && balance.predicted) {
+    uint64_t predicted_total = 0;
+    uint64_t busy_total = 0;
+    for (size_t i = 0; i < busy_workers; i++) {
+      predicted_total += balance.predicted[i];
+      busy_total += busy_ns[i];
+    }
+    printf("Balance: %lu chunks, predicted busy ", (unsigned long)tile_count);
+    print_busy(balance.predicted, busy_workers,
+               predicted_total ? (double)busy_total / predicted_total : 0.0);
+    printf(", actual ");
+    print_busy(busy_ns, busy_workers, 1.0);
+    printf("\n");
+  } else if (busy_ns && args.stats) {
+    printf("Workers: busy ");
+    print_busy(busy_ns, busy_workers, 1.0);
+    printf("\n");
+  }
+  if (compared) {
+    printf("Compare: double took %lu ms, %lu pixels differ\n",
+           timespec_to_ms(&compare_data), (unsigned long)compare_differ);
   }
+  fractal_perturb_destroy(&ctx);
+  fractal_escalate_destroy(&ctx);
+  fractal_budgets_destroy(&budgets);
+  fractal_balance_destroy(&balance);
+  fractal_buddhabrot_destroy(&buddhabrot);
+  fractal_mandelbulb_destroy(&mandelbulb);
+  fractal_flame_destroy(&flame);
+  fractal_lyapunov_destroy(&lyapunov);
+  free(busy_ns);
   return rc;
 }
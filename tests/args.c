@@ -449,6 +449,65 @@ TEST(ArgsTuple) {
   free(err);
 }
 
+TEST(ArgsTupleDecimal) {
+  struct tuple_spec dec_spec = {
+      .count = 2,
+      .is_decimal = true,
+  };
+  const struct arg_spec specs[] = {
+      {
+          .flag = "--twodec",
+          .takes_arg = true,
+          .parser = tuple_parser,
+          .offset = 0,
+          .parser_ctx = &dec_spec,
+      },
+      {.flag = NULL},
+  };
+  char* decs[2] = {NULL, NULL};
+
+  EXPECT_STREQ(NULL,
+               parse_args(2,
+                          (const char*[]){"--twodec",
+                                          "-0.74364388703715870475219150611477"
+                                          ",1e-5"},
+                          specs, NULL, NULL, decs));
+  EXPECT_STREQ(decs[0], "-0.74364388703715870475219150611477");
+  EXPECT_STREQ(decs[1], "1e-5");
+  free(decs[0]);
+  free(decs[1]);
+
+  EXPECT_STREQ(NULL, parse_args(2, (const char*[]){"--twodec", "+.5,3."},
+                                specs, NULL, NULL, decs));
+  EXPECT_STREQ(decs[0], "+.5");
+  EXPECT_STREQ(decs[1], "3.");
+  free(decs[0]);
+  free(decs[1]);
+
+  char* err = parse_args(2, (const char*[]){"--twodec", "0x10,1"}, specs,
+                         NULL, NULL, decs);
+  EXPECT_STREQ(
+      err, "Unable to parse '--twodec 0x10,1': expected decimal, error at 'x'");
+  free(err);
+
+  err = parse_args(2, (const char*[]){"--twodec", "1,inf"}, specs, NULL, NULL,
+                   decs);
+  EXPECT_STREQ(
+      err, "Unable to parse '--twodec 1,inf': expected decimal, error at 'i'");
+  free(err);
+
+  err = parse_args(2, (const char*[]){"--twodec", "1e,2"}, specs, NULL, NULL,
+                   decs);
+  EXPECT_STREQ(
+      err, "Unable to parse '--twodec 1e,2': expected decimal, error at 'e'");
+  free(err);
+
+  err = parse_args(2, (const char*[]){"--twodec", "1"}, specs, NULL, NULL,
+                   decs);
+  EXPECT_STREQ(err, "Unable to parse '--twodec 1': expected 2 decimals");
+  free(err);
+}
+
 TEST(ArgsExpectedArgs) {
   const char* ctx[2];
   const struct arg_spec specs[] = {
@@ -636,7 +695,7 @@ TEST(ArgsParsesHetrogenousSpecRequired) {
   EXPECT_STREQ(err, "Missing required arg: --u32");
   free(err);
 
-  err = parse_args(0, (const char*[]){}, specs, (void*)init_test_ctx,
+  err = parse_args(0, NULL, specs, (void*)init_test_ctx,
                    (void*)validate_test_ctx, &ctx);
   EXPECT_STREQ(err, "Missing required arg: --str");
   free(err);
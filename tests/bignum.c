@@ -0,0 +1,85 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#include <frakl/bignum.h>
+
+#include "tests.h"
+
+TEST(BignumLimbsFor) {
+  EXPECT_EQ(bignum_limbs_for(1.0, 0), 1);
+  EXPECT_EQ(bignum_limbs_for(0.25, 32), 3);
+  EXPECT_EQ(bignum_limbs_for(1e-100, 64), 14);
+  EXPECT_EQ(bignum_limbs_for(1e-300, 256), 0);
+}
+
+TEST(BignumDecimal) {
+  struct bignum n;
+  EXPECT_EQ(bignum_from_decimal(&n, "-0.75", 3), NULL);
+  EXPECT_TRUE(n.negative);
+  EXPECT_EQ(n.limbs[0], 0);
+  EXPECT_EQ(n.limbs[1], 0xC0000000);
+  EXPECT_EQ(n.limbs[2], 0);
+  EXPECT_EQ(bignum_to_double(&n), -0.75);
+
+  EXPECT_EQ(bignum_from_decimal(&n, "12.5e-1", 2), NULL);
+  EXPECT_EQ(bignum_to_double(&n), 1.25);
+  EXPECT_EQ(bignum_from_decimal(&n, "+3", 2), NULL);
+  EXPECT_EQ(bignum_to_double(&n), 3.0);
+  EXPECT_EQ(bignum_from_decimal(&n, "-0.000", 2), NULL);
+  EXPECT_FALSE(n.negative);
+
+  // 0.1 is 0x0.1999... so everything past the first fraction limb is 9s.
+  EXPECT_EQ(bignum_from_decimal(&n, "0.1", 5), NULL);
+  EXPECT_EQ(n.limbs[1], 0x19999999);
+  for (unsigned i = 2; i < 5; i++) {
+    EXPECT_EQ(n.limbs[i], 0x99999999);
+  }
+
+  // Digits way past a double still land in the right limb.
+  EXPECT_EQ(bignum_from_decimal(
+                &n, "0.000000000000000000000000000000000000000001e-2", 8),
+            NULL);
+  const double tiny = bignum_to_double(&n);
+  EXPECT_TRUE(tiny > 0.999999e-44 && tiny < 1.000001e-44);
+
+  EXPECT_STREQ(bignum_from_decimal(&n, "", 2), "expected digits");
+  EXPECT_STREQ(bignum_from_decimal(&n, "1.2.3", 2), "expected decimal number");
+  EXPECT_STREQ(bignum_from_decimal(&n, "1e", 2), "expected exponent digits");
+  EXPECT_STREQ(bignum_from_decimal(&n, "5e9", 2), "integer part out of range");
+}
+
+TEST(BignumArithmetic) {
+  struct bignum a;
+  struct bignum b;
+  struct bignum r;
+
+  bignum_from_double(&a, -1.5, 4);
+  bignum_from_double(&b, 0.25, 4);
+  bignum_add(&r, &a, &b);
+  EXPECT_EQ(bignum_to_double(&r), -1.25);
+  bignum_sub(&r, &a, &b);
+  EXPECT_EQ(bignum_to_double(&r), -1.75);
+  bignum_sub(&r, &b, &a);
+  EXPECT_EQ(bignum_to_double(&r), 1.75);
+  bignum_mul(&r, &a, &b);
+  EXPECT_EQ(bignum_to_double(&r), -0.375);
+  bignum_mul(&r, &a, &a);
+  EXPECT_EQ(bignum_to_double(&r), 2.25);
+  bignum_sub(&r, &a, &a);
+  EXPECT_EQ(bignum_to_double(&r), 0.0);
+  EXPECT_FALSE(r.negative);
+
+  // 1 + 2^-100 squared is 1 + 2^-99 + 2^-200, the last of which needs 8
+  // limbs to show up.
+  bignum_from_decimal(&a, "1", 8);
+  bignum_init(&b, 8);
+  b.limbs[4] = 1 << 28;
+  bignum_add(&a, &a, &b);
+  bignum_mul(&r, &a, &a);
+  EXPECT_EQ(r.limbs[0], 1);
+  EXPECT_EQ(r.limbs[4], 1 << 29);
+  EXPECT_EQ(r.limbs[7], 1 << 24);
+
+  // Aliasing the result with both operands.
+  bignum_mul(&a, &a, &a);
+  EXPECT_EQ(memcmp(a.limbs, r.limbs, 8 * sizeof(uint32_t)), 0);
+}
@@ -0,0 +1,1559 @@
+// Copywrite (c) 2019 Dan Zimmerman
+
+#include <frakl/balance.h>
+#include <frakl/buddhabrot.h>
+#include <frakl/budget.h>
+#include <frakl/escalate.h>
+#include <frakl/flame.h>
+#include <frakl/fractal.h>
+#include <frakl/lyapunov.h>
+#include <frakl/mandelbulb.h>
+#include <frakl/newton.h>
+#include <frakl/perturb.h>
+#include <frakl/progressive.h>
+#include <frakl/supersample.h>
+#include <float.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "tests.h"
+
+#define FRACTAL_TEST_WIDTH 67
+#define FRACTAL_TEST_HEIGHT 41
+
+static void init_ctx(struct fractal_ctx* ctx, enum fractal_kernel kernel,
+                     bool lane_refill, bool interior_check, bool periodicity,
+                     uint8_t* buffer) {
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->width = FRACTAL_TEST_WIDTH;
+  ctx->height = FRACTAL_TEST_HEIGHT;
+  ctx->max_iteration = 300;
+  ctx->fwidth = 3.0;
+  ctx->fheight = ctx->fwidth * ctx->height / ctx->width;
+  ctx->fleft = -2.25;
+  ctx->ftop = -ctx->fheight / 2.0;
+  ctx->buffer = buffer;
+  ctx->kernel = kernel;
+  ctx->lane_refill = lane_refill;
+  ctx->interior_check = interior_check;
+  ctx->periodicity =
+      periodicity ? fractal_periodicity_on : fractal_periodicity_off;
+  ctx->precision = fractal_precision_double;
+  EXPECT_EQ(fractal_ctx_select_kernel(ctx), NULL);
+}
+
+static void render(struct fractal_ctx* ctx, enum fractal_kernel kernel,
+                   bool lane_refill, bool interior_check, bool periodicity,
+                   uint8_t* buffer) {
+  init_ctx(ctx, kernel, lane_refill, interior_check, periodicity, buffer);
+  wq_rect_t rect = {.x = 0, .y = 0, .w = ctx->width, .h = ctx->height};
+  fractal_worker(&rect, ctx);
+}
+
+TEST(FractalKernelNames) {
+  EXPECT_STREQ(fractal_kernel_name(fractal_kernel_scalar), "scalar");
+  EXPECT_STREQ(fractal_kernel_name(fractal_kernel_avx512), "avx512");
+  EXPECT_TRUE(fractal_kernel_is_supported(fractal_kernel_scalar));
+
+  struct fractal_ctx ctx = {.kernel = fractal_kernel_auto};
+  EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+  EXPECT_TRUE(ctx.kernel != fractal_kernel_auto);
+  EXPECT_TRUE(fractal_kernel_is_supported(ctx.kernel));
+}
+
+TEST(FractalKernelsMatchScalar) {
+  uint8_t expected[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t actual[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  struct fractal_ctx ctx;
+
+  render(&ctx, fractal_kernel_scalar, false, false, false, expected);
+  EXPECT_EQ(atomic_load(&ctx.stats.interior_pixels), 0);
+  for (enum fractal_kernel kernel = fractal_kernel_scalar;
+       kernel <= fractal_kernel_avx512; kernel++) {
+    if (!fractal_kernel_is_supported(kernel)) {
+      printf("  Skipping unsupported kernel %s\n", fractal_kernel_name(kernel));
+      continue;
+    }
+    for (unsigned mode = 0; mode < 8; mode++) {
+      const bool lane_refill = (mode & 1) != 0;
+      const bool interior_check = (mode & 2) != 0;
+      const bool periodicity = (mode & 4) != 0;
+      memset(actual, 0, sizeof(actual));
+      render(&ctx, kernel, lane_refill, interior_check, periodicity, actual);
+      EXPECT_(memcmp(expected, actual, sizeof(actual)) == 0,
+              "kernel %s%s%s%s differs from scalar",
+              fractal_kernel_name(kernel),
+              lane_refill ? " (lane refill)" : "",
+              interior_check ? " (interior check)" : "",
+              periodicity ? " (periodicity)" : "");
+      EXPECT_EQ(atomic_load(&ctx.stats.periodic_pixels) != 0, periodicity);
+      EXPECT_TRUE(atomic_load(&ctx.stats.lane_iterations) <=
+                  atomic_load(&ctx.stats.lane_slots));
+      EXPECT_EQ(atomic_load(&ctx.stats.interior_pixels) != 0, interior_check);
+    }
+  }
+}
+
+TEST(FractalUnrolledKernelsMatchScalar) {
+  uint8_t expected[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t actual[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  struct fractal_ctx ctx;
+
+  // Neither is a multiple of the block, and 5 never gets a whole one.
+  const uint32_t maxes[2] = {300, 5};
+  for (unsigned m = 0; m < 2; m++) {
+    init_ctx(&ctx, fractal_kernel_scalar, false, false, false, expected);
+    ctx.max_iteration = maxes[m];
+    fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+    for (enum fractal_kernel kernel = fractal_kernel_scalar;
+         kernel <= fractal_kernel_avx512; kernel++) {
+      if (!fractal_kernel_is_supported(kernel)) {
+        continue;
+      }
+      for (unsigned mode = 0; mode < 4; mode++) {
+        const bool interior_check = (mode & 1) != 0;
+        const bool periodicity = (mode & 2) != 0;
+        memset(actual, 0, sizeof(actual));
+        init_ctx(&ctx, kernel, false, interior_check, periodicity, actual);
+        ctx.max_iteration = maxes[m];
+        ctx.unroll = true;
+        EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+        EXPECT_TRUE(ctx.unroll);
+        fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+        EXPECT_(memcmp(expected, actual, sizeof(actual)) == 0,
+                "unrolled kernel %s (max %u, mode %u) differs from scalar",
+                fractal_kernel_name(kernel), maxes[m], mode);
+      }
+    }
+  }
+
+  init_ctx(&ctx, fractal_kernel_scalar, true, false, false, actual);
+  ctx.unroll = true;
+  EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+  EXPECT_FALSE(ctx.unroll);
+}
+
+// Zoomed onto the edge of the main cardioid so that some rects are uniform.
+static void init_mariani_ctx(struct fractal_ctx* ctx, uint8_t* buffer) {
+  init_ctx(ctx, fractal_kernel_auto, false, true, false, buffer);
+  ctx->fwidth = 0.75;
+  ctx->fheight = ctx->fwidth * ctx->height / ctx->width;
+  ctx->fleft = -0.5;
+  ctx->ftop = 0.1;
+}
+
+// Renders ctx's view with Mariani-Silver subdivision, on a wq of capacity
+// cap.
+static void render_mariani(struct fractal_ctx* ctx, uintptr_t cap) {
+  ctx->wq = wq_create_rect("test", (void*)fractal_mariani_worker, 0, cap);
+  EXPECT_TRUE(
+      wq_push_rect(ctx->wq, (wq_rect_t){.w = ctx->width, .h = ctx->height}));
+  wq_start(ctx->wq, ctx);
+  wq_wait(ctx->wq);
+  wq_destroy(ctx->wq);
+}
+
+TEST(FractalMarianiMatchesBrute) {
+  uint8_t expected[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t actual[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  struct fractal_ctx ctx;
+
+  init_mariani_ctx(&ctx, expected);
+  fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+  // Small enough that some sub-rects get computed inline.
+  for (uintptr_t cap = 4; cap <= 256; cap *= 8) {
+    memset(actual, 0, sizeof(actual));
+    init_mariani_ctx(&ctx, actual);
+    render_mariani(&ctx, cap);
+    EXPECT_EQ(memcmp(expected, actual, sizeof(actual)), 0);
+    EXPECT_TRUE(atomic_load(&ctx.stats.filled_pixels) != 0);
+  }
+}
+
+// Views where filling on matching bytes alone lets thin filaments and
+// minibrots slip between border pixels at this size.
+TEST(FractalMarianiReferenceViews) {
+  static uint8_t expected[800 * 600];
+  static uint8_t actual[800 * 600];
+  struct fractal_ctx ctx;
+
+  const struct {
+    const char* name;
+    const char* center[2];
+    double fwidth;
+    bool interior_check;
+  } views[] = {
+      {"default", {"0", "0"}, 4.0, true},
+      {"seahorse valley", {"-0.745", "0.1"}, 0.05, true},
+      {"filaments", {"-0.10109636384562", "0.95628651080914"}, 1e-4, true},
+      {"antenna", {"-1.9", "0"}, 0.2, true},
+      {"interior check off", {"-0.5", "0"}, 2.5, false},
+  };
+  for (unsigned v = 0; v < sizeof(views) / sizeof(views[0]); v++) {
+    for (unsigned pass = 0; pass < 2; pass++) {
+      uint8_t* const buffer = pass ? actual : expected;
+      memset(buffer, 0, sizeof(expected));
+      init_ctx(&ctx, fractal_kernel_auto, false, views[v].interior_check,
+               false, buffer);
+      ctx.width = 800;
+      ctx.height = 600;
+      // Each byte covers about 20 iteration counts.
+      ctx.max_iteration = 5000;
+      ctx.fwidth = views[v].fwidth;
+      ctx.fheight = ctx.fwidth * ctx.height / ctx.width;
+      EXPECT_EQ(fractal_ctx_set_center(&ctx, views[v].center), NULL);
+      EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+      if (pass) {
+        render_mariani(&ctx, 64);
+      } else {
+        fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+      }
+    }
+    unsigned differ = 0;
+    for (size_t i = 0; i < sizeof(expected); i++) {
+      differ += expected[i] != actual[i];
+    }
+    EXPECT_(differ == 0, "%u pixels of %s differ from brute force", differ,
+            views[v].name);
+    EXPECT_(atomic_load(&ctx.stats.filled_pixels) != 0,
+            "nothing filled in %s", views[v].name);
+  }
+}
+
+TEST(FractalPeriodicityAuto) {
+  struct fractal_ctx ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.width = 64;
+  ctx.height = 64;
+  ctx.max_iteration = 100000;
+  ctx.interior_check = true;
+
+  // Centered on the period-3 minibrot, nearly all of it cycles.
+  ctx.fwidth = ctx.fheight = 0.02;
+  ctx.fleft = -1.7549 - ctx.fwidth / 2;
+  ctx.ftop = -ctx.fheight / 2;
+  ctx.periodicity = fractal_periodicity_auto;
+  EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+  EXPECT_EQ(ctx.periodicity, fractal_periodicity_on);
+  EXPECT_TRUE(ctx.periodicity_auto);
+
+  // Far outside the set nothing cycles.
+  ctx.fwidth = ctx.fheight = 0.5;
+  ctx.fleft = 1.5;
+  ctx.ftop = 1.5;
+  ctx.periodicity = fractal_periodicity_auto;
+  EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+  EXPECT_EQ(ctx.periodicity, fractal_periodicity_off);
+}
+
+// Iterates c = center + (dx, dy) entirely in bignums.
+static uint32_t bignum_iterate(struct bignum const center[2], double dx,
+                               double dy, uint32_t max) {
+  const unsigned len = center[0].len;
+  struct bignum cx;
+  struct bignum cy;
+  struct bignum xx;
+  struct bignum yy;
+  struct bignum xy;
+  bignum_from_double(&cx, dx, len);
+  bignum_from_double(&cy, dy, len);
+  bignum_add(&cx, &cx, &center[0]);
+  bignum_add(&cy, &cy, &center[1]);
+  struct bignum zx = cx;
+  struct bignum zy = cy;
+  uint32_t n = 0;
+  for (;;) {
+    const double x = bignum_to_double(&zx);
+    const double y = bignum_to_double(&zy);
+    if (x * x + y * y > 4.0 || n == max) {
+      return n;
+    }
+    bignum_mul(&xx, &zx, &zx);
+    bignum_mul(&yy, &zy, &zy);
+    bignum_mul(&xy, &zx, &zy);
+    bignum_sub(&zx, &xx, &yy);
+    bignum_add(&zx, &zx, &cx);
+    bignum_add(&zy, &xy, &xy);
+    bignum_add(&zy, &zy, &cy);
+    n += 1;
+  }
+}
+
+TEST(FractalPerturbationMatchesBignum) {
+  // Zoomed 1e30 times into the Misiurewicz point i, which has detail at every
+  // scale.
+  const char* const center[2] = {"0.0000000000000000000000000000001",
+                                 "1.0000000000000000000000000000003"};
+  uint8_t actual[16 * 16];
+  struct fractal_ctx ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.width = 16;
+  ctx.height = 16;
+  ctx.max_iteration = 255;
+  ctx.fwidth = ctx.fheight = 1e-30;
+  ctx.fleft = -ctx.fwidth / 2;
+  ctx.ftop = 1.0 - ctx.fheight / 2;
+  ctx.buffer = actual;
+  ctx.perturbation = fractal_perturbation_auto;
+  EXPECT_EQ(fractal_perturb_init(&ctx, center), NULL);
+  EXPECT_EQ(ctx.perturbation, fractal_perturbation_on);
+  EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+  EXPECT_EQ(ctx.kernel_fn, fractal_perturb_kernel);
+
+  fractal_perturb_render(&ctx, 0, 16);
+  EXPECT_TRUE(ctx.perturb->references >= 1);
+  for (uint32_t row = 0; row < 16; row++) {
+    for (uint32_t column = 0; column < 16; column++) {
+      const uint32_t expected = bignum_iterate(
+          ctx.perturb->center, 1e-30 * ((double)column - 8) / 16,
+          1e-30 * ((double)row - 8) / 16, 255);
+      EXPECT_(actual[row * 16 + column] == expected,
+              "pixel %u,%u is %u, expected %u", column, row,
+              actual[row * 16 + column], expected);
+    }
+  }
+  fractal_perturb_destroy(&ctx);
+  EXPECT_EQ(ctx.perturb, NULL);
+
+  // Doubles are plenty for the usual view.
+  ctx.fwidth = ctx.fheight = 3.0;
+  ctx.perturbation = fractal_perturbation_auto;
+  EXPECT_EQ(fractal_perturb_init(&ctx, (const char* const[]){"-0.75", "0"}),
+            NULL);
+  EXPECT_EQ(ctx.perturbation, fractal_perturbation_off);
+  EXPECT_EQ(ctx.perturb, NULL);
+}
+
+TEST(FractalDoubleDoubleKernelsMatchBignum) {
+  // 1e18 times into i, past double but well within double-double.
+  const char* const center[2] = {"0.00000000000000000001",
+                                 "1.00000000000000000003"};
+  uint8_t expected[16 * 16];
+  uint8_t actual[16 * 16];
+  struct fractal_ctx ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.width = 16;
+  ctx.height = 16;
+  ctx.max_iteration = 255;
+  ctx.fwidth = ctx.fheight = 1e-18;
+  EXPECT_EQ(fractal_ctx_set_center(&ctx, center), NULL);
+  EXPECT_EQ(ctx.fleft, 1e-20 - 5e-19);
+  EXPECT_TRUE(ctx.ftop_lo != 0.0);
+
+  struct bignum exact[2];
+  EXPECT_EQ(bignum_from_decimal(&exact[0], center[0], 4), NULL);
+  EXPECT_EQ(bignum_from_decimal(&exact[1], center[1], 4), NULL);
+  for (uint32_t i = 0; i < 16 * 16; i++) {
+    const uint32_t row = i / 16;
+    const uint32_t column = i % 16;
+    expected[i] =
+        bignum_iterate(exact, 1e-18 * ((double)column - 8) / 16,
+                       1e-18 * ((double)row - 8) / 16, ctx.max_iteration);
+  }
+
+  for (enum fractal_kernel kernel = fractal_kernel_scalar;
+       kernel <= fractal_kernel_avx512; kernel++) {
+    if (!fractal_kernel_is_supported(kernel)) {
+      continue;
+    }
+    for (unsigned mode = 0; mode < 4; mode++) {
+      memset(actual, 0, sizeof(actual));
+      memset(&ctx.stats, 0, sizeof(ctx.stats));
+      ctx.buffer = actual;
+      ctx.kernel = kernel;
+      ctx.interior_check = (mode & 1) != 0;
+      ctx.periodicity =
+          mode & 2 ? fractal_periodicity_on : fractal_periodicity_off;
+      ctx.precision = fractal_precision_auto;
+      EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+      EXPECT_EQ(ctx.precision, fractal_precision_double_double);
+      EXPECT_TRUE(ctx.precision_auto);
+      fractal_worker(&(wq_rect_t){.w = 16, .h = 16}, &ctx);
+      EXPECT_(memcmp(expected, actual, sizeof(actual)) == 0,
+              "kernel %s (mode %u) differs from bignums",
+              fractal_kernel_name(kernel), mode);
+    }
+  }
+
+  // The usual view stays in double, or float for a thumbnail.
+  ctx.fwidth = ctx.fheight = 3.0;
+  ctx.precision = fractal_precision_auto;
+  EXPECT_EQ(fractal_ctx_set_center(&ctx, (const char* const[]){"-0.75", "0"}),
+            NULL);
+  EXPECT_EQ(ctx.fleft_lo, 0.0);
+  EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+  EXPECT_EQ(ctx.precision, fractal_precision_float);
+  ctx.width = ctx.height = 1024;
+  ctx.precision = fractal_precision_auto;
+  EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+  EXPECT_EQ(ctx.precision, fractal_precision_double);
+}
+
+TEST(FractalPrecisionBits) {
+  struct fractal_ctx ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.width = ctx.height = 256;
+  ctx.max_iteration = 1024;
+  ctx.fwidth = ctx.fheight = 4.0;
+  ctx.fleft = ctx.ftop = -2.0;
+  // 128 pixels per unit, 1024 iterations and the guard bits.
+  EXPECT_EQ(fractal_ctx_precision_bits(&ctx), 7 + 10 + 8);
+  ctx.max_iteration = 64;
+  EXPECT_EQ(fractal_ctx_precision_bits(&ctx), 7 + 6 + 8);
+
+  EXPECT_STREQ(fractal_precision_name(fractal_precision_float), "float");
+  EXPECT_STREQ(fractal_precision_name(fractal_precision_long_double),
+               "long-double");
+}
+
+TEST(FractalFloatKernelsMatchScalar) {
+  uint8_t expected[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t actual[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t doubles[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  struct fractal_ctx ctx;
+
+  render(&ctx, fractal_kernel_scalar, false, false, false, doubles);
+  for (unsigned mode = 0; mode < 4; mode++) {
+    const bool interior_check = (mode & 1) != 0;
+    const bool periodicity = (mode & 2) != 0;
+    init_ctx(&ctx, fractal_kernel_scalar, false, interior_check, periodicity,
+             expected);
+    ctx.precision = fractal_precision_float;
+    EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+    fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+    // Floats only round differently right at the boundary.
+    unsigned differ = 0;
+    for (size_t i = 0; i < sizeof(expected); i++) {
+      differ += expected[i] != doubles[i];
+    }
+    EXPECT_(differ < sizeof(expected) / 100, "%u pixels differ from double",
+            differ);
+
+    for (enum fractal_kernel kernel = fractal_kernel_sse2;
+         kernel <= fractal_kernel_avx512; kernel++) {
+      if (!fractal_kernel_is_supported(kernel)) {
+        continue;
+      }
+      memset(actual, 0, sizeof(actual));
+      init_ctx(&ctx, kernel, false, interior_check, periodicity, actual);
+      ctx.precision = fractal_precision_float;
+      EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+      fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+      EXPECT_(memcmp(expected, actual, sizeof(actual)) == 0,
+              "kernel %s (mode %u) differs from scalar float",
+              fractal_kernel_name(kernel), mode);
+      EXPECT_TRUE(atomic_load(&ctx.stats.lane_iterations) <=
+                  atomic_load(&ctx.stats.lane_slots));
+    }
+  }
+}
+
+TEST(FractalLongDoubleMatchesBignum) {
+  // 1e13 times into i, just past what double resolves at 255 iterations.
+  const char* const center[2] = {"0.000000000000001", "1.000000000000003"};
+  uint8_t expected[16 * 16];
+  uint8_t actual[16 * 16];
+  struct fractal_ctx ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.width = 16;
+  ctx.height = 16;
+  ctx.max_iteration = 255;
+  ctx.fwidth = ctx.fheight = 1e-13;
+  ctx.kernel = fractal_kernel_auto;
+  EXPECT_EQ(fractal_ctx_set_center(&ctx, center), NULL);
+  ctx.precision = fractal_precision_auto;
+  EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+  if (LDBL_MANT_DIG < 64) {
+    printf("  Skipping, long double is no wider than double\n");
+    return;
+  }
+  EXPECT_EQ(ctx.precision, fractal_precision_long_double);
+  EXPECT_EQ(ctx.kernel, fractal_kernel_scalar);
+
+  struct bignum exact[2];
+  EXPECT_EQ(bignum_from_decimal(&exact[0], center[0], 4), NULL);
+  EXPECT_EQ(bignum_from_decimal(&exact[1], center[1], 4), NULL);
+  for (uint32_t i = 0; i < 16 * 16; i++) {
+    expected[i] = bignum_iterate(exact, 1e-13 * ((double)(i % 16) - 8) / 16,
+                                 1e-13 * ((double)(i / 16) - 8) / 16,
+                                 ctx.max_iteration);
+  }
+  for (unsigned mode = 0; mode < 4; mode++) {
+    memset(actual, 0, sizeof(actual));
+    ctx.buffer = actual;
+    ctx.interior_check = (mode & 1) != 0;
+    ctx.periodicity =
+        mode & 2 ? fractal_periodicity_on : fractal_periodicity_off;
+    EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+    fractal_worker(&(wq_rect_t){.w = 16, .h = 16}, &ctx);
+    EXPECT_(memcmp(expected, actual, sizeof(actual)) == 0,
+            "long double (mode %u) differs from bignums", mode);
+  }
+}
+
+TEST(FractalFloatFirstMatchesDouble) {
+  uint8_t expected[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t actual[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  struct fractal_ctx ctx;
+
+  init_ctx(&ctx, fractal_kernel_scalar, false, false, false, expected);
+  ctx.float_first = true;
+  EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+  EXPECT_FALSE(ctx.float_first);
+
+  // The whole set, then a sliver of the boundary where float can't keep up.
+  const double fwidths[2] = {3.0, 0.002};
+  const double flefts[2] = {-2.25, -0.7463};
+  for (unsigned view = 0; view < 2; view++) {
+    for (unsigned mode = 0; mode < 4; mode++) {
+      const bool interior_check = (mode & 1) != 0;
+      const bool periodicity = (mode & 2) != 0;
+      init_ctx(&ctx, fractal_kernel_scalar, false, interior_check, periodicity,
+               expected);
+      ctx.fwidth = fwidths[view];
+      ctx.fheight = ctx.fwidth * ctx.height / ctx.width;
+      ctx.fleft = flefts[view];
+      ctx.ftop = 0.1 * view - ctx.fheight / 2.0;
+      fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+
+      for (enum fractal_kernel kernel = fractal_kernel_sse2;
+           kernel <= fractal_kernel_avx512; kernel++) {
+        if (!fractal_kernel_is_supported(kernel)) {
+          continue;
+        }
+        memset(actual, 0, sizeof(actual));
+        init_ctx(&ctx, kernel, false, interior_check, periodicity, actual);
+        ctx.fwidth = fwidths[view];
+        ctx.fheight = ctx.fwidth * ctx.height / ctx.width;
+        ctx.fleft = flefts[view];
+        ctx.ftop = 0.1 * view - ctx.fheight / 2.0;
+        ctx.float_first = true;
+        EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+        EXPECT_TRUE(ctx.float_first);
+        fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+        EXPECT_(memcmp(expected, actual, sizeof(actual)) == 0,
+                "kernel %s (view %u, mode %u) differs from double",
+                fractal_kernel_name(kernel), view, mode);
+        const uint64_t pixels = atomic_load(&ctx.stats.float_first_pixels);
+        EXPECT_TRUE(pixels != 0);
+        EXPECT_TRUE(atomic_load(&ctx.stats.fallback_pixels) <= pixels);
+      }
+    }
+  }
+}
+
+TEST(FractalFixedKernelsMatchScalar) {
+  uint8_t expected[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t actual[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t doubles[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  struct fractal_ctx ctx;
+
+  init_ctx(&ctx, fractal_kernel_scalar, false, false, false, expected);
+  ctx.precision = fractal_precision_fixed;
+  ctx.fleft = -4.5;
+  EXPECT_TRUE(fractal_ctx_select_kernel(&ctx) != NULL);
+
+  render(&ctx, fractal_kernel_scalar, false, false, false, doubles);
+  for (unsigned mode = 0; mode < 4; mode++) {
+    const bool interior_check = (mode & 1) != 0;
+    const bool periodicity = (mode & 2) != 0;
+    init_ctx(&ctx, fractal_kernel_scalar, false, interior_check, periodicity,
+             expected);
+    ctx.precision = fractal_precision_fixed;
+    EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+    fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+    unsigned differ = 0;
+    for (size_t i = 0; i < sizeof(expected); i++) {
+      differ += expected[i] != doubles[i];
+    }
+    EXPECT_(differ < sizeof(expected) / 100, "%u pixels differ from double",
+            differ);
+
+    for (enum fractal_kernel kernel = fractal_kernel_sse2;
+         kernel <= fractal_kernel_avx512; kernel++) {
+      if (!fractal_kernel_is_supported(kernel)) {
+        continue;
+      }
+      memset(actual, 0, sizeof(actual));
+      init_ctx(&ctx, kernel, false, interior_check, periodicity, actual);
+      ctx.precision = fractal_precision_fixed;
+      EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+      fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+      EXPECT_(memcmp(expected, actual, sizeof(actual)) == 0,
+              "kernel %s (mode %u) differs from scalar fixed point",
+              fractal_kernel_name(kernel), mode);
+    }
+  }
+}
+
+// 64-bit FNV-1a of the n bytes at data.
+static uint64_t fnv1a(uint8_t const* data, size_t n) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < n; i++) {
+    hash = (hash ^ data[i]) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+// Fixed point renders are the same bit for bit everywhere, so they're pinned
+// to checksums. A change to fixed point arithmetic or the view's coordinates
+// shows up here even if every kernel agrees with the scalar one. The
+// interior check and periodicity don't change a pixel.
+TEST(FractalFixedGolden) {
+  uint8_t buffer[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  struct fractal_ctx ctx;
+
+  const struct {
+    const char* center[2];
+    double fwidth;
+    uint64_t golden;
+  } views[] = {
+      {{"-0.75", "0"}, 3.0, 0xcfd8006098f2f9d1ull},
+      {{"-0.7436447860", "0.1318252536"}, 1e-6, 0xb122f311453c0b49ull},
+  };
+  for (unsigned v = 0; v < sizeof(views) / sizeof(views[0]); v++) {
+    for (unsigned mode = 0; mode < 4; mode++) {
+      for (enum fractal_kernel kernel = fractal_kernel_scalar;
+           kernel <= fractal_kernel_avx512; kernel++) {
+        if (!fractal_kernel_is_supported(kernel)) {
+          continue;
+        }
+        memset(buffer, 0, sizeof(buffer));
+        init_ctx(&ctx, kernel, false, (mode & 1) != 0, (mode & 2) != 0,
+                 buffer);
+        ctx.max_iteration = 1000;
+        ctx.fwidth = views[v].fwidth;
+        ctx.fheight = ctx.fwidth * ctx.height / ctx.width;
+        EXPECT_EQ(fractal_ctx_set_center(&ctx, views[v].center), NULL);
+        ctx.precision = fractal_precision_fixed;
+        EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+        fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+        const uint64_t hash = fnv1a(buffer, sizeof(buffer));
+        EXPECT_(hash == views[v].golden,
+                "view %u kernel %s (mode %u) hashes to %#llx", v,
+                fractal_kernel_name(kernel), mode, (unsigned long long)hash);
+      }
+    }
+  }
+}
+
+TEST(FractalMirrorRowsExact) {
+  uint8_t expected[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t actual[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint32_t source[FRACTAL_TEST_HEIGHT];
+  struct fractal_ctx ctx;
+
+  const enum fractal_precision precisions[5] = {
+      fractal_precision_double, fractal_precision_float,
+      fractal_precision_long_double, fractal_precision_double_double,
+      fractal_precision_fixed};
+  for (unsigned p = 0; p < 5; p++) {
+    render(&ctx, fractal_kernel_auto, false, true, true, expected);
+    ctx.precision = precisions[p];
+    EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+    fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+
+    // Render only the rows that aren't mirrored, then copy the rest over.
+    memcpy(actual, expected, sizeof(actual));
+    const uint32_t mirrored = fractal_ctx_mirror_rows(&ctx, source);
+    for (uint32_t row = 0; row < ctx.height; row++) {
+      if (source[row] != row) {
+        EXPECT_TRUE(source[row] < row);
+        memset(actual + row * ctx.width, 0, ctx.width);
+      }
+    }
+    ctx.buffer = actual;
+    fractal_ctx_copy_mirrored_rows(&ctx, source);
+    EXPECT_(memcmp(expected, actual, sizeof(actual)) == 0,
+            "%s rows mirrored inexactly",
+            fractal_precision_name(ctx.precision));
+    // Every row with its partner in view, all but the top and middle ones.
+    EXPECT_(mirrored == (ctx.height - 1) / 2, "%u %s rows mirrored", mirrored,
+            fractal_precision_name(ctx.precision));
+  }
+
+  // Entirely above the real axis.
+  init_ctx(&ctx, fractal_kernel_auto, false, true, true, expected);
+  ctx.ftop = 0.25;
+  EXPECT_EQ(fractal_ctx_mirror_rows(&ctx, source), 0);
+}
+
+TEST(FractalMirrorRowsDefaultView) {
+  const uint32_t sizes[][2] = {{800, 600}, {801, 601}, {3000, 3000}};
+  static uint32_t source[3000];
+  struct fractal_ctx ctx;
+
+  for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    init_ctx(&ctx, fractal_kernel_auto, false, true, false, NULL);
+    ctx.width = sizes[i][0];
+    ctx.height = sizes[i][1];
+    ctx.fwidth = 4.0;
+    ctx.fheight = ctx.fwidth * (double)ctx.height / (double)ctx.width;
+    EXPECT_EQ(fractal_ctx_set_center(&ctx, (const char* const[]){"0", "0"}),
+              NULL);
+    // Row 0's partner is just below the view, and the middle row of even
+    // heights is its own.
+    EXPECT_EQ(fractal_ctx_mirror_rows(&ctx, source), (ctx.height - 1) / 2);
+    for (uint32_t row = ctx.height / 2 + 1; row < ctx.height; row++) {
+      EXPECT_EQ(source[row], ctx.height - row);
+    }
+  }
+}
+
+TEST(FractalMirrorRowsOneRange) {
+  static uint32_t source[600];
+  struct fractal_ctx ctx;
+
+  // The real axis a third of the way down, on row 200.
+  init_ctx(&ctx, fractal_kernel_auto, false, true, false, NULL);
+  ctx.width = 800;
+  ctx.height = 600;
+  ctx.fwidth = 4.0;
+  ctx.fheight = 3.0;
+  EXPECT_EQ(fractal_ctx_set_center(&ctx, (const char* const[]){"0", "0.5"}),
+            NULL);
+  EXPECT_EQ(fractal_ctx_mirror_rows(&ctx, source), 200);
+  for (uint32_t row = 0; row < ctx.height; row++) {
+    EXPECT_EQ(source[row], row > 200 && row <= 400 ? 400 - row : row);
+  }
+}
+
+static void init_formula_ctx(struct fractal_ctx* ctx,
+                             enum fractal_kernel kernel, bool periodicity,
+                             enum fractal_formula formula, uint32_t power,
+                             bool julia, uint8_t* buffer) {
+  init_ctx(ctx, kernel, false, false, periodicity, buffer);
+  ctx->formula = formula;
+  ctx->power = power;
+  ctx->julia = julia;
+  ctx->julia_c[0] = -0.8;
+  ctx->julia_c[1] = 0.156;
+  if (julia) {
+    ctx->fleft = -1.5;
+    ctx->ftop = -ctx->fheight / 2.0;
+  }
+  EXPECT_EQ(fractal_ctx_select_kernel(ctx), NULL);
+}
+
+TEST(FractalFormulaKernelsMatchScalar) {
+  uint8_t mandlebrot[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t expected[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t actual[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  struct fractal_ctx ctx;
+
+  render(&ctx, fractal_kernel_scalar, false, false, false, mandlebrot);
+  const struct {
+    enum fractal_formula formula;
+    uint32_t power;
+  } formulas[] = {
+      {fractal_formula_mandlebrot, 0},   {fractal_formula_multibrot, 3},
+      {fractal_formula_multibrot, 4},    {fractal_formula_multibrot, 5},
+      {fractal_formula_multibrot, 6},    {fractal_formula_multibrot, 7},
+      {fractal_formula_multibrot, 8},    {fractal_formula_burning_ship, 0},
+      {fractal_formula_tricorn, 0},      {fractal_formula_celtic, 0},
+  };
+  for (unsigned f = 0; f < sizeof(formulas) / sizeof(formulas[0]); f++) {
+    for (unsigned mode = 0; mode < 4; mode++) {
+      const bool julia = (mode & 1) != 0;
+      // Periodicity can stop points that escape much later, so both sides
+      // detect it the same way.
+      const bool periodicity = (mode & 2) != 0;
+      init_formula_ctx(&ctx, fractal_kernel_scalar, periodicity,
+                       formulas[f].formula, formulas[f].power, julia,
+                       expected);
+      fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+      if (!julia && formulas[f].formula != fractal_formula_mandlebrot) {
+        EXPECT_(memcmp(expected, mandlebrot, sizeof(expected)) != 0,
+                "%s renders the Mandelbrot set",
+                fractal_formula_name(formulas[f].formula));
+      }
+      for (enum fractal_kernel kernel = fractal_kernel_scalar;
+           kernel <= fractal_kernel_avx512; kernel++) {
+        if (!fractal_kernel_is_supported(kernel)) {
+          continue;
+        }
+        memset(actual, 0, sizeof(actual));
+        init_formula_ctx(&ctx, kernel, periodicity, formulas[f].formula,
+                         formulas[f].power, julia, actual);
+        fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+        EXPECT_(memcmp(expected, actual, sizeof(actual)) == 0,
+                "%s^%u%s kernel %s%s differs from scalar",
+                fractal_formula_name(formulas[f].formula), formulas[f].power,
+                julia ? " Julia" : "", fractal_kernel_name(kernel),
+                periodicity ? " (periodicity)" : "");
+      }
+    }
+  }
+}
+
+TEST(FractalJuliaMirrorRowsExact) {
+  uint8_t expected[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t actual[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint32_t source[FRACTAL_TEST_HEIGHT];
+  struct fractal_ctx ctx;
+
+  // Centered on the origin, where Julia sets are point symmetric. Columns
+  // only pair up exactly at widths like 64, all but the first. The Burning
+  // Ship's absolute values leave f(-z) = f(z), so its Julia sets are too.
+  const enum fractal_formula formulas[2] = {fractal_formula_mandlebrot,
+                                            fractal_formula_burning_ship};
+  for (unsigned f = 0; f < 2; f++) {
+    init_formula_ctx(&ctx, fractal_kernel_auto, true, formulas[f], 0, true,
+                     expected);
+    ctx.width = 64;
+    fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+    memcpy(actual, expected, sizeof(actual));
+    const uint32_t mirrored = fractal_ctx_mirror_rows(&ctx, source);
+    EXPECT_(mirrored != 0, "no %s Julia rows mirrored",
+            fractal_formula_name(formulas[f]));
+    for (uint32_t row = 0; row < ctx.height; row++) {
+      if (source[row] != row) {
+        memset(actual + row * ctx.width, 0, ctx.width);
+      }
+    }
+    ctx.buffer = actual;
+    fractal_ctx_copy_mirrored_rows(&ctx, source);
+    EXPECT_(memcmp(expected, actual, sizeof(actual)) == 0,
+            "%s Julia rows mirrored inexactly",
+            fractal_formula_name(formulas[f]));
+  }
+
+  // Off to the right, and the Burning Ship set itself isn't symmetric at all.
+  ctx.fleft = 0.25;
+  EXPECT_EQ(fractal_ctx_mirror_rows(&ctx, source), 0);
+  init_formula_ctx(&ctx, fractal_kernel_auto, true,
+                   fractal_formula_burning_ship, 0, false, expected);
+  EXPECT_EQ(fractal_ctx_mirror_rows(&ctx, source), 0);
+}
+
+static fractal_kernel_fn_t progressive_kernel_fn;
+static uint8_t progressive_computed[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+
+// Counts how many times each pixel is computed.
+static void progressive_counting_kernel(struct fractal_ctx* ctx,
+                                        wq_rect_t const* rect) {
+  progressive_kernel_fn(ctx, rect);
+  const uint32_t step = ctx->column_step ?: 1;
+  for (uint32_t row = rect->y; row < rect->y + rect->h; row++) {
+    for (uint32_t i = 0; i < rect->w; i++) {
+      progressive_computed[row * ctx->width + rect->x + i * step] += 1;
+    }
+  }
+}
+
+TEST(FractalProgressiveMatchesSinglePass) {
+  uint8_t expected[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t actual[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  struct timespec pass_done[FRACTAL_PROGRESSIVE_PASSES];
+  struct fractal_ctx ctx;
+
+  const enum fractal_precision precisions[5] = {
+      fractal_precision_double, fractal_precision_float,
+      fractal_precision_long_double, fractal_precision_double_double,
+      fractal_precision_fixed};
+  for (unsigned p = 0; p < 5; p++) {
+    init_ctx(&ctx, fractal_kernel_auto, false, true, true, expected);
+    ctx.precision = precisions[p];
+    EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+    fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+
+    init_ctx(&ctx, fractal_kernel_auto, false, true, true, actual);
+    ctx.precision = precisions[p];
+    ctx.column_step = FRACTAL_PROGRESSIVE_FIRST_STEP;
+    EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+    progressive_kernel_fn = ctx.kernel_fn;
+    ctx.kernel_fn = progressive_counting_kernel;
+    memset(progressive_computed, 0, sizeof(progressive_computed));
+    fractal_progressive_render(&ctx, 2, pass_done);
+    EXPECT_(memcmp(expected, actual, sizeof(actual)) == 0,
+            "%s progressive render differs",
+            fractal_precision_name(ctx.precision));
+    for (size_t i = 0; i < sizeof(progressive_computed); i++) {
+      EXPECT_EQ(progressive_computed[i], 1);
+    }
+  }
+}
+
+TEST(FractalEscalateMatchesSingleRender) {
+  uint8_t expected[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t actual[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  const uint32_t budgets[3] = {20, 200, 2000};
+  struct fractal_ctx ctx;
+
+  for (unsigned periodicity = 0; periodicity < 2; periodicity++) {
+    init_ctx(&ctx, fractal_kernel_scalar, false, true, periodicity, expected);
+    ctx.max_iteration = budgets[2];
+    EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+    fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+
+    for (enum fractal_kernel kernel = fractal_kernel_scalar;
+         kernel <= fractal_kernel_avx512; kernel++) {
+      if (!fractal_kernel_is_supported(kernel)) {
+        continue;
+      }
+      init_ctx(&ctx, kernel, false, true, periodicity, actual);
+      ctx.max_iteration = budgets[2];
+      fractal_escalate_init(&ctx, budgets, 3);
+      EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+      EXPECT_EQ(ctx.kernel, kernel);
+      fractal_worker(&(wq_rect_t){.w = ctx.width, .h = 20}, &ctx);
+      fractal_worker(&(wq_rect_t){.y = 20, .w = ctx.width, .h = 21}, &ctx);
+      fractal_escalate_render(&ctx, 2);
+      EXPECT_(memcmp(expected, actual, sizeof(actual)) == 0,
+              "kernel %s escalated render differs with periodicity %u",
+              fractal_kernel_name(kernel), periodicity);
+
+      struct fractal_escalate const* escalate = ctx.escalate;
+      EXPECT_TRUE(escalate->unresolved[0] > escalate->unresolved[1]);
+      EXPECT_TRUE(escalate->unresolved[1] >= escalate->unresolved[2]);
+      EXPECT_EQ(escalate->length, escalate->unresolved[2]);
+      fractal_escalate_destroy(&ctx);
+      EXPECT_EQ(ctx.escalate, NULL);
+    }
+  }
+}
+
+TEST(FractalBudgetsKeepDarkPixels) {
+  uint8_t expected[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t actual[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  struct fractal_budgets budgets;
+  struct fractal_ctx ctx;
+
+  init_ctx(&ctx, fractal_kernel_scalar, false, true, false, expected);
+  ctx.max_iteration = 1 << 12;
+  fractal_budgets_init(&budgets, &ctx, 1 << 12);
+  EXPECT_EQ(budgets.columns, 2);
+  EXPECT_EQ(budgets.rows, 1);
+  EXPECT_EQ(ctx.max_iteration, budgets.max);
+  uint64_t counts[32];
+  const unsigned highest = fractal_budgets_histogram(&budgets, counts);
+  EXPECT_EQ(1u << highest, budgets.max);
+  uint64_t total = 0;
+  for (unsigned bit = 0; bit <= highest; bit++) {
+    total += counts[bit];
+  }
+  EXPECT_EQ(total, 2);
+  for (uint32_t tile = 0; tile < 2; tile++) {
+    const uint32_t budget = budgets.budgets[tile];
+    EXPECT_TRUE(budget >= FRACTAL_BUDGET_MIN && budget <= budgets.max);
+    EXPECT_EQ(budget & (budget - 1), 0);
+  }
+  const wq_rect_t tiles[2] = {
+      {.w = FRACTAL_BUDGET_TILE, .h = ctx.height},
+      {.x = FRACTAL_BUDGET_TILE,
+       .w = ctx.width - FRACTAL_BUDGET_TILE,
+       .h = ctx.height},
+  };
+  fractal_worker(&tiles[0], &ctx);
+  fractal_worker(&tiles[1], &ctx);
+
+  // Every kernel sticks to the same budgets.
+  for (enum fractal_kernel kernel = fractal_kernel_scalar;
+       kernel <= fractal_kernel_avx512; kernel++) {
+    if (!fractal_kernel_is_supported(kernel)) {
+      continue;
+    }
+    init_ctx(&ctx, kernel, true, true, true, actual);
+    ctx.budgets = budgets.budgets;
+    ctx.budget_tile = FRACTAL_BUDGET_TILE;
+    ctx.budget_columns = budgets.columns;
+    ctx.max_iteration = budgets.max;
+    EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+    fractal_worker(&tiles[0], &ctx);
+    fractal_worker(&tiles[1], &ctx);
+    EXPECT_(memcmp(expected, actual, sizeof(actual)) == 0,
+            "kernel %s differs from scalar with budgets",
+            fractal_kernel_name(kernel));
+  }
+
+  // Against one budget for the whole view the dark pixels are the same.
+  init_ctx(&ctx, fractal_kernel_scalar, false, true, false, actual);
+  ctx.max_iteration = budgets.max;
+  fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+  EXPECT_(memcmp(expected, actual, sizeof(actual)) == 0,
+          "budgets differ from a uniform render at %u", budgets.max);
+  fractal_budgets_destroy(&budgets);
+}
+
+TEST(FractalBudgetsMatchUniformRender) {
+  static uint8_t expected[512 * 512];
+  static uint8_t actual[512 * 512];
+  struct fractal_budgets budgets;
+  struct fractal_ctx ctx;
+
+  const struct {
+    const char* name;
+    const char* center[2];
+    double fwidth;
+  } views[] = {
+      {"default", {"-0.75", "0"}, 3.0},
+      {"seahorse valley", {"-0.745", "0.1"}, 0.05},
+  };
+  for (unsigned v = 0; v < sizeof(views) / sizeof(views[0]); v++) {
+    for (unsigned pass = 0; pass < 2; pass++) {
+      init_ctx(&ctx, fractal_kernel_auto, false, true, true,
+               pass ? actual : expected);
+      ctx.width = 512;
+      ctx.height = 512;
+      ctx.fwidth = views[v].fwidth;
+      ctx.fheight = ctx.fwidth;
+      EXPECT_EQ(fractal_ctx_set_center(&ctx, views[v].center), NULL);
+      EXPECT_EQ(fractal_ctx_select_kernel(&ctx), NULL);
+      if (!pass) {
+        fractal_budgets_init(&budgets, &ctx, 1 << 14);
+        ctx.budgets = NULL;
+        fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+        continue;
+      }
+      ctx.budgets = budgets.budgets;
+      ctx.budget_tile = FRACTAL_BUDGET_TILE;
+      ctx.budget_columns = budgets.columns;
+      ctx.max_iteration = budgets.max;
+      for (uint32_t y = 0; y < ctx.height; y += FRACTAL_BUDGET_TILE) {
+        for (uint32_t x = 0; x < ctx.width; x += FRACTAL_BUDGET_TILE) {
+          fractal_worker(&(wq_rect_t){.x = x,
+                                      .y = y,
+                                      .w = FRACTAL_BUDGET_TILE,
+                                      .h = FRACTAL_BUDGET_TILE},
+                         &ctx);
+        }
+      }
+    }
+    fractal_budgets_render(&budgets, &ctx, 2);
+    unsigned differ = 0;
+    for (size_t i = 0; i < sizeof(expected); i++) {
+      differ += expected[i] != actual[i];
+    }
+    EXPECT_(differ == 0, "%u pixels of %s differ from a uniform render at %u",
+            differ, views[v].name, budgets.max);
+    EXPECT_TRUE(budgets.redone_pixels != 0);
+    EXPECT_EQ(ctx.budgets, budgets.budgets);
+    fractal_budgets_destroy(&budgets);
+  }
+}
+
+TEST(FractalBalanceCoversView) {
+  uint8_t expected[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t actual[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  struct fractal_balance balance;
+  struct fractal_ctx ctx;
+
+  render(&ctx, fractal_kernel_auto, false, true, true, expected);
+  init_ctx(&ctx, fractal_kernel_auto, false, true, true, actual);
+  memset(actual, 0, sizeof(actual));
+  fractal_balance_init(&balance, &ctx, 3);
+  EXPECT_EQ(balance.columns, 5);
+  EXPECT_EQ(balance.rows, 3);
+  // Split like mirrored rows would be, in the middle of a row of cells.
+  const uintptr_t count = fractal_balance_add_rows(&balance, 0, 20) +
+                          fractal_balance_add_rows(&balance, 20, 21);
+  EXPECT_EQ(count, balance.count);
+  EXPECT_TRUE(count > 3);
+
+  wq_t wq = wq_create_rect("test", (void*)fractal_worker, 3, count);
+  EXPECT_EQ(fractal_balance_push(&balance, wq), count);
+  wq_start(wq, &ctx);
+  wq_wait(wq);
+  wq_destroy(wq);
+  EXPECT_(memcmp(expected, actual, sizeof(actual)) == 0,
+          "balanced chunks don't cover the view");
+
+  uint64_t total = 0;
+  for (uintptr_t i = 0; i < count; i++) {
+    EXPECT_TRUE(i == 0 || balance.chunks[i - 1].cost >= balance.chunks[i].cost);
+    total += balance.chunks[i].cost;
+  }
+  uint64_t predicted = 0;
+  for (size_t i = 0; i < 3; i++) {
+    predicted += balance.predicted[i];
+    // Taking the next chunk whenever free, nobody ends up more than the
+    // largest chunk behind the average.
+    EXPECT_TRUE(balance.predicted[i] <= total / 3 + balance.chunks[0].cost);
+  }
+  EXPECT_EQ(predicted, total);
+  fractal_balance_destroy(&balance);
+}
+
+static void render_buddhabrot(struct fractal_ctx* ctx, uint32_t const* limits,
+                              unsigned channels,
+                              enum fractal_histogram histogram,
+                              size_t worker_count, uint8_t* buffer,
+                              uint64_t* escaped) {
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->width = FRACTAL_TEST_WIDTH;
+  ctx->height = FRACTAL_TEST_HEIGHT;
+  ctx->fwidth = 4.0;
+  ctx->fheight = ctx->fwidth * ctx->height / ctx->width;
+  ctx->fleft = -2.25;
+  ctx->ftop = -ctx->fheight / 2.0;
+  ctx->buffer = buffer;
+  struct fractal_buddhabrot buddhabrot;
+  EXPECT_EQ(fractal_buddhabrot_init(&buddhabrot, ctx, limits, channels,
+                                    histogram, worker_count),
+            NULL);
+  fractal_buddhabrot_render(&buddhabrot, 20000);
+  EXPECT_TRUE(buddhabrot.escaped > 0);
+  EXPECT_TRUE(buddhabrot.hits > buddhabrot.escaped);
+  *escaped = buddhabrot.escaped;
+  fractal_buddhabrot_destroy(&buddhabrot);
+}
+
+TEST(FractalBuddhabrotHistogramsAgree) {
+  uint8_t expected[3 * FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t actual[3 * FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  struct fractal_ctx ctx;
+  uint64_t expected_escaped;
+  uint64_t actual_escaped;
+
+  // Samples are the same whichever worker takes them, so private histograms
+  // and one shared one add up to the same counts.
+  const uint32_t limits[3] = {500, 100, 20};
+  for (unsigned channels = 1; channels <= 3; channels += 2) {
+    const size_t len = channels * FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT;
+    render_buddhabrot(&ctx, limits, channels, fractal_histogram_private, 1,
+                      expected, &expected_escaped);
+    render_buddhabrot(&ctx, limits, channels, fractal_histogram_private, 3,
+                      actual, &actual_escaped);
+    EXPECT_EQ(expected_escaped, actual_escaped);
+    EXPECT_EQ(memcmp(expected, actual, len), 0);
+    render_buddhabrot(&ctx, limits, channels, fractal_histogram_atomic, 3,
+                      actual, &actual_escaped);
+    EXPECT_EQ(expected_escaped, actual_escaped);
+    EXPECT_EQ(memcmp(expected, actual, len), 0);
+  }
+
+  // Orbits escaping within 20 iterations count in every channel, the rest
+  // only in the first two, so the channels differ.
+  bool differ = false;
+  for (uint32_t i = 0; i < FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT; i++) {
+    differ |= expected[3 * i] != expected[3 * i + 2];
+  }
+  EXPECT_TRUE(differ);
+}
+
+static void render_mandelbulb(struct fractal_ctx* ctx,
+                              enum fractal_kernel kernel, bool prepass,
+                              uint8_t* buffer, uint64_t* steps) {
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->width = FRACTAL_TEST_WIDTH;
+  ctx->height = FRACTAL_TEST_HEIGHT;
+  ctx->fwidth = 2.6;
+  ctx->fheight = ctx->fwidth * ctx->height / ctx->width;
+  ctx->fleft = -ctx->fwidth / 2.0;
+  ctx->ftop = -ctx->fheight / 2.0;
+  ctx->buffer = buffer;
+  ctx->kernel = kernel;
+  struct fractal_mandelbulb mandelbulb;
+  EXPECT_EQ(fractal_mandelbulb_init(&mandelbulb, ctx, prepass), NULL);
+  EXPECT_TRUE(ctx->kernel != fractal_kernel_auto);
+  EXPECT_EQ(fractal_mandelbulb_render(&mandelbulb, 2, 16,
+                                      wq_tile_order_hilbert),
+            wq_tile_count(ctx->width, ctx->height, 16, 16));
+  EXPECT_EQ(atomic_load(&mandelbulb.rays),
+            (uint64_t)FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT);
+  EXPECT_TRUE(atomic_load(&mandelbulb.hits) > 0);
+  *steps = atomic_load(&mandelbulb.steps);
+  fractal_mandelbulb_destroy(&mandelbulb);
+}
+
+TEST(FractalMandelbulbKernelsMatchScalar) {
+  uint8_t expected[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t actual[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  struct fractal_ctx ctx;
+  uint64_t expected_steps;
+  uint64_t actual_steps;
+
+  for (unsigned prepass = 0; prepass < 2; prepass++) {
+    render_mandelbulb(&ctx, fractal_kernel_scalar, prepass, expected,
+                      &expected_steps);
+    for (enum fractal_kernel kernel = fractal_kernel_sse2;
+         kernel <= fractal_kernel_avx512; kernel++) {
+      if (!fractal_kernel_is_supported(kernel)) {
+        continue;
+      }
+      render_mandelbulb(&ctx, kernel, prepass, actual, &actual_steps);
+      EXPECT_(memcmp(expected, actual, sizeof(actual)) == 0,
+              "%s differs from scalar, prepass %u",
+              fractal_kernel_name(kernel), prepass);
+      EXPECT_EQ(expected_steps, actual_steps);
+    }
+  }
+}
+
+TEST(FractalMandelbulbPrepassSkipsSteps) {
+  uint8_t expected[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t actual[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  struct fractal_ctx ctx;
+  uint64_t expected_steps;
+  uint64_t actual_steps;
+
+  render_mandelbulb(&ctx, fractal_kernel_auto, false, expected,
+                    &expected_steps);
+  render_mandelbulb(&ctx, fractal_kernel_auto, true, actual, &actual_steps);
+  EXPECT_TRUE(actual_steps < expected_steps);
+  // Rays starting further along stop at slightly different points of the
+  // surface, but still hit it.
+  uint32_t flipped = 0;
+  for (uint32_t i = 0; i < FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT; i++) {
+    flipped += (expected[i] == 0) != (actual[i] == 0);
+  }
+  EXPECT_(flipped <= FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT / 200,
+          "%u pixels hit with only one of them", flipped);
+}
+
+static void init_lyapunov_ctx(struct fractal_ctx* ctx,
+                              struct fractal_lyapunov const* lyapunov,
+                              enum fractal_kernel kernel, uint8_t* buffer) {
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->width = FRACTAL_TEST_WIDTH;
+  ctx->height = FRACTAL_TEST_HEIGHT;
+  ctx->fwidth = 2.0;
+  ctx->fheight = ctx->fwidth * ctx->height / ctx->width;
+  ctx->fleft = 2.0;
+  ctx->ftop = 3.0 - ctx->fheight / 2.0;
+  ctx->buffer = buffer;
+  ctx->kernel = kernel;
+  ctx->precision = fractal_precision_double;
+  ctx->lyapunov = lyapunov;
+  EXPECT_EQ(fractal_ctx_select_kernel(ctx), NULL);
+}
+
+TEST(FractalLyapunovRuns) {
+  struct fractal_lyapunov lyapunov;
+  EXPECT_TRUE(fractal_lyapunov_init(&lyapunov, "", 100) != NULL);
+  EXPECT_TRUE(fractal_lyapunov_init(&lyapunov, "ABC", 100) != NULL);
+
+  EXPECT_EQ(fractal_lyapunov_init(&lyapunov, "AABAB", 100), NULL);
+  // Seven rounds of AABAB, with a log after the 32nd step splitting an A A.
+  EXPECT_EQ(lyapunov.round, 35);
+  EXPECT_EQ(lyapunov.rounds, 3);
+  EXPECT_EQ(lyapunov.warmup_rounds, 1);
+  uint32_t steps = 0;
+  uint32_t logs = 0;
+  for (uint32_t i = 0; i < lyapunov.run_count; i++) {
+    struct fractal_lyapunov_run const* run = &lyapunov.runs[i];
+    EXPECT_EQ(lyapunov.sequence[steps % 5], run->b ? 'B' : 'A');
+    steps += run->count;
+    if (run->log) {
+      logs++;
+      EXPECT_TRUE(steps == 32 || steps == 35);
+    }
+  }
+  EXPECT_EQ(steps, 35);
+  EXPECT_EQ(logs, 2);
+  EXPECT_EQ(lyapunov.runs[lyapunov.run_count - 1].log, true);
+  fractal_lyapunov_destroy(&lyapunov);
+}
+
+TEST(FractalLyapunovKernelsMatchScalar) {
+  uint8_t expected[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t actual[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  struct timespec pass_done[FRACTAL_PROGRESSIVE_PASSES];
+  struct fractal_ctx ctx;
+  struct fractal_lyapunov lyapunov;
+
+  EXPECT_EQ(fractal_lyapunov_init(&lyapunov, "AABAB", 400), NULL);
+  init_lyapunov_ctx(&ctx, &lyapunov, fractal_kernel_scalar, expected);
+  fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+  // Both stable and chaotic pixels.
+  uint32_t stable = 0;
+  for (uint32_t i = 0; i < sizeof(expected); i++) {
+    stable += expected[i] != 0;
+  }
+  EXPECT_(stable > 0 && stable < sizeof(expected), "%u stable pixels",
+          stable);
+
+  for (enum fractal_kernel kernel = fractal_kernel_scalar;
+       kernel <= fractal_kernel_avx512; kernel++) {
+    if (!fractal_kernel_is_supported(kernel)) {
+      continue;
+    }
+    memset(actual, 0, sizeof(actual));
+    init_lyapunov_ctx(&ctx, &lyapunov, kernel, actual);
+    fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+    EXPECT_(memcmp(expected, actual, sizeof(actual)) == 0,
+            "%s differs from scalar", fractal_kernel_name(kernel));
+
+    memset(actual, 0, sizeof(actual));
+    init_lyapunov_ctx(&ctx, &lyapunov, kernel, actual);
+    ctx.column_step = FRACTAL_PROGRESSIVE_FIRST_STEP;
+    fractal_progressive_render(&ctx, 2, pass_done);
+    EXPECT_(memcmp(expected, actual, sizeof(actual)) == 0,
+            "%s progressive render differs", fractal_kernel_name(kernel));
+  }
+  fractal_lyapunov_destroy(&lyapunov);
+}
+
+static void init_newton_ctx(struct fractal_ctx* ctx,
+                            struct fractal_newton const* newton,
+                            enum fractal_kernel kernel, uint8_t* buffer) {
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->width = FRACTAL_TEST_WIDTH;
+  ctx->height = FRACTAL_TEST_HEIGHT;
+  ctx->max_iteration = 100;
+  ctx->fwidth = 3.0;
+  ctx->fheight = ctx->fwidth * ctx->height / ctx->width;
+  ctx->fleft = -1.5;
+  ctx->ftop = -ctx->fheight / 2.0;
+  ctx->buffer = buffer;
+  ctx->kernel = kernel;
+  ctx->precision = fractal_precision_double;
+  ctx->newton = newton;
+  EXPECT_EQ(fractal_ctx_select_kernel(ctx), NULL);
+}
+
+TEST(FractalNewtonCoefficients) {
+  struct fractal_newton newton;
+  EXPECT_TRUE(fractal_newton_init(&newton, NULL, 0) != NULL);
+
+  // (z - 1)(z + 2)(z - i) = z^3 + (1 - i) z^2 - (2 + i) z + 2i
+  const double roots[3][2] = {{1.0, 0.0}, {-2.0, 0.0}, {0.0, 1.0}};
+  EXPECT_EQ(fractal_newton_init(&newton, roots, 3), NULL);
+  EXPECT_EQ(newton.root_count, 3);
+  const double expected[3][2] = {{1.0, -1.0}, {-2.0, -1.0}, {0.0, 2.0}};
+  for (unsigned k = 0; k < 3; k++) {
+    EXPECT_(newton.coefficients[k][0] == expected[k][0] &&
+                newton.coefficients[k][1] == expected[k][1],
+            "coefficient %u is %g,%g", k, newton.coefficients[k][0],
+            newton.coefficients[k][1]);
+  }
+}
+
+TEST(FractalNewtonKernelsMatchScalar) {
+  uint8_t expected[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t actual[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  struct timespec pass_done[FRACTAL_PROGRESSIVE_PASSES];
+  struct fractal_ctx ctx;
+  struct fractal_newton newton;
+
+  const double roots[5][2] = {
+      {1.0, 0.0}, {0.0, 1.0}, {-1.0, 0.0}, {0.0, -1.0}, {0.5, 0.5}};
+  EXPECT_EQ(fractal_newton_init(&newton, roots, 5), NULL);
+  init_newton_ctx(&ctx, &newton, fractal_kernel_scalar, expected);
+  fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+  // Every root's band shows up.
+  const uint32_t band = 255 / 5;
+  bool bands[5] = {false};
+  for (uint32_t i = 0; i < sizeof(expected); i++) {
+    if (expected[i]) {
+      bands[(expected[i] - 1) / band] = true;
+    }
+  }
+  for (unsigned r = 0; r < 5; r++) {
+    EXPECT_(bands[r], "no pixel converged to root %u", r);
+  }
+
+  for (enum fractal_kernel kernel = fractal_kernel_scalar;
+       kernel <= fractal_kernel_avx512; kernel++) {
+    if (!fractal_kernel_is_supported(kernel)) {
+      continue;
+    }
+    memset(actual, 0, sizeof(actual));
+    init_newton_ctx(&ctx, &newton, kernel, actual);
+    fractal_worker(&(wq_rect_t){.w = ctx.width, .h = ctx.height}, &ctx);
+    EXPECT_(memcmp(expected, actual, sizeof(actual)) == 0,
+            "%s differs from scalar", fractal_kernel_name(kernel));
+
+    memset(actual, 0, sizeof(actual));
+    init_newton_ctx(&ctx, &newton, kernel, actual);
+    ctx.column_step = FRACTAL_PROGRESSIVE_FIRST_STEP;
+    fractal_progressive_render(&ctx, 2, pass_done);
+    EXPECT_(memcmp(expected, actual, sizeof(actual)) == 0,
+            "%s progressive render differs", fractal_kernel_name(kernel));
+  }
+}
+
+// Writes text to a temporary flame file, returning its path in path.
+static void write_flame(char* path, const char* text) {
+  strcpy(path, "/tmp/frak_flame_XXXXXX");
+  const int fd = mkstemp(path);
+  EXPECT_TRUE(fd >= 0);
+  EXPECT_EQ(write(fd, text, strlen(text)), (ssize_t)strlen(text));
+  close(fd);
+}
+
+static const char* load_flame(struct fractal_flame_spec* spec,
+                              const char* text) {
+  char path[32];
+  write_flame(path, text);
+  const char* err = fractal_flame_load(spec, path);
+  unlink(path);
+  return err;
+}
+
+TEST(FractalFlameLoad) {
+  struct fractal_flame_spec spec;
+  EXPECT_TRUE(fractal_flame_load(&spec, "/nonexistent.flame") != NULL);
+  EXPECT_TRUE(load_flame(&spec, "# nothing\n") != NULL);
+  EXPECT_STREQ(load_flame(&spec, "xform 1 0.5 1 0 0 0 1\n"),
+               "line 1: expected 6 affine coefficients");
+  EXPECT_STREQ(load_flame(&spec, "\nxform 1 0 1 0 0 0 1 0 bent 1\n"),
+               "line 2: unknown variation 'bent'");
+  EXPECT_TRUE(load_flame(&spec, "xform 1 2 1 0 0 0 1 0\n") != NULL);
+  EXPECT_TRUE(load_flame(&spec, "xform 1 0 1 0 0 0 1 0\ncolor 0 0 256 0\n") !=
+              NULL);
+
+  EXPECT_EQ(load_flame(&spec,
+                       "xform 2 0.25 1 0 0 0 1 0  # identity\n"
+                       "xform 1 1 0.5 0 0 0 0.5 0 swirl 0.5 disc 0.25\n"
+                       "color 0 0 0 0\n"
+                       "color 100 200 100 0\n"),
+            NULL);
+  EXPECT_EQ(spec.xform_count, 2);
+  EXPECT_EQ(spec.xforms[0].weight, 2.0);
+  EXPECT_EQ(spec.xforms[0].variation_count, 1);
+  EXPECT_EQ(spec.xforms[0].variations[0], fractal_flame_linear);
+  EXPECT_EQ(spec.xforms[1].variation_count, 2);
+  EXPECT_EQ(spec.xforms[1].variations[1], fractal_flame_disc);
+  EXPECT_EQ(spec.xforms[1].amounts[1], 0.25);
+  // Blended up to index 100, held after it.
+  EXPECT_EQ(spec.palette[50][0], 100);
+  EXPECT_EQ(spec.palette[50][1], 50);
+  EXPECT_EQ(spec.palette[255][0], 200);
+}
+
+static void render_flame(struct fractal_ctx* ctx,
+                         struct fractal_flame_spec const* spec,
+                         size_t worker_count, uint8_t* buffer,
+                         uint64_t* hits) {
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->width = FRACTAL_TEST_WIDTH;
+  ctx->height = FRACTAL_TEST_HEIGHT;
+  ctx->fwidth = 2.5;
+  ctx->fheight = ctx->fwidth * ctx->height / ctx->width;
+  ctx->fleft = -ctx->fwidth / 2.0;
+  ctx->ftop = -ctx->fheight / 2.0;
+  ctx->buffer = buffer;
+  struct fractal_flame flame;
+  EXPECT_EQ(fractal_flame_init(&flame, ctx, spec, 2, worker_count), NULL);
+  fractal_flame_render(&flame, 200000);
+  EXPECT_EQ(flame.iterations, 200000);
+  *hits = flame.hits;
+  fractal_flame_destroy(&flame);
+}
+
+TEST(FractalFlameWorkersAgree) {
+  uint8_t expected[3 * FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t actual[3 * FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  struct fractal_ctx ctx;
+  struct fractal_flame_spec spec;
+  uint64_t expected_hits;
+  uint64_t actual_hits;
+
+  EXPECT_EQ(load_flame(&spec,
+                       "xform 1 0 0.5 0 0 0 0.5 0.5\n"
+                       "xform 1 0.5 0.5 0 0.5 0 0.5 -0.5\n"
+                       "xform 1 1 0.5 0 -0.5 0 0.5 -0.5 linear 0.8 swirl 0.2\n"
+                       "color 0 255 64 0\n"
+                       "color 255 0 128 255\n"),
+            NULL);
+  // Batches walk the same points whichever worker takes them, so the
+  // private buffers add up to the same image.
+  render_flame(&ctx, &spec, 1, expected, &expected_hits);
+  render_flame(&ctx, &spec, 3, actual, &actual_hits);
+  EXPECT_TRUE(expected_hits > 0);
+  EXPECT_EQ(expected_hits, actual_hits);
+  EXPECT_EQ(memcmp(expected, actual, sizeof(actual)), 0);
+
+  // Both ends of the palette show up.
+  bool red = false;
+  bool blue = false;
+  for (uint32_t i = 0; i < FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT; i++) {
+    red |= expected[3 * i] > 2 * expected[3 * i + 2];
+    blue |= expected[3 * i + 2] > 2 * expected[3 * i];
+  }
+  EXPECT_TRUE(red && blue);
+}
+
+TEST(FractalFlameHotCellDoesNotWrap) {
+  uint8_t buffer[3 * FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  struct fractal_ctx ctx;
+  struct fractal_flame_spec spec;
+  uint64_t hits;
+
+  // Every point falls onto the origin, so one cell takes every hit, adding
+  // 255 to each color more often than 32 bits hold.
+  EXPECT_EQ(load_flame(&spec,
+                       "xform 1 0 0.5 0 0 0 0.5 0\n"
+                       "color 0 255 255 255\n"),
+            NULL);
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.width = FRACTAL_TEST_WIDTH;
+  ctx.height = FRACTAL_TEST_HEIGHT;
+  ctx.fwidth = 2.0;
+  ctx.fheight = ctx.fwidth * ctx.height / ctx.width;
+  ctx.fleft = -1.0;
+  ctx.ftop = -ctx.fheight / 2.0;
+  ctx.buffer = buffer;
+  struct fractal_flame flame;
+  EXPECT_EQ(fractal_flame_init(&flame, &ctx, &spec, 1, 1), NULL);
+  fractal_flame_render(&flame, 20000000);
+  hits = flame.hits;
+  EXPECT_TRUE(atomic_load(&flame.max) > UINT32_MAX / 255);
+  fractal_flame_destroy(&flame);
+  EXPECT_EQ(hits, 20000000);
+
+  uint32_t brightest = 0;
+  for (uint32_t i = 0; i < FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT; i++) {
+    if (buffer[3 * i] > buffer[3 * brightest]) {
+      brightest = i;
+    }
+  }
+  for (unsigned c = 0; c < 3; c++) {
+    EXPECT_EQ(buffer[3 * brightest + c], 255);
+  }
+}
+
+static bool supersample_test_contrasts(uint8_t const* image, uint32_t column,
+                                       uint32_t row, uint32_t threshold) {
+  const int v = image[row * FRACTAL_TEST_WIDTH + column];
+  const int dx[4] = {-1, 1, 0, 0};
+  const int dy[4] = {0, 0, -1, 1};
+  for (unsigned i = 0; i < 4; i++) {
+    const int x = (int)column + dx[i];
+    const int y = (int)row + dy[i];
+    if (x < 0 || y < 0 || x >= FRACTAL_TEST_WIDTH ||
+        y >= FRACTAL_TEST_HEIGHT) {
+      continue;
+    }
+    if (abs(v - image[y * FRACTAL_TEST_WIDTH + x]) > (int)threshold) {
+      return true;
+    }
+  }
+  return false;
+}
+
+TEST(FractalSupersampleRefinesContrast) {
+  uint8_t base[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  uint8_t actual[FRACTAL_TEST_WIDTH * FRACTAL_TEST_HEIGHT];
+  struct fractal_supersample supersample;
+  struct fractal_ctx ctx;
+
+  render(&ctx, fractal_kernel_auto, false, true, true, base);
+  memcpy(actual, base, sizeof(actual));
+  ctx.buffer = actual;
+  EXPECT_EQ(fractal_supersample_init(&supersample, &ctx, 4, 255), NULL);
+  fractal_supersample_render(&supersample, &ctx, 2);
+  EXPECT_EQ(supersample.refined_pixels, 0);
+  EXPECT_EQ(memcmp(base, actual, sizeof(actual)), 0);
+
+  const uint32_t threshold = 8;
+  EXPECT_EQ(fractal_supersample_init(&supersample, &ctx, 4, threshold), NULL);
+  fractal_supersample_render(&supersample, &ctx, 2);
+  uint64_t contrasting = 0;
+  uint64_t changed = 0;
+  for (uint32_t row = 0; row < ctx.height; row++) {
+    for (uint32_t column = 0; column < ctx.width; column++) {
+      const uint32_t i = row * ctx.width + column;
+      if (supersample_test_contrasts(base, column, row, threshold)) {
+        contrasting += 1;
+        changed += actual[i] != base[i];
+      } else {
+        EXPECT_EQ(actual[i], base[i]);
+      }
+    }
+  }
+  EXPECT_TRUE(contrasting != 0);
+  EXPECT_EQ(supersample.refined_pixels, contrasting);
+  EXPECT_TRUE(changed != 0);
+}
@@ -191,6 +191,15 @@ TEST(QueuePushN) {
   EXPECT_EQ(queue_pop_n(q, 10, buffer), 3);
   EXPECT_EQ(memcmp(pusher, buffer, sizeof(pusher)), 0);
 
+  // Fill the queue once head has wrapped around behind tail.
+  EXPECT_EQ(queue_push_n(q, 2, pusher), 2);
+  EXPECT_EQ(queue_pop_n(q, 2, buffer), 2);
+  EXPECT_EQ(queue_push_n(q, 3, pusher), 3);
+  EXPECT_EQ(queue_push_n(q, 1, pusher), 0);
+  EXPECT_EQ(queue_get_length(q), 3);
+  EXPECT_EQ(queue_pop_n(q, 10, buffer), 3);
+  EXPECT_EQ(memcmp(pusher, buffer, sizeof(pusher)), 0);
+
   queue_destroy(q);
 }
 
@@ -240,3 +249,31 @@ TEST(QueueMultiThread) {
   EXPECT_TRUE(queue_is_empty(q));
   queue_destroy(q);
 }
+
+TEST(QueueRects) {
+  struct queue_rect rects[3] = {
+      {.x = 1, .y = 2, .w = 3, .h = 4},
+      {.x = 5, .y = 6, .w = 7, .h = 8},
+      {.x = 9, .y = 10, .w = 11, .h = 12},
+  };
+  struct queue_rect buffer[3];
+
+  queue_t q = queue_create(3);
+  EXPECT_EQ(queue_push_rects(q, 2, rects), 2);
+  EXPECT_EQ(queue_get_length(q), 2);
+
+  EXPECT_EQ(queue_pop_rects(q, 1, buffer), 1);
+  EXPECT_EQ(memcmp(&buffer[0], &rects[0], sizeof(struct queue_rect)), 0);
+
+  EXPECT_EQ(queue_push_rects(q, 3, rects), 2);
+  EXPECT_EQ(queue_get_length(q), 3);
+
+  EXPECT_EQ(queue_pop_rects(q, 10, buffer), 3);
+  EXPECT_EQ(memcmp(&buffer[0], &rects[1], sizeof(struct queue_rect)), 0);
+  EXPECT_EQ(memcmp(&buffer[1], &rects[0], sizeof(struct queue_rect)), 0);
+  EXPECT_EQ(memcmp(&buffer[2], &rects[1], sizeof(struct queue_rect)), 0);
+
+  EXPECT_EQ(queue_pop_rects(q, 3, buffer), 0);
+  EXPECT_TRUE(queue_is_empty(q));
+  queue_destroy(q);
+}
@@ -2,10 +2,15 @@
 
 #include <frakl/time_utils.h>
 #include <frakl/wq.h>
+#include <stdatomic.h>
 #include <unistd.h>
 
 #include "tests.h"
 
+#ifndef __has_feature
+#define __has_feature(x) 0
+#endif
+
 static void computer(uint8_t** cells, unsigned n, uint8_t* base) {
   uint8_t* const* const end = cells + n;
   do {
@@ -29,6 +34,7 @@ static void _test_wq_internal(bool use_local_cache) {
 
   wq_t wq = wq_create("test", (void*)computer, 0, 512);
   wq_set_worker_cache_size(wq, use_local_cache ? (uint32_t)-1 : 1);
+  wq_set_timing(wq, true);
 
   void* q_items[sizeof(buffer) / 2];
   for (unsigned i = 0; i < sizeof(buffer) / 2; i++) {
@@ -49,6 +55,15 @@ static void _test_wq_internal(bool use_local_cache) {
   EXPECT_TRUE(was_running);
   EXPECT_FALSE(wq_is_running(wq));
 
+  uint64_t busy = 0;
+  for (size_t i = 0; i < wq_get_worker_count(wq); i++) {
+    busy += wq_get_busy_ns(wq)[i];
+  }
+  EXPECT_TRUE(busy > 0);
+  EXPECT_TRUE(busy <= (uint64_t)wq_get_worker_count(wq) *
+                          (concurrent.tv_sec * 1000000000ull +
+                           concurrent.tv_nsec));
+
   clock_gettime(CLOCK_MONOTONIC_RAW, &start);
   for (unsigned i = 0; i < sizeof(buffer); i++) {
     unsigned diff = i;
@@ -66,7 +81,7 @@ static void _test_wq_internal(bool use_local_cache) {
   timespec_minus(&delta, &concurrent);
 
   // Note that serial took longer than concurrent, i.e. wq works!
-#if !defined(__has_feature) || !__has_feature(thread_sanitizer)
+#if !__has_feature(thread_sanitizer)
   EXPECT_TRUE(sysconf(_SC_NPROCESSORS_ONLN) <= 1 ||
               (delta.tv_sec >= 0 && delta.tv_nsec >= 0));
 #endif
@@ -78,3 +93,145 @@ static void _test_wq_internal(bool use_local_cache) {
 TEST(WorkqueueNoLocalCache) { _test_wq_internal(false); }
 
 TEST(WorkqueueLocalCache) { _test_wq_internal(true); }
+
+static void rect_computer(wq_rect_t const* rect, uint8_t* base) {
+  for (uint32_t y = rect->y; y < rect->y + rect->h; y++) {
+    for (uint32_t x = rect->x; x < rect->x + rect->w; x++) {
+      base[y * 37 + x] += 1;
+    }
+  }
+}
+
+static void _test_wq_grid_internal(uint32_t pixels_per_item) {
+  uint8_t buffer[37 * 23];
+  memset(buffer, 0, sizeof(buffer));
+
+  const uintptr_t count = wq_grid_count(37, 23, pixels_per_item);
+  wq_t wq = wq_create_rect("test", (void*)rect_computer, 0, count);
+  EXPECT_EQ(wq_push_grid(wq, 37, 23, pixels_per_item), count);
+  wq_start(wq, buffer);
+  wq_wait(wq);
+  wq_destroy(wq);
+
+  for (unsigned i = 0; i < sizeof(buffer); i++) {
+    EXPECT_EQ(buffer[i], 1);
+  }
+}
+
+TEST(WorkqueueGrid) {
+  EXPECT_EQ(wq_grid_count(37, 23, 1), 37 * 23);
+  EXPECT_EQ(wq_grid_count(37, 23, 10), 4 * 23);
+  EXPECT_EQ(wq_grid_count(37, 23, 37), 23);
+  EXPECT_EQ(wq_grid_count(37, 23, 80), 12);
+  EXPECT_EQ(wq_grid_count(37, 23, 37 * 23), 1);
+  EXPECT_EQ(wq_grid_count(37, 23, (uint32_t)-1), 1);
+
+  _test_wq_grid_internal(1);
+  _test_wq_grid_internal(10);
+  _test_wq_grid_internal(80);
+  _test_wq_grid_internal((uint32_t)-1);
+}
+
+TEST(WorkqueueGridRows) {
+  uint8_t buffer[37 * 23];
+  memset(buffer, 0, sizeof(buffer));
+
+  const uintptr_t count = wq_grid_count(37, 5, 10) + wq_grid_count(37, 9, 80);
+  wq_t wq = wq_create_rect("test", (void*)rect_computer, 0, count);
+  EXPECT_EQ(wq_push_grid_rows(wq, 37, 2, 5, 10), wq_grid_count(37, 5, 10));
+  EXPECT_EQ(wq_push_grid_rows(wq, 37, 14, 9, 80), wq_grid_count(37, 9, 80));
+  wq_start(wq, buffer);
+  wq_wait(wq);
+  wq_destroy(wq);
+
+  for (unsigned i = 0; i < sizeof(buffer); i++) {
+    const unsigned row = i / 37;
+    EXPECT_EQ(buffer[i], (row >= 2 && row < 7) || row >= 14);
+  }
+}
+
+TEST(WorkqueueTiles) {
+  uint8_t buffer[37 * 23];
+  EXPECT_EQ(wq_tile_count(37, 23, 8, 8), 5 * 3);
+  EXPECT_EQ(wq_tile_count(37, 23, 37, 23), 1);
+  for (enum wq_tile_order order = wq_tile_order_row_major;
+       order <= wq_tile_order_hilbert; order++) {
+    const uint32_t sizes[3] = {1, 8, 64};
+    for (unsigned i = 0; i < 3; i++) {
+      memset(buffer, 0, sizeof(buffer));
+      const uintptr_t count = wq_tile_count(37, 20, sizes[i], sizes[i]);
+      wq_t wq = wq_create_rect("test", (void*)rect_computer, 0, count);
+      EXPECT_EQ(
+          wq_push_tiles(wq, 37, 3, 20, sizes[i], sizes[i], order), count);
+      wq_start(wq, buffer);
+      wq_wait(wq);
+      wq_destroy(wq);
+
+      for (unsigned j = 0; j < sizeof(buffer); j++) {
+        EXPECT_(buffer[j] == (j / 37 >= 3),
+                "order %d, size %u: pixel %u computed %u times", order,
+                sizes[i], j, buffer[j]);
+      }
+    }
+  }
+
+  const uint32_t size = wq_auto_tile_size(4000, 3000, 4);
+  EXPECT_TRUE(size >= 16 && size % 16 == 0);
+  EXPECT_TRUE(wq_tile_count(4000, 3000, size, size) >= 16 * 4 || size == 16);
+}
+
+struct splitter_ctx {
+  wq_t wq;
+  _Atomic(uint32_t) cells;
+};
+
+// Splits rects in half, pushing the halves back onto the wq, until they're a
+// single cell wide.
+static void rect_splitter(wq_rect_t const* rect, struct splitter_ctx* ctx) {
+  if (rect->w == 1) {
+    atomic_fetch_add(&ctx->cells, 1);
+    return;
+  }
+  const uint32_t half = rect->w / 2;
+  const wq_rect_t halves[2] = {
+      {.x = rect->x, .y = rect->y, .w = half, .h = 1},
+      {.x = rect->x + half, .y = rect->y, .w = rect->w - half, .h = 1},
+  };
+  for (unsigned i = wq_push_rects(ctx->wq, 2, halves); i < 2; i++) {
+    rect_splitter(&halves[i], ctx);
+  }
+}
+
+TEST(WorkqueuePushFromCallback) {
+  // A tiny queue so that pushes regularly find it full.
+  for (uintptr_t cap = 2; cap <= 1024; cap *= 32) {
+    struct splitter_ctx ctx;
+    ctx.wq = wq_create_rect("test", (void*)rect_splitter, 0, cap);
+    atomic_init(&ctx.cells, 0);
+    EXPECT_TRUE(wq_push_rect(ctx.wq, (wq_rect_t){.w = 1000, .h = 1}));
+    wq_start(ctx.wq, &ctx);
+    wq_wait(ctx.wq);
+    wq_destroy(ctx.wq);
+    EXPECT_EQ(atomic_load(&ctx.cells), 1000);
+  }
+}
+
+// Records which worker handled each rect.
+static void rect_indexer(wq_rect_t const* rect, uint8_t* workers) {
+  workers[rect->x] = (uint8_t)wq_get_worker_index();
+}
+
+TEST(WorkqueueWorkerIndex) {
+  uint8_t workers[256];
+  wq_t wq = wq_create_rect("test", (void*)rect_indexer, 3, sizeof(workers));
+  for (uint32_t i = 0; i < sizeof(workers); i++) {
+    EXPECT_TRUE(wq_push_rect(wq, (wq_rect_t){.x = i, .w = 1, .h = 1}));
+  }
+  memset(workers, 0xff, sizeof(workers));
+  wq_start(wq, workers);
+  wq_wait(wq);
+  for (uint32_t i = 0; i < sizeof(workers); i++) {
+    EXPECT_TRUE(workers[i] < wq_get_worker_count(wq));
+  }
+  wq_destroy(wq);
+}